@@ -0,0 +1,243 @@
+// cGesture.cpp - touch reports to press, drag, release, fling, pinch and long press gestures
+// - a press only becomes a drag past kSlop, the first drag carries all the movement since the press
+// - fling velocity is over the last kFlingWindowMs of samples, none if the finger stopped before lifting
+// - a second finger starts a pinch, the primary finger is followed silently until it is alone again
+//{{{  includes
+#include "cGesture.h"
+//}}}
+
+//{{{
+static int32_t isqrt (uint32_t value) {
+
+  uint32_t root = 0;
+  uint32_t bit = 1u << 30;
+  while (bit > value)
+    bit >>= 2;
+
+  while (bit) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+      }
+    else
+      root >>= 1;
+    bit >>= 2;
+    }
+
+  return (int32_t)root;
+  }
+//}}}
+//{{{
+static int32_t iabs (int32_t value) {
+  return value < 0 ? -value : value;
+  }
+//}}}
+
+//{{{
+int cGesture::report (const tTouchReport& report, tGesture* gestures) {
+
+  int count = 0;
+
+  if (!report.touches) {
+    //{{{  all up, release, fling if still moving
+    if (mDown) {
+      auto gesture = add (gestures, count, eGestureRelease, report.ms);
+      gesture->x = mLastX;
+      gesture->y = mLastY;
+
+      if (mDragging && !mPinched) {
+        int32_t vx;
+        int32_t vy;
+        velocity (report.ms, vx, vy);
+        if (((int64_t)vx * vx) + ((int64_t)vy * vy) >= ((int64_t)kFlingMin * kFlingMin)) {
+          gesture = add (gestures, count, eGestureFling, report.ms);
+          gesture->x = mLastX;
+          gesture->y = mLastY;
+          gesture->vx = vx;
+          gesture->vy = vy;
+          }
+        }
+
+      mDown = false;
+      }
+
+    return count;
+    }
+    //}}}
+
+  int slot = mDown ? find (report, mId) : 0;
+  if (!mDown) {
+    //{{{  first finger down, press
+    mDown = true;
+    mDragging = false;
+    mLongPressed = false;
+    mPinching = false;
+    mPinched = false;
+    mSamples = 0;
+
+    mId = report.id[0];
+    mDownMs = report.ms;
+    mDownX = mLastX = report.x[0];
+    mDownY = mLastY = report.y[0];
+    mLastZ = report.z[0];
+    addSample (report.ms, mLastX, mLastY);
+
+    auto gesture = add (gestures, count, eGesturePress, report.ms);
+    gesture->x = mLastX;
+    gesture->y = mLastY;
+    gesture->z = mLastZ;
+    }
+    //}}}
+  else if (slot < 0) {
+    //{{{  primary lifted with another finger still down, follow that one from where it is
+    slot = 0;
+    mId = report.id[0];
+    mDownX = mLastX = report.x[0];
+    mDownY = mLastY = report.y[0];
+    mDragging = false;
+    mLongPressed = true;
+    mSamples = 0;
+    }
+    //}}}
+
+  if (report.touches >= 2) {
+    //{{{  pinch
+    int32_t distance = cGesture::distance (report);
+
+    if (!mPinching) {
+      mPinching = true;
+      mPinched = true;
+      mLongPressed = true;
+      mPinchDistance = distance > 0 ? distance : 1;
+      mPinchScale = 256;
+      }
+
+    else {
+      int32_t scale = (distance * 256) / mPinchDistance;
+      if (scale != mPinchScale) {
+        mPinchScale = scale;
+        auto gesture = add (gestures, count, eGesturePinch, report.ms);
+        gesture->x = (report.x[0] + report.x[1]) / 2;
+        gesture->y = (report.y[0] + report.y[1]) / 2;
+        gesture->scale = scale;
+        }
+      }
+
+    // primary moves without drags, a finger left after the pinch restarts slop from here
+    mDownX = mLastX = report.x[slot];
+    mDownY = mLastY = report.y[slot];
+    mDragging = false;
+    mSamples = 0;
+    return count;
+    }
+    //}}}
+  mPinching = false;
+
+  //{{{  one finger, drag past slop, long press if it never moved
+  int16_t x = report.x[slot];
+  int16_t y = report.y[slot];
+  mLastZ = report.z[slot];
+  addSample (report.ms, x, y);
+
+  if (!mDragging && ((iabs (x - mDownX) > kSlop) || (iabs (y - mDownY) > kSlop)))
+    mDragging = true;
+
+  if (mDragging && ((x != mLastX) || (y != mLastY))) {
+    auto gesture = add (gestures, count, eGestureDrag, report.ms);
+    gesture->x = x;
+    gesture->y = y;
+    gesture->z = mLastZ;
+    gesture->dx = x - mLastX;
+    gesture->dy = y - mLastY;
+    mLastX = x;
+    mLastY = y;
+    }
+
+  if (!mDragging && !mLongPressed && (report.ms - mDownMs >= kLongPressMs)) {
+    mLongPressed = true;
+    auto gesture = add (gestures, count, eGestureLongPress, report.ms);
+    gesture->x = mLastX;
+    gesture->y = mLastY;
+    gesture->z = mLastZ;
+    }
+  //}}}
+
+  return count;
+  }
+//}}}
+
+// private
+//{{{
+int cGesture::find (const tTouchReport& report, uint8_t id) {
+
+  for (int slot = 0; (slot < report.touches) && (slot < 2); slot++)
+    if (report.id[slot] == id)
+      return slot;
+
+  return -1;
+  }
+//}}}
+//{{{
+void cGesture::addSample (uint32_t ms, int16_t x, int16_t y) {
+
+  mSampleMs[mSampleIndex] = ms;
+  mSampleX[mSampleIndex] = x;
+  mSampleY[mSampleIndex] = y;
+  mSampleIndex = (mSampleIndex + 1) % kSamples;
+  if (mSamples < kSamples)
+    mSamples++;
+  }
+//}}}
+//{{{
+void cGesture::velocity (uint32_t ms, int32_t& vx, int32_t& vy) {
+// newest sample back to the oldest within kFlingWindowMs of it
+
+  vx = 0;
+  vy = 0;
+  if (mSamples < 2)
+    return;
+
+  int newest = (mSampleIndex + kSamples - 1) % kSamples;
+  if (ms - mSampleMs[newest] > kFlingStopMs)
+    return;
+
+  int oldest = newest;
+  for (int i = 1; i < mSamples; i++) {
+    int index = (newest + kSamples - i) % kSamples;
+    if (mSampleMs[newest] - mSampleMs[index] > kFlingWindowMs)
+      break;
+    oldest = index;
+    }
+
+  int32_t span = (int32_t)(mSampleMs[newest] - mSampleMs[oldest]);
+  if (span > 0) {
+    vx = ((mSampleX[newest] - mSampleX[oldest]) * 1000) / span;
+    vy = ((mSampleY[newest] - mSampleY[oldest]) * 1000) / span;
+    }
+  }
+//}}}
+//{{{
+int32_t cGesture::distance (const tTouchReport& report) {
+
+  int32_t dx = report.x[1] - report.x[0];
+  int32_t dy = report.y[1] - report.y[0];
+  return isqrt ((uint32_t)(dx * dx + dy * dy));
+  }
+//}}}
+//{{{
+tGesture* cGesture::add (tGesture* gestures, int& count, eGesture type, uint32_t ms) {
+
+  auto gesture = gestures + count++;
+  gesture->type = type;
+  gesture->ms = ms;
+  gesture->x = 0;
+  gesture->y = 0;
+  gesture->z = 0;
+  gesture->dx = 0;
+  gesture->dy = 0;
+  gesture->vx = 0;
+  gesture->vy = 0;
+  gesture->scale = 256;
+  return gesture;
+  }
+//}}}
@@ -0,0 +1,79 @@
+// cGesture.h - touch reports to press, drag, release, fling, pinch and long press gestures
+// - no hal or rtos, builds on a host, recorded touch traces can be replayed through report
+// - fingers are followed by controller touch id, not report slot, a slot reorder is not a jump
+// - integer only, velocities in pixels per second, pinch scale in 1/256ths
+#pragma once
+#include <stdint.h>
+
+//{{{  struct tTouchReport
+struct tTouchReport {
+  uint32_t ms;        // int edge time
+  uint8_t touches;    // 0 is all fingers up
+  int16_t x[2];
+  int16_t y[2];
+  uint8_t id[2];
+  uint8_t z[2];
+  };
+//}}}
+enum eGesture { eGesturePress, eGestureDrag, eGestureRelease, eGestureFling, eGesturePinch, eGestureLongPress };
+//{{{  struct tGesture
+struct tGesture {
+  eGesture type;
+  uint32_t ms;
+  int16_t x;          // primary finger, pinch centre
+  int16_t y;
+  uint8_t z;
+  int16_t dx;         // drag, since the previous press or drag
+  int16_t dy;
+  int32_t vx;         // fling, pixels per second
+  int32_t vy;
+  int32_t scale;      // pinch, finger distance over distance at pinch start, 256 is unchanged
+  };
+//}}}
+
+class cGesture {
+public:
+  static const int kMaxGestures = 2;     // most one report can produce, release then fling
+  static const int kSlop = 8;            // pixels before a press becomes a drag
+  static const uint32_t kLongPressMs = 600;
+  static const int32_t kFlingMin = 400;  // pixels per second
+  static const uint32_t kFlingWindowMs = 80;
+  static const uint32_t kFlingStopMs = 40;
+
+  // report in time order, returns gestures written to gestures[kMaxGestures]
+  int report (const tTouchReport& report, tGesture* gestures);
+
+  bool down() { return mDown; }
+
+private:
+  static const int kSamples = 8;
+
+  int find (const tTouchReport& report, uint8_t id);
+  void addSample (uint32_t ms, int16_t x, int16_t y);
+  void velocity (uint32_t ms, int32_t& vx, int32_t& vy);
+  int32_t distance (const tTouchReport& report);
+  tGesture* add (tGesture* gestures, int& count, eGesture type, uint32_t ms);
+
+  bool mDown = false;
+  bool mDragging = false;
+  bool mLongPressed = false;
+  bool mPinching = false;
+  bool mPinched = false;     // since the press, no fling
+
+  uint8_t mId = 0;
+  uint32_t mDownMs = 0;
+  int16_t mDownX = 0;
+  int16_t mDownY = 0;
+  int16_t mLastX = 0;
+  int16_t mLastY = 0;
+  uint8_t mLastZ = 0;
+
+  int32_t mPinchDistance = 0;
+  int32_t mPinchScale = 256;
+
+  uint32_t mSampleMs[kSamples];
+  int16_t mSampleX[kSamples];
+  int16_t mSampleY[kSamples];
+  int mSamples = 0;
+  int mSampleIndex = 0;
+  };
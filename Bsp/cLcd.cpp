@@ -13,6 +13,7 @@
 #include "task.h"
 #include "semphr.h"
 #include "cpuUsage.h"
+#include "dmaBuf.h"
 
 #include "stm32f7xx_hal.h"
 
@@ -317,7 +318,7 @@ void LCD_LTDC_IRQHandler() {
   }
 //}}}
 //{{{
-void LCD_DMA2D_IRQHandler() {
+ITCM_CODE void LCD_DMA2D_IRQHandler() {
 
   // clear interrupts
   DMA2D->IFCR = DMA2D_ISR_TCIF | DMA2D_ISR_TEIF | DMA2D_ISR_CEIF;
@@ -546,6 +547,7 @@ void cLcd::endRender (bool forceInfo) {
     std::string str = dec (ltdc.lineIrq) + ":f " +
                       dec (ltdc.lineTicks) + "ms " +
                       dec (mDma2dTimeouts) + " " +
+                      dec (mDma2dFlushes) + " " +
                       dec (ltdc.transferErrorIrq) + " " +
                       dec (ltdc.fifoUnderunIrq);
     text (COL_WHITE, cWidget::getFontHeight(), str, 0, getLcdHeightPix() - 2 * cWidget::getBoxHeight(), getLcdWidthPix(), 24);
@@ -560,21 +562,9 @@ void cLcd::endRender (bool forceInfo) {
           0, -cWidget::getFontHeight() + getLcdHeightPix(), getLcdWidthPix(), cWidget::getFontHeight());
     //}}}
 
-  // terminate opCode buffer
-  *mDma2dCurBuf = kEnd;
-
-   // send opCode buffer
-  LCD_DMA2D_IRQHandler();
-
-  // wait
-  if (xSemaphoreTake (mDma2dSem, 500) == pdFALSE)
-    mDma2dTimeouts++;
+  dma2dFlush();
   showLayer (0, mBuffer[mDrawBuffer], 255);
 
-  // reset opcode buffer
-  mDma2dCurBuf = mDma2dBuf;
-  *mDma2dCurBuf = kEnd;
-
   mDrawTime = xTaskGetTickCount() - mDrawStartTime;
   }
 //}}}
@@ -628,6 +618,8 @@ void cLcd::pixel (uint32_t colour, int16_t x, int16_t y) {
 //{{{
 void cLcd::rect (uint32_t colour, int16_t x, int16_t y, uint16_t width, uint16_t height) {
 
+  dma2dReserve (10);
+
   // often same colour
   if (colour != mCurDstColour) {
     *mDma2dCurBuf++ = AHB1PERIPH_BASE + 0xB000U + 0x38; // OCOLR - output colour
@@ -655,6 +647,8 @@ void cLcd::rect (uint32_t colour, int16_t x, int16_t y, uint16_t width, uint16_t
 //{{{
 void cLcd::stamp (uint32_t colour, uint8_t* src, int16_t x, int16_t y, uint16_t width, uint16_t height) {
 
+  dma2dReserve (7);
+
   // often same colour
   if (colour != mCurSrcColour) {
     *mDma2dCurBuf++ = AHB1PERIPH_BASE + 0xB000U + 0x20; // FGCOLR - fgnd colour
@@ -696,6 +690,8 @@ int cLcd::text (uint32_t colour, uint16_t fontHeight, std::string str, int16_t x
 void cLcd::copy (uint8_t* src, int16_t x, int16_t y, uint16_t width, uint16_t height) {
 // copy RGB888 to ARGB8888
 
+  dma2dReserve (14);
+
   // output
   *mDma2dCurBuf++ = AHB1PERIPH_BASE + 0xB000U + 0x3C; // OMAR - output start address
   *mDma2dCurBuf++ = mCurFrameBufferAddress + ((y * getLcdWidthPix()) + x) * dstComponents;
@@ -728,6 +724,8 @@ void cLcd::copy (uint8_t* src, int16_t srcx, int16_t srcy, uint16_t srcWidth, ui
 // copy src to dst
 // - some corner cases missing, not enough src for dst needs padding
 
+  dma2dReserve (14);
+
   // output
   *mDma2dCurBuf++ = AHB1PERIPH_BASE + 0xB000U + 0x3C; // OMAR - output start address
   *mDma2dCurBuf++ = mCurFrameBufferAddress + ((dsty * getLcdWidthPix()) + dstx) * dstComponents;
@@ -757,6 +755,38 @@ void cLcd::copy (uint8_t* src, int16_t srcx, int16_t srcy, uint16_t srcWidth, ui
 
 // private
 //{{{
+void cLcd::dma2dReserve (int words) {
+// room for words of opcodes and the end marker, else run the list so far, a mid frame flush
+
+  if (mDma2dCurBuf + words + 1 > mDma2dBuf + (DMA2D_BUFFER_SIZE / 4)) {
+    mDma2dFlushes++;
+    dma2dFlush();
+    }
+  }
+//}}}
+//{{{
+void cLcd::dma2dFlush() {
+// run the display list and wait for it, the dma2d registers it set are still set for the next list
+
+  // terminate opCode buffer
+  *mDma2dCurBuf = kEnd;
+
+  // dma2d reads font bitmaps and copy sources written by the cpu, write them back first
+  dmaCleanAll();
+
+   // send opCode buffer
+  LCD_DMA2D_IRQHandler();
+
+  // wait
+  if (xSemaphoreTake (mDma2dSem, 500) == pdFALSE)
+    mDma2dTimeouts++;
+
+  // reset opcode buffer
+  mDma2dCurBuf = mDma2dBuf;
+  *mDma2dCurBuf = kEnd;
+  }
+//}}}
+//{{{
 void cLcd::ltdcInit (uint32_t frameBufferAddress) {
 
   hLtdc.Instance = LTDC;
@@ -31,6 +31,8 @@ public:
   void displayOn();
   void displayOff();
 
+  int getDrawTime() { return mDrawTime; }
+
   // iDraw
   #ifdef STM32F746G_DISCO
     uint16_t getLcdWidthPix() { return 480; }
@@ -61,6 +63,9 @@ private:
   void setLayer (uint8_t layer, uint32_t frameBufferAddress);
   void showLayer (uint8_t layer, uint32_t frameBufferAddress, uint8_t alpha);
 
+  void dma2dReserve (int words);
+  void dma2dFlush();
+
   void reset();
   void displayTop();
   void displayTail();
@@ -115,6 +120,7 @@ private:
 
   uint32_t* mDma2dCurBuf = nullptr;
   uint32_t mDma2dTimeouts = 0;
+  uint32_t mDma2dFlushes = 0;   // display list filled DMA2D_BUFFER mid frame
 
   uint32_t mCurFrameBufferAddress = 0;
   uint32_t mSetFrameBufferAddress[2];
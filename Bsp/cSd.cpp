@@ -3,6 +3,7 @@
 #include "cSd.h"
 #include <string.h>
 #include "freertos.h"
+#include "dmaBuf.h"
 
 #include "utils.h"
 #include "cLcd.h"
@@ -16,6 +17,8 @@ static DMA_HandleTypeDef dma_tx_handle;
 
 static const uint32_t mReadCacheSize = 0x40;
 static uint8_t* mReadCache = 0;
+static uint8_t* mBounce = 0;
+static uint32_t mBounces = 0;
 static uint32_t mReadCacheBlock = 0xFFFFFFB0;
 static uint32_t mReads = 0;
 static uint32_t mReadHits = 0;
@@ -194,7 +197,8 @@ uint8_t SD_Init() {
   //osMutexDef (sdMutex);
   //mSdMutex = osMutexCreate (osMutex (sdMutex));
 
-  mReadCache = (uint8_t*)pvPortMalloc (512 * mReadCacheSize);
+  mReadCache = (uint8_t*)dmaAlloc (512 * mReadCacheSize);
+  mBounce = (uint8_t*)dmaAlloc (512);
 
   return MSD_OK;
   }
@@ -236,16 +240,30 @@ void SD_GetCardInfo (HAL_SD_CardInfoTypedef* CardInfo) {
 //{{{
 std::string SD_info() {
   return "r:" + dec (mReadHits) + ":" + dec (mReads) + ":"  + dec (mReadBlock + mReadMultipleLen) +
-         " w:" + dec (mWrites);
+         " w:" + dec (mWrites) + " b:" + dec (mBounces);
   }
 //}}}
 
 //{{{
 uint8_t SD_Read (uint8_t* buf, uint32_t blk_addr, uint16_t blocks) {
 
+  if (!dmaAligned (buf, blocks * 512)) {
+    // buf shares cache lines with other data, dma a block at a time into mBounce and copy
+    mBounces++;
+    for (auto i = 0; i < blocks; i++) {
+      dmaRxStart (mBounce, 512);
+      if (HAL_SD_ReadBlocks (&uSdHandle, (uint32_t*)mBounce, (blk_addr + i) * 512, 1) != SD_OK)
+        return MSD_ERROR;
+      dmaRxDone (mBounce, 512);
+      memcpy (buf + (i * 512), mBounce, 512);
+      }
+    return MSD_OK;
+    }
+
+  dmaRxStart (buf, blocks * 512);
   if (HAL_SD_ReadBlocks (&uSdHandle, (uint32_t*)buf, blk_addr * 512, blocks) != SD_OK)
     return MSD_ERROR;
-  SCB_InvalidateDCache_by_Addr ((uint32_t*)((uint32_t)buf & 0xFFFFFFE0), (blocks * 512) + 32);
+  dmaRxDone (buf, blocks * 512);
 
   return MSD_OK;
   }
@@ -253,6 +271,7 @@ uint8_t SD_Read (uint8_t* buf, uint32_t blk_addr, uint16_t blocks) {
 //{{{
 uint8_t SD_Write (uint8_t* buf, uint32_t blk_addr, uint16_t blocks) {
 
+  dmaTxStart (buf, blocks * 512);
   if (HAL_SD_WriteBlocks (&uSdHandle, (uint32_t*)buf, blk_addr * 512, blocks) != SD_OK)
     return MSD_ERROR;
   //can't remove ?
@@ -4,6 +4,7 @@
 #include "os/ethernetif.h"
 
 #include "memory.h"
+#include "staticTasks.h"
 #include "stm32f7xx_hal.h"
 
 #include "lwip/opt.h"
@@ -203,7 +204,7 @@ err_t ethernetif_init (struct netif* netif) {
   vSemaphoreCreateBinary (mRxSem);
 
   TaskHandle_t handle;
-  xTaskCreate ((TaskFunction_t)ethernetInputThread, "eth", 350, netif, 6, &handle);
+  staticTaskCreate ((TaskFunction_t)ethernetInputThread, "eth", 350, netif, 6, &handle);
 
   // Enable MAC and DMA transmission and reception
   HAL_ETH_Start (&EthHandle);
@@ -0,0 +1,304 @@
+// sdIo.cpp - sd block io queue, class then deadline order, background splits, adjacent merges
+// - the caller runs its own transfer when it owns the card, no io task, no switch when uncontended
+// - waiters queue in class then deadline order, the owner hands the card to the head of the queue
+// - scan and bulk requests go SD_IO_SPLIT_BLOCKS at a time and requeue behind any better waiter
+// - a waiter whose blocks and buffer carry on from the owner's transfer is served in the same transfer
+// - the card is handed over on a binary semaphore per task, not the task notification, which the msc task
+//   and others use for their own wakeups
+//{{{  includes
+#include "sdIo.h"
+#include "cSd.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "utils.h"
+//}}}
+
+//{{{  struct tSdIoRequest
+struct tSdIoRequest {
+  tSdIoRequest* next;
+  SemaphoreHandle_t handoff;
+  uint8_t ioClass;
+  bool write;
+  uint8_t* buf;
+  uint32_t block;
+  uint16_t blocks;
+  TickType_t submitted;
+  TickType_t deadline;
+  volatile bool served;   // done by another owner's merged transfer
+  int8_t result;
+  };
+//}}}
+//{{{  static vars
+static const TickType_t kDeadline[eSdIoClasses] = { 20, 100, 1000, 5000 };
+static const char* const kClassNames[eSdIoClasses] = { "play", "ui", "scan", "bulk" };
+static const BaseType_t kHandoffTls = 0;   // thread local storage index of the task's handoff semaphore
+
+static tSdIoRequest* mQueue = nullptr;   // waiters, best first
+static bool mBusy = false;
+
+static uint32_t mLatency[eSdIoClasses][SD_IO_BUCKETS];
+static uint32_t mMisses[eSdIoClasses];
+static uint32_t mSplits = 0;
+static uint32_t mPreempts = 0;
+static uint32_t mMerges = 0;
+//}}}
+
+//{{{
+static bool better (tSdIoRequest* a, tSdIoRequest* b) {
+  return (a->ioClass < b->ioClass) || ((a->ioClass == b->ioClass) && (int32_t)(a->deadline - b->deadline) < 0);
+  }
+//}}}
+//{{{
+static void enqueue (tSdIoRequest* request) {
+// in critical section
+
+  auto prev = &mQueue;
+  while (*prev && !better (request, *prev))
+    prev = &(*prev)->next;
+  request->next = *prev;
+  *prev = request;
+  }
+//}}}
+//{{{
+static tSdIoRequest* dequeue() {
+// in critical section, next owner, nullptr leaves the card idle
+
+  auto request = mQueue;
+  if (request)
+    mQueue = request->next;
+  else
+    mBusy = false;
+  return request;
+  }
+//}}}
+
+//{{{
+static int8_t transfer (bool write, uint8_t* buf, uint32_t block, uint16_t blocks) {
+  return write ? SD_WriteCached (buf, block, blocks) : SD_ReadCached (buf, block, blocks);
+  }
+//}}}
+//{{{
+static uint16_t merge (tSdIoRequest* owner, uint16_t blocks, tSdIoRequest** merged, int maxMerged) {
+// pull waiters that carry on from owner's transfer, blocks and buffer, returns the combined blocks
+
+  int numMerged = 0;
+  taskENTER_CRITICAL();
+  bool found = true;
+  while (found && (numMerged < maxMerged)) {
+    found = false;
+    for (auto prev = &mQueue; *prev; prev = &(*prev)->next) {
+      auto request = *prev;
+      if ((request->write == owner->write) &&
+          (request->block == owner->block + blocks) &&
+          (request->buf == owner->buf + (blocks * 512)) &&
+          (blocks + request->blocks <= SD_IO_MAX_BLOCKS)) {
+        *prev = request->next;
+        merged[numMerged++] = request;
+        blocks += request->blocks;
+        found = true;
+        break;
+        }
+      }
+    }
+  taskEXIT_CRITICAL();
+
+  merged[numMerged] = nullptr;
+  return blocks;
+  }
+//}}}
+//{{{
+static void complete (tSdIoRequest* request) {
+
+  auto latency = xTaskGetTickCount() - request->submitted;
+  if ((int32_t)(xTaskGetTickCount() - request->deadline) > 0)
+    mMisses[request->ioClass]++;
+
+  int bucket = 0;
+  while ((bucket < SD_IO_BUCKETS-1) && (latency >= (1u << bucket)))
+    bucket++;
+  mLatency[request->ioClass][bucket]++;
+  }
+//}}}
+//{{{
+static SemaphoreHandle_t handoffSem() {
+// calling task's handoff semaphore, made on its first request, one give per wait so never left given
+
+  auto sem = (SemaphoreHandle_t)pvTaskGetThreadLocalStoragePointer (NULL, kHandoffTls);
+  if (!sem) {
+    sem = xSemaphoreCreateBinary();
+    vTaskSetThreadLocalStoragePointer (NULL, kHandoffTls, sem);
+    }
+  return sem;
+  }
+//}}}
+//{{{
+static int8_t sdIoRequest (bool write, uint8_t* buf, uint32_t block, uint16_t blocks) {
+
+  if (__get_IPSR() || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)) {
+    // usb msc callbacks from the otg irq, or before the scheduler, nothing to queue behind, straight through
+    int8_t result = 0;
+    while (blocks && !result) {
+      uint16_t piece = blocks > SD_IO_MAX_BLOCKS ? SD_IO_MAX_BLOCKS : blocks;
+      result = transfer (write, buf, block, piece);
+      buf += piece * 512;
+      block += piece;
+      blocks -= piece;
+      }
+    return result;
+    }
+
+  tSdIoRequest request;
+  request.handoff = handoffSem();
+  request.ioClass = sdIoGetClass();
+  request.write = write;
+  request.buf = buf;
+  request.block = block;
+  request.blocks = blocks;
+  request.submitted = xTaskGetTickCount();
+  request.deadline = request.submitted + kDeadline[request.ioClass];
+  request.served = false;
+  request.result = 0;
+
+  //{{{  own the card, or wait in the queue to be handed it
+  taskENTER_CRITICAL();
+  bool wait = mBusy;
+  if (wait)
+    enqueue (&request);
+  else
+    mBusy = true;
+  taskEXIT_CRITICAL();
+
+  if (wait) {
+    xSemaphoreTake (request.handoff, portMAX_DELAY);
+    if (request.served) {
+      complete (&request);
+      return request.result;
+      }
+    }
+  //}}}
+
+  bool background = request.ioClass >= eSdIoScan;
+  if (background && (request.blocks > SD_IO_SPLIT_BLOCKS))
+    mSplits++;
+
+  while (request.blocks && !request.result) {
+    uint16_t piece = request.blocks > SD_IO_MAX_BLOCKS ? SD_IO_MAX_BLOCKS : request.blocks;
+    if (background && (piece > SD_IO_SPLIT_BLOCKS))
+      piece = SD_IO_SPLIT_BLOCKS;
+
+    // last piece, carry on into any waiter that follows on
+    tSdIoRequest* merged[4];
+    uint16_t blocks = piece;
+    if (piece == request.blocks)
+      blocks = merge (&request, piece, merged, 3);
+    else
+      merged[0] = nullptr;
+
+    request.result = transfer (request.write, request.buf, request.block, blocks);
+
+    for (auto i = 0; merged[i]; i++) {
+      mMerges++;
+      merged[i]->result = request.result;
+      merged[i]->served = true;
+      xSemaphoreGive (merged[i]->handoff);
+      }
+
+    request.buf += piece * 512;
+    request.block += piece;
+    request.blocks -= piece;
+
+    if (request.blocks && background) {
+      //{{{  better waiter, requeue the rest of this request behind it
+      taskENTER_CRITICAL();
+      tSdIoRequest* next = (mQueue && better (mQueue, &request)) ? dequeue() : nullptr;
+      if (next)
+        enqueue (&request);
+      taskEXIT_CRITICAL();
+
+      if (next) {
+        mPreempts++;
+        xSemaphoreGive (next->handoff);
+        xSemaphoreTake (request.handoff, portMAX_DELAY);
+        if (request.served) {
+          // the rest went in another owner's merged transfer
+          complete (&request);
+          return request.result;
+          }
+        }
+      }
+      //}}}
+    }
+
+  complete (&request);
+
+  taskENTER_CRITICAL();
+  auto next = dequeue();
+  taskEXIT_CRITICAL();
+  if (next)
+    xSemaphoreGive (next->handoff);
+
+  return request.result;
+  }
+//}}}
+
+//{{{
+void sdIoSetClass (eSdIoClass ioClass) {
+// calling task's class, kept in its application tag
+  vTaskSetApplicationTaskTag (NULL, (TaskHookFunction_t)(ioClass + 1));
+  }
+//}}}
+//{{{
+eSdIoClass sdIoGetClass() {
+
+  auto tag = (uint32_t)xTaskGetApplicationTaskTag (NULL);
+  return ((tag > 0) && (tag <= eSdIoClasses)) ? eSdIoClass(tag - 1) : eSdIoUi;
+  }
+//}}}
+//{{{
+bool sdIoBackground() {
+  return (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && !__get_IPSR() && (sdIoGetClass() >= eSdIoScan);
+  }
+//}}}
+
+//{{{
+int8_t sdIoRead (uint8_t* buf, uint32_t block, uint16_t blocks) {
+  return sdIoRequest (false, buf, block, blocks);
+  }
+//}}}
+//{{{
+int8_t sdIoWrite (uint8_t* buf, uint32_t block, uint16_t blocks) {
+  return sdIoRequest (true, buf, block, blocks);
+  }
+//}}}
+
+//{{{
+const uint32_t* sdIoLatency (eSdIoClass ioClass) {
+  return mLatency[ioClass];
+  }
+//}}}
+//{{{
+std::string sdIoInfo() {
+// per class count, bucket holding the 95th percentile, deadline misses
+
+  std::string info;
+  for (auto ioClass = 0; ioClass < eSdIoClasses; ioClass++) {
+    uint32_t count = 0;
+    for (auto bucket = 0; bucket < SD_IO_BUCKETS; bucket++)
+      count += mLatency[ioClass][bucket];
+    if (count) {
+      uint32_t sum = 0;
+      int bucket = 0;
+      while ((bucket < SD_IO_BUCKETS-1) && ((sum += mLatency[ioClass][bucket]) * 100 < count * 95))
+        bucket++;
+      info += std::string(kClassNames[ioClass]) + ":" + dec (count) +
+              (bucket < SD_IO_BUCKETS-1 ? " p95<" + dec (1 << bucket) : std::string(" p95>=") + dec (1 << (bucket-1))) +
+              "ms miss:" + dec (mMisses[ioClass]) + " ";
+      }
+    }
+
+  return info + "split:" + dec (mSplits) + " pre:" + dec (mPreempts) + " merge:" + dec (mMerges);
+  }
+//}}}
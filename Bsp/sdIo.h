@@ -0,0 +1,24 @@
+// sdIo.h - sd block io queue, class then deadline order, background splits, adjacent merges
+#pragma once
+//{{{  includes
+#include <string>
+#include <stdint.h>
+//}}}
+
+// classes in priority order, set per task, untagged tasks are ui
+enum eSdIoClass { eSdIoPlayback, eSdIoUi, eSdIoScan, eSdIoBulk, eSdIoClasses };
+
+#define SD_IO_SPLIT_BLOCKS  16      // background requests served 8k at a time, then yield to any better request
+#define SD_IO_MAX_BLOCKS    0x40    // one transfer, the SD_ReadCached cache size
+#define SD_IO_SPLIT_BYTES   (SD_IO_SPLIT_BLOCKS * 512)
+#define SD_IO_BUCKETS       9       // latency histogram, <1ms, <2ms, <4ms .. <128ms, >=128ms
+
+void sdIoSetClass (eSdIoClass ioClass);
+eSdIoClass sdIoGetClass();
+bool sdIoBackground();
+
+int8_t sdIoRead (uint8_t* buf, uint32_t block, uint16_t blocks);
+int8_t sdIoWrite (uint8_t* buf, uint32_t block, uint16_t blocks);
+
+const uint32_t* sdIoLatency (eSdIoClass ioClass);
+std::string sdIoInfo();
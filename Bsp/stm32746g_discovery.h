@@ -97,6 +97,15 @@ typedef enum { BUTTON_MODE_GPIO = 0, BUTTON_MODE_EXTI = 1 }ButtonMode_TypeDef;
 /* I2C interrupt requests */
 #define DISCOVERY_AUDIO_I2Cx_EV_IRQn                     I2C3_EV_IRQn
 #define DISCOVERY_AUDIO_I2Cx_ER_IRQn                     I2C3_ER_IRQn
+#define DISCOVERY_AUDIO_I2Cx_EV_IRQHandler               I2C3_EV_IRQHandler
+#define DISCOVERY_AUDIO_I2Cx_ER_IRQHandler               I2C3_ER_IRQHandler
+
+/* I2C3 rx dma, touch reports */
+#define DISCOVERY_AUDIO_I2Cx_DMA_CLK_ENABLE()            __HAL_RCC_DMA1_CLK_ENABLE()
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_STREAM               DMA1_Stream2
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_CHANNEL              DMA_CHANNEL_3
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQn                 DMA1_Stream2_IRQn
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQHandler           DMA1_Stream2_IRQHandler
 
 /* Definition for external, camera and Arduino connector I2Cx resources */
 #define DISCOVERY_EXT_I2Cx                               I2C1
@@ -134,6 +143,9 @@ void      BSP_PB_Init(Button_TypeDef Button, ButtonMode_TypeDef ButtonMode);
 void      BSP_PB_DeInit(Button_TypeDef Button);
 uint32_t  BSP_PB_GetState(Button_TypeDef Button);
 
+/* codec and touch bus, for the irq handlers */
+extern I2C_HandleTypeDef hI2cAudioHandler;
+
 //{{{
 #ifdef __cplusplus
 }
@@ -95,6 +95,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32746g_discovery_audio.h"
+#include "uartLog.h"
 
 /** @addtogroup BSP
   * @{
@@ -792,6 +793,12 @@ uint8_t BSP_AUDIO_IN_Init(uint16_t InputDevice, uint8_t Volume, uint32_t AudioFr
   uint32_t deviceid = 0x00;
   uint32_t slot_active;
 
+  /* sai rx dma stream is the debug log's usart1 tx stream */
+  if (logDmaStream(AUDIO_IN_SAIx_DMAx_STREAM))
+  {
+    return AUDIO_ERROR;
+  }
+
   if ((InputDevice != INPUT_DEVICE_INPUT_LINE_1) &&       /* Only INPUT_LINE_1 and MICROPHONE_2 inputs supported */
       (InputDevice != INPUT_DEVICE_DIGITAL_MICROPHONE_2))
   {
@@ -869,6 +876,12 @@ uint8_t BSP_AUDIO_IN_OUT_Init(uint16_t InputDevice, uint16_t OutputDevice, uint8
   uint32_t deviceid = 0x00;
   uint32_t slot_active;
 
+  /* sai rx dma stream is the debug log's usart1 tx stream */
+  if (logDmaStream(AUDIO_IN_SAIx_DMAx_STREAM))
+  {
+    return AUDIO_ERROR;
+  }
+
   if (InputDevice != INPUT_DEVICE_DIGITAL_MICROPHONE_2)  /* Only MICROPHONE_2 input supported */
   {
     ret = AUDIO_ERROR;
@@ -71,6 +71,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32746g_discovery_ts.h"
+#include "dmaBuf.h"
 
 /** @addtogroup BSP
   * @{
@@ -119,6 +120,8 @@ static TS_DrvTypeDef *tsDriver;
 static uint16_t tsXBoundary, tsYBoundary;
 static uint8_t  tsOrientation;
 static uint8_t  I2cAddress;
+
+uint16_t TS_IO_ReadDma(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
 /**
   * @}
   */
@@ -212,6 +215,56 @@ uint8_t BSP_TS_ITGetStatus(void)
   return (tsDriver->GetITStatus(I2cAddress));
 }
 
+/**
+  * @brief  Reads TD_STATUS and the first touch points in one dma burst, from the touch task.
+  * @note   Registers from TD_STATUS are 6 bytes per point, XH event and x msb, XL,
+  *         YH id and y msb, YL, weight, misc.
+  * @param  TS_Report: Pointer to touch report structure
+  * @retval TS_OK if the read succeeded, TS_ERROR with no touches otherwise
+  */
+uint8_t BSP_TS_GetReport(TS_ReportTypeDef *TS_Report)
+{
+  static uint8_t regs[DMA_LINE] __attribute__((aligned(DMA_LINE)));
+  uint16_t x, y, tmp;
+  uint32_t index;
+
+  TS_Report->touchDetected = 0;
+  if (TS_IO_ReadDma(I2cAddress, FT5336_TD_STAT_REG, regs, 1 + (TS_REPORT_NB_TOUCH * 6)) != 0)
+    return TS_ERROR;
+
+  /* Counts above the controller maximum are invalid, as in DetectTouch */
+  index = regs[0] & FT5336_TD_STAT_MASK;
+  if (index > FT5336_MAX_DETECTABLE_TOUCH)
+    return TS_OK;
+  TS_Report->touchDetected = (index > TS_REPORT_NB_TOUCH) ? TS_REPORT_NB_TOUCH : index;
+
+  for (index = 0; index < TS_Report->touchDetected; index++)
+  {
+    uint8_t *point = regs + 1 + (index * 6);
+    x = ((point[0] & 0x0F) << 8) | point[1];
+    y = ((point[2] & 0x0F) << 8) | point[3];
+
+    /* Same orientation as BSP_TS_GetState */
+    if (tsOrientation & TS_SWAP_XY)
+    {
+      tmp = x;
+      x = y;
+      y = tmp;
+    }
+    if (tsOrientation & TS_SWAP_X)
+      x = 4096 - x;
+    if (tsOrientation & TS_SWAP_Y)
+      y = 4096 - y;
+
+    TS_Report->touchX[index] = x;
+    TS_Report->touchY[index] = y;
+    TS_Report->touchId[index] = point[2] >> 4;
+    TS_Report->touchWeight[index] = point[4];
+  }
+
+  return TS_OK;
+}
+
 /**
   * @brief  Returns status and positions of the touch screen.
   * @param  TS_State: Pointer to touch screen current state structure
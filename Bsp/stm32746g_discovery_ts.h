@@ -103,6 +103,21 @@ typedef struct
 
 } TS_StateTypeDef;
 
+/**
+*  @brief TS_ReportTypeDef
+*  One burst read of the first touches, ids track fingers across reports
+*/
+#define TS_REPORT_NB_TOUCH              2
+
+typedef struct
+{
+  uint8_t  touchDetected;                   /*!< Active touches, at most TS_REPORT_NB_TOUCH */
+  uint16_t touchX[TS_REPORT_NB_TOUCH];      /*!< Screen X, orientation applied */
+  uint16_t touchY[TS_REPORT_NB_TOUCH];      /*!< Screen Y, orientation applied */
+  uint8_t  touchId[TS_REPORT_NB_TOUCH];     /*!< Controller touch id, stable while the finger is down */
+  uint8_t  touchWeight[TS_REPORT_NB_TOUCH]; /*!< Weight property of touches */
+} TS_ReportTypeDef;
+
 /**
   * @}
   */
@@ -186,6 +201,7 @@ uint8_t BSP_TS_Get_GestureId(TS_StateTypeDef *TS_State);
 
 uint8_t BSP_TS_ITConfig(void);
 uint8_t BSP_TS_ITGetStatus(void);
+uint8_t BSP_TS_GetReport(TS_ReportTypeDef *TS_Report);
 void    BSP_TS_ITClear(void);
 uint8_t BSP_TS_ResetTouchData(TS_StateTypeDef *TS_State);
 /**
@@ -1,5 +1,9 @@
 #ifdef STM32F769I_DISCO
 #include "stm32f769i_discovery.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "dmaBuf.h"
 
 uint32_t GPIO_PIN[LEDn]       = {LED1_PIN, LED2_PIN, LED3_PIN};
 GPIO_TypeDef* GPIO_PORT[LEDn] = {LED1_GPIO_PORT, LED2_GPIO_PORT, LED3_GPIO_PORT};
@@ -8,9 +12,17 @@ GPIO_TypeDef* BUTTON_PORT[BUTTONn]  = {WAKEUP_BUTTON_GPIO_PORT };
 const uint16_t BUTTON_PIN[BUTTONn]  = {WAKEUP_BUTTON_PIN };
 const uint16_t BUTTON_IRQn[BUTTONn] = {WAKEUP_BUTTON_EXTI_IRQn };
 
-static I2C_HandleTypeDef hI2cAudioHandler = {0};
+I2C_HandleTypeDef hI2cAudioHandler = {0};
 static I2C_HandleTypeDef hI2cExtHandler   = {0};
 
+/* audio bus is shared by codec and touch, touch reports are read by dma from the touch task */
+static DMA_HandleTypeDef hdmaI2cAudioRx;
+static SemaphoreHandle_t i2cAudioMutex = NULL;
+/* dma completion has its own semaphore, the touch task's notification is its int edge */
+static SemaphoreHandle_t i2cAudioDmaSem = NULL;
+static volatile int i2cAudioDmaWaiting = 0;
+static volatile HAL_StatusTypeDef i2cAudioDmaStatus = HAL_OK;
+
 static void     I2Cx_MspInit(I2C_HandleTypeDef *i2c_handler);
 static void     I2Cx_Init(I2C_HandleTypeDef *i2c_handler);
 
@@ -18,6 +30,9 @@ static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8
 static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddSize, uint8_t *Buffer, uint16_t Length);
 static HAL_StatusTypeDef I2Cx_IsDeviceReady(I2C_HandleTypeDef *i2c_handler, uint16_t DevAddress, uint32_t Trials);
 static void              I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr);
+static int               I2Cx_Lock(I2C_HandleTypeDef *i2c_handler);
+static void              I2Cx_Unlock(I2C_HandleTypeDef *i2c_handler, int locked);
+static HAL_StatusTypeDef I2Cx_ReadMultipleDma(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddSize, uint8_t *Buffer, uint16_t Length);
 
 /*{{{  AUDIO IO functions*/
 void            AUDIO_IO_Init(void);
@@ -30,6 +45,7 @@ void            AUDIO_IO_Delay(uint32_t Delay);
 void     TS_IO_Init(void);
 void     TS_IO_Write(uint8_t Addr, uint8_t Reg, uint8_t Value);
 uint8_t  TS_IO_Read(uint8_t Addr, uint8_t Reg);
+uint16_t TS_IO_ReadDma(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
 uint16_t TS_IO_ReadMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
 void     TS_IO_WriteMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
 void     TS_IO_Delay(uint32_t Delay);
@@ -216,6 +232,29 @@ static void I2Cx_MspInit(I2C_HandleTypeDef *i2c_handler)
   HAL_NVIC_SetPriority(DISCOVERY_AUDIO_I2Cx_ER_IRQn, 0x0F, 0);
   HAL_NVIC_EnableIRQ(DISCOVERY_AUDIO_I2Cx_ER_IRQn);
 
+  /* Configure the DMA stream for touch report reads */
+  DISCOVERY_AUDIO_I2Cx_DMA_CLK_ENABLE();
+  hdmaI2cAudioRx.Instance                 = DISCOVERY_AUDIO_I2Cx_DMA_RX_STREAM;
+  hdmaI2cAudioRx.Init.Channel             = DISCOVERY_AUDIO_I2Cx_DMA_RX_CHANNEL;
+  hdmaI2cAudioRx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hdmaI2cAudioRx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdmaI2cAudioRx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdmaI2cAudioRx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdmaI2cAudioRx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hdmaI2cAudioRx.Init.Mode                = DMA_NORMAL;
+  hdmaI2cAudioRx.Init.Priority            = DMA_PRIORITY_LOW;
+  hdmaI2cAudioRx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+  hdmaI2cAudioRx.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+  hdmaI2cAudioRx.Init.MemBurst            = DMA_MBURST_SINGLE;
+  hdmaI2cAudioRx.Init.PeriphBurst         = DMA_PBURST_SINGLE;
+  HAL_DMA_DeInit(&hdmaI2cAudioRx);
+  HAL_DMA_Init(&hdmaI2cAudioRx);
+  __HAL_LINKDMA(i2c_handler, hdmarx, hdmaI2cAudioRx);
+
+  /* Same lower priority as the I2C interrupts, it may notify the touch task */
+  HAL_NVIC_SetPriority(DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQn);
+
   }
   else
   {
@@ -269,6 +308,10 @@ static void I2Cx_Init(I2C_HandleTypeDef *i2c_handler)
     {
       /* Audio and LCD I2C configuration */
       i2c_handler->Instance = DISCOVERY_AUDIO_I2Cx;
+      if (!i2cAudioMutex)
+        i2cAudioMutex = xSemaphoreCreateMutex();
+      if (!i2cAudioDmaSem)
+        i2cAudioDmaSem = xSemaphoreCreateBinary();
     }
     else
     {
@@ -303,6 +346,7 @@ static void I2Cx_Init(I2C_HandleTypeDef *i2c_handler)
 static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddress, uint8_t *Buffer, uint16_t Length)
 {
   HAL_StatusTypeDef status = HAL_OK;
+  int locked = I2Cx_Lock(i2c_handler);
 
   status = HAL_I2C_Mem_Read(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, 1000);
 
@@ -312,6 +356,7 @@ static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8
     /* I2C error occured */
     I2Cx_Error(i2c_handler, Addr);
   }
+  I2Cx_Unlock(i2c_handler, locked);
   return status;
 }
 /*}}}*/
@@ -329,6 +374,7 @@ static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8
 static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddress, uint8_t *Buffer, uint16_t Length)
 {
   HAL_StatusTypeDef status = HAL_OK;
+  int locked = I2Cx_Lock(i2c_handler);
 
   status = HAL_I2C_Mem_Write(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, 1000);
 
@@ -338,6 +384,7 @@ static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint
     /* Re-Initiaize the I2C Bus */
     I2Cx_Error(i2c_handler, Addr);
   }
+  I2Cx_Unlock(i2c_handler, locked);
   return status;
 }
 /*}}}*/
@@ -352,7 +399,13 @@ static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint
   */
 static HAL_StatusTypeDef I2Cx_IsDeviceReady(I2C_HandleTypeDef *i2c_handler, uint16_t DevAddress, uint32_t Trials)
 {
-  return (HAL_I2C_IsDeviceReady(i2c_handler, DevAddress, Trials, 1000));
+  HAL_StatusTypeDef status;
+  int locked = I2Cx_Lock(i2c_handler);
+
+  status = HAL_I2C_IsDeviceReady(i2c_handler, DevAddress, Trials, 1000);
+
+  I2Cx_Unlock(i2c_handler, locked);
+  return status;
 }
 /*}}}*/
 /*{{{*/
@@ -371,6 +424,128 @@ static void I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr)
   I2Cx_Init(i2c_handler);
 }
 /*}}}*/
+/*{{{*/
+/**
+  * @brief  Takes the audio bus mutex, codec, touch task and main thread share the bus.
+  * @note   Nothing to take before the scheduler runs or from an interrupt.
+  * @param  i2c_handler : I2C handler
+  * @retval 1 if taken
+  */
+static int I2Cx_Lock(I2C_HandleTypeDef *i2c_handler)
+{
+  if ((i2c_handler != &hI2cAudioHandler) || !i2cAudioMutex || __get_IPSR() ||
+      (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+    return 0;
+
+  xSemaphoreTake(i2cAudioMutex, portMAX_DELAY);
+  return 1;
+}
+/*}}}*/
+/*{{{*/
+/**
+  * @brief  Gives the audio bus mutex if I2Cx_Lock took it.
+  * @param  i2c_handler : I2C handler
+  * @param  locked: I2Cx_Lock result
+  * @retval None
+  */
+static void I2Cx_Unlock(I2C_HandleTypeDef *i2c_handler, int locked)
+{
+  if (locked)
+    xSemaphoreGive(i2cAudioMutex);
+}
+/*}}}*/
+/*{{{*/
+/**
+  * @brief  Reads multiple data by dma, the calling task sleeps until the transfer completes.
+  * @note   Buffer must be dmaAligned, polled read before the scheduler runs or from an interrupt.
+  * @param  i2c_handler : I2C handler
+  * @param  Addr: I2C address
+  * @param  Reg: Reg address
+  * @param  MemAddSize: Memory address size
+  * @param  Buffer: Pointer to data buffer
+  * @param  Length: Length of the data
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef I2Cx_ReadMultipleDma(I2C_HandleTypeDef *i2c_handler,
+                                              uint8_t Addr,
+                                              uint16_t Reg,
+                                              uint16_t MemAddSize,
+                                              uint8_t *Buffer,
+                                              uint16_t Length)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+  int locked;
+
+  if (__get_IPSR() || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+    return I2Cx_ReadMultiple(i2c_handler, Addr, Reg, MemAddSize, Buffer, Length);
+
+  locked = I2Cx_Lock(i2c_handler);
+
+  /* drop a give from a completion that landed after an earlier timeout */
+  xSemaphoreTake(i2cAudioDmaSem, 0);
+  i2cAudioDmaStatus = HAL_OK;
+  i2cAudioDmaWaiting = 1;
+  dmaRxStart(Buffer, Length);
+
+  status = HAL_I2C_Mem_Read_DMA(i2c_handler, Addr, (uint16_t)Reg, MemAddSize, Buffer, Length);
+  if (status == HAL_OK)
+  {
+    /* A few hundred us at 400kHz, 10ms is a stuck bus */
+    if (xSemaphoreTake(i2cAudioDmaSem, 10) != pdTRUE)
+    {
+      HAL_DMA_Abort(i2c_handler->hdmarx);
+      status = HAL_TIMEOUT;
+    }
+    else
+      status = i2cAudioDmaStatus;
+  }
+
+  i2cAudioDmaWaiting = 0;
+  dmaRxDone(Buffer, Length);
+
+  /* Check the communication status */
+  if(status != HAL_OK)
+  {
+    /* I2C error occurred */
+    I2Cx_Error(i2c_handler, Addr);
+  }
+
+  I2Cx_Unlock(i2c_handler, locked);
+  return status;
+}
+/*}}}*/
+/*{{{*/
+/**
+  * @brief  Wakes the task waiting in I2Cx_ReadMultipleDma.
+  * @param  status: transfer result
+  * @retval None
+  */
+static void I2Cx_DmaDone(HAL_StatusTypeDef status)
+{
+  BaseType_t taskWoken = pdFALSE;
+
+  if (i2cAudioDmaWaiting)
+  {
+    i2cAudioDmaStatus = status;
+    xSemaphoreGiveFromISR(i2cAudioDmaSem, &taskWoken);
+  }
+  portYIELD_FROM_ISR(taskWoken);
+}
+/*}}}*/
+/*{{{*/
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c == &hI2cAudioHandler)
+    I2Cx_DmaDone(HAL_OK);
+}
+/*}}}*/
+/*{{{*/
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  if (hi2c == &hI2cAudioHandler)
+    I2Cx_DmaDone(HAL_ERROR);
+}
+/*}}}*/
 
 /*{{{*/
 /**
@@ -482,6 +657,20 @@ uint8_t TS_IO_Read(uint8_t Addr, uint8_t Reg)
 }
 /*}}}*/
 /*{{{*/
+/**
+  * @brief  Reads touch registers by dma, the calling task sleeps until they arrive.
+  * @param  Addr: I2C address
+  * @param  Reg: Register address
+  * @param  Buffer: Pointer to data buffer, dmaAligned
+  * @param  Length: Length of the data
+  * @retval HAL status
+  */
+uint16_t TS_IO_ReadDma(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length)
+{
+  return I2Cx_ReadMultipleDma(&hI2cAudioHandler, Addr, (uint16_t)Reg, I2C_MEMADD_SIZE_8BIT, Buffer, Length);
+}
+/*}}}*/
+/*{{{*/
 /**
   * @brief  Reads multiple data with I2C communication
   *         channel from TouchScreen.
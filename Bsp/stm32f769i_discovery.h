@@ -76,6 +76,15 @@ typedef enum { DISCO_OK    = 0, DISCO_ERROR = 1 } DISCO_Status_TypeDef;
 #define DISCOVERY_AUDIO_I2Cx_SDA_GPIO_PORT               GPIOB
 #define DISCOVERY_AUDIO_I2Cx_EV_IRQn                     I2C4_EV_IRQn
 #define DISCOVERY_AUDIO_I2Cx_ER_IRQn                     I2C4_ER_IRQn
+#define DISCOVERY_AUDIO_I2Cx_EV_IRQHandler               I2C4_EV_IRQHandler
+#define DISCOVERY_AUDIO_I2Cx_ER_IRQHandler               I2C4_ER_IRQHandler
+
+/* I2C4 rx dma, touch reports */
+#define DISCOVERY_AUDIO_I2Cx_DMA_CLK_ENABLE()            __HAL_RCC_DMA1_CLK_ENABLE()
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_STREAM               DMA1_Stream2
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_CHANNEL              DMA_CHANNEL_2
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQn                 DMA1_Stream2_IRQn
+#define DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQHandler           DMA1_Stream2_IRQHandler
 
 #define DISCOVERY_EXT_I2Cx                             I2C1
 #define DISCOVERY_EXT_I2Cx_CLK_ENABLE()                __HAL_RCC_I2C1_CLK_ENABLE()
@@ -106,6 +115,9 @@ void             BSP_PB_Init(Button_TypeDef Button, ButtonMode_TypeDef Button_Mo
 void             BSP_PB_DeInit(Button_TypeDef Button);
 uint32_t         BSP_PB_GetState(Button_TypeDef Button);
 
+/* codec and touch bus, for the irq handlers */
+extern I2C_HandleTypeDef hI2cAudioHandler;
+
 //{{{
 #ifdef __cplusplus
 }
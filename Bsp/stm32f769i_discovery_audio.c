@@ -129,6 +129,7 @@
   */
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f769i_discovery_audio.h"
+#include "uartLog.h"
 
 /** @addtogroup BSP
   * @{
@@ -1127,6 +1128,13 @@ uint8_t BSP_AUDIO_IN_Init(uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr)
 uint8_t BSP_AUDIO_IN_InitEx(uint16_t InputDevice, uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr)
 {
   uint8_t ret = AUDIO_ERROR;
+
+  /* bottom right mic dma stream is the debug log's usart1 tx stream */
+  if ((InputDevice == INPUT_DEVICE_DIGITAL_MIC) && (ChnlNbr > 2) && logDmaStream(AUDIO_DFSDMx_DMAx_BUTTOM_RIGHT_STREAM))
+  {
+    return AUDIO_ERROR;
+  }
+
   AudioIn_Device = InputDevice;
 
   if(InputDevice == INPUT_DEVICE_DIGITAL_MIC)
@@ -72,6 +72,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f769i_discovery.h"
 #include "stm32f769i_discovery_ts.h"
+#include "dmaBuf.h"
 
 /** @addtogroup BSP
   * @{
@@ -120,6 +121,8 @@ static TS_DrvTypeDef *ts_driver;
 static uint8_t  ts_orientation;
 static uint8_t  I2C_Address = 0;
 
+uint16_t TS_IO_ReadDma(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
+
 /* Table for touchscreen event information display on LCD : table indexed on enum @ref TS_TouchEventTypeDef information */
 char * ts_event_string_tab[TOUCH_EVENT_NB_MAX] = { "None",
                                                    "Press down",
@@ -241,6 +244,56 @@ uint8_t BSP_TS_ITConfig(void)
   return (ts_status);
 }
 
+/**
+  * @brief  Reads TD_STATUS and the first touch points in one dma burst, from the touch task.
+  * @note   Registers from TD_STATUS are 6 bytes per point, XH event and x msb, XL,
+  *         YH id and y msb, YL, weight, misc.
+  * @param  TS_Report: Pointer to touch report structure
+  * @retval TS_OK if the read succeeded, TS_ERROR with no touches otherwise
+  */
+uint8_t BSP_TS_GetReport(TS_ReportTypeDef *TS_Report)
+{
+  static uint8_t regs[DMA_LINE] __attribute__((aligned(DMA_LINE)));
+  uint16_t x, y, tmp;
+  uint32_t index;
+
+  TS_Report->touchDetected = 0;
+  if (TS_IO_ReadDma(I2C_Address, FT6206_TD_STAT_REG, regs, 1 + (TS_REPORT_NB_TOUCH * 6)) != 0)
+    return TS_ERROR;
+
+  /* Counts above the controller maximum are invalid, as in DetectTouch */
+  index = regs[0] & FT6206_TD_STAT_MASK;
+  if (index > FT6206_MAX_DETECTABLE_TOUCH)
+    return TS_OK;
+  TS_Report->touchDetected = (index > TS_REPORT_NB_TOUCH) ? TS_REPORT_NB_TOUCH : index;
+
+  for (index = 0; index < TS_Report->touchDetected; index++)
+  {
+    uint8_t *point = regs + 1 + (index * 6);
+    x = ((point[0] & 0x0F) << 8) | point[1];
+    y = ((point[2] & 0x0F) << 8) | point[3];
+
+    /* Same orientation as BSP_TS_GetState */
+    if (ts_orientation & TS_SWAP_XY)
+    {
+      tmp = x;
+      x = y;
+      y = tmp;
+    }
+    if (ts_orientation & TS_SWAP_X)
+      x = FT_6206_MAX_WIDTH - 1 - x;
+    if (ts_orientation & TS_SWAP_Y)
+      y = FT_6206_MAX_HEIGHT - 1 - y;
+
+    TS_Report->touchX[index] = x;
+    TS_Report->touchY[index] = y;
+    TS_Report->touchId[index] = point[2] >> 4;
+    TS_Report->touchWeight[index] = point[4];
+  }
+
+  return TS_OK;
+}
+
 /**
   * @brief  Returns status and positions of the touch screen.
   * @param  TS_State: Pointer to touch screen current state structure
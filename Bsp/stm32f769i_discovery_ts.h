@@ -104,6 +104,21 @@ typedef struct
 
 } TS_StateTypeDef;
 
+/**
+*  @brief TS_ReportTypeDef
+*  One burst read of the first touches, ids track fingers across reports
+*/
+#define TS_REPORT_NB_TOUCH              2
+
+typedef struct
+{
+  uint8_t  touchDetected;                   /*!< Active touches, at most TS_REPORT_NB_TOUCH */
+  uint16_t touchX[TS_REPORT_NB_TOUCH];      /*!< Screen X, orientation applied */
+  uint16_t touchY[TS_REPORT_NB_TOUCH];      /*!< Screen Y, orientation applied */
+  uint8_t  touchId[TS_REPORT_NB_TOUCH];     /*!< Controller touch id, stable while the finger is down */
+  uint8_t  touchWeight[TS_REPORT_NB_TOUCH]; /*!< Weight property of touches */
+} TS_ReportTypeDef;
+
 /**
  *  @brief TS_StatusTypeDef
  *  Define BSP_TS_xxx() functions possible return value,
@@ -182,6 +197,7 @@ uint8_t BSP_TS_ResetTouchData(TS_StateTypeDef *TS_State);
 #endif /* TS_MULTI_TOUCH_SUPPORTED == 1 */
 
 uint8_t BSP_TS_ITConfig(void);
+uint8_t BSP_TS_GetReport(TS_ReportTypeDef *TS_Report);
 
 /* These __weak function can be surcharged by application code in case the current settings
    need to be changed for specific (example GPIO allocation) */
@@ -7,6 +7,8 @@
 #include "task.h"
 
 #include "os/ethernetif.h"
+#include "trace.h"
+#include "uartLog.h"
 #include "cLcdPrivate.h"
 #include "cSdPrivate.h"
 
@@ -61,6 +63,7 @@ void getStackRegs (uint32_t* faultStackAddress) {
   printf ("afsr %08lx\n", SCB->AFSR);
   printf ("hcsr %08lx\n", SCB->SHCSR);
   printf ("*** breakpoint #0 ***\n");
+  logFlush();
 
   __asm("BKPT #0\n") ;
   }
@@ -77,6 +80,10 @@ void SysTick_Handler() {
     xPortSysTickHandler();
   }
 
+// debug uart tx
+extern DMA_HandleTypeDef logDmaHandle;
+void DMA2_Stream7_IRQHandler() { HAL_DMA_IRQHandler (&logDmaHandle); }
+
 // usb
 extern PCD_HandleTypeDef hpcd;
 void OTG_FS_IRQHandler() { HAL_PCD_IRQHandler (&hpcd); }
@@ -84,25 +91,33 @@ void OTG_HS_IRQHandler() { HAL_PCD_IRQHandler (&hpcd); }
 
 // ethernet
 extern ETH_HandleTypeDef EthHandle;
-void ETH_IRQHandler() { HAL_ETH_IRQHandler (&EthHandle); }
+void ETH_IRQHandler() { traceIsrIn (TRACE_ISR_ETH); HAL_ETH_IRQHandler (&EthHandle); traceIsrOut (TRACE_ISR_ETH); }
 
 // QSPI
 extern QSPI_HandleTypeDef QSPIHandle;
 void QUADSPI_IRQHandler() { HAL_QSPI_IRQHandler (&QSPIHandle); }
 
 // lcd
-void LTDC_IRQHandler() { LCD_LTDC_IRQHandler(); }
-void DMA2D_IRQHandler() { LCD_DMA2D_IRQHandler(); }
+void LTDC_IRQHandler() { traceIsrIn (TRACE_ISR_LTDC); LCD_LTDC_IRQHandler(); traceIsrOut (TRACE_ISR_LTDC); }
+ITCM_CODE void DMA2D_IRQHandler() { traceIsrIn (TRACE_ISR_DMA2D); LCD_DMA2D_IRQHandler(); traceIsrOut (TRACE_ISR_DMA2D); }
 
 // audio out
 extern SAI_HandleTypeDef haudio_out_sai;
-void AUDIO_OUT_SAIx_DMAx_IRQHandler() { HAL_DMA_IRQHandler (haudio_out_sai.hdmatx); }
+void AUDIO_OUT_SAIx_DMAx_IRQHandler() { traceIsrIn (TRACE_ISR_SAI); HAL_DMA_IRQHandler (haudio_out_sai.hdmatx); traceIsrOut (TRACE_ISR_SAI); }
+
+// codec and touch i2c, touch reports by dma
+void DISCOVERY_AUDIO_I2Cx_EV_IRQHandler() { HAL_I2C_EV_IRQHandler (&hI2cAudioHandler); }
+void DISCOVERY_AUDIO_I2Cx_ER_IRQHandler() { HAL_I2C_ER_IRQHandler (&hI2cAudioHandler); }
+void DISCOVERY_AUDIO_I2Cx_DMA_RX_IRQHandler() { HAL_DMA_IRQHandler (hI2cAudioHandler.hdmarx); }
+
+// touch int, HAL_GPIO_EXTI_Callback wakes the touch task
+void EXTI15_10_IRQHandler() { HAL_GPIO_EXTI_IRQHandler (TS_INT_PIN); }
 
 #ifdef STM32F746G_DISCO
   // sd irqs
-  void SDMMC1_IRQHandler() { HAL_SD_IRQHandler (&uSdHandle); }
-  void DMA2_Stream3_IRQHandler() { HAL_DMA_IRQHandler (uSdHandle.hdmarx); }
-  void DMA2_Stream6_IRQHandler() { HAL_DMA_IRQHandler (uSdHandle.hdmatx); }
+  void SDMMC1_IRQHandler() { traceIsrIn (TRACE_ISR_SDMMC); HAL_SD_IRQHandler (&uSdHandle); traceIsrOut (TRACE_ISR_SDMMC); }
+  void DMA2_Stream3_IRQHandler() { traceIsrIn (TRACE_ISR_SD_DMA); HAL_DMA_IRQHandler (uSdHandle.hdmarx); traceIsrOut (TRACE_ISR_SD_DMA); }
+  void DMA2_Stream6_IRQHandler() { traceIsrIn (TRACE_ISR_SD_DMA); HAL_DMA_IRQHandler (uSdHandle.hdmatx); traceIsrOut (TRACE_ISR_SD_DMA); }
   // audio in
   //extern SAI_HandleTypeDef haudio_in_sai;
   //void AUDIO_IN_SAIx_DMAx_IRQHandler() { HAL_DMA_IRQHandler (haudio_in_sai.hdmarx); }
@@ -118,9 +133,9 @@ void AUDIO_OUT_SAIx_DMAx_IRQHandler() { HAL_DMA_IRQHandler (haudio_out_sai.hdmat
   void DMA1_Stream7_IRQHandler() { HAL_DMA_IRQHandler (UartHandle.hdmatx); }
 
   // sd irqs
-  void SDMMC2_IRQHandler() { HAL_SD_IRQHandler (&uSdHandle); }
-  void DMA2_Stream0_IRQHandler() { HAL_DMA_IRQHandler (uSdHandle.hdmarx); }
-  void DMA2_Stream5_IRQHandler() { HAL_DMA_IRQHandler (uSdHandle.hdmatx); }
+  void SDMMC2_IRQHandler() { traceIsrIn (TRACE_ISR_SDMMC); HAL_SD_IRQHandler (&uSdHandle); traceIsrOut (TRACE_ISR_SDMMC); }
+  void DMA2_Stream0_IRQHandler() { traceIsrIn (TRACE_ISR_SD_DMA); HAL_DMA_IRQHandler (uSdHandle.hdmarx); traceIsrOut (TRACE_ISR_SD_DMA); }
+  void DMA2_Stream5_IRQHandler() { traceIsrIn (TRACE_ISR_SD_DMA); HAL_DMA_IRQHandler (uSdHandle.hdmatx); traceIsrOut (TRACE_ISR_SD_DMA); }
 
   // audio in reuses SD dma channels?
   //extern DFSDM_Filter_HandleTypeDef hAudioInTopLeftFilter;
@@ -0,0 +1,113 @@
+// touch.cpp - interrupt driven touch, int edge wakes the touch task, report read by i2c dma, gestures queued
+// - the edge isr only timestamps and notifies, the report is one TD_STATUS burst read by dma while the task sleeps
+// - while fingers are down a missed edge is covered by reading every kDownTimeout, lifts are never lost
+// - gestures queue with their int edge time, the ui drains them once a frame
+//{{{  includes
+#include "touch.h"
+
+#ifdef STM32F746G_DISCO
+  #include "stm32746g_discovery_ts.h"
+#else
+  #include "stm32f769i_discovery_ts.h"
+#endif
+
+#include "task.h"
+#include "queue.h"
+#include "staticTasks.h"
+
+#include "utils.h"
+//}}}
+
+static const TickType_t kDownTimeout = 25;
+static const int kQueueLength = 32;
+
+//{{{  static vars
+static TaskHandle_t mTask = nullptr;
+static QueueHandle_t mQueue = nullptr;
+static volatile TickType_t mIntTicks = 0;
+
+static uint32_t mInts = 0;
+static uint32_t mReports = 0;
+static uint32_t mTimeouts = 0;
+static uint32_t mErrors = 0;
+static uint32_t mDrops = 0;
+static uint32_t mMaxLatency = 0;
+//}}}
+
+//{{{
+extern "C" { void HAL_GPIO_EXTI_Callback (uint16_t pin) {
+
+  if ((pin == TS_INT_PIN) && mTask) {
+    mIntTicks = xTaskGetTickCountFromISR();
+    mInts++;
+
+    BaseType_t taskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR (mTask, &taskWoken);
+    portYIELD_FROM_ISR (taskWoken);
+    }
+  }
+}
+//}}}
+//{{{
+static void touchThread (void* arg) {
+
+  cGesture gesture;
+  tGesture gestures[cGesture::kMaxGestures];
+
+  while (true) {
+    bool edge = ulTaskNotifyTake (pdTRUE, gesture.down() ? kDownTimeout : portMAX_DELAY);
+    if (!edge)
+      mTimeouts++;
+
+    TS_ReportTypeDef tsReport;
+    if (BSP_TS_GetReport (&tsReport) != TS_OK) {
+      // no report is not a lift, the down timeout reads again
+      mErrors++;
+      continue;
+      }
+    mReports++;
+
+    tTouchReport report;
+    report.ms = edge ? mIntTicks : xTaskGetTickCount();
+    report.touches = tsReport.touchDetected;
+    for (auto touch = 0; touch < TS_REPORT_NB_TOUCH; touch++) {
+      report.x[touch] = tsReport.touchX[touch];
+      report.y[touch] = tsReport.touchY[touch];
+      report.id[touch] = tsReport.touchId[touch];
+      report.z[touch] = tsReport.touchWeight[touch];
+      }
+
+    uint32_t latency = xTaskGetTickCount() - report.ms;
+    if (latency > mMaxLatency)
+      mMaxLatency = latency;
+
+    auto count = gesture.report (report, gestures);
+    for (auto i = 0; i < count; i++)
+      if (xQueueSend (mQueue, &gestures[i], 0) != pdPASS)
+        mDrops++;
+    }
+  }
+//}}}
+
+//{{{
+void touchInit (uint16_t width, uint16_t height) {
+
+  BSP_TS_Init (width, height);
+
+  mQueue = xQueueCreate (kQueueLength, sizeof(tGesture));
+  staticTaskCreate ((TaskFunction_t)touchThread, "touch", 256, 0, 4, &mTask);
+
+  BSP_TS_ITConfig();
+  }
+//}}}
+//{{{
+bool touchGesture (tGesture& gesture, TickType_t wait) {
+  return mQueue && (xQueueReceive (mQueue, &gesture, wait) == pdPASS);
+  }
+//}}}
+//{{{
+std::string touchInfo() {
+  return "touch int:" + dec (mInts) + " rep:" + dec (mReports) + " to:" + dec (mTimeouts) +
+         " err:" + dec (mErrors) + " drop:" + dec (mDrops) + " lat<=" + dec (mMaxLatency) + "ms";
+  }
+//}}}
@@ -0,0 +1,16 @@
+// touch.h - interrupt driven touch, int edge wakes the touch task, report read by i2c dma, gestures queued
+#pragma once
+//{{{  includes
+#include <string>
+#include "cGesture.h"
+
+#include "FreeRTOS.h"
+//}}}
+
+// BSP_TS_Init, int line, touch task, before the scheduler or from a task
+void touchInit (uint16_t width, uint16_t height);
+
+// next gesture in time order, false if none within wait
+bool touchGesture (tGesture& gesture, TickType_t wait);
+
+std::string touchInfo();
@@ -166,6 +166,16 @@ void vPortInitialiseBlocks( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 size_t xPortGetMinimumEverFreeHeapSize( void ) PRIVILEGED_FUNCTION;
 
+/* heap_5.c placement, fast and dma from on chip sram, bulk from sdram. */
+typedef enum { eHeapBulk = 0, eHeapFast, eHeapDma } eHeapPlace;
+void *pvPortMallocPlaced( size_t xSize, eHeapPlace ePlace ) PRIVILEGED_FUNCTION;
+
+/* heap_5.c slab front end statistics. */
+size_t xPortGetLargestFreeBlock( void ) PRIVILEGED_FUNCTION;
+void vPortHeapStats( char *pcBuffer, size_t xLength ) PRIVILEGED_FUNCTION;
+uint32_t ulPortGetTaskHeapBytes( void *xTask ) PRIVILEGED_FUNCTION;
+void vPortHeapTaskDeleted( void *xTask ) PRIVILEGED_FUNCTION;
+
 /*
  * Setup the hardware ready for the scheduler to take control.  This generally
  * sets up a tick interrupt and sets timers for the correct tick frequency.
@@ -1,22 +1,62 @@
 // heap_5.c - multiple memory blocks explicitly declared by app main()
+// - small blocks come from lock free size class slabs carved out of the bulk region
+// - fast and dma placements come from on chip sram regions, bulk from sdram, each falls back to the other when full
+// - list blocks are cache line aligned and padded, no two allocations share a line, so any can be a dma buffer
+// - allocations before the regions are defined, static constructors, fall back to newlib malloc
+// - bytes held per task, the owner is in the list block header or the slab owner map, the slot is kept
+//   after the task is deleted until what it allocated is freed
 /*{{{  includes*/
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "FreeRTOS.h"
 #include "task.h"
+
+#ifdef __ARM_FEATURE_LDREX
+  #include "stm32f7xx.h"
+#endif
 /*}}}*/
 
 // Block sizes must not get too small
 #define heapMINIMUM_BLOCK_SIZE  ((size_t)(uxHeapStructSize << 1))
 #define heapBITS_PER_BYTE       ((size_t)8)
+#define heapMAX_REGIONS         4
+#define heapBYTE_ALIGNMENT      32          // cache line
+#define heapBYTE_ALIGNMENT_MASK (heapBYTE_ALIGNMENT - 1)
+#define heapINTERNAL_END        0x60000000  // below is on chip, dtcm and sram, above is fmc sdram
+
+// slabs, classes 16,32,64,128,256 bytes, pages handed to a class on demand and never returned
+#define heapSLAB_CLASSES        5
+#define heapSLAB_MIN_SHIFT      4
+#define heapSLAB_MAX_SIZE       (1 << (heapSLAB_MIN_SHIFT + heapSLAB_CLASSES - 1))
+#define heapSLAB_PAGE_SIZE      0x1000
+#define heapSLAB_ARENA_SIZE     0x40000
+#define heapSLAB_PAGES          (heapSLAB_ARENA_SIZE / heapSLAB_PAGE_SIZE)
+#define heapSLAB_OWNER_PAGES    ((heapSLAB_ARENA_SIZE >> heapSLAB_MIN_SHIFT) / heapSLAB_PAGE_SIZE)
+#define heapSLAB_FILL_WINDOW    0x10000     // allocs, fill counts halve here, recent fill and no overflow
+#define heapTASK_STATS          16          // owner byte, slot + 1, 0 none
+
+// exclusive load and store, host build for test/ is one thread, a plain load and a store that always succeeds
+#ifdef __ARM_FEATURE_LDREX
+	#define heapLDREX(p)      __LDREXW ((uint32_t*)(p))
+	#define heapSTREX(v, p)   __STREXW ((uint32_t)(v), (uint32_t*)(p))
+	#define heapCLREX()       __CLREX()
+#else
+	#define heapLDREX(p)      (*(p))
+	#define heapSTREX(v, p)   ((*(p) = (v)), 0)
+	#define heapCLREX()
+#endif
 
 // free blocks linked in order of memory address
 typedef struct A_BLOCK_LINK {
 	struct A_BLOCK_LINK* pxNextFreeBlock; // The next free block in the list
 	size_t xBlockSize;                    // The size of the free block
+	uint32_t ulOwner;                     // allocated, task stats slot + 1, 0 none
 	} BlockLink_t;
 
 // correctly byte align structure at beginning of allocated memory block
-static const uint32_t uxHeapStructSize  = (sizeof(BlockLink_t) + (portBYTE_ALIGNMENT-1)) & ~portBYTE_ALIGNMENT_MASK;
+static const uint32_t uxHeapStructSize  = (sizeof(BlockLink_t) + (heapBYTE_ALIGNMENT-1)) & ~heapBYTE_ALIGNMENT_MASK;
 
 static BlockLink_t xStart;
 static BlockLink_t* pxEnd = NULL;
@@ -29,6 +69,41 @@ static size_t xBlockAllocatedBit = 0;
 static size_t xFreeBytesRemaining = 0;
 static size_t xMinimumEverFreeBytesRemaining = 0;
 
+static uint8_t* pucRegionStart[heapMAX_REGIONS];
+static uint8_t* pucRegionEnd[heapMAX_REGIONS];
+static BaseType_t xNumRegions = 0;
+
+/*{{{  slab vars*/
+typedef struct {
+	void* volatile pvFree;                 // lock free stack of free blocks, link in first word
+	volatile uint32_t ulAllocs;
+	volatile uint32_t ulFrees;
+	volatile uint32_t ulFillAllocs;        // recent allocs and bytes asked for, internal fragmentation
+	volatile uint32_t ulFillRequested;
+	volatile uint32_t ulPages;
+	} SlabClass_t;
+
+typedef struct {
+	volatile uint32_t ulClaimed;           // from the task's first allocation until it is deleted holding nothing
+	TaskHandle_t volatile xTask;           // NULL once deleted, a new task at the same tcb is not this one
+	char pcName[configMAX_TASK_NAME_LEN];  // copied on claim, the task may be deleted later
+	volatile uint32_t ulAllocs;
+	volatile uint32_t ulBytes;             // held now, block sizes allocated less freed
+	} TaskStats_t;
+
+static SlabClass_t xSlabClasses[heapSLAB_CLASSES];
+static uint8_t* pucSlabArena = NULL;
+static uint8_t* pucSlabOwner = NULL;   // owner byte per smallest block, first pages of the arena
+static volatile uint32_t ulSlabNextPage = 0;
+static uint8_t ucSlabPageClass[heapSLAB_PAGES];
+
+static volatile uint32_t ulHeapAllocs = 0;
+static volatile uint32_t ulHeapFrees = 0;
+static volatile uint32_t ulSlabFallbacks = 0;
+static volatile uint32_t ulPlaceFallbacks[3];
+static TaskStats_t xTaskStats[heapTASK_STATS];
+/*}}}*/
+
 size_t xPortGetFreeHeapSize() { return xFreeBytesRemaining; }
 size_t xPortGetMinimumEverFreeHeapSize() { return xMinimumEverFreeBytesRemaining; }
 
@@ -75,7 +150,7 @@ static void prvInsertBlockIntoFreeList (BlockLink_t* pxBlockToInsert) {
 	}
 /*}}}*/
 /*{{{*/
-void* pvPortMalloc (size_t xWantedSize) {
+static void* prvHeapMalloc (size_t xWantedSize, BaseType_t xInternal) {
 
 	BlockLink_t *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
 	void* pvReturn = NULL;
@@ -94,8 +169,8 @@ void* pvPortMalloc (size_t xWantedSize) {
 				xWantedSize += uxHeapStructSize;
 
 				// Ensure that blocks are always aligned to the required number of bytes
-				if ((xWantedSize & portBYTE_ALIGNMENT_MASK) != 0x00) // Byte alignment required
-					xWantedSize += (portBYTE_ALIGNMENT - (xWantedSize & portBYTE_ALIGNMENT_MASK));
+				if ((xWantedSize & heapBYTE_ALIGNMENT_MASK) != 0x00) // Byte alignment required
+					xWantedSize += (heapBYTE_ALIGNMENT - (xWantedSize & heapBYTE_ALIGNMENT_MASK));
 				else
 					mtCOVERAGE_TEST_MARKER();
 				}
@@ -106,7 +181,8 @@ void* pvPortMalloc (size_t xWantedSize) {
 				// Traverse the list from the start (lowest address) block until one of adequate size is found
 				pxPreviousBlock = &xStart;
 				pxBlock = xStart.pxNextFreeBlock;
-				while ((pxBlock->xBlockSize < xWantedSize) && (pxBlock->pxNextFreeBlock != NULL)) {
+				while (((pxBlock->xBlockSize < xWantedSize) || (((uintptr_t)pxBlock < heapINTERNAL_END) != xInternal)) &&
+				       (pxBlock->pxNextFreeBlock != NULL)) {
 					pxPreviousBlock = pxBlock;
 					pxBlock = pxBlock->pxNextFreeBlock;
 					}
@@ -145,6 +221,7 @@ void* pvPortMalloc (size_t xWantedSize) {
 					// The block is being returned - it is allocated and owned by the application and has no "next" block
 					pxBlock->xBlockSize |= xBlockAllocatedBit;
 					pxBlock->pxNextFreeBlock = NULL;
+					pxBlock->ulOwner = 0;
 					}
 				else
 					mtCOVERAGE_TEST_MARKER();
@@ -172,7 +249,7 @@ void* pvPortMalloc (size_t xWantedSize) {
 	}
 /*}}}*/
 /*{{{*/
-void vPortFree (void* pv) {
+static void prvHeapFree (void* pv) {
 
 	BlockLink_t* pxLink;
 	uint8_t* puc = (uint8_t*)pv;
@@ -218,25 +295,28 @@ void vPortDefineHeapRegions (const HeapRegion_t* const pxHeapRegions) {
 	uint8_t *pucAlignedHeap;
 	size_t xTotalRegionSize, xTotalHeapSize = 0;
 	BaseType_t xDefinedRegions = 0;
-	uint32_t ulAddress;
+	uintptr_t xAddress;
 
 	// Can only call once! */
 	configASSERT (pxEnd == NULL);
 
 	const HeapRegion_t* pxHeapRegion = &(pxHeapRegions[ xDefinedRegions]);
 	while (pxHeapRegion->xSizeInBytes > 0) {
+		configASSERT (xDefinedRegions < heapMAX_REGIONS);
+		pucRegionStart[xDefinedRegions] = pxHeapRegion->pucStartAddress;
+		pucRegionEnd[xDefinedRegions] = pxHeapRegion->pucStartAddress + pxHeapRegion->xSizeInBytes;
 		xTotalRegionSize = pxHeapRegion->xSizeInBytes;
 
 		// Ensure the heap region starts on a correctly aligned boundary
-		ulAddress = (uint32_t)pxHeapRegion->pucStartAddress;
-		if ((ulAddress & portBYTE_ALIGNMENT_MASK) != 0) {
-			ulAddress += (portBYTE_ALIGNMENT - 1);
-			ulAddress &= ~portBYTE_ALIGNMENT_MASK;
+		xAddress = (uintptr_t)pxHeapRegion->pucStartAddress;
+		if ((xAddress & heapBYTE_ALIGNMENT_MASK) != 0) {
+			xAddress += (heapBYTE_ALIGNMENT - 1);
+			xAddress &= ~heapBYTE_ALIGNMENT_MASK;
 			// Adjust the size for the bytes lost to alignment
-			xTotalRegionSize -= ulAddress - (uint32_t)pxHeapRegion->pucStartAddress;
+			xTotalRegionSize -= xAddress - (uintptr_t)pxHeapRegion->pucStartAddress;
 			}
 
-		pucAlignedHeap = (uint8_t*)ulAddress;
+		pucAlignedHeap = (uint8_t*)xAddress;
 
 		// Set xStart if it has not already been set
 		if (xDefinedRegions == 0) {
@@ -249,24 +329,24 @@ void vPortDefineHeapRegions (const HeapRegion_t* const pxHeapRegions) {
 			// Should only get here if one region has already been added to the heap
 			configASSERT (pxEnd != NULL);
 			// Check blocks are passed in with increasing start addresses
-			configASSERT (ulAddress > (uint32_t) pxEnd);
+			configASSERT (xAddress > (uintptr_t) pxEnd);
 			}
 
 		// Remember the location of the end marker in the previous region, if any
 		pxPreviousFreeBlock = pxEnd;
 
 		// pxEnd is used to mark the end of the list of free blocks and is inserted at the end of the region space
-		ulAddress = ((uint32_t) pucAlignedHeap) + xTotalRegionSize;
-		ulAddress -= uxHeapStructSize;
-		ulAddress &= ~portBYTE_ALIGNMENT_MASK;
-		pxEnd = (BlockLink_t*) ulAddress;
+		xAddress = ((uintptr_t) pucAlignedHeap) + xTotalRegionSize;
+		xAddress -= uxHeapStructSize;
+		xAddress &= ~heapBYTE_ALIGNMENT_MASK;
+		pxEnd = (BlockLink_t*) xAddress;
 		pxEnd->xBlockSize = 0;
 		pxEnd->pxNextFreeBlock = NULL;
 
 		// To start with there is a single free block in this region that is
 		// sized to take up the entire heap region minus the space taken by the free block structure
 		pxFirstFreeBlockInRegion = (BlockLink_t*) pucAlignedHeap;
-		pxFirstFreeBlockInRegion->xBlockSize = ulAddress - (uint32_t)pxFirstFreeBlockInRegion;
+		pxFirstFreeBlockInRegion->xBlockSize = xAddress - (uintptr_t)pxFirstFreeBlockInRegion;
 		pxFirstFreeBlockInRegion->pxNextFreeBlock = pxEnd;
 
 		// If this is not the first region that makes up the entire heap space then link the previous region to this region
@@ -288,5 +368,332 @@ void vPortDefineHeapRegions (const HeapRegion_t* const pxHeapRegions) {
 
 	// Work out the position of the top bit in a size_t variable
 	xBlockAllocatedBit = ((size_t)1) << ((sizeof(size_t) * heapBITS_PER_BYTE) - 1);
+	xNumRegions = xDefinedRegions;
+
+	// slab arena from the first region, without it every size goes to the list
+	pucSlabArena = prvHeapMalloc (heapSLAB_ARENA_SIZE, pdFALSE);
+	if (pucSlabArena) {
+		pucSlabOwner = pucSlabArena;
+		memset (pucSlabOwner, 0, heapSLAB_OWNER_PAGES * heapSLAB_PAGE_SIZE);
+		ulSlabNextPage = heapSLAB_OWNER_PAGES;
+		}
+	}
+/*}}}*/
+
+/*{{{*/
+static uint32_t prvAtomicAdd (volatile uint32_t* pulValue, uint32_t ulAdd) {
+// ldrex/strex, exception entry or return clears the monitor so a preempted update retries, returns the new value
+
+	uint32_t ulNew;
+	do {
+		ulNew = heapLDREX (pulValue) + ulAdd;
+		} while (heapSTREX (ulNew, pulValue));
+
+	return ulNew;
+	}
+/*}}}*/
+/*{{{*/
+static void prvAtomicHalve (volatile uint32_t* pulValue) {
+
+	uint32_t ulNew;
+	do {
+		ulNew = heapLDREX (pulValue) >> 1;
+		} while (heapSTREX (ulNew, pulValue));
+	}
+/*}}}*/
+/*{{{*/
+static void prvSlabPush (SlabClass_t* pxClass, void* pvFirst, void* pvLast) {
+// push chain pvFirst..pvLast
+
+	void* pvHead;
+	do {
+		pvHead = (void*)heapLDREX (&pxClass->pvFree);
+		*(void**)pvLast = pvHead;
+		} while (heapSTREX (pvFirst, &pxClass->pvFree));
+	}
+/*}}}*/
+/*{{{*/
+static void* prvSlabPop (SlabClass_t* pxClass) {
+// single core, anything that could swap the head between ldrex and strex is an exception, which fails the strex,
+// so reading the next link in between is safe from ABA
+
+	void* pvBlock;
+	do {
+		pvBlock = (void*)heapLDREX (&pxClass->pvFree);
+		if (!pvBlock) {
+			heapCLREX();
+			return NULL;
+			}
+		} while (heapSTREX (*(void**)pvBlock, &pxClass->pvFree));
+
+	return pvBlock;
+	}
+/*}}}*/
+/*{{{*/
+static void* prvSlabRefill (BaseType_t xClass) {
+// carve a new page for xClass, keep one block, push the rest
+
+	uint32_t ulPage;
+	do {
+		ulPage = heapLDREX (&ulSlabNextPage);
+		if (ulPage >= heapSLAB_PAGES) {
+			heapCLREX();
+			return NULL;
+			}
+		} while (heapSTREX (ulPage + 1, &ulSlabNextPage));
+
+	ucSlabPageClass[ulPage] = xClass;
+	prvAtomicAdd (&xSlabClasses[xClass].ulPages, 1);
+
+	size_t xBlockSize = 1 << (heapSLAB_MIN_SHIFT + xClass);
+	uint8_t* pucPage = pucSlabArena + (ulPage * heapSLAB_PAGE_SIZE);
+	uint8_t* pucLast = pucPage + heapSLAB_PAGE_SIZE - xBlockSize;
+	for (uint8_t* puc = pucPage + xBlockSize; puc < pucLast; puc += xBlockSize)
+		*(void**)puc = puc + xBlockSize;
+	prvSlabPush (&xSlabClasses[xClass], pucPage + xBlockSize, pucLast);
+
+	return pucPage;
+	}
+/*}}}*/
+/*{{{*/
+static uint32_t prvTaskOwner() {
+// stats slot + 1 of the current task, claims a free slot on its first allocation, 0 if none
+
+	TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+	if (!xTask)
+		return 0;
+
+	for (BaseType_t i = 0; i < heapTASK_STATS; i++)
+		if (xTaskStats[i].xTask == xTask)
+			return i + 1;
+
+	for (BaseType_t i = 0; i < heapTASK_STATS; i++) {
+		TaskStats_t* pxStats = &xTaskStats[i];
+		if (heapLDREX (&pxStats->ulClaimed)) {
+			heapCLREX();
+			continue;
+			}
+		if (heapSTREX (1, &pxStats->ulClaimed))
+			continue;
+
+		// ulBytes is 0, a slot is only released holding nothing
+		strncpy (pxStats->pcName, pcTaskGetTaskName (xTask), configMAX_TASK_NAME_LEN - 1);
+		pxStats->ulAllocs = 0;
+		pxStats->xTask = xTask;
+		return i + 1;
+		}
+
+	return 0;
+	}
+/*}}}*/
+/*{{{*/
+static void prvOwnerAlloc (uint32_t ulOwner, uint32_t ulBytes) {
+
+	if (ulOwner) {
+		prvAtomicAdd (&xTaskStats[ulOwner-1].ulAllocs, 1);
+		prvAtomicAdd (&xTaskStats[ulOwner-1].ulBytes, ulBytes);
+		}
+	}
+/*}}}*/
+/*{{{*/
+static void prvOwnerFree (uint32_t ulOwner, uint32_t ulBytes) {
+// a deleted task's slot is released by the free that leaves it holding nothing
+
+	if (ulOwner) {
+		TaskStats_t* pxStats = &xTaskStats[ulOwner-1];
+		if (!prvAtomicAdd (&pxStats->ulBytes, -ulBytes) && !pxStats->xTask)
+			pxStats->ulClaimed = 0;
+		}
+	}
+/*}}}*/
+
+/*{{{*/
+void* pvPortMalloc (size_t xWantedSize) {
+
+	if (!pxEnd)
+		// before vPortDefineHeapRegions
+		return malloc (xWantedSize);
+
+	if (pucSlabArena && xWantedSize && (xWantedSize <= heapSLAB_MAX_SIZE)) {
+		BaseType_t xClass = 0;
+		while ((1u << (heapSLAB_MIN_SHIFT + xClass)) < xWantedSize)
+			xClass++;
+
+		SlabClass_t* pxClass = &xSlabClasses[xClass];
+		void* pvBlock = prvSlabPop (pxClass);
+		if (!pvBlock)
+			pvBlock = prvSlabRefill (xClass);
+		if (pvBlock) {
+			prvAtomicAdd (&pxClass->ulAllocs, 1);
+			prvAtomicAdd (&pxClass->ulFillRequested, xWantedSize);
+			if (prvAtomicAdd (&pxClass->ulFillAllocs, 1) >= heapSLAB_FILL_WINDOW) {
+				prvAtomicHalve (&pxClass->ulFillAllocs);
+				prvAtomicHalve (&pxClass->ulFillRequested);
+				}
+
+			uint32_t ulOwner = prvTaskOwner();
+			pucSlabOwner[((uint8_t*)pvBlock - pucSlabArena) >> heapSLAB_MIN_SHIFT] = ulOwner;
+			prvOwnerAlloc (ulOwner, 1 << (heapSLAB_MIN_SHIFT + xClass));
+			return pvBlock;
+			}
+
+		// arena used up
+		prvAtomicAdd (&ulSlabFallbacks, 1);
+		}
+
+	return pvPortMallocPlaced (xWantedSize, eHeapBulk);
+	}
+/*}}}*/
+/*{{{*/
+void* pvPortMallocPlaced (size_t xWantedSize, eHeapPlace ePlace) {
+// list heap only, in the placement's regions if there is room, else the others
+
+	if (!pxEnd)
+		return malloc (xWantedSize);
+
+	BaseType_t xInternal = ePlace != eHeapBulk;
+	void* pvReturn = prvHeapMalloc (xWantedSize, xInternal);
+	if (!pvReturn) {
+		pvReturn = prvHeapMalloc (xWantedSize, !xInternal);
+		if (pvReturn)
+			prvAtomicAdd (&ulPlaceFallbacks[ePlace], 1);
+		}
+
+	if (pvReturn) {
+		prvAtomicAdd (&ulHeapAllocs, 1);
+		BlockLink_t* pxLink = (BlockLink_t*)((uint8_t*)pvReturn - uxHeapStructSize);
+		pxLink->ulOwner = prvTaskOwner();
+		prvOwnerAlloc (pxLink->ulOwner, pxLink->xBlockSize & ~xBlockAllocatedBit);
+		}
+	return pvReturn;
+	}
+/*}}}*/
+/*{{{*/
+void vPortFree (void* pv) {
+
+	uint8_t* puc = (uint8_t*)pv;
+	if (!puc)
+		return;
+
+	if (pucSlabArena && (puc >= pucSlabArena) && (puc < pucSlabArena + heapSLAB_ARENA_SIZE)) {
+		BaseType_t xClass = ucSlabPageClass[(puc - pucSlabArena) / heapSLAB_PAGE_SIZE];
+		SlabClass_t* pxClass = &xSlabClasses[xClass];
+		prvOwnerFree (pucSlabOwner[(puc - pucSlabArena) >> heapSLAB_MIN_SHIFT], 1 << (heapSLAB_MIN_SHIFT + xClass));
+		prvSlabPush (pxClass, pv, pv);
+		prvAtomicAdd (&pxClass->ulFrees, 1);
+		return;
+		}
+
+	for (BaseType_t i = 0; i < xNumRegions; i++)
+		if ((puc >= pucRegionStart[i]) && (puc < pucRegionEnd[i])) {
+			BlockLink_t* pxLink = (BlockLink_t*)(puc - uxHeapStructSize);
+			prvOwnerFree (pxLink->ulOwner, pxLink->xBlockSize & ~xBlockAllocatedBit);
+			prvHeapFree (pv);
+			prvAtomicAdd (&ulHeapFrees, 1);
+			return;
+			}
+
+	// allocated by newlib before the regions were defined, anything else is not a heap pointer
+	extern char end asm("end");
+	configASSERT ((puc >= (uint8_t*)&end) && (puc < (uint8_t*)sbrk (0)));
+	free (pv);
+	}
+/*}}}*/
+
+/*{{{*/
+static void prvFreeStats (BaseType_t xInternal, size_t* pxFree, size_t* pxLargest) {
+
+	*pxFree = 0;
+	*pxLargest = 0;
+
+	vTaskSuspendAll();
+	for (BlockLink_t* pxBlock = xStart.pxNextFreeBlock; pxBlock && (pxBlock != pxEnd); pxBlock = pxBlock->pxNextFreeBlock)
+		if (((uintptr_t)pxBlock < heapINTERNAL_END) == xInternal) {
+			*pxFree += pxBlock->xBlockSize;
+			if (pxBlock->xBlockSize > *pxLargest)
+				*pxLargest = pxBlock->xBlockSize;
+			}
+	xTaskResumeAll();
+	}
+/*}}}*/
+/*{{{*/
+size_t xPortGetLargestFreeBlock() {
+
+	size_t xFree;
+	size_t xLargest;
+	size_t xLargestInternal;
+	prvFreeStats (pdFALSE, &xFree, &xLargest);
+	prvFreeStats (pdTRUE, &xFree, &xLargestInternal);
+
+	return xLargest > xLargestInternal ? xLargest : xLargestInternal;
+	}
+/*}}}*/
+/*{{{*/
+uint32_t ulPortGetTaskHeapBytes (void* xTask) {
+// bytes xTask holds now, block sizes, whichever task frees them
+
+	for (BaseType_t i = 0; i < heapTASK_STATS; i++)
+		if (xTaskStats[i].xTask == xTask)
+			return xTaskStats[i].ulBytes;
+
+	return 0;
+	}
+/*}}}*/
+/*{{{*/
+void vPortHeapTaskDeleted (void* xTask) {
+// traceTASK_DELETE, in the kernel's critical section, the slot stays until the task's blocks are freed
+
+	for (BaseType_t i = 0; i < heapTASK_STATS; i++) {
+		TaskStats_t* pxStats = &xTaskStats[i];
+		if (pxStats->xTask == xTask) {
+			pxStats->xTask = NULL;
+			if (!pxStats->ulBytes)
+				pxStats->ulClaimed = 0;
+			return;
+			}
+		}
+	}
+/*}}}*/
+/*{{{*/
+void vPortHeapStats (char* pcBuffer, size_t xLength) {
+// text report in the style of vTaskList, slab classes, list heap and per task allocations
+
+	int len = 0;
+	for (BaseType_t i = 0; (i < heapSLAB_CLASSES) && (len < (int)xLength); i++) {
+		SlabClass_t* pxClass = &xSlabClasses[i];
+		uint32_t ulBlockSize = 1 << (heapSLAB_MIN_SHIFT + i);
+		uint32_t ulInUse = pxClass->ulAllocs - pxClass->ulFrees;
+		uint32_t ulFree = ((pxClass->ulPages * heapSLAB_PAGE_SIZE) / ulBlockSize) - ulInUse;
+		uint32_t ulFillAllocs = pxClass->ulFillAllocs;
+		uint32_t ulUsedPercent = ulFillAllocs ?
+			(uint32_t)(((uint64_t)pxClass->ulFillRequested * 100) / ((uint64_t)ulFillAllocs * ulBlockSize)) : 100;
+		len += snprintf (pcBuffer + len, xLength - len, "slab%4u pages%3u use%6u free%6u fill%3u%%\r\n",
+		                 (unsigned)ulBlockSize, (unsigned)pxClass->ulPages, (unsigned)ulInUse,
+		                 (unsigned)ulFree, (unsigned)ulUsedPercent);
+		}
+
+	if (len < (int)xLength)
+		len += snprintf (pcBuffer + len, xLength - len, "heap free%8u min%8u use%6u slabFallback%u\r\n",
+		                 (unsigned)xFreeBytesRemaining, (unsigned)xMinimumEverFreeBytesRemaining,
+		                 (unsigned)(ulHeapAllocs - ulHeapFrees), (unsigned)ulSlabFallbacks);
+
+	for (BaseType_t xInternal = pdTRUE; (xInternal >= pdFALSE) && (len < (int)xLength); xInternal--) {
+		// external fragmentation, how much of the free space is not in its largest block
+		size_t xFree;
+		size_t xLargest;
+		prvFreeStats (xInternal, &xFree, &xLargest);
+		len += snprintf (pcBuffer + len, xLength - len, "%s free%8u largest%8u frag%3u%% fallback%u\r\n",
+		                 xInternal ? "sram " : "sdram", (unsigned)xFree, (unsigned)xLargest,
+		                 xFree ? (unsigned)(100 - ((xLargest * 100) / xFree)) : 0,
+		                 xInternal ? (unsigned)(ulPlaceFallbacks[eHeapFast] + ulPlaceFallbacks[eHeapDma]) :
+		                             (unsigned)ulPlaceFallbacks[eHeapBulk]);
+		}
+
+	for (BaseType_t i = 0; (i < heapTASK_STATS) && (len < (int)xLength); i++)
+		if (xTaskStats[i].ulClaimed)
+			len += snprintf (pcBuffer + len, xLength - len, "%-12s allocs%7u bytes%9u%s\r\n",
+			                 xTaskStats[i].pcName,
+			                 (unsigned)xTaskStats[i].ulAllocs, (unsigned)xTaskStats[i].ulBytes,
+			                 xTaskStats[i].xTask ? "" : " deleted");
 	}
 /*}}}*/
@@ -38,6 +38,7 @@
 #include "lwip/stats.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "staticTasks.h"
 
 
 xTaskHandle xTaskGetCurrentTaskHandle( void ) PRIVILEGED_FUNCTION;
@@ -47,6 +48,59 @@ xTaskHandle xTaskGetCurrentTaskHandle( void ) PRIVILEGED_FUNCTION;
 
 static u16_t s_nextthread = 0;
 
+#if configAPP_STATIC_ALLOCATION
+/* mboxes and semaphores are made once in sys_init and recycled, every netconn
+   takes and frees them, fallback to the heap only if a pool runs dry */
+#define SYS_MBOX_POOL 16
+#define SYS_SEM_POOL  16
+
+static QueueHandle_t s_mboxPool[SYS_MBOX_POOL];
+static u8_t s_mboxUsed[SYS_MBOX_POOL];
+static QueueHandle_t s_semPool[SYS_SEM_POOL];
+static u8_t s_semUsed[SYS_SEM_POOL];
+
+/*-----------------------------------------------------------------------------------*/
+// Take a free handle from a pool, NULL if none
+static QueueHandle_t sys_pool_take(QueueHandle_t *pool, u8_t *used, int size)
+{
+QueueHandle_t handle = NULL;
+int i;
+
+	taskENTER_CRITICAL();
+	for( i = 0; i < size; i++ )
+	{
+		if( pool[i] && !used[i] )
+		{
+			used[i] = 1;
+			handle = pool[i];
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	return handle;
+}
+
+/*-----------------------------------------------------------------------------------*/
+// Return a handle to its pool, 0 if it came from the heap
+static int sys_pool_give(QueueHandle_t *pool, u8_t *used, int size, QueueHandle_t handle)
+{
+int i;
+
+	for( i = 0; i < size; i++ )
+	{
+		if( pool[i] == handle )
+		{
+			xQueueReset( handle );
+			used[i] = 0;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
 
 /*-----------------------------------------------------------------------------------*/
 //  Creates an empty mailbox.
@@ -54,6 +108,10 @@ err_t sys_mbox_new(sys_mbox_t *mbox, int size)
 {
 	(void ) size;
 	
+#if configAPP_STATIC_ALLOCATION
+	*mbox = sys_pool_take( s_mboxPool, s_mboxUsed, SYS_MBOX_POOL );
+	if( *mbox == NULL )
+#endif
 	*mbox = xQueueCreate( archMESG_QUEUE_LENGTH, sizeof( void * ) );
 
 #if SYS_STATS
@@ -87,6 +145,9 @@ void sys_mbox_free(sys_mbox_t *mbox)
 		// TODO notify the user of failure.
 	}
 
+#if configAPP_STATIC_ALLOCATION
+	if( !sys_pool_give( s_mboxPool, s_mboxUsed, SYS_MBOX_POOL, *mbox ) )
+#endif
 	vQueueDelete( *mbox );
 
 #if SYS_STATS
@@ -221,6 +282,13 @@ void sys_mbox_set_invalid(sys_mbox_t *mbox)
 //  the initial state of the semaphore.
 err_t sys_sem_new(sys_sem_t *sem, u8_t count)
 {
+#if configAPP_STATIC_ALLOCATION
+	// pooled semaphores come back reset, empty, so give to match a new one
+	*sem = sys_pool_take( s_semPool, s_semUsed, SYS_SEM_POOL );
+	if( *sem != NULL )
+		xSemaphoreGive( *sem );
+	else
+#endif
 	vSemaphoreCreateBinary(*sem );
 	if(*sem == NULL)
 	{
@@ -307,6 +375,9 @@ void sys_sem_free(sys_sem_t *sem)
       --lwip_stats.sys.sem.used;
 #endif /* SYS_STATS */
 			
+#if configAPP_STATIC_ALLOCATION
+	if( !sys_pool_give( s_semPool, s_semUsed, SYS_SEM_POOL, *sem ) )
+#endif
 	vQueueDelete(*sem);
 }
 /*-----------------------------------------------------------------------------------*/
@@ -330,6 +401,21 @@ void sys_init(void)
 {
 	// keep track of how many threads have been created
 	s_nextthread = 0;
+
+#if configAPP_STATIC_ALLOCATION
+{
+int i;
+
+	for( i = 0; i < SYS_MBOX_POOL; i++ )
+		s_mboxPool[i] = xQueueCreate( archMESG_QUEUE_LENGTH, sizeof( void * ) );
+	for( i = 0; i < SYS_SEM_POOL; i++ )
+	{
+		vSemaphoreCreateBinary( s_semPool[i] );
+		if( s_semPool[i] )
+			xQueueReset( s_semPool[i] );
+	}
+}
+#endif
 }
 /*-----------------------------------------------------------------------------------*/
                                       /* Mutexes*/
@@ -396,7 +482,7 @@ int result;
 
    if ( s_nextthread < SYS_THREAD_MAX )
    {
-      result = xTaskCreate( thread, ( signed portCHAR * ) name, stacksize, arg, prio, &CreatedTask );
+      result = staticTaskCreate( thread, name, stacksize, arg, prio, &CreatedTask );
 
 	   // For each task created, store the task handle (pid) in the timers array.
 	   // This scheme doesn't allow for threads to be deleted
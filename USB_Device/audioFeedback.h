@@ -0,0 +1,40 @@
+// audioFeedback.h - uac2 asynchronous feedback, samples per (micro)frame from sai timing and pcm fifo level
+// - no hal or rtos, builds on a host, where a simulated sai clock and host can drive it
+// - high speed feedback is 16.16 samples per microframe, full speed 10.14 per frame
+// - pcm fifo size and target and the FNSOF masks here too, test/audioFeedbackTest checks against them
+#pragma once
+#include <stdint.h>
+
+#define AUDIO_FEEDBACK_HS_FRAC  16
+#define AUDIO_FEEDBACK_FS_FRAC  14
+
+#define AUDIO_FIFO_FRAMES       512      // power of 2, 10ms at 48k
+#define AUDIO_FIFO_TARGET       192      // 4ms, playout starts here, feedback steers the fill back to it
+#define AUDIO_HS_FRAME_MASK     0x3FFF   // DSTS FNSOF, 11 bit frame and 3 bit microframe at hs
+#define AUDIO_FS_FRAME_MASK     0x7FF    // 11 bit frame at fs
+
+/*{{{*/
+static inline uint32_t audioFeedbackNominal (uint32_t rate, uint32_t framesPerSec, int fracBits) {
+  return (uint32_t)(((uint64_t)rate << fracBits) / framesPerSec);
+  }
+/*}}}*/
+/*{{{*/
+static inline uint32_t audioFeedback (uint32_t rate, uint32_t framesPerSec, int fracBits,
+                                      uint32_t samples, uint32_t frames, int32_t fifoError) {
+// samples the sai played over frames usb (micro)frames, fifoError is target - fill in frames
+// - measured rate plus a fifo correction of fifoError spread over 2 seconds of frames
+// - clamped to 1/64 of nominal, a stuck sai or missed sof count cannot run the host away
+
+  uint32_t nominal = audioFeedbackNominal (rate, framesPerSec, fracBits);
+  int64_t feedback = frames ? (int64_t)(((uint64_t)samples << fracBits) / frames) : nominal;
+  feedback += ((int64_t)fifoError << fracBits) / (2 * (int64_t)framesPerSec);
+
+  int64_t range = nominal >> 6;
+  if (feedback > nominal + range)
+    feedback = nominal + range;
+  else if (feedback < nominal - range)
+    feedback = nominal - range;
+
+  return (uint32_t)feedback;
+  }
+/*}}}*/
@@ -0,0 +1,632 @@
+// usbd_audio.c
+// - usb audio class 2 speaker, 16 bit stereo, 44.1 or 48 khz chosen by the host on the clock source
+// - iso out data goes through a pcm fifo to the sai double buffer, the otg isr fills it, the sai dma isr drains it
+// - asynchronous, the sai clock is master, the feedback endpoint tells the host the samples per (micro)frame
+//   the sai really plays, counted against the usb frame number at each sai half, steered to a fifo target
+// - rate changes restart the sai from the audio task, the bsp calls are not isr safe
+/*{{{  includes*/
+#include "usbd_audio.h"
+#include "usbd_core.h"
+#include "audioFeedback.h"
+
+#include "dmaBuf.h"
+#include "staticTasks.h"
+#include "uartLog.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+/*}}}*/
+/*{{{  audio defines*/
+#define AUDIO_OUT_EP           0x01
+#define AUDIO_FEEDBACK_EP      0x81
+
+#define AUDIO_CHANNELS         2
+#define AUDIO_FRAME_BYTES      4        // 16 bit stereo, a word a frame
+#define AUDIO_MAX_RATE         48000
+#define AUDIO_HS_PACKET        ((AUDIO_MAX_RATE / 8000 + 1) * AUDIO_FRAME_BYTES)  // one frame over for the host to catch up
+#define AUDIO_FS_PACKET        ((AUDIO_MAX_RATE / 1000 + 1) * AUDIO_FRAME_BYTES)
+#define AUDIO_HS_FEEDBACK      4        // 16.16
+#define AUDIO_FS_FEEDBACK      3        // 10.14
+
+#define AUDIO_SAI_FRAMES       48       // a sai half, 1ms at 48k
+#define AUDIO_SAI_BYTES        (2 * AUDIO_SAI_FRAMES * AUDIO_FRAME_BYTES)
+#define AUDIO_STATS_MS         10000
+
+#define AUDIO_CLOCK_ID         0x10
+#define AUDIO_INPUT_ID         0x01
+#define AUDIO_OUTPUT_ID        0x03
+
+#define AUDIO_REQ_CUR          0x01
+#define AUDIO_REQ_RANGE        0x02
+#define AUDIO_CS_SAM_FREQ      0x01
+#define AUDIO_CS_CLOCK_VALID   0x02
+
+#define AUDIO_CONFIG_DESC_SIZ  134
+/*}}}*/
+/*{{{  audio static vars*/
+static USBD_AUDIO_ItfTypeDef* audioFops = NULL;
+static TaskHandle_t audioTask = NULL;
+
+static uint8_t* audioRx = NULL;    // iso out packet, otg dma
+static uint8_t* audioFb = NULL;    // feedback packet, otg dma
+static int16_t* audioSai = NULL;   // sai double buffer
+
+// ep0 data, otg dma, a line of its own
+static uint8_t audioCtl[DMA_LINE] __attribute__((aligned(DMA_LINE)));
+static uint8_t audioCtlCs = 0;     // control selector waiting for its SET CUR data
+
+// pcm fifo, free running indices, otg isr owns audioIn, sai isr owns audioOut
+static uint32_t audioFifo[AUDIO_FIFO_FRAMES];
+static volatile uint32_t audioIn = 0;
+static volatile uint32_t audioOut = 0;
+static volatile uint8_t audioFlush = 1;     // sai isr empties the fifo and restarts the feedback measure
+static uint8_t audioPlaying = 0;            // fifo reached AUDIO_FIFO_TARGET since the flush or an underrun
+
+static volatile uint32_t audioRate = AUDIO_MAX_RATE;
+static uint8_t audioHighSpeed = 0;
+static volatile uint8_t audioAlt = 0;
+
+// sai samples played against usb (micro)frames since audioFrame0
+static volatile uint32_t audioFeedbackValue = 0;
+static uint32_t audioFrame0 = 0;
+static uint32_t audioSamples = 0;
+
+static volatile uint32_t audioUnderruns = 0;
+static volatile uint32_t audioOverruns = 0;
+static volatile uint32_t audioFbMisses = 0;
+
+// wNumSubRanges, then dMIN dMAX dRES per rate
+static const uint8_t kAudioRange[26] = {
+  0x02, 0x00,
+  0x44, 0xAC, 0x00, 0x00,  0x44, 0xAC, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00,   /* 44100 */
+  0x80, 0xBB, 0x00, 0x00,  0x80, 0xBB, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00,   /* 48000 */
+  };
+/*}}}*/
+
+/*{{{*/
+static uint32_t audioFramesPerSec() {
+  return audioHighSpeed ? 8000 : 1000;
+  }
+/*}}}*/
+/*{{{*/
+static int audioFrac() {
+  return audioHighSpeed ? AUDIO_FEEDBACK_HS_FRAC : AUDIO_FEEDBACK_FS_FRAC;
+  }
+/*}}}*/
+/*{{{*/
+static uint32_t audioFrameNumber() {
+// (micro)frame of the last sof
+
+  USB_OTG_DeviceTypeDef* device = (USB_OTG_DeviceTypeDef*)((uintptr_t)hpcd.Instance + USB_OTG_DEVICE_BASE);
+  return (device->DSTS & USB_OTG_DSTS_FNSOF) >> 8;
+  }
+/*}}}*/
+
+/*{{{*/
+static void audioMeasure (uint32_t fill) {
+// sai isr, a second of frames, then the feedback is what the sai played plus the fifo correction
+
+  uint32_t frame = audioFrameNumber();
+  uint32_t frames = (frame - audioFrame0) & (audioHighSpeed ? AUDIO_HS_FRAME_MASK : AUDIO_FS_FRAME_MASK);
+  audioSamples += AUDIO_SAI_FRAMES;
+
+  if (frames >= audioFramesPerSec()) {
+    audioFeedbackValue = audioFeedback (audioRate, audioFramesPerSec(), audioFrac(), audioSamples, frames,
+                                        audioPlaying ? AUDIO_FIFO_TARGET - (int32_t)fill : 0);
+    audioFrame0 = frame;
+    audioSamples = 0;
+    }
+  }
+/*}}}*/
+/*{{{*/
+void USBD_AUDIO_SaiHalf (int second) {
+
+  int16_t* half = audioSai + (second ? AUDIO_SAI_FRAMES * AUDIO_CHANNELS : 0);
+
+  if (audioFlush) {
+    audioOut = audioIn;
+    audioPlaying = 0;
+    audioFrame0 = audioFrameNumber();
+    audioSamples = 0;
+    audioFlush = 0;
+    }
+  else {
+    uint32_t fill = audioIn - audioOut;
+    if (audioPlaying && (fill < AUDIO_SAI_FRAMES)) {
+      audioPlaying = 0;
+      if (audioAlt)
+        audioUnderruns++;
+      }
+    else if (!audioPlaying && (fill >= AUDIO_FIFO_TARGET))
+      audioPlaying = 1;
+
+    if (audioPlaying) {
+      uint32_t* dst = (uint32_t*)half;
+      uint32_t out = audioOut;
+      for (int i = 0; i < AUDIO_SAI_FRAMES; i++)
+        *dst++ = audioFifo[out++ & (AUDIO_FIFO_FRAMES-1)];
+      audioOut = out;
+      fill -= AUDIO_SAI_FRAMES;
+      dmaTxStart (half, AUDIO_SAI_BYTES / 2);
+      audioMeasure (fill);
+      return;
+      }
+    audioMeasure (fill);
+    }
+
+  memset (half, 0, AUDIO_SAI_BYTES / 2);
+  dmaTxStart (half, AUDIO_SAI_BYTES / 2);
+  }
+/*}}}*/
+
+/*{{{*/
+static void audioSendFeedback (USBD_HandleTypeDef* pdev) {
+// otg isr, little endian, 4 bytes 16.16 high speed, 3 bytes 10.14 full speed
+
+  uint32_t feedback = audioFeedbackValue;
+  audioFb[0] = feedback;
+  audioFb[1] = feedback >> 8;
+  audioFb[2] = feedback >> 16;
+  audioFb[3] = feedback >> 24;
+  USBD_LL_Transmit (pdev, AUDIO_FEEDBACK_EP, audioFb, audioHighSpeed ? AUDIO_HS_FEEDBACK : AUDIO_FS_FEEDBACK);
+  }
+/*}}}*/
+/*{{{*/
+static void audioSetAlt (USBD_HandleTypeDef* pdev, uint8_t alt) {
+// otg isr, alt 1 streams, the sai keeps running on silence in alt 0
+
+  if (alt && !audioAlt) {
+    USBD_LL_OpenEP (pdev, AUDIO_OUT_EP, USBD_EP_TYPE_ISOC, audioHighSpeed ? AUDIO_HS_PACKET : AUDIO_FS_PACKET);
+    USBD_LL_OpenEP (pdev, AUDIO_FEEDBACK_EP, USBD_EP_TYPE_ISOC, audioHighSpeed ? AUDIO_HS_FEEDBACK : AUDIO_FS_FEEDBACK);
+    USBD_LL_FlushEP (pdev, AUDIO_OUT_EP);
+    USBD_LL_FlushEP (pdev, AUDIO_FEEDBACK_EP);
+
+    audioFeedbackValue = audioFeedbackNominal (audioRate, audioFramesPerSec(), audioFrac());
+    audioFlush = 1;
+    audioAlt = 1;
+
+    USBD_LL_PrepareReceive (pdev, AUDIO_OUT_EP, audioRx, audioHighSpeed ? AUDIO_HS_PACKET : AUDIO_FS_PACKET);
+    audioSendFeedback (pdev);
+    }
+
+  else if (!alt && audioAlt) {
+    audioAlt = 0;
+    USBD_LL_FlushEP (pdev, AUDIO_FEEDBACK_EP);
+    USBD_LL_CloseEP (pdev, AUDIO_OUT_EP);
+    USBD_LL_CloseEP (pdev, AUDIO_FEEDBACK_EP);
+    }
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t audioClockRequest (USBD_HandleTypeDef* pdev, USBD_SetupReqTypedef* req) {
+// clock source, CUR and RANGE of the sampling frequency, CUR of clock valid, the rest stall
+
+  uint8_t cs = HIBYTE(req->wValue);
+
+  if (req->bmRequest & 0x80) {
+    uint16_t len = 0;
+    if ((cs == AUDIO_CS_SAM_FREQ) && (req->bRequest == AUDIO_REQ_CUR)) {
+      uint32_t rate = audioRate;
+      audioCtl[0] = rate;
+      audioCtl[1] = rate >> 8;
+      audioCtl[2] = rate >> 16;
+      audioCtl[3] = rate >> 24;
+      len = 4;
+      }
+    else if ((cs == AUDIO_CS_SAM_FREQ) && (req->bRequest == AUDIO_REQ_RANGE)) {
+      memcpy (audioCtl, kAudioRange, sizeof (kAudioRange));
+      len = sizeof (kAudioRange);
+      }
+    else if ((cs == AUDIO_CS_CLOCK_VALID) && (req->bRequest == AUDIO_REQ_CUR)) {
+      audioCtl[0] = 1;
+      len = 1;
+      }
+
+    if (len) {
+      USBD_CtlSendData (pdev, audioCtl, MIN (len, req->wLength));
+      return USBD_OK;
+      }
+    }
+
+  else if ((cs == AUDIO_CS_SAM_FREQ) && (req->bRequest == AUDIO_REQ_CUR) && (req->wLength == 4)) {
+    audioCtlCs = cs;
+    USBD_CtlPrepareRx (pdev, audioCtl, 4);
+    return USBD_OK;
+    }
+
+  USBD_CtlError (pdev, req);
+  return USBD_FAIL;
+  }
+/*}}}*/
+
+/*{{{*/
+static void audioThread (void* arg) {
+// sai side, restarts the sai when the host changes rate, logs the rate the sai really plays
+
+  uint32_t rate = 0;
+  TickType_t statsTicks = xTaskGetTickCount();
+
+  while (1) {
+    if (rate != audioRate) {
+      rate = audioRate;
+      audioFlush = 1;
+      memset (audioSai, 0, AUDIO_SAI_BYTES);
+      dmaTxStart (audioSai, AUDIO_SAI_BYTES);
+      audioFops->Play (rate, audioSai, AUDIO_SAI_BYTES);
+      }
+
+    ulTaskNotifyTake (pdTRUE, 1000);
+
+    if (audioAlt && (xTaskGetTickCount() - statsTicks >= AUDIO_STATS_MS)) {
+      uint32_t saiRate = ((uint64_t)audioFeedbackValue * audioFramesPerSec()) >> audioFrac();
+      logPrint (LOG_INFO, "usb audio %lu sai %lu fifo %lu under %lu over %lu fbMiss %lu\n",
+                rate, saiRate, audioIn - audioOut, audioUnderruns, audioOverruns, audioFbMisses);
+      statsTicks = xTaskGetTickCount();
+      }
+    }
+  }
+/*}}}*/
+
+/*{{{  audio desc*/
+/*{{{*/
+// iad, control interface with clock source, usb streaming input terminal and headphone output terminal,
+// streaming interface alt 0 idle, alt 1 async iso data out with its iso feedback in
+#define AUDIO_CFG_DESC(descType, dataPacket, feedbackPacket) {                                        \
+  0x09,   /* bLength: Configuation Descriptor size */                                                  \
+  descType,                                                                                            \
+  LOBYTE(AUDIO_CONFIG_DESC_SIZ),                                                                       \
+  HIBYTE(AUDIO_CONFIG_DESC_SIZ),                                                                       \
+  0x02, /* bNumInterfaces: 2 interfaces */                                                             \
+  0x01, /* bConfigurationValue: */                                                                     \
+  0x04, /* iConfiguration: */                                                                          \
+  0xC0, /* bmAttributes: */                                                                            \
+  0x32, /* MaxPower 100 mA */                                                                          \
+                                                                                                       \
+  /********************  interface association ********************/                                  \
+  0x08, /* bLength */                                                                                  \
+  0x0B, /* bDescriptorType: IAD */                                                                     \
+  0x00, /* bFirstInterface */                                                                          \
+  0x02, /* bInterfaceCount */                                                                          \
+  0x01, /* bFunctionClass: audio */                                                                    \
+  0x00, /* bFunctionSubClass */                                                                        \
+  0x20, /* bFunctionProtocol: IP version 2 */                                                          \
+  0x00, /* iFunction */                                                                                \
+                                                                                                       \
+  /********************  audio control interface ********************/                                \
+  0x09, /* bLength: Interface Descriptor size */                                                       \
+  0x04, /* bDescriptorType: */                                                                         \
+  0x00, /* bInterfaceNumber */                                                                         \
+  0x00, /* bAlternateSetting */                                                                        \
+  0x00, /* bNumEndpoints */                                                                            \
+  0x01, /* bInterfaceClass: audio */                                                                   \
+  0x01, /* bInterfaceSubClass: audio control */                                                        \
+  0x20, /* bInterfaceProtocol: IP version 2 */                                                         \
+  0x05, /* iInterface: */                                                                              \
+                                                                                                       \
+  0x09, /* bLength */                                                                                  \
+  0x24, /* bDescriptorType: CS_INTERFACE */                                                            \
+  0x01, /* bDescriptorSubtype: HEADER */                                                               \
+  0x00, /* bcdADC 2.00 */                                                                              \
+  0x02,                                                                                                \
+  0x02, /* bCategory: headphones */                                                                    \
+  0x2E, /* wTotalLength: header, clock, input, output */                                               \
+  0x00,                                                                                                \
+  0x00, /* bmControls */                                                                               \
+                                                                                                       \
+  0x08, /* bLength */                                                                                  \
+  0x24, /* bDescriptorType: CS_INTERFACE */                                                            \
+  0x0A, /* bDescriptorSubtype: CLOCK_SOURCE */                                                         \
+  AUDIO_CLOCK_ID,                                                                                      \
+  0x03, /* bmAttributes: internal programmable */                                                      \
+  0x07, /* bmControls: frequency read write, validity read */                                          \
+  0x00, /* bAssocTerminal */                                                                           \
+  0x00, /* iClockSource */                                                                             \
+                                                                                                       \
+  0x11, /* bLength */                                                                                  \
+  0x24, /* bDescriptorType: CS_INTERFACE */                                                            \
+  0x02, /* bDescriptorSubtype: INPUT_TERMINAL */                                                       \
+  AUDIO_INPUT_ID,                                                                                      \
+  0x01, /* wTerminalType: usb streaming */                                                             \
+  0x01,                                                                                                \
+  0x00, /* bAssocTerminal */                                                                           \
+  AUDIO_CLOCK_ID,                                                                                      \
+  AUDIO_CHANNELS,                                                                                      \
+  0x03, /* bmChannelConfig: front left, front right */                                                 \
+  0x00,                                                                                                \
+  0x00,                                                                                                \
+  0x00,                                                                                                \
+  0x00, /* iChannelNames */                                                                            \
+  0x00, /* bmControls */                                                                               \
+  0x00,                                                                                                \
+  0x00, /* iTerminal */                                                                                \
+                                                                                                       \
+  0x0C, /* bLength */                                                                                  \
+  0x24, /* bDescriptorType: CS_INTERFACE */                                                            \
+  0x03, /* bDescriptorSubtype: OUTPUT_TERMINAL */                                                      \
+  AUDIO_OUTPUT_ID,                                                                                     \
+  0x02, /* wTerminalType: headphones */                                                                \
+  0x03,                                                                                                \
+  0x00, /* bAssocTerminal */                                                                           \
+  AUDIO_INPUT_ID, /* bSourceID */                                                                      \
+  AUDIO_CLOCK_ID,                                                                                      \
+  0x00, /* bmControls */                                                                               \
+  0x00,                                                                                                \
+  0x00, /* iTerminal */                                                                                \
+                                                                                                       \
+  /********************  audio streaming interface, alt 0 ********************/                       \
+  0x09, /* bLength: Interface Descriptor size */                                                       \
+  0x04, /* bDescriptorType: */                                                                         \
+  0x01, /* bInterfaceNumber */                                                                         \
+  0x00, /* bAlternateSetting */                                                                        \
+  0x00, /* bNumEndpoints */                                                                            \
+  0x01, /* bInterfaceClass: audio */                                                                   \
+  0x02, /* bInterfaceSubClass: audio streaming */                                                      \
+  0x20, /* bInterfaceProtocol: IP version 2 */                                                         \
+  0x00, /* iInterface: */                                                                              \
+                                                                                                       \
+  /********************  audio streaming interface, alt 1 ********************/                       \
+  0x09, /* bLength: Interface Descriptor size */                                                       \
+  0x04, /* bDescriptorType: */                                                                         \
+  0x01, /* bInterfaceNumber */                                                                         \
+  0x01, /* bAlternateSetting */                                                                        \
+  0x02, /* bNumEndpoints */                                                                            \
+  0x01, /* bInterfaceClass: audio */                                                                   \
+  0x02, /* bInterfaceSubClass: audio streaming */                                                      \
+  0x20, /* bInterfaceProtocol: IP version 2 */                                                         \
+  0x00, /* iInterface: */                                                                              \
+                                                                                                       \
+  0x10, /* bLength */                                                                                  \
+  0x24, /* bDescriptorType: CS_INTERFACE */                                                            \
+  0x01, /* bDescriptorSubtype: AS_GENERAL */                                                           \
+  AUDIO_INPUT_ID, /* bTerminalLink */                                                                  \
+  0x00, /* bmControls */                                                                               \
+  0x01, /* bFormatType: FORMAT_TYPE_I */                                                               \
+  0x01, /* bmFormats: PCM */                                                                           \
+  0x00,                                                                                                \
+  0x00,                                                                                                \
+  0x00,                                                                                                \
+  AUDIO_CHANNELS,                                                                                      \
+  0x03, /* bmChannelConfig: front left, front right */                                                 \
+  0x00,                                                                                                \
+  0x00,                                                                                                \
+  0x00,                                                                                                \
+  0x00, /* iChannelNames */                                                                            \
+                                                                                                       \
+  0x06, /* bLength */                                                                                  \
+  0x24, /* bDescriptorType: CS_INTERFACE */                                                            \
+  0x02, /* bDescriptorSubtype: FORMAT_TYPE */                                                          \
+  0x01, /* bFormatType: FORMAT_TYPE_I */                                                               \
+  0x02, /* bSubslotSize */                                                                             \
+  0x10, /* bBitResolution */                                                                           \
+                                                                                                       \
+  /********************  audio streaming endpoints ********************/                              \
+  0x07, /*Endpoint descriptor length = 7 */                                                            \
+  0x05, /*Endpoint descriptor type */                                                                  \
+  AUDIO_OUT_EP, /*Endpoint address (OUT, address 1) */                                                 \
+  0x05, /*Isochronous asynchronous data endpoint */                                                    \
+  LOBYTE(dataPacket),                                                                                  \
+  HIBYTE(dataPacket),                                                                                  \
+  0x01, /* bInterval: every (micro)frame */                                                            \
+                                                                                                       \
+  0x08, /* bLength */                                                                                  \
+  0x25, /* bDescriptorType: CS_ENDPOINT */                                                             \
+  0x01, /* bDescriptorSubtype: EP_GENERAL */                                                           \
+  0x00, /* bmAttributes */                                                                             \
+  0x00, /* bmControls */                                                                               \
+  0x00, /* bLockDelayUnits */                                                                          \
+  0x00, /* wLockDelay */                                                                               \
+  0x00,                                                                                                \
+                                                                                                       \
+  0x07, /*Endpoint descriptor length = 7 */                                                            \
+  0x05, /*Endpoint descriptor type */                                                                  \
+  AUDIO_FEEDBACK_EP, /*Endpoint address (IN, address 1) */                                             \
+  0x11, /*Isochronous feedback endpoint */                                                             \
+  LOBYTE(feedbackPacket),                                                                              \
+  HIBYTE(feedbackPacket),                                                                              \
+  0x01, /* bInterval: every (micro)frame */                                                            \
+  }
+/*}}}*/
+/*{{{*/
+__ALIGN_BEGIN static const uint8_t USBD_AUDIO_CfgHSDesc[AUDIO_CONFIG_DESC_SIZ] __ALIGN_END =
+  AUDIO_CFG_DESC (USB_DESC_TYPE_CONFIGURATION, AUDIO_HS_PACKET, AUDIO_HS_FEEDBACK);
+/*}}}*/
+/*{{{*/
+static uint8_t* USBD_AUDIO_GetHSCfgDesc (uint16_t* length) {
+  *length = sizeof (USBD_AUDIO_CfgHSDesc);
+  return (uint8_t*)USBD_AUDIO_CfgHSDesc;
+  }
+/*}}}*/
+/*{{{*/
+__ALIGN_BEGIN static const uint8_t USBD_AUDIO_CfgFSDesc[AUDIO_CONFIG_DESC_SIZ] __ALIGN_END =
+  AUDIO_CFG_DESC (USB_DESC_TYPE_CONFIGURATION, AUDIO_FS_PACKET, AUDIO_FS_FEEDBACK);
+/*}}}*/
+/*{{{*/
+static uint8_t* USBD_AUDIO_GetFSCfgDesc (uint16_t* length) {
+  *length = sizeof (USBD_AUDIO_CfgFSDesc);
+  return (uint8_t*)USBD_AUDIO_CfgFSDesc;
+  }
+/*}}}*/
+/*{{{*/
+__ALIGN_BEGIN static const uint8_t USBD_AUDIO_OtherSpeedCfgDesc[AUDIO_CONFIG_DESC_SIZ] __ALIGN_END =
+  AUDIO_CFG_DESC (USB_DESC_TYPE_OTHER_SPEED_CONFIGURATION, AUDIO_FS_PACKET, AUDIO_FS_FEEDBACK);
+/*}}}*/
+/*{{{*/
+static uint8_t* USBD_AUDIO_GetOtherSpeedCfgDesc (uint16_t* length) {
+  *length = sizeof (USBD_AUDIO_OtherSpeedCfgDesc);
+  return (uint8_t*)USBD_AUDIO_OtherSpeedCfgDesc;
+  }
+/*}}}*/
+/*{{{*/
+__ALIGN_BEGIN static const uint8_t USBD_AUDIO_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END = {
+  USB_LEN_DEV_QUALIFIER_DESC,
+  USB_DESC_TYPE_DEVICE_QUALIFIER,
+  0x00,
+  0x02,
+  0xEF,
+  0x02,
+  0x01,
+  0x40,
+  0x01,
+  0x00,
+  };
+/*}}}*/
+/*{{{*/
+static uint8_t* USBD_AUDIO_GetDeviceQualifierDescriptor (uint16_t* length) {
+  *length = sizeof (USBD_AUDIO_DeviceQualifierDesc);
+  return (uint8_t*)USBD_AUDIO_DeviceQualifierDesc;
+  }
+/*}}}*/
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_Init (USBD_HandleTypeDef* pdev, uint8_t cfgidx) {
+// streaming endpoints open with alt 1
+
+  pdev->pClassData = audioFops;
+  audioHighSpeed = pdev->dev_speed == USBD_SPEED_HIGH;
+  audioAlt = 0;
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_DeInit (USBD_HandleTypeDef* pdev, uint8_t cfgidx) {
+  audioSetAlt (pdev, 0);
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_Setup (USBD_HandleTypeDef* pdev, USBD_SetupReqTypedef *req) {
+
+  switch (req->bmRequest & USB_REQ_TYPE_MASK) {
+    case USB_REQ_TYPE_CLASS : /* Class request, entity in the wIndex high byte */
+      if ((HIBYTE(req->wIndex) == AUDIO_CLOCK_ID) && (LOBYTE(req->wIndex) == 0))
+        return audioClockRequest (pdev, req);
+      USBD_CtlError (pdev, req);
+      return USBD_FAIL;
+
+    case USB_REQ_TYPE_STANDARD: /* Interface & Endpoint request */
+      switch (req->bRequest) {
+        /*{{{*/
+        case USB_REQ_GET_INTERFACE :
+          audioCtl[0] = (LOBYTE(req->wIndex) == 1) ? audioAlt : 0;
+          USBD_CtlSendData (pdev, audioCtl, 1);
+          break;
+        /*}}}*/
+        /*{{{*/
+        case USB_REQ_SET_INTERFACE :
+          if (LOBYTE(req->wIndex) == 1)
+            audioSetAlt (pdev, (uint8_t)(req->wValue));
+          break;
+        /*}}}*/
+        }
+      break;
+
+    default:
+      break;
+    }
+
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef* pdev) {
+// SET CUR sampling frequency data, the audio task restarts the sai at the new rate
+
+  if (audioCtlCs == AUDIO_CS_SAM_FREQ) {
+    uint32_t rate = audioCtl[0] | (audioCtl[1] << 8) | (audioCtl[2] << 16) | (audioCtl[3] << 24);
+    if (((rate == 44100) || (rate == 48000)) && (rate != audioRate)) {
+      audioRate = rate;
+      audioFeedbackValue = audioFeedbackNominal (rate, audioFramesPerSec(), audioFrac());
+
+      BaseType_t taskWoken = pdFALSE;
+      vTaskNotifyGiveFromISR (audioTask, &taskWoken);
+      portEND_SWITCHING_ISR (taskWoken);
+      }
+    }
+
+  audioCtlCs = 0;
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_DataIn (USBD_HandleTypeDef* pdev, uint8_t epnum) {
+// feedback went, queue the latest for the next (micro)frame
+
+  if (audioAlt)
+    audioSendFeedback (pdev);
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_DataOut (USBD_HandleTypeDef* pdev, uint8_t epnum) {
+// packet into the pcm fifo, what does not fit is dropped, feedback should keep that from happening
+
+  uint32_t frames = USBD_LL_GetRxDataSize (pdev, epnum) / AUDIO_FRAME_BYTES;
+  uint32_t in = audioIn;
+  uint32_t space = AUDIO_FIFO_FRAMES - (in - audioOut);
+  if (frames > space) {
+    frames = space;
+    audioOverruns++;
+    }
+
+  const uint32_t* src = (const uint32_t*)audioRx;
+  for (uint32_t i = 0; i < frames; i++)
+    audioFifo[in++ & (AUDIO_FIFO_FRAMES-1)] = *src++;
+  audioIn = in;
+
+  if (audioAlt)
+    USBD_LL_PrepareReceive (pdev, AUDIO_OUT_EP, audioRx, audioHighSpeed ? AUDIO_HS_PACKET : AUDIO_FS_PACKET);
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_IsoINIncomplete (USBD_HandleTypeDef* pdev, uint8_t epnum) {
+// feedback missed its (micro)frame, requeue it
+
+  if (audioAlt) {
+    audioFbMisses++;
+    USBD_LL_FlushEP (pdev, AUDIO_FEEDBACK_EP);
+    audioSendFeedback (pdev);
+    }
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static uint8_t USBD_AUDIO_IsoOUTIncomplete (USBD_HandleTypeDef* pdev, uint8_t epnum) {
+
+  if (audioAlt)
+    USBD_LL_PrepareReceive (pdev, AUDIO_OUT_EP, audioRx, audioHighSpeed ? AUDIO_HS_PACKET : AUDIO_FS_PACKET);
+  return 0;
+  }
+/*}}}*/
+
+/*{{{*/
+void USBD_AUDIO_RegisterInterface (USBD_HandleTypeDef* pdev, USBD_AUDIO_ItfTypeDef* fops) {
+// task context, before USBD_Start, packet and sai buffers, audio task starts the sai at the default rate
+
+  pdev->pUserData = fops;
+  audioFops = fops;
+
+  audioRx = (uint8_t*)dmaAlloc (AUDIO_FS_PACKET);
+  audioFb = (uint8_t*)dmaAlloc (DMA_LINE);
+  audioSai = (int16_t*)dmaAlloc (AUDIO_SAI_BYTES);
+  staticTaskCreate ((TaskFunction_t)audioThread, "usbAudio", 512, pdev, 4, &audioTask);
+  }
+/*}}}*/
+/*{{{*/
+USBD_ClassTypeDef USBD_AUDIO = {
+  USBD_AUDIO_Init,
+  USBD_AUDIO_DeInit,
+  USBD_AUDIO_Setup,
+  NULL, /*EP0_TxSent*/
+  USBD_AUDIO_EP0_RxReady,
+  USBD_AUDIO_DataIn,
+  USBD_AUDIO_DataOut,
+  NULL, /*SOF */
+  USBD_AUDIO_IsoINIncomplete,
+  USBD_AUDIO_IsoOUTIncomplete,
+  USBD_AUDIO_GetHSCfgDesc,
+  USBD_AUDIO_GetFSCfgDesc,
+  USBD_AUDIO_GetOtherSpeedCfgDesc,
+  USBD_AUDIO_GetDeviceQualifierDescriptor,
+  };
+/*}}}*/
@@ -0,0 +1,25 @@
+#pragma once
+//{{{
+#ifdef __cplusplus
+ extern "C" {
+#endif
+//}}}
+#include  "usbd_def.h"
+
+extern USBD_ClassTypeDef USBD_AUDIO;
+
+typedef struct _USBD_AUDIO_ITF {
+  // task context, (re)start the sai dma going round buf, 16 bit stereo, at rate
+  void (*Play) (uint32_t rate, int16_t* buf, uint32_t bytes);
+  } USBD_AUDIO_ItfTypeDef;
+
+void USBD_AUDIO_RegisterInterface (USBD_HandleTypeDef* pdev, USBD_AUDIO_ItfTypeDef* fops);
+
+// sai dma half and complete isr, second is the half just played, refilled from the pcm fifo
+void USBD_AUDIO_SaiHalf (int second);
+
+//{{{
+#ifdef __cplusplus
+}
+#endif
+//}}}
@@ -1,14 +1,22 @@
 // usbd_conf.c
+// - USE_USB_HS, ulpi phy, 512 byte bulk endpoints, otg dma straight to and from the msc media buffers
+// - dma buffers outside dtcm get d-cache maintenance here, transmit cleans, receive invalidates on completion
 /*{{{  includes*/
 #include "usbd_core.h"
 #include "usbd_desc.h"
 #include "usbd_msc.h"
+
+#include "dmaBuf.h"
 /*}}}*/
 
-PCD_HandleTypeDef hpcd;
+PCD_HandleTypeDef hpcd __attribute__((aligned(USBD_PCD_ALIGN)));
 uint32_t rdAlign = 0;
 uint32_t wrAlign = 0;
 
+// receive buffer per out endpoint, invalidated when its transfer completes
+static uint8_t* rxBuf[16];
+static uint16_t rxLen[16];
+
 /*{{{*/
 void HAL_PCD_MspInit (PCD_HandleTypeDef* hpcd) {
 
@@ -189,6 +197,10 @@ void HAL_PCD_SetupStageCallback (PCD_HandleTypeDef* hpcd) {
 /*}}}*/
 /*{{{*/
 void HAL_PCD_DataOutStageCallback (PCD_HandleTypeDef* hpcd, uint8_t epnum) {
+
+  if (hpcd->Init.dma_enable)
+    dmaRxDone (rxBuf[epnum], rxLen[epnum]);
+
   USBD_LL_DataOutStage (hpcd->pData, epnum, hpcd->OUT_ep[epnum].xfer_buff);
   }
 /*}}}*/
@@ -292,12 +304,17 @@ USBD_StatusTypeDef USBD_LL_Init (USBD_HandleTypeDef* pdev) {
   hpcd.Init.dev_endpoints = 6;
   hpcd.Init.phy_itface = PCD_PHY_ULPI;
   hpcd.Init.speed = PCD_SPEED_HIGH;
+  hpcd.Init.dma_enable = 1;
   hpcd.Init.vbus_sensing_enable = 1;
   HAL_PCD_Init (&hpcd);
 
+  // 4k fifo ram, 1024 words, top words kept for the dma endpoint registers
+  // - rx  0x200 words, 3 512 byte bulk packets + setup packets + status
+  // - tx0  0x40 words, 64 byte control packets
+  // - tx1 0x180 words, 3 512 byte bulk in packets queued, or the usb audio feedback
   HAL_PCDEx_SetRxFiFo (&hpcd, 0x200);
-  HAL_PCDEx_SetTxFiFo (&hpcd, 0, 0x80);
-  HAL_PCDEx_SetTxFiFo (&hpcd, 1, 0x174);
+  HAL_PCDEx_SetTxFiFo (&hpcd, 0, 0x40);
+  HAL_PCDEx_SetTxFiFo (&hpcd, 1, 0x180);
 #endif
 
   return USBD_OK;
@@ -370,8 +387,12 @@ USBD_StatusTypeDef USBD_LL_SetUSBAddress (USBD_HandleTypeDef* pdev, uint8_t dev_
 /*}}}*/
 /*{{{*/
 USBD_StatusTypeDef USBD_LL_Transmit (USBD_HandleTypeDef* pdev, uint8_t ep_addr, uint8_t* pbuf, uint16_t size) {
-  if (((uint32_t)pbuf) & 0x03)
+  if (((uintptr_t)pbuf) & 0x03)
     wrAlign++;
+
+  if (hpcd.Init.dma_enable)
+    dmaTxStart (pbuf, size);
+
   HAL_PCD_EP_Transmit (pdev->pData, ep_addr, pbuf, size);
   return USBD_OK;
   }
@@ -379,9 +400,16 @@ USBD_StatusTypeDef USBD_LL_Transmit (USBD_HandleTypeDef* pdev, uint8_t ep_addr,
 /*{{{*/
 USBD_StatusTypeDef USBD_LL_PrepareReceive (USBD_HandleTypeDef* pdev, uint8_t ep_addr, uint8_t* pbuf, uint16_t size) {
 
-  if (((uint32_t)pbuf) & 0x03)
+  if (((uintptr_t)pbuf) & 0x03)
     rdAlign++;
 
+  if (hpcd.Init.dma_enable) {
+    // buf must own its cache lines, the msc media buffers and cbw do
+    rxBuf[ep_addr & 0x0F] = pbuf;
+    rxLen[ep_addr & 0x0F] = size;
+    dmaRxStart (pbuf, size);
+    }
+
   HAL_PCD_EP_Receive (pdev->pData, ep_addr, pbuf, size);
   return USBD_OK;
   }
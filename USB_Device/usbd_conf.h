@@ -6,7 +6,11 @@
 #include <string.h>
 //}}}
 
-#define USBD_MAX_NUM_INTERFACES               1
+// otg hs dma writes setup packets into hpcd, initMpuRegions keeps its USBD_PCD_ALIGN bytes uncached
+#define USBD_PCD_ALIGN  1024
+extern PCD_HandleTypeDef hpcd;
+
+#define USBD_MAX_NUM_INTERFACES               2   // audio control and streaming
 #define USBD_MAX_NUM_CONFIGURATION            1
 #define USBD_MAX_STR_DESC_SIZ                 0x100
 #define USBD_SUPPORT_USER_STRING              0
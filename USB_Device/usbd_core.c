@@ -259,8 +259,26 @@ USBD_StatusTypeDef USBD_LL_SOF (USBD_HandleTypeDef* pdev) {
   }
 /*}}}*/
 
-USBD_StatusTypeDef USBD_LL_IsoINIncomplete (USBD_HandleTypeDef* pdev, uint8_t epnum) { return USBD_OK; }
-USBD_StatusTypeDef USBD_LL_IsoOUTIncomplete (USBD_HandleTypeDef* pdev, uint8_t epnum) { return USBD_OK; }
+/*{{{*/
+USBD_StatusTypeDef USBD_LL_IsoINIncomplete (USBD_HandleTypeDef* pdev, uint8_t epnum) {
+
+  if (pdev->dev_state == USBD_STATE_CONFIGURED)
+    if (pdev->pClass->IsoINIncomplete != NULL)
+      pdev->pClass->IsoINIncomplete (pdev, epnum);
+
+  return USBD_OK;
+  }
+/*}}}*/
+/*{{{*/
+USBD_StatusTypeDef USBD_LL_IsoOUTIncomplete (USBD_HandleTypeDef* pdev, uint8_t epnum) {
+
+  if (pdev->dev_state == USBD_STATE_CONFIGURED)
+    if (pdev->pClass->IsoOUTIncomplete != NULL)
+      pdev->pClass->IsoOUTIncomplete (pdev, epnum);
+
+  return USBD_OK;
+  }
+/*}}}*/
 
 USBD_StatusTypeDef USBD_LL_DevConnected (USBD_HandleTypeDef* pdev) { return USBD_OK; }
 /*{{{*/
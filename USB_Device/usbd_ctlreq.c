@@ -25,14 +25,11 @@ static void USBD_GetDescriptor (USBD_HandleTypeDef* pdev, USBD_SetupReqTypedef*
     /*}}}*/
     /*{{{*/
     case USB_DESC_TYPE_CONFIGURATION:
-      if (pdev->dev_speed == USBD_SPEED_HIGH ) {
+      // class descriptors are const, in flash, and carry their own bDescriptorType
+      if (pdev->dev_speed == USBD_SPEED_HIGH )
         pbuf = (uint8_t*)pdev->pClass->GetHSConfigDescriptor (&len);
-        pbuf[1] = USB_DESC_TYPE_CONFIGURATION;
-        }
-      else {
+      else
         pbuf = (uint8_t*)pdev->pClass->GetFSConfigDescriptor (&len);
-        pbuf[1] = USB_DESC_TYPE_CONFIGURATION;
-        }
       break;
     /*}}}*/
     /*{{{*/
@@ -89,7 +86,6 @@ static void USBD_GetDescriptor (USBD_HandleTypeDef* pdev, USBD_SetupReqTypedef*
     case USB_DESC_TYPE_OTHER_SPEED_CONFIGURATION:
       if (pdev->dev_speed == USBD_SPEED_HIGH) {
         pbuf = (uint8_t *)pdev->pClass->GetOtherSpeedConfigDescriptor (&len);
-        pbuf[1] = USB_DESC_TYPE_OTHER_SPEED_CONFIGURATION;
         break;
         }
       else {
@@ -17,6 +17,11 @@
 #define USBD_INTERFACE_HS_STRING      "MSC Interface"
 #define USBD_CONFIGURATION_FS_STRING  "MSC Config"
 #define USBD_INTERFACE_FS_STRING      "MSC Interface"
+
+#define USBD_AUDIO_PID                0x5730
+#define USBD_AUDIO_PRODUCT_STRING     "USB DAC"
+#define USBD_AUDIO_CONFIG_STRING      "Audio Config"
+#define USBD_AUDIO_INTERFACE_STRING   "Audio Interface"
 /*}}}*/
 
 /*{{{*/
@@ -42,6 +47,29 @@ __ALIGN_BEGIN static const uint8_t USBD_DeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END
   }; /* USB_DeviceDescriptor */
 /*}}}*/
 /*{{{*/
+// audio, iad class codes, one audio function of two interfaces
+__ALIGN_BEGIN static const uint8_t USBD_AudioDeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END = {
+  0x12,                       /* bLength */
+  USB_DESC_TYPE_DEVICE,       /* bDescriptorType */
+  0x00,                       /* bcdUSB */
+  0x02,
+  0xEF,                       /* bDeviceClass: miscellaneous */
+  0x02,                       /* bDeviceSubClass: common */
+  0x01,                       /* bDeviceProtocol: interface association */
+  USB_MAX_EP0_SIZE,           /* bMaxPacketSize */
+  LOBYTE(USBD_VID),           /* idVendor */
+  HIBYTE(USBD_VID),           /* idVendor */
+  LOBYTE(USBD_AUDIO_PID),     /* idProduct */
+  HIBYTE(USBD_AUDIO_PID),     /* idProduct */
+  0x00,                       /* bcdDevice rel. 2.00 */
+  0x02,
+  USBD_IDX_MFC_STR,           /* Index of manufacturer string */
+  USBD_IDX_PRODUCT_STR,       /* Index of product string */
+  USBD_IDX_SERIAL_STR,        /* Index of serial number string */
+  USBD_MAX_NUM_CONFIGURATION  /* bNumConfigurations */
+  };
+/*}}}*/
+/*{{{*/
 __ALIGN_BEGIN static const uint8_t USBD_LangIDDesc[USB_LEN_LANGID_STR_DESC] __ALIGN_END = {
   USB_LEN_LANGID_STR_DESC,
   USB_DESC_TYPE_STRING,
@@ -158,3 +186,40 @@ USBD_DescriptorsTypeDef MSC_Desc = {
   USBD_MSC_InterfaceStrDescriptor,
   };
 /*}}}*/
+
+/*{{{*/
+uint8_t* USBD_AUDIO_DeviceDescriptor (USBD_SpeedTypeDef speed, uint16_t* length) {
+  *length = sizeof(USBD_AudioDeviceDesc);
+  return (uint8_t*)USBD_AudioDeviceDesc;
+  }
+/*}}}*/
+/*{{{*/
+uint8_t* USBD_AUDIO_ProductStrDescriptor (USBD_SpeedTypeDef speed, uint16_t* length) {
+  USBD_GetString ((uint8_t*)USBD_AUDIO_PRODUCT_STRING, USBD_StrDesc, length);
+  return USBD_StrDesc;
+  }
+/*}}}*/
+/*{{{*/
+uint8_t* USBD_AUDIO_ConfigStrDescriptor (USBD_SpeedTypeDef speed, uint16_t* length) {
+  USBD_GetString ((uint8_t*)USBD_AUDIO_CONFIG_STRING, USBD_StrDesc, length);
+  return USBD_StrDesc;
+  }
+/*}}}*/
+/*{{{*/
+uint8_t* USBD_AUDIO_InterfaceStrDescriptor (USBD_SpeedTypeDef speed, uint16_t* length) {
+  USBD_GetString ((uint8_t*)USBD_AUDIO_INTERFACE_STRING, USBD_StrDesc, length);
+  return USBD_StrDesc;
+  }
+/*}}}*/
+
+/*{{{*/
+USBD_DescriptorsTypeDef AUDIO_Desc = {
+  USBD_AUDIO_DeviceDescriptor,
+  USBD_MSC_LangIDStrDescriptor,
+  USBD_MSC_ManufacturerStrDescriptor,
+  USBD_AUDIO_ProductStrDescriptor,
+  USBD_MSC_SerialStrDescriptor,
+  USBD_AUDIO_ConfigStrDescriptor,
+  USBD_AUDIO_InterfaceStrDescriptor,
+  };
+/*}}}*/
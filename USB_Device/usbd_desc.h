@@ -8,3 +8,4 @@
 #define  USB_SIZ_STRING_SERIAL       0x1A
 
 extern USBD_DescriptorsTypeDef MSC_Desc;
+extern USBD_DescriptorsTypeDef AUDIO_Desc;
@@ -1,14 +1,40 @@
 // usbd_msc.c
+// - READ, WRITE 10,16 data goes through a ring of MSC_MEDIA_PACKET buffers,
+//   the msc task moves sd data while the otg isr moves usb data, sd and usb overlap
+// - writes are acknowledged once queued in the ring, so several are outstanding for the card,
+//   a write carrying on from a queued one is received onto its end, one card write for both
+// - a queued write that fails on the card fails the next command, SYNCHRONIZE CACHE and
+//   START STOP UNIT hold their csw until the queue is on the card
+// - so MODE SENSE reports a caching page with WCE set, hosts that read it flush with SYNCHRONIZE CACHE
 /*{{{  includes*/
 #include "usbd_msc.h"
 #include "usbd_core.h"
 
 #include "memory.h"
+#include "dmaBuf.h"
+#include "cpuUsage.h"
+#include "staticTasks.h"
+#include "uartLog.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
 /*}}}*/
 /*{{{  msc defines*/
 #define MSC_MAX_FS_PACKET  64
-#define MSC_MAX_HS_PACKET  1024
-#define MSC_MEDIA_PACKET   1024
+#define MSC_MAX_HS_PACKET  512     // high speed bulk maximum
+#define MSC_MEDIA_PACKET   0x8000  // 32k, 64 blocks, one sd transfer
+#define MSC_MEDIA_BUFFERS  4       // ring, sd and usb sides both go round in order
+#define MSC_MEDIA_NEXT(i)  (((i) + 1) % MSC_MEDIA_BUFFERS)
+#define MSC_MEDIA_PREV(i)  (((i) + MSC_MEDIA_BUFFERS - 1) % MSC_MEDIA_BUFFERS)
+
+// media buffer states
+#define MSC_MEDIA_EMPTY    0
+#define MSC_MEDIA_SD       1       // msc task reading or writing the card
+#define MSC_MEDIA_READY    2       // read data waiting for usb
+#define MSC_MEDIA_QUEUED   3       // acknowledged write data waiting for the card
+#define MSC_MEDIA_USB      4       // on the usb endpoint
+
+#define MSC_STATS_BYTES    0x800000  // log MB/s every 8mb each way
 
 #define MSC_EPIN_ADDR      0x81
 #define MSC_EPOUT_ADDR     0x01
@@ -44,6 +70,10 @@
 
 #define SCSI_SEND_DIAGNOSTIC                        0x1D
 #define SCSI_READ_FORMAT_CAPACITIES                 0x23
+
+#define SCSI_SYNCHRONIZE_CACHE10                    0x35
+#define SCSI_SYNCHRONIZE_CACHE16                    0x91
+#define SCSI_SERVICE_ACTION_READ_CAPACITY16         0x10
 /*}}}*/
 /*{{{  scsi errors? defines*/
 #define NO_SENSE                                    0
@@ -75,21 +105,25 @@
 
 #define READ_FORMAT_CAPACITY_DATA_LEN               0x0C
 #define READ_CAPACITY10_DATA_LEN                    0x08
+#define READ_CAPACITY16_DATA_LEN                    0x20
 #define MODE_SENSE10_DATA_LEN                       0x08
 #define MODE_SENSE6_DATA_LEN                        0x04
 #define REQUEST_SENSE_DATA_LEN                      0x12
 #define STANDARD_INQUIRY_DATA_LEN                   0x24
 #define BLKVFY                                      0x04
 
-#define MODE_SENSE6_LEN  8
-#define MODE_SENSE10_LEN 8
+#define MODE_PAGE_CACHING    0x08
+#define MODE_PAGE_ALL        0x3F
+#define MODE_PAGE_CHANGEABLE 1       // page control, changeable values
+#define MODE_CACHING_LEN     20
+#define MODE_CACHING_WCE     0x04
 #define LENGTH_INQUIRY_PAGE00  7
 #define LENGTH_FORMAT_CAPACITIES  20
 
 #define SENSE_LIST_DEPTH  4
 
-static const uint8_t MSC_Mode_Sense6_data[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-static const uint8_t MSC_Mode_Sense10_data[] = { 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+// write back, writes are acknowledged from the media ring, none of the page is changeable
+static const uint8_t MSC_Caching_Page[MODE_CACHING_LEN] = { MODE_PAGE_CACHING, MODE_CACHING_LEN - 2, MODE_CACHING_WCE };
 static const uint8_t MSC_Page00_Inquiry_Data[] = { 0x00, 0x00, 0x00, (LENGTH_INQUIRY_PAGE00 - 4), 0x00, 0x80, 0x83 };
 
 // struct USBD_SCSI_SenseTypeDef
@@ -112,6 +146,7 @@ typedef struct _SENSE_ITEM {
 #define USBD_BOT_LAST_DATA_IN              3       /* Last Data In Last */
 #define USBD_BOT_SEND_DATA                 4       /* Send Immediate data */
 #define USBD_BOT_NO_DATA                   5       /* No data Stage */
+#define USBD_BOT_FLUSH                     6       /* csw waits for queued writes */
 
 #define USBD_BOT_CBW_SIGNATURE             0x43425355
 #define USBD_BOT_CSW_SIGNATURE             0x53425355
@@ -168,9 +203,9 @@ typedef struct {
   uint8_t                  bot_status;
   uint16_t                 bot_data_length;
 
-  uint8_t                  bot_data [MSC_MEDIA_PACKET];
-  USBD_MSC_BOT_CBWTypeDef  cbw;
-  USBD_MSC_BOT_CSWTypeDef  csw;
+  uint8_t                  bot_data [USBD_BOT_MAX_DATA];
+  USBD_MSC_BOT_CBWTypeDef  cbw __attribute__((aligned(DMA_LINE)));  // otg dma receives into cbw, own cache line
+  USBD_MSC_BOT_CSWTypeDef  csw __attribute__((aligned(DMA_LINE)));
 
   USBD_SCSI_SenseTypeDef   scsi_sense [SENSE_LIST_DEPTH];
   uint8_t                  scsi_sense_head;
@@ -179,10 +214,36 @@ typedef struct {
   uint16_t                 scsi_blk_size;
   uint32_t                 scsi_blk_nbr;
 
-  uint32_t                 scsi_blk_addr;
-  uint32_t                 scsi_blk_len;
+  uint32_t                 scsi_blk_addr;   // block
+  uint32_t                 scsi_blk_len;    // bytes
   } USBD_MSC_BOT_HandleTypeDef;
 /*}}}*/
+/*{{{  media static vars*/
+static USBD_MSC_BOT_HandleTypeDef* mscHandle = NULL;
+
+static uint8_t* mscMedia[MSC_MEDIA_BUFFERS];
+static volatile uint8_t mscState[MSC_MEDIA_BUFFERS];
+static uint32_t mscAddr[MSC_MEDIA_BUFFERS];   // block
+static uint32_t mscLen[MSC_MEDIA_BUFFERS];    // bytes
+
+static uint8_t mscSd = 0;               // next buffer for the sd side
+static uint8_t mscUsb = 0;              // next buffer for the usb side
+static uint32_t mscUsbLeft = 0;         // bytes usb still has to move
+static uint32_t mscRecv = 0;            // bytes of the receive on the out endpoint
+static int8_t mscMerging = -1;          // queued buffer the receive is appending to
+
+static volatile uint8_t mscQueued = 0;       // buffers of acknowledged writes not yet on the card
+static volatile uint8_t mscWriteFailed = 0;  // a queued write failed, the next command reports it
+static volatile uint32_t mscCommand = 0;     // bumped by SCSI_AbortMedia, stale sd reads are dropped
+static uint32_t mscMerges = 0;
+
+static TaskHandle_t mscTask = NULL;
+static uint32_t mscStartCycles = 0;
+static uint32_t mscReadBytes = 0;
+static uint32_t mscReadUs = 0;
+static uint32_t mscWriteBytes = 0;
+static uint32_t mscWriteUs = 0;
+/*}}}*/
 
 /*{{{*/
 static void BOT_SendCSW (USBD_HandleTypeDef* pdev, uint8_t CSW_Status) {
@@ -201,6 +262,17 @@ static void BOT_SendCSW (USBD_HandleTypeDef* pdev, uint8_t CSW_Status) {
 
 // scsi
 /*{{{*/
+static void SCSI_WakeMedia() {
+// isr, msc task has a buffer to fill or empty
+
+  if (mscTask) {
+    portBASE_TYPE taskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR (mscTask, &taskWoken);
+    portEND_SWITCHING_ISR (taskWoken);
+    }
+  }
+/*}}}*/
+/*{{{*/
 static void SCSI_SenseCode (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t sKey, uint8_t ASC) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
@@ -213,7 +285,7 @@ static void SCSI_SenseCode (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t sKey,
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_CheckAddressRange (USBD_HandleTypeDef* pdev, uint8_t lun , uint32_t blk_offset , uint16_t blk_nbr) {
+static int8_t SCSI_CheckAddressRange (USBD_HandleTypeDef* pdev, uint8_t lun , uint32_t blk_offset , uint32_t blk_nbr) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
@@ -226,56 +298,184 @@ static int8_t SCSI_CheckAddressRange (USBD_HandleTypeDef* pdev, uint8_t lun , ui
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_ProcessRead (USBD_HandleTypeDef* pdev, uint8_t lun) {
+static void SCSI_StartMedia (USBD_HandleTypeDef* pdev) {
+// new READ, WRITE, isr, the ring carries on from the last command, queued writes go to the card first
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
-  uint32_t len = MIN(hmsc->scsi_blk_len, MSC_MEDIA_PACKET);
-  if (((USBD_StorageTypeDef*)pdev->pUserData)->Read (hmsc->bot_data,
-                                                     hmsc->scsi_blk_addr / hmsc->scsi_blk_size,
-                                                     len / hmsc->scsi_blk_size) < 0) {
-    SCSI_SenseCode (pdev, lun, HARDWARE_ERROR, UNRECOVERED_READ_ERROR);
-    return -1;
+  mscUsbLeft = hmsc->scsi_blk_len;
+  mscStartCycles = cpuWallCycles();
+  }
+/*}}}*/
+/*{{{*/
+static void SCSI_AbortMedia() {
+// isr or in critical, bot reset, deinit, read error, drop the command's buffers
+// - queued writes were acknowledged, they stay and still go to the card
+// - reads only fill once the queue is on the card, so with none queued the sd side restarts at the usb side
+
+  mscCommand++;
+  mscUsbLeft = 0;
+  mscRecv = 0;
+
+  if (mscMerging >= 0) {
+    mscState[mscMerging] = MSC_MEDIA_QUEUED;
+    mscMerging = -1;
     }
 
-  USBD_LL_Transmit (pdev, MSC_EPIN_ADDR, hmsc->bot_data, len);
-  hmsc->scsi_blk_addr += len;
-  hmsc->scsi_blk_len -= len;
+  for (int i = 0; i < MSC_MEDIA_BUFFERS; i++)
+    if ((mscState[i] == MSC_MEDIA_READY) || (mscState[i] == MSC_MEDIA_USB))
+      mscState[i] = MSC_MEDIA_EMPTY;
 
-  /* case 6 : Hi = Di */
-  hmsc->csw.dDataResidue -= len;
+  if (!mscQueued)
+    mscSd = mscUsb;
+  }
+/*}}}*/
+/*{{{*/
+static void SCSI_EndMedia (uint32_t bytes, uint32_t* statBytes, uint32_t* statUs) {
+// command done, add to the sustained rate, command time only, host gaps left out
 
-  if (hmsc->scsi_blk_len == 0)
-    hmsc->bot_state = USBD_BOT_LAST_DATA_IN;
+  *statBytes += bytes;
+  *statUs += (cpuWallCycles() - mscStartCycles) / (SystemCoreClock / 1000000);
+  }
+/*}}}*/
+/*{{{*/
+static void SCSI_SendMedia (USBD_HandleTypeDef* pdev) {
+// isr or msc task in critical, send the usb side's buffer once the sd side has filled it
 
-  return 0;
+  USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
+
+  if ((hmsc->bot_state == USBD_BOT_DATA_IN) && (mscState[mscUsb] == MSC_MEDIA_READY)) {
+    mscState[mscUsb] = MSC_MEDIA_USB;
+    mscUsbLeft -= mscLen[mscUsb];
+
+    /* case 6 : Hi = Di */
+    hmsc->csw.dDataResidue -= mscLen[mscUsb];
+    if (mscUsbLeft == 0)
+      hmsc->bot_state = USBD_BOT_LAST_DATA_IN;
+
+    USBD_LL_Transmit (pdev, MSC_EPIN_ADDR, mscMedia[mscUsb], mscLen[mscUsb]);
+    }
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_ProcessWrite (USBD_HandleTypeDef* pdev, uint8_t lun) {
+static void SCSI_ReceiveMedia (USBD_HandleTypeDef* pdev) {
+// isr or msc task in critical, receive the next packet of a write
+// - onto the end of the previous buffer if that is still queued and the write carries on from it
+// - else into the usb side's buffer once the sd side has emptied it
 
-  USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*) pdev->pClassData;
+  USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
-  uint32_t len = MIN(hmsc->scsi_blk_len, MSC_MEDIA_PACKET);
-  if (((USBD_StorageTypeDef*)pdev->pUserData)->Write (hmsc->bot_data,
-                                                      hmsc->scsi_blk_addr / hmsc->scsi_blk_size,
-                                                      len / hmsc->scsi_blk_size) < 0) {
-    SCSI_SenseCode (pdev, lun, HARDWARE_ERROR, WRITE_FAULT);
-    return -1;
+  if ((hmsc->bot_state != USBD_BOT_DATA_OUT) || !mscUsbLeft || mscRecv)
+    return;
+
+  uint8_t* buf;
+  int prev = MSC_MEDIA_PREV (mscUsb);
+  if ((mscState[prev] == MSC_MEDIA_QUEUED) &&
+      (mscAddr[prev] + (mscLen[prev] / hmsc->scsi_blk_size) == hmsc->scsi_blk_addr) &&
+      (mscLen[prev] + mscUsbLeft <= MSC_MEDIA_PACKET)) {
+    mscState[prev] = MSC_MEDIA_USB;
+    mscMerging = prev;
+    mscRecv = mscUsbLeft;
+    buf = mscMedia[prev] + mscLen[prev];
+    }
+  else if (mscState[mscUsb] == MSC_MEDIA_EMPTY) {
+    mscState[mscUsb] = MSC_MEDIA_USB;
+    mscAddr[mscUsb] = hmsc->scsi_blk_addr;
+    mscLen[mscUsb] = 0;
+    mscRecv = MIN (mscUsbLeft, MSC_MEDIA_PACKET);
+    buf = mscMedia[mscUsb];
     }
+  else
+    return;
+
+  hmsc->scsi_blk_addr += mscRecv / hmsc->scsi_blk_size;
+  mscUsbLeft -= mscRecv;
+  USBD_LL_PrepareReceive (pdev, MSC_EPOUT_ADDR, buf, mscRecv);
+  }
+/*}}}*/
+/*{{{*/
+static int SCSI_ProcessRead (USBD_HandleTypeDef* pdev) {
+// msc task, read the next packet into the sd side's buffer, returns 0 when there is nothing to do
+// - the sd side's buffer stays queued until earlier writes are on the card
 
-  hmsc->scsi_blk_addr += len;
-  hmsc->scsi_blk_len -= len;
+  USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
-  /* case 12 : Ho = Do */
-  hmsc->csw.dDataResidue -= len;
+  taskENTER_CRITICAL();
+  int i = mscSd;
+  uint32_t command = mscCommand;
+  int go = ((hmsc->bot_state == USBD_BOT_DATA_IN) || (hmsc->bot_state == USBD_BOT_LAST_DATA_IN)) &&
+           hmsc->scsi_blk_len && (mscState[i] == MSC_MEDIA_EMPTY);
+  if (go) {
+    mscState[i] = MSC_MEDIA_SD;
+    mscAddr[i] = hmsc->scsi_blk_addr;
+    mscLen[i] = MIN (hmsc->scsi_blk_len, MSC_MEDIA_PACKET);
+    hmsc->scsi_blk_addr += mscLen[i] / hmsc->scsi_blk_size;
+    hmsc->scsi_blk_len -= mscLen[i];
+    mscSd = MSC_MEDIA_NEXT (i);
+    }
+  taskEXIT_CRITICAL();
+  if (!go)
+    return 0;
 
-  if (hmsc->scsi_blk_len == 0)
-    BOT_SendCSW (pdev, USBD_CSW_CMD_PASSED);
-  else /* Prepare EP to Receive next packet */
-    USBD_LL_PrepareReceive (pdev, MSC_EPOUT_ADDR, hmsc->bot_data, MIN (hmsc->scsi_blk_len, MSC_MEDIA_PACKET));
+  int8_t result = ((USBD_StorageTypeDef*)pdev->pUserData)->Read (mscMedia[i], mscAddr[i],
+                                                                 mscLen[i] / hmsc->scsi_blk_size);
+  taskENTER_CRITICAL();
+  if (command != mscCommand)
+    // aborted while on the card
+    mscState[i] = MSC_MEDIA_EMPTY;
+  else if (result < 0) {
+    mscState[i] = MSC_MEDIA_EMPTY;
+    SCSI_AbortMedia();
+    SCSI_SenseCode (pdev, hmsc->cbw.bLUN, HARDWARE_ERROR, UNRECOVERED_READ_ERROR);
+    BOT_SendCSW (pdev, USBD_CSW_CMD_FAILED);
+    }
+  else {
+    mscState[i] = MSC_MEDIA_READY;
+    SCSI_SendMedia (pdev);
+    }
+  SCSI_ReceiveMedia (pdev);
+  taskEXIT_CRITICAL();
 
-  return 0;
+  return 1;
+  }
+/*}}}*/
+/*{{{*/
+static int SCSI_ProcessWrite (USBD_HandleTypeDef* pdev) {
+// msc task, write the sd side's buffer once it is queued, returns 0 when there is nothing to do
+
+  USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
+
+  taskENTER_CRITICAL();
+  int i = mscSd;
+  int go = mscState[i] == MSC_MEDIA_QUEUED;
+  if (go)
+    mscState[i] = MSC_MEDIA_SD;
+  taskEXIT_CRITICAL();
+  if (!go)
+    return 0;
+
+  int8_t result = ((USBD_StorageTypeDef*)pdev->pUserData)->Write (mscMedia[i], mscAddr[i],
+                                                                  mscLen[i] / hmsc->scsi_blk_size);
+  taskENTER_CRITICAL();
+  if (result < 0) {
+    // already acknowledged, sense now, the next command fails
+    SCSI_SenseCode (pdev, hmsc->cbw.bLUN, HARDWARE_ERROR, WRITE_FAULT);
+    mscWriteFailed = 1;
+    }
+
+  mscState[i] = MSC_MEDIA_EMPTY;
+  mscSd = MSC_MEDIA_NEXT (i);
+  mscQueued--;
+
+  if ((hmsc->bot_state == USBD_BOT_FLUSH) && !mscQueued) {
+    BOT_SendCSW (pdev, mscWriteFailed ? USBD_CSW_CMD_FAILED : USBD_CSW_CMD_PASSED);
+    mscWriteFailed = 0;
+    }
+  else
+    SCSI_ReceiveMedia (pdev);
+  taskEXIT_CRITICAL();
+
+  return 1;
   }
 /*}}}*/
 /*{{{*/
@@ -353,6 +553,38 @@ static int8_t SCSI_ReadCapacity10 (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_
   }
 /*}}}*/
 /*{{{*/
+static int8_t SCSI_ReadCapacity16 (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
+
+  USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
+
+  if ((params[1] & 0x1F) != SCSI_SERVICE_ACTION_READ_CAPACITY16) {
+    SCSI_SenseCode (pdev, lun, ILLEGAL_REQUEST, INVALID_CDB);
+    return -1;
+    }
+
+  if (((USBD_StorageTypeDef *)pdev->pUserData)->GetCapacity (&hmsc->scsi_blk_nbr, &hmsc->scsi_blk_size) != 0) {
+    SCSI_SenseCode (pdev, lun, NOT_READY, MEDIUM_NOT_PRESENT);
+    return -1;
+    }
+
+  for (int i = 0; i < READ_CAPACITY16_DATA_LEN; i++)
+    hmsc->bot_data[i] = 0;
+
+  // last block, 64 bit, high word 0
+  hmsc->bot_data[4] = (uint8_t)((hmsc->scsi_blk_nbr - 1) >> 24);
+  hmsc->bot_data[5] = (uint8_t)((hmsc->scsi_blk_nbr - 1) >> 16);
+  hmsc->bot_data[6] = (uint8_t)((hmsc->scsi_blk_nbr - 1) >>  8);
+  hmsc->bot_data[7] = (uint8_t)(hmsc->scsi_blk_nbr - 1);
+
+  hmsc->bot_data[10] = (uint8_t)(hmsc->scsi_blk_size >>  8);
+  hmsc->bot_data[11] = (uint8_t)(hmsc->scsi_blk_size);
+
+  uint32_t allocLen = (params[10] << 24) | (params[11] << 16) | (params[12] << 8) | params[13];
+  hmsc->bot_data_length = MIN (allocLen, READ_CAPACITY16_DATA_LEN);
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
 static int8_t SCSI_ReadFormatCapacity(USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
@@ -385,17 +617,31 @@ static int8_t SCSI_ReadFormatCapacity(USBD_HandleTypeDef* pdev, uint8_t lun, uin
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_ModeSense6 (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params)
-{
+static uint16_t SCSI_ModePages (uint8_t* buf, uint8_t* params) {
+// pages for MODE SENSE 6 and 10 after their headers, the caching page when asked for it or for all,
+// others have no page, just the header
+
+  uint8_t page = params[2] & 0x3F;
+  if ((page != MODE_PAGE_CACHING) && (page != MODE_PAGE_ALL))
+    return 0;
+
+  memcpy (buf, MSC_Caching_Page, MODE_CACHING_LEN);
+  if ((params[2] >> 6) == MODE_PAGE_CHANGEABLE)
+    buf[2] = 0;
+  return MODE_CACHING_LEN;
+  }
+/*}}}*/
+/*{{{*/
+static int8_t SCSI_ModeSense6 (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
+
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
-  uint16_t len = 8 ;
-  hmsc->bot_data_length = len;
-  while (len) {
-    len--;
-    hmsc->bot_data[len] = MSC_Mode_Sense6_data[len];
-    }
+  // mode data length, medium type, not write protected, no block descriptors
+  uint16_t len = MODE_SENSE6_DATA_LEN + SCSI_ModePages (hmsc->bot_data + MODE_SENSE6_DATA_LEN, params);
+  memset (hmsc->bot_data, 0, MODE_SENSE6_DATA_LEN);
+  hmsc->bot_data[0] = len - 1;
 
+  hmsc->bot_data_length = MIN (len, params[4]);
   return 0;
   }
 /*}}}*/
@@ -404,12 +650,12 @@ static int8_t SCSI_ModeSense10 (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t*
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
-  uint16_t len = 8;
-  hmsc->bot_data_length = len;
-  while (len) {
-    len--;
-    hmsc->bot_data[len] = MSC_Mode_Sense10_data[len];
-    }
+  uint16_t len = MODE_SENSE10_DATA_LEN + SCSI_ModePages (hmsc->bot_data + MODE_SENSE10_DATA_LEN, params);
+  memset (hmsc->bot_data, 0, MODE_SENSE10_DATA_LEN);
+  hmsc->bot_data[0] = (len - 2) >> 8;
+  hmsc->bot_data[1] = (len - 2) & 0xFF;
+
+  hmsc->bot_data_length = MIN (len, (params[7] << 8) | params[8]);
   return 0;
   }
 /*}}}*/
@@ -440,15 +686,24 @@ static int8_t SCSI_RequestSense (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t*
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_StartStopUnit (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
+static int8_t SCSI_SynchronizeCache (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
+// queued writes are acknowledged before they are on the card, the csw waits for them
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
   hmsc->bot_data_length = 0;
+  if (mscQueued)
+    hmsc->bot_state = USBD_BOT_FLUSH;
   return 0;
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_Read10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
+static int8_t SCSI_StartStopUnit (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
+// eject, medium removal, nothing queued left behind
+  return SCSI_SynchronizeCache (pdev, lun, params);
+  }
+/*}}}*/
+/*{{{*/
+static int8_t SCSI_Read (USBD_HandleTypeDef* pdev, uint8_t lun, uint32_t blk_addr, uint32_t blk_len) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
@@ -464,28 +719,52 @@ static int8_t SCSI_Read10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* para
       return -1;
       }
 
-    hmsc->scsi_blk_addr = (params[2] << 24) | (params[3] << 16) | (params[4] <<  8) | params[5];
-    hmsc->scsi_blk_len =  (params[7] <<  8) | params[8];
-    if (SCSI_CheckAddressRange (pdev, lun, hmsc->scsi_blk_addr, hmsc->scsi_blk_len) < 0)
+    if (SCSI_CheckAddressRange (pdev, lun, blk_addr, blk_len) < 0)
       return -1; /* error */
 
-    hmsc->bot_state = USBD_BOT_DATA_IN;
-    hmsc->scsi_blk_addr *= hmsc->scsi_blk_size;
-    hmsc->scsi_blk_len *= hmsc->scsi_blk_size;
-
     /* cases 4,5 : Hi <> Dn */
-    if (hmsc->cbw.dDataLength != hmsc->scsi_blk_len) {
+    if (hmsc->cbw.dDataLength != (uint64_t)blk_len * hmsc->scsi_blk_size) {
       SCSI_SenseCode (pdev, hmsc->cbw.bLUN, ILLEGAL_REQUEST, INVALID_CDB);
       return -1;
       }
+
+    hmsc->scsi_blk_addr = blk_addr;
+    hmsc->scsi_blk_len = blk_len * hmsc->scsi_blk_size;
+    if (hmsc->scsi_blk_len == 0) {
+      // nothing to move, straight to csw
+      hmsc->bot_data_length = 0;
+      return 0;
+      }
+
+    // msc task reads, first packet is sent as soon as it is in
+    hmsc->bot_state = USBD_BOT_DATA_IN;
+    SCSI_StartMedia (pdev);
+    SCSI_WakeMedia();
     }
 
-  hmsc->bot_data_length = MSC_MEDIA_PACKET;
-  return SCSI_ProcessRead (pdev, lun);
+  return 0;
   }
 /*}}}*/
 /*{{{*/
-static int8_t SCSI_Write10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
+static int8_t SCSI_Read10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
+  return SCSI_Read (pdev, lun, (params[2] << 24) | (params[3] << 16) | (params[4] <<  8) | params[5],
+                    (params[7] <<  8) | params[8]);
+  }
+/*}}}*/
+/*{{{*/
+static int8_t SCSI_Read16 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
+
+  if (params[2] | params[3] | params[4] | params[5]) {
+    SCSI_SenseCode (pdev, lun, ILLEGAL_REQUEST, ADDRESS_OUT_OF_RANGE);
+    return -1;
+    }
+
+  return SCSI_Read (pdev, lun, (params[6] << 24) | (params[7] << 16) | (params[8] <<  8) | params[9],
+                    (params[10] << 24) | (params[11] << 16) | (params[12] <<  8) | params[13]);
+  }
+/*}}}*/
+/*{{{*/
+static int8_t SCSI_Write (USBD_HandleTypeDef* pdev, uint8_t lun, uint32_t blk_addr, uint32_t blk_len) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
@@ -502,33 +781,51 @@ static int8_t SCSI_Write10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* par
       return -1;
       }
 
-    hmsc->scsi_blk_addr = (params[2] << 24) | (params[3] << 16) | (params[4] <<  8) | params[5];
-    hmsc->scsi_blk_len = (params[7] <<  8) | params[8];
-
     /* check if LBA address is in the right range */
-    if (SCSI_CheckAddressRange (pdev, lun, hmsc->scsi_blk_addr, hmsc->scsi_blk_len) < 0)
+    if (SCSI_CheckAddressRange (pdev, lun, blk_addr, blk_len) < 0)
       return -1; /* error */
 
-    hmsc->scsi_blk_addr *= hmsc->scsi_blk_size;
-    hmsc->scsi_blk_len  *= hmsc->scsi_blk_size;
-
     /* cases 3,11,13 : Hn,Ho <> D0 */
-    if (hmsc->cbw.dDataLength != hmsc->scsi_blk_len) {
+    if (hmsc->cbw.dDataLength != (uint64_t)blk_len * hmsc->scsi_blk_size) {
       SCSI_SenseCode (pdev, hmsc->cbw.bLUN, ILLEGAL_REQUEST, INVALID_CDB);
       return -1;
       }
 
+    hmsc->scsi_blk_addr = blk_addr;
+    hmsc->scsi_blk_len = blk_len * hmsc->scsi_blk_size;
+    if (hmsc->scsi_blk_len == 0) {
+      hmsc->bot_data_length = 0;
+      return 0;
+      }
+
     /* Prepare EP to receive first data packet */
     hmsc->bot_state = USBD_BOT_DATA_OUT;
-    USBD_LL_PrepareReceive (pdev, MSC_EPOUT_ADDR, hmsc->bot_data, MIN (hmsc->scsi_blk_len, MSC_MEDIA_PACKET));
+    SCSI_StartMedia (pdev);
+    SCSI_ReceiveMedia (pdev);
     }
-  else /* Write Process ongoing */
-    return SCSI_ProcessWrite (pdev, lun);
 
   return 0;
   }
 /*}}}*/
 /*{{{*/
+static int8_t SCSI_Write10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
+  return SCSI_Write (pdev, lun, (params[2] << 24) | (params[3] << 16) | (params[4] <<  8) | params[5],
+                     (params[7] <<  8) | params[8]);
+  }
+/*}}}*/
+/*{{{*/
+static int8_t SCSI_Write16 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
+
+  if (params[2] | params[3] | params[4] | params[5]) {
+    SCSI_SenseCode (pdev, lun, ILLEGAL_REQUEST, ADDRESS_OUT_OF_RANGE);
+    return -1;
+    }
+
+  return SCSI_Write (pdev, lun, (params[6] << 24) | (params[7] << 16) | (params[8] <<  8) | params[9],
+                     (params[10] << 24) | (params[11] << 16) | (params[12] <<  8) | params[13]);
+  }
+/*}}}*/
+/*{{{*/
 static int8_t SCSI_Verify10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* params) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*) pdev->pClassData;
@@ -548,6 +845,12 @@ static int8_t SCSI_Verify10 (USBD_HandleTypeDef* pdev, uint8_t lun , uint8_t* pa
 /*{{{*/
 static int8_t SCSI_ProcessCmd (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* params) {
 
+  if (mscWriteFailed && (params[0] != SCSI_REQUEST_SENSE)) {
+    // deferred error, an acknowledged write failed on the card, its sense is already queued
+    mscWriteFailed = 0;
+    return -1;
+    }
+
   switch (params[0]) {
     case SCSI_TEST_UNIT_READY:
       return SCSI_TestUnitReady (pdev, lun, params);
@@ -576,12 +879,25 @@ static int8_t SCSI_ProcessCmd (USBD_HandleTypeDef* pdev, uint8_t lun, uint8_t* p
     case SCSI_READ_CAPACITY10:
       return SCSI_ReadCapacity10 (pdev, lun, params);
 
+    case SCSI_READ_CAPACITY16:
+      return SCSI_ReadCapacity16 (pdev, lun, params);
+
     case SCSI_READ10:
       return SCSI_Read10 (pdev, lun, params);
 
+    case SCSI_READ16:
+      return SCSI_Read16 (pdev, lun, params);
+
     case SCSI_WRITE10:
       return SCSI_Write10 (pdev, lun, params);
 
+    case SCSI_WRITE16:
+      return SCSI_Write16 (pdev, lun, params);
+
+    case SCSI_SYNCHRONIZE_CACHE10:
+    case SCSI_SYNCHRONIZE_CACHE16:
+      return SCSI_SynchronizeCache (pdev, lun, params);
+
     case SCSI_VERIFY10:
       return SCSI_Verify10 (pdev, lun, params);
 
@@ -645,7 +961,8 @@ static void BOT_CBW_Decode (USBD_HandleTypeDef* pdev) {
     /*Burst xfer handled internally*/
     else if ((hmsc->bot_state != USBD_BOT_DATA_IN) &&
              (hmsc->bot_state != USBD_BOT_DATA_OUT) &&
-             (hmsc->bot_state != USBD_BOT_LAST_DATA_IN)) {
+             (hmsc->bot_state != USBD_BOT_LAST_DATA_IN) &&
+             (hmsc->bot_state != USBD_BOT_FLUSH)) {
       if (hmsc->bot_data_length > 0)
         BOT_SendData (pdev, hmsc->bot_data, hmsc->bot_data_length);
       else if (hmsc->bot_data_length == 0)
@@ -679,8 +996,33 @@ void BOT_DataOut (USBD_HandleTypeDef* pdev, uint8_t epnum) {
       break;
 
     case USBD_BOT_DATA_OUT:
-      if (SCSI_ProcessCmd (pdev, hmsc->cbw.bLUN, &hmsc->cbw.CB[0]) < 0)
-        BOT_SendCSW (pdev, USBD_CSW_CMD_FAILED);
+      // packet is in, queue it for the msc task
+      if (mscMerging >= 0) {
+        mscLen[mscMerging] += mscRecv;
+        mscState[mscMerging] = MSC_MEDIA_QUEUED;
+        mscMerging = -1;
+        mscMerges++;
+        }
+      else {
+        mscLen[mscUsb] = mscRecv;
+        mscState[mscUsb] = MSC_MEDIA_QUEUED;
+        mscQueued++;
+        mscUsb = MSC_MEDIA_NEXT (mscUsb);
+        }
+
+      /* case 12 : Ho = Do */
+      hmsc->csw.dDataResidue -= mscRecv;
+      mscRecv = 0;
+
+      if (mscUsbLeft == 0) {
+        // all queued, acknowledged now, the card catches up behind the next commands
+        SCSI_EndMedia (hmsc->cbw.dDataLength, &mscWriteBytes, &mscWriteUs);
+        BOT_SendCSW (pdev, USBD_CSW_CMD_PASSED);
+        }
+      else
+        SCSI_ReceiveMedia (pdev);
+
+      SCSI_WakeMedia();
       break;
 
     default:
@@ -689,6 +1031,38 @@ void BOT_DataOut (USBD_HandleTypeDef* pdev, uint8_t epnum) {
   }
 /*}}}*/
 
+/*{{{*/
+static int mscReport (const char* dir, uint32_t* bytes, uint32_t* us) {
+// sustained rate over the last MSC_STATS_BYTES, MB = 1000000 bytes
+
+  if ((*bytes >= MSC_STATS_BYTES) && *us) {
+    uint32_t rate = (*bytes * 100) / *us;
+    logPrint (LOG_INFO, "msc %s %lu.%02lu MB/s\n", dir, rate / 100, rate % 100);
+    *bytes = 0;
+    *us = 0;
+    return 1;
+    }
+
+  return 0;
+  }
+/*}}}*/
+/*{{{*/
+static void mscThread (void* arg) {
+// sd side of the media pipeline, usb side runs in the otg isr
+
+  USBD_HandleTypeDef* pdev = (USBD_HandleTypeDef*)arg;
+
+  while (1) {
+    ulTaskNotifyTake (pdTRUE, portMAX_DELAY);
+    while (SCSI_ProcessRead (pdev) || SCSI_ProcessWrite (pdev)) {}
+
+    mscReport ("read", &mscReadBytes, &mscReadUs);
+    if (mscReport ("write", &mscWriteBytes, &mscWriteUs))
+      logPrint (LOG_INFO, "msc write merges %lu\n", mscMerges);
+    }
+  }
+/*}}}*/
+
 /*{{{  msc desc*/
 /*{{{*/
 __ALIGN_BEGIN static const uint8_t USBD_MSC_CfgHSDesc[USB_MSC_CONFIG_DESC_SIZ] __ALIGN_END = {
@@ -818,16 +1192,16 @@ __ALIGN_BEGIN static const uint8_t USBD_MSC_OtherSpeedCfgDesc[USB_MSC_CONFIG_DES
   0x05, /*Endpoint descriptor type */
   MSC_EPIN_ADDR, /*Endpoint address (IN, address 1) */
   0x02, /*Bulk endpoint type */
-  0x40,
-  0x00,
+  LOBYTE(MSC_MAX_FS_PACKET),
+  HIBYTE(MSC_MAX_FS_PACKET),
   0x00, /*Polling interval in milliseconds */
 
   0x07, /*Endpoint descriptor length = 7 */
   0x05, /*Endpoint descriptor type */
   MSC_EPOUT_ADDR, /*Endpoint address (OUT, address 1) */
   0x02, /*Bulk endpoint type */
-  0x40,
-  0x00,
+  LOBYTE(MSC_MAX_FS_PACKET),
+  HIBYTE(MSC_MAX_FS_PACKET),
   0x00  /*Polling interval in milliseconds*/
   };
 /*}}}*/
@@ -872,8 +1246,8 @@ static uint8_t USBD_MSC_Init (USBD_HandleTypeDef* pdev, uint8_t cfgidx) {
     USBD_LL_OpenEP (pdev, MSC_EPIN_ADDR, USBD_EP_TYPE_BULK, MSC_MAX_FS_PACKET);
     }
 
-  pdev->pClassData = malloc (sizeof (USBD_MSC_BOT_HandleTypeDef));
-  //pdev->pClassData = (void*)USB_BUFFER;
+  // allocated once by USBD_MSC_RegisterStorage, isr here, every SET_CONFIGURATION reuses it
+  pdev->pClassData = mscHandle;
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
 
@@ -900,6 +1274,7 @@ static uint8_t USBD_MSC_DeInit (USBD_HandleTypeDef* pdev, uint8_t cfgidx) {
 
   USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
   hmsc->bot_state = USBD_BOT_IDLE;
+  SCSI_AbortMedia();
 
   return 0;
   }
@@ -930,6 +1305,7 @@ static uint8_t USBD_MSC_Setup (USBD_HandleTypeDef* pdev, USBD_SetupReqTypedef *r
              USBD_MSC_BOT_HandleTypeDef* hmsc = (USBD_MSC_BOT_HandleTypeDef*)pdev->pClassData;
              hmsc->bot_state = USBD_BOT_IDLE;
              hmsc->bot_status = USBD_BOT_STATUS_RECOVERY;
+             SCSI_AbortMedia();
              USBD_LL_PrepareReceive (pdev, MSC_EPOUT_ADDR, (uint8_t*)&hmsc->cbw, USBD_BOT_CBW_LENGTH);
              }
           else {
@@ -997,12 +1373,22 @@ static uint8_t USBD_MSC_DataIn (USBD_HandleTypeDef* pdev, uint8_t epnum) {
 
   switch (hmsc->bot_state) {
     case USBD_BOT_DATA_IN:
-      if (SCSI_ProcessCmd (pdev, hmsc->cbw.bLUN, &hmsc->cbw.CB[0]) < 0)
-        BOT_SendCSW (pdev, USBD_CSW_CMD_FAILED);
+      // usb side's buffer is sent, back to the msc task to refill, send the next if it is ready
+      mscState[mscUsb] = MSC_MEDIA_EMPTY;
+      mscUsb = MSC_MEDIA_NEXT (mscUsb);
+      SCSI_SendMedia (pdev);
+      SCSI_WakeMedia();
       break;
 
-    case USBD_BOT_SEND_DATA:
     case USBD_BOT_LAST_DATA_IN:
+      mscState[mscUsb] = MSC_MEDIA_EMPTY;
+      mscUsb = MSC_MEDIA_NEXT (mscUsb);
+      SCSI_EndMedia (hmsc->cbw.dDataLength, &mscReadBytes, &mscReadUs);
+      BOT_SendCSW (pdev, USBD_CSW_CMD_PASSED);
+      SCSI_WakeMedia();
+      break;
+
+    case USBD_BOT_SEND_DATA:
       BOT_SendCSW (pdev, USBD_CSW_CMD_PASSED);
       break;
 
@@ -1022,7 +1408,14 @@ static uint8_t USBD_MSC_DataOut (USBD_HandleTypeDef* pdev, uint8_t epnum) {
 
 /*{{{*/
 void USBD_MSC_RegisterStorage (USBD_HandleTypeDef* pdev, USBD_StorageTypeDef* fops) {
+// task context, before USBD_Start, class handle, media buffers and msc task
+
   pdev->pUserData = fops;
+
+  mscHandle = (USBD_MSC_BOT_HandleTypeDef*)dmaAlloc (sizeof (USBD_MSC_BOT_HandleTypeDef));
+  for (int i = 0; i < MSC_MEDIA_BUFFERS; i++)
+    mscMedia[i] = (uint8_t*)dmaAlloc (MSC_MEDIA_PACKET);
+  staticTaskCreate ((TaskFunction_t)mscThread, "msc", 512, pdev, 4, &mscTask);
   }
 /*}}}*/
 /*{{{*/
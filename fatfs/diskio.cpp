@@ -8,6 +8,8 @@
 #include "diskio.h"
 
 #include "cSd.h"
+#include "sdIo.h"
+#include "trace.h"
 
 #include "utils.h"
 #include "cLcd.h"
@@ -70,6 +72,9 @@ DRESULT diskIoctl (BYTE cmd, void* buff) {
 //{{{
 DRESULT diskRead (BYTE* buffer, DWORD sector, UINT count) {
 
+  DRESULT result;
+  traceSpanBegin (TRACE_SPAN_DISK_READ);
+
   if ((uint32_t)buffer & 0x03) {
     cLcd::debug ("diskRead align b:" + hex ((int)buffer) + " sec:" + dec (sector) + " num:" + dec (count));
 
@@ -77,20 +82,22 @@ DRESULT diskRead (BYTE* buffer, DWORD sector, UINT count) {
     auto tempBuffer = (uint8_t*)pvPortMalloc (count * SECTOR_SIZE);
 
     // read into 32bit aligned tempBuffer
-    auto result = SD_ReadCached (tempBuffer, sector, count) == MSD_OK ? RES_OK : RES_ERROR;
+    result = sdIoRead (tempBuffer, sector, count) == MSD_OK ? RES_OK : RES_ERROR;
     memcpy (buffer, tempBuffer, count * SECTOR_SIZE);
 
     vPortFree (tempBuffer);
-    return result;
     }
 
   else
     //cLcd::debug ("diskRead - sec:" + cLcd::dec (sector) + " num:" + cLcd::dec (count));
-    return SD_ReadCached ((uint8_t*)buffer, sector, count) == MSD_OK ? RES_OK : RES_ERROR;
+    result = sdIoRead ((uint8_t*)buffer, sector, count) == MSD_OK ? RES_OK : RES_ERROR;
+
+  traceSpanEnd (TRACE_SPAN_DISK_READ);
+  return result;
   }
 //}}}
 //{{{
 DRESULT diskWrite (const BYTE* buffer, DWORD sector, UINT count) {
-  return SD_WriteCached ((uint8_t*)buffer, (uint64_t)(sector * SECTOR_SIZE), count) == MSD_OK ? RES_OK : RES_ERROR;
+  return sdIoWrite ((uint8_t*)buffer, sector, count) == MSD_OK ? RES_OK : RES_ERROR;
   }
 //}}}
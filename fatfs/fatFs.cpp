@@ -16,6 +16,7 @@
 #include "utils.h"
 #include "fatFs.h"
 #include "diskio.h"
+#include "sdIo.h"
 
 #include "cLcd.h"
 //}}}
@@ -2824,6 +2825,21 @@ cFile::~cFile() {
 //{{{
 FRESULT cFile::read (void* readBuffer, int bytesToRead, int& bytesRead) {
 
+  if ((bytesToRead > SD_IO_SPLIT_BYTES) && sdIoBackground()) {
+    //{{{  background read, a piece per fatFs lock, so playback reads queued on the lock get in between
+    bytesRead = 0;
+    while (bytesToRead) {
+      int pieceRead;
+      auto result = read ((BYTE*)readBuffer + bytesRead, bytesToRead > SD_IO_SPLIT_BYTES ? SD_IO_SPLIT_BYTES : bytesToRead, pieceRead);
+      bytesRead += pieceRead;
+      bytesToRead -= pieceRead;
+      if ((result != FR_OK) || !pieceRead)
+        return result;
+      }
+    return FR_OK;
+    }
+    //}}}
+
   bytesRead = 0;
   if (!mFatFs->lock()) {
     //{{{  error
@@ -65,6 +65,19 @@ static void fs_free (struct fs_file* file) {
 }
 //}}}
 //{{{
+u32_t fs_hash (const char* name, u32_t seed) {
+// fnv-1a, folded so the low bits used to index the tables are well mixed
+
+  u32_t hash = seed;
+  while (*name) {
+    hash ^= (u8_t)*name++;
+    hash *= 16777619;
+    }
+
+  return hash ^ (hash >> 16);
+  }
+//}}}
+//{{{
 struct fs_file * fs_open (const char* name) {
 
   struct fs_file *file;
@@ -83,22 +96,23 @@ struct fs_file * fs_open (const char* name) {
   file->is_custom_file = 0;
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
 
-  for(f = FS_ROOT; f != NULL; f = f->next) {
-    if (!strcmp(name, (char *)f->name)) {
-      file->data = (const char *)f->data;
-      file->len = f->len;
-      file->index = f->len;
-      file->pextension = NULL;
-      file->http_header_included = f->http_header_included;
+  // one probe of the perfect hash table, then confirm the name
+  f = fs_hash_table[fs_hash (name, FS_HASH_SEED) & (FS_HASH_SIZE - 1)];
+  if ((f != NULL) && !strcmp(name, (char *)f->name)) {
+    file->data = (const char *)f->data;
+    file->len = f->len;
+    file->index = f->len;
+    file->pextension = NULL;
+    file->http_header_included = f->http_header_included;
+    file->http_header_len = f->http_header_len;
 #if HTTPD_PRECALCULATED_CHECKSUM
-      file->chksum_count = f->chksum_count;
-      file->chksum = f->chksum;
+    file->chksum_count = f->chksum_count;
+    file->chksum = f->chksum;
 #endif /* HTTPD_PRECALCULATED_CHECKSUM */
 #if LWIP_HTTPD_FILE_STATE
-      file->state = fs_state_init(file, name);
+    file->state = fs_state_init(file, name);
 #endif /* #if LWIP_HTTPD_FILE_STATE */
-      return file;
-    }
+    return file;
   }
   fs_free(file);
   return NULL;
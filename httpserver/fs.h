@@ -45,6 +45,7 @@ struct fs_file {
   u16_t chksum_count;
 #endif /* HTTPD_PRECALCULATED_CHECKSUM */
   u8_t http_header_included;
+  u16_t http_header_len;
 #if LWIP_HTTPD_CUSTOM_FILES
   u8_t is_custom_file;
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
@@ -53,6 +54,7 @@ struct fs_file {
 #endif /* LWIP_HTTPD_FILE_STATE */
   };
 
+u32_t fs_hash(const char *name, u32_t seed);
 struct fs_file *fs_open(const char *name);
 void fs_close(struct fs_file *file);
 int fs_read(struct fs_file *file, char *buffer, int count);
@@ -2,12 +2,13 @@
 #include "fs.h"
 #include "lwip/def.h"
 #include "fsdata.h"
+#include "memory.h"
 
 #define file_NULL (struct fsdata_file*) NULL
 
 static const unsigned int dummy_align__STM32F7xx_files_logo_jpg = 0;
 //{{{
-static const unsigned char data__STM32F7xx_files_logo_jpg[] = {
+static const unsigned char data__STM32F7xx_files_logo_jpg[] QSPI_CONST = {
 /* /STM32F7xx_files/logo.jpg (26 chars) */
 0x2f,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x5f,0x66,0x69,0x6c,0x65,0x73,
 0x2f,0x6c,0x6f,0x67,0x6f,0x2e,0x6a,0x70,0x67,0x00,0x00,0x00,
@@ -193,7 +194,7 @@ static const unsigned char data__STM32F7xx_files_logo_jpg[] = {
 
 static const unsigned int dummy_align__STM32F7xx_files_ST_gif = 1;
 //{{{
-static const unsigned char data__STM32F7xx_files_ST_gif[] = {
+static const unsigned char data__STM32F7xx_files_ST_gif[] QSPI_CONST = {
 /* /STM32F7xx_files/ST.gif (24 chars) */
 0x2f,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x5f,0x66,0x69,0x6c,0x65,0x73,
 0x2f,0x53,0x54,0x2e,0x67,0x69,0x66,0x00,
@@ -523,7 +524,7 @@ static const unsigned char data__STM32F7xx_files_ST_gif[] = {
 
 static const unsigned int dummy_align__STM32F7xx_files_stm32_jpg = 2;
 //{{{
-static const unsigned char data__STM32F7xx_files_stm32_jpg[] = {
+static const unsigned char data__STM32F7xx_files_stm32_jpg[] QSPI_CONST = {
 /* /STM32F7xx_files/stm32.jpg (27 chars) */
 0x2f,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x5f,0x66,0x69,0x6c,0x65,0x73,
 0x2f,0x73,0x74,0x6d,0x33,0x32,0x2e,0x6a,0x70,0x67,0x00,0x00,
@@ -1636,7 +1637,7 @@ static const unsigned char data__STM32F7xx_files_stm32_jpg[] = {
 
 static const unsigned int dummy_align__404_html = 3;
 //{{{
-static const unsigned char data__404_html[] = {
+static const unsigned char data__404_html[] QSPI_CONST = {
 /* /404.html (10 chars) */
 0x2f,0x34,0x30,0x34,0x2e,0x68,0x74,0x6d,0x6c,0x00,0x00,0x00,
 
@@ -1732,7 +1733,7 @@ static const unsigned char data__404_html[] = {
 
 static const unsigned int dummy_align__STM32F7xx_html = 4;
 //{{{
-static const unsigned char data__STM32F7xx_html[] = {
+static const unsigned char data__STM32F7xx_html[] QSPI_CONST = {
 /* /STM32F7xx.html (16 chars) */
 0x2f,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x2e,0x68,0x74,0x6d,0x6c,0x00,
 
@@ -2346,6 +2347,7 @@ const struct fsdata_file file__STM32F7xx_files_logo_jpg[] = { {
   data__STM32F7xx_files_logo_jpg + 28,
   sizeof(data__STM32F7xx_files_logo_jpg) - 28,
   1,
+  108,
   }};
 //}}}
 //{{{
@@ -2355,6 +2357,7 @@ const struct fsdata_file file__STM32F7xx_files_ST_gif[] = { {
   data__STM32F7xx_files_ST_gif + 24,
   sizeof(data__STM32F7xx_files_ST_gif) - 24,
   1,
+  107,
   }};
 //}}}
 //{{{
@@ -2364,6 +2367,7 @@ const struct fsdata_file file__STM32F7xx_files_stm32_jpg[] = { {
   data__STM32F7xx_files_stm32_jpg + 28,
   sizeof(data__STM32F7xx_files_stm32_jpg) - 28,
   1,
+  108,
   }};
 //}}}
 //{{{
@@ -2373,6 +2377,7 @@ const struct fsdata_file file__404_html[] = { {
   data__404_html + 12,
   sizeof(data__404_html) - 12,
   1,
+  119,
   }};
 //}}}
 //{{{
@@ -2382,8 +2387,25 @@ const struct fsdata_file file__STM32F7xx_html[] = { {
   data__STM32F7xx_html + 16,
   sizeof(data__STM32F7xx_html) - 16,
   1,
+  107,
   }};
 //}}}
 
 #define FS_ROOT file__STM32F7xx_html
 #define FS_NUMFILES 5
+
+// perfect hash of file names, generated by makefshash.py
+#define FS_HASH_SEED 0x811c9dca
+#define FS_HASH_SIZE 8
+//{{{
+static const struct fsdata_file* const fs_hash_table[FS_HASH_SIZE] = {
+  file__STM32F7xx_files_logo_jpg,
+  file__STM32F7xx_html,
+  file__STM32F7xx_files_stm32_jpg,
+  file__404_html,
+  file_NULL,
+  file__STM32F7xx_files_ST_gif,
+  file_NULL,
+  file_NULL,
+  };
+//}}}
@@ -10,6 +10,7 @@ struct fsdata_file {
   const unsigned char *data;
   int len;
   u8_t http_header_included;
+  u16_t http_header_len;
 #if HTTPD_PRECALCULATED_CHECKSUM
   u16_t chksum_count;
   const struct fsdata_chksum *chksum;
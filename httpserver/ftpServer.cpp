@@ -7,12 +7,19 @@
 #include "lwip/opt.h"
 #include "lwip/arch.h"
 #include "lwip/api.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
 
 #include "ftpServer.h"
-#include "cmsis_os.h"
+#include "sdIo.h"
+#include "dmaBuf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "staticTasks.h"
 
 #include "utils.h"
-#include "cLcd.h"
 
 #ifdef STM32F746G_DISCO
   #include "stm32746g_discovery.h"
@@ -44,7 +51,20 @@
 #define FTP_BUF_SIZE             512
 #define SERVER_THREAD_STACK_SIZE 256
 #define FTP_THREAD_STACK_SIZE    (1600 + FTP_BUF_SIZE + (5 * 256))
-#define FTP_THREAD_PRIORITY      (LOWPRIO + 2)
+
+// data channel, file task reads or writes ring buffers while the session thread sends or receives them
+#define FTP_DATA_BUFS            4
+#define FTP_DATA_BUF_SIZE        0x2000        // 8k, 16 sectors per file read or write
+#define FTP_DATA_HOLD            2             // sent buffers held until later writes prove them acked
+#define FTP_DATA_STACK_SIZE      1024
+#define FTP_DATA_PRIORITY        4
+
+#if FTP_DATA_HOLD * FTP_DATA_BUF_SIZE < TCP_SND_BUF
+  #error "NETCONN_NOCOPY buffers could be reused before acked, raise FTP_DATA_HOLD"
+#endif
+#if FTP_DATA_BUFS < FTP_DATA_HOLD + 2
+  #error "FTP_DATA_BUFS too small to overlap file and tcp"
+#endif
 //}}}
 
 class cFtpServer {
@@ -61,6 +81,8 @@ public:
     dataPort = FTP_DATA_PORT + num;
     cmdStatus = 0;
     dataConnMode = NOTSET;
+    mSessionBytes = 0;
+    mSessionTicks = 0;
 
     //  Get the local and peer IP
     uint16_t dummy;
@@ -96,6 +118,35 @@ public:
       netconn_close (listdataconn);
       netconn_delete (listdataconn);
       }
+
+    if (mSessionTicks)
+      debug ("ftp session " + dec (mSessionBytes) + " bytes " +
+                   dec (mSessionTicks) + "ms " + dec (rate (mSessionBytes, mSessionTicks)) + " bytes/s");
+    }
+  //}}}
+  //{{{
+  bool dataInit() {
+  // pool the data buffers once and start the file task, before any session
+
+    // sd dma targets, whole cache lines
+    for (auto i = 0; i < FTP_DATA_BUFS; i++) {
+      mDataBuf[i] = (uint8_t*)dmaAlloc (FTP_DATA_BUF_SIZE);
+      if (!mDataBuf[i])
+        return false;
+      }
+
+    mDataEmpty = xQueueCreate (FTP_DATA_BUFS, sizeof(uint8_t));
+    mDataFull = xQueueCreate (FTP_DATA_BUFS, sizeof(uint8_t));
+    vSemaphoreCreateBinary (mDataStartSem);
+    xSemaphoreTake (mDataStartSem, 0);
+    vSemaphoreCreateBinary (mDataDoneSem);
+    xSemaphoreTake (mDataDoneSem, 0);
+    vSemaphoreCreateBinary (mDataSndBufSem);
+    xSemaphoreTake (mDataSndBufSem, 0);
+
+    TaskHandle_t handle;
+    return staticTaskCreate ((TaskFunction_t)dataFileThread, "ftpData", FTP_DATA_STACK_SIZE, this,
+                             FTP_DATA_PRIORITY, &handle) == pdPASS;
     }
   //}}}
   cFatFs* mFatFs = nullptr;
@@ -280,7 +331,7 @@ private:
 
     deletebuf:
 
-    cLcd::debug ("rxcmd " + dec (num) + " " + command + " " + parameters);
+    debug ("rxcmd " + dec (num) + " " + command + " " + parameters);
 
     netbuf_delete (inbuf);
     return rc;
@@ -423,12 +474,23 @@ private:
     }
   //}}}
   //{{{
+  uint32_t rate (uint32_t bytes, uint32_t ms) {
+    return ms ? (uint32_t)(((uint64_t)bytes * 1000) / ms) : 0;
+    }
+  //}}}
+  //{{{
   void closeTransfer() {
 
+    uint32_t ms = (xTaskGetTickCount() - transferStart) * portTICK_PERIOD_MS;
+    mSessionBytes += bytesTransfered;
+    mSessionTicks += ms ? ms : 1;
+
     if (bytesTransfered > 0) {
       sendBegin ("226-File successfully transferred\r\n");
       sendCat ("226 ");
-      sendCat (" xxx ms, ");
+      sendCat (i2str (ms));
+      sendCat (" ms, ");
+      sendCat (i2str (rate (bytesTransfered, ms)));
       sendCatWrite (" bytes/s");
       }
     else
@@ -436,6 +498,179 @@ private:
     }
   //}}}
 
+  //{{{
+  static void dataFileThread (void const* argument) {
+  // file side of the data channel, a zero length buffer ends the transfer in either direction
+
+    auto ftpServer = (cFtpServer*)argument;
+    sdIoSetClass (eSdIoBulk);
+
+    while (true) {
+      xSemaphoreTake (ftpServer->mDataStartSem, portMAX_DELAY);
+      if (ftpServer->mDataRead)
+        ftpServer->dataFileRead();
+      else
+        ftpServer->dataFileWrite();
+      xSemaphoreGive (ftpServer->mDataDoneSem);
+      }
+    }
+  //}}}
+  //{{{
+  void dataFileRead() {
+  // RETR, read file into empty buffers, session sends them
+
+    uint8_t i;
+    int nb;
+    do {
+      xQueueReceive (mDataEmpty, &i, portMAX_DELAY);
+      nb = 0;
+      if (!mDataAbort) {
+        mDataFileErr = mDataFile->read (mDataBuf[i], FTP_DATA_BUF_SIZE, nb);
+        if (mDataFileErr != FR_OK)
+          nb = 0;
+        }
+      mDataLen[i] = nb;
+      xQueueSend (mDataFull, &i, portMAX_DELAY);
+      } while (nb);
+    }
+  //}}}
+  //{{{
+  void dataFileWrite() {
+  // STOR, write buffers the session received, keep draining after an error so the session never blocks
+
+    uint8_t i;
+    uint32_t len;
+    do {
+      xQueueReceive (mDataFull, &i, portMAX_DELAY);
+      len = mDataLen[i];
+      if (len && (mDataFileErr == FR_OK)) {
+        UINT nb;
+        mDataFileErr = mDataFile->write (mDataBuf[i], len, nb);
+        if ((mDataFileErr == FR_OK) && (nb != len))
+          mDataFileErr = FR_DENIED;
+        }
+      xQueueSend (mDataEmpty, &i, portMAX_DELAY);
+      } while (len);
+    }
+  //}}}
+  //{{{
+  void dataStart (cFile* file, bool read) {
+
+    mDataFile = file;
+    mDataRead = read;
+    mDataAbort = false;
+    mDataFileErr = FR_OK;
+
+    xQueueReset (mDataFull);
+    xQueueReset (mDataEmpty);
+    for (uint8_t i = 0; i < FTP_DATA_BUFS; i++)
+      xQueueSend (mDataEmpty, &i, 0);
+
+    transferStart = xTaskGetTickCount();
+    bytesTransfered = 0;
+    xSemaphoreGive (mDataStartSem);
+    }
+  //}}}
+  //{{{
+  void dataSendFile() {
+  // RETR, NETCONN_NOCOPY writes straight from the buffers the file task filled,
+  // each buffer is held until FTP_DATA_HOLD later writes have been queued, by then it is acked
+
+    uint8_t held[FTP_DATA_HOLD + 1];
+    int numHeld = 0;
+    nerr = ERR_OK;
+
+    while (true) {
+      uint8_t i;
+      xQueueReceive (mDataFull, &i, portMAX_DELAY);
+      if (!mDataLen[i]) {
+        xQueueSend (mDataEmpty, &i, 0);
+        break;
+        }
+
+      if (nerr == ERR_OK) {
+        nerr = netconn_write (dataconn, mDataBuf[i], mDataLen[i], NETCONN_NOCOPY);
+        if (nerr == ERR_OK)
+          bytesTransfered += mDataLen[i];
+        else
+          mDataAbort = true;
+        }
+
+      held[numHeld++] = i;
+      if (numHeld > FTP_DATA_HOLD) {
+        xQueueSend (mDataEmpty, &held[0], 0);
+        memmove (held, held + 1, --numHeld);
+        }
+      }
+
+    // file task done, wait for the tail to be acked before the buffers can be reused,
+    // the pcb belongs to the tcpip thread, ask it for the send buffer
+    xSemaphoreTake (mDataDoneSem, portMAX_DELAY);
+    for (int wait = 0; (nerr == ERR_OK) && (wait < 5000); wait++) {
+      if (tcpip_callback (dataSndBufCallback, this) != ERR_OK)
+        break;
+      xSemaphoreTake (mDataSndBufSem, portMAX_DELAY);
+      if (mDataSndBuf == TCP_SND_BUF)
+        break;
+      vTaskDelay (1);
+      }
+    }
+  //}}}
+  //{{{
+  static void dataSndBufCallback (void* arg) {
+  // tcpip thread, free send buffer of the data connection, all of it once everything is acked or the pcb is gone
+
+    auto ftpServer = (cFtpServer*)arg;
+    struct tcp_pcb* pcb = ftpServer->dataconn->pcb.tcp;
+    ftpServer->mDataSndBuf = pcb ? tcp_sndbuf (pcb) : TCP_SND_BUF;
+    xSemaphoreGive (ftpServer->mDataSndBufSem);
+    }
+  //}}}
+  //{{{
+  void dataReceiveFile() {
+  // STOR, copy received pbufs into the ring and free them at once to keep the tcp window open,
+  // the file task writes full buffers while more arrives
+
+    uint8_t i;
+    uint32_t off = 0;
+    xQueueReceive (mDataEmpty, &i, portMAX_DELAY);
+
+    struct pbuf* rcvbuf;
+    while ((nerr = netconn_recv_tcp_pbuf (dataconn, &rcvbuf)) == ERR_OK) {
+      for (struct pbuf* q = rcvbuf; q; q = q->next) {
+        auto payload = (uint8_t*)q->payload;
+        uint32_t len = q->len;
+        while (len) {
+          uint32_t copyLen = len < FTP_DATA_BUF_SIZE - off ? len : FTP_DATA_BUF_SIZE - off;
+          memcpy (mDataBuf[i] + off, payload, copyLen);
+          payload += copyLen;
+          len -= copyLen;
+          off += copyLen;
+          if (off == FTP_DATA_BUF_SIZE) {
+            mDataLen[i] = off;
+            xQueueSend (mDataFull, &i, portMAX_DELAY);
+            xQueueReceive (mDataEmpty, &i, portMAX_DELAY);
+            off = 0;
+            }
+          }
+        }
+      bytesTransfered += rcvbuf->tot_len;
+      pbuf_free (rcvbuf);
+      }
+
+    // flush partial buffer, then end marker
+    if (off) {
+      mDataLen[i] = off;
+      xQueueSend (mDataFull, &i, portMAX_DELAY);
+      xQueueReceive (mDataEmpty, &i, portMAX_DELAY);
+      }
+    mDataLen[i] = 0;
+    xQueueSend (mDataFull, &i, portMAX_DELAY);
+
+    xSemaphoreTake (mDataDoneSem, portMAX_DELAY);
+    }
+  //}}}
+
   //{{{
   bool fsExists (char* path) {
   // Return true if a file or directory exists
@@ -782,24 +1017,25 @@ private:
             sendCatWrite( parameters );
             }
           else if (dataConnect()) {
-            int nb;
-
             //DEBUG_PRINT( "Sending %s\r\n", parameters );
             sendBegin ("150-Connected to port ");
             sendCat (i2str( dataPort));
             sendCat ("\r\n150 ");
             sendCat (i2str (file.getSize()));
             sendCatWrite (" bytes to download");
-            bytesTransfered = 0;
 
-            //DEBUG_PRINT( "Start transfert\r\n");
-            while (file.read (buf, FTP_BUF_SIZE, nb) == FR_OK && nb > 0 ) {
-              netconn_write( dataconn, buf, nb, NETCONN_COPY );
-              bytesTransfered += nb;
-              //DEBUG_PRINT( "Sent %u bytes\r", bytesTransfered );
+            dataStart (&file, true);
+            dataSendFile();
+            if (nerr != ERR_OK) {
+              sendBegin ("426 Connection closed; transfer aborted ");
+              sendCatWrite (i2str (abs (nerr)));
               }
-            //DEBUG_PRINT( "\n");
-            closeTransfer();
+            else if (mDataFileErr != FR_OK) {
+              sendBegin ("451 Requested action aborted: file error ");
+              sendCatWrite (i2str (abs (mDataFileErr)));
+              }
+            else
+              closeTransfer();
             dataClose();
           }
         }
@@ -954,54 +1190,23 @@ private:
           sendCatWrite( parameters );
           }
         else if (dataConnect()) {
-          struct pbuf* rcvbuf = NULL;
-          void* prcvbuf;
-          uint16_t buflen = 0;
-          uint16_t off = 0;
-          uint16_t copylen;
-          int8_t  ferr = 0;
-          UINT nb;
-
           sendBegin ("150 Connected to port ");
           sendCatWrite (i2str (dataPort));
-          bytesTransfered = 0;
-          do {
-            nerr = netconn_recv_tcp_pbuf (dataconn, &rcvbuf);
-            if (nerr != ERR_OK)
-              break;
-            prcvbuf = rcvbuf->payload;
-            buflen = rcvbuf->tot_len;
-            while (buflen > 0) {
-              if (buflen <= FTP_BUF_SIZE - off)
-                copylen = buflen;
-              else
-                copylen = FTP_BUF_SIZE - off;
-              buflen -= copylen;
-              memcpy (buf + off, prcvbuf, copylen);
-              prcvbuf += copylen;
-              off += copylen;
-              if (off == FTP_BUF_SIZE) {
-                if (ferr == 0 )
-                  ferr = file.write (buf, FTP_BUF_SIZE, nb);
-                off = 0;
-                }
-              bytesTransfered += copylen;
-              }
-            } while (true); // ferr == 0 );
 
-          if (off > 0 && ferr == 0)
-            ferr = file.write (buf, off, nb);
+          dataStart (&file, false);
+          dataReceiveFile();
 
+          dataClose();
           if (nerr != ERR_CLSD) {
             sendBegin ("451 Requested action aborted: communication error ");
             sendCatWrite (i2str (abs(nerr)));
             }
-          if (ferr != 0) {
+          else if (mDataFileErr != FR_OK) {
             sendBegin ("451 Requested action aborted: file error ");
-            sendCatWrite (i2str (abs (ferr)));
+            sendCatWrite (i2str (abs (mDataFileErr)));
             }
-          dataClose();
-          closeTransfer();
+          else
+            closeTransfer();
           }
         }
       }
@@ -1075,6 +1280,9 @@ private:
   char str [25];
 
   uint32_t bytesTransfered;
+  TickType_t transferStart;
+  uint32_t mSessionBytes = 0;
+  uint32_t mSessionTicks = 0;         // ms spent transferring, rate excludes idle time between commands
   int8_t nerr;
   uint8_t num;
   char buf [FTP_BUF_SIZE];           // data buffer for communication
@@ -1082,31 +1290,51 @@ private:
 
   enum dcm_type { NOTSET  = 0, PASSIVE = 1, ACTIVE  = 2, };
   dcm_type dataConnMode;
+
+  // data channel ring
+  uint8_t* mDataBuf[FTP_DATA_BUFS];
+  volatile uint32_t mDataLen[FTP_DATA_BUFS];
+  QueueHandle_t mDataEmpty;
+  QueueHandle_t mDataFull;
+  SemaphoreHandle_t mDataStartSem;
+  SemaphoreHandle_t mDataDoneSem;
+  SemaphoreHandle_t mDataSndBufSem;
+  volatile uint32_t mDataSndBuf;
+  cFile* mDataFile;
+  bool mDataRead;
+  volatile bool mDataAbort;
+  volatile FRESULT mDataFileErr;
   //}}}
   };
 
 //{{{
 void ftpServerThread (void const* argument) {
 
-  cLcd::debug ("ftpServerThread");
+  debug ("ftpServerThread");
 
   SD_Init();
   if (SD_present())
-    cLcd::debug ("ftpServer SD CARD");
+    debug ("ftpServer SD CARD");
 
   cFtpServer ftpServer;
 
   ftpServer.mFatFs = cFatFs::create();
   if (ftpServer.mFatFs->mount() != FR_OK) {
     // fatfs mount error, return
-    cLcd::debug ("fatFs mount problem");
-    osThreadTerminate (NULL);
+    debug ("fatFs mount problem");
+    vTaskDelete (NULL);
     return;
     }
-  cLcd::debug (ftpServer.mFatFs->getLabel() +
+  debug (ftpServer.mFatFs->getLabel() +
                " vsn:" + hex (ftpServer.mFatFs->getVolumeSerialNumber()) +
                " freeSectors:" + dec (ftpServer.mFatFs->getFreeSectors()));
 
+  if (!ftpServer.dataInit()) {
+    debug ("ftpServer data buffers problem");
+    vTaskDelete (NULL);
+    return;
+    }
+
   // create the TCP connection handle
   struct netconn* ftpServerNetConn = netconn_new (NETCONN_TCP);
   LWIP_ERROR("http_server: invalid ftpsrvconn", (ftpServerNetConn != NULL), return;);
@@ -1120,7 +1348,7 @@ void ftpServerThread (void const* argument) {
     if (netconn_accept (ftpServerNetConn, &ftpNetConn) == ERR_OK) {
       ftpServer.service (1, ftpNetConn);
       netconn_delete (ftpNetConn);
-      cLcd::debug ("ftpServer connection dropped");
+      debug ("ftpServer connection dropped");
       }
     }
   }
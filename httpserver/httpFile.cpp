@@ -0,0 +1,245 @@
+// httpFile.cpp - file tasks reading FatFs files into pooled double buffers for the http server
+//{{{  includes
+#include <string.h>
+#include <strings.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "httpFile.h"
+#include "staticTasks.h"
+#include "sdIo.h"
+#include "dmaBuf.h"
+
+#include "cSd.h"
+#include "../fatfs/fatFs.h"
+
+#include "utils.h"
+#include "cLcd.h"
+//}}}
+
+//{{{  struct tWorker
+typedef struct {
+  struct http_file file;                  // first, so a http_file* is its tWorker*
+  SemaphoreHandle_t startSem;             // request handed over by tcpip thread
+  SemaphoreHandle_t freeSem;              // counts empty buffers
+  struct tcpip_callback_msg* readyMsg;    // preallocated, posted to tcpip thread
+  } tWorker;
+//}}}
+static tWorker mWorkers[HTTP_FILE_WORKERS];
+
+//{{{
+static void postReady (tWorker* worker) {
+// wake tcpip thread, a pending post already covers anything set before its callback runs
+
+  if (!worker->file.posted) {
+    worker->file.posted = 1;
+    while (tcpip_trycallback (worker->readyMsg) != ERR_OK)
+      vTaskDelay (1);
+    }
+  }
+//}}}
+//{{{
+static void streamFile (tWorker* worker) {
+
+  auto file = &worker->file;
+
+  cFile sdFile (file->path, FA_OPEN_EXISTING | FA_READ);
+  if (sdFile.getError()) {
+    file->status = 404;
+    return;
+    }
+
+  // resolve range, suffix ranges arrive as rangeFirst 0xFFFFFFFF, rangeLast length
+  uint32_t size = sdFile.getSize();
+  uint32_t first = 0;
+  uint32_t last = size ? size - 1 : 0;
+  if (file->hasRange) {
+    if (file->rangeFirst == 0xFFFFFFFF) {
+      first = file->rangeLast < size ? size - file->rangeLast : 0;
+      }
+    else {
+      first = file->rangeFirst;
+      if (file->rangeLast < last)
+        last = file->rangeLast;
+      }
+    if ((first >= size) || (first > last)) {
+      file->size = size;
+      file->status = 416;
+      return;
+      }
+    }
+
+  if (first && (sdFile.seek (first) != FR_OK)) {
+    file->status = 404;
+    return;
+    }
+
+  file->size = size;
+  file->first = first;
+  file->len = size ? last - first + 1 : 0;
+  file->status = file->hasRange ? 206 : 200;
+  postReady (worker);
+
+  // read straight into the send buffers, alternating, tcp sends one while the other fills
+  auto left = file->len;
+  auto buf = 0;
+  while (left && !file->abort) {
+    xSemaphoreTake (worker->freeSem, portMAX_DELAY);
+    if (file->abort)
+      break;
+
+    int bytesRead = 0;
+    int bytesToRead = left < HTTP_FILE_BUF_SIZE ? left : HTTP_FILE_BUF_SIZE;
+    if ((sdFile.read (file->buf[buf], bytesToRead, bytesRead) != FR_OK) || !bytesRead) {
+      debug ("httpFile read error " + std::string (file->path));
+      file->abort = 1;
+      break;
+      }
+
+    file->bufLen[buf] = bytesRead;
+    file->bufReady[buf] = 1;
+    postReady (worker);
+
+    left -= bytesRead;
+    buf = (buf + 1) % HTTP_FILE_BUFS;
+    }
+  }
+//}}}
+//{{{
+static void httpFileThread (void const* argument) {
+
+  auto worker = (tWorker*)argument;
+  sdIoSetClass (eSdIoBulk);
+
+  while (true) {
+    xSemaphoreTake (worker->startSem, portMAX_DELAY);
+    streamFile (worker);
+    worker->file.done = 1;
+    postReady (worker);
+    }
+  }
+//}}}
+
+//{{{
+void httpFileInit (tcpip_callback_fn ready) {
+// task context, before the server starts, buffers pooled once for the life of the server
+
+  if (!cFatFs::get() && SD_present()) {
+    if (cFatFs::create()->mount() != FR_OK)
+      debug ("httpFile fatFs mount problem");
+    }
+
+  for (auto i = 0; i < HTTP_FILE_WORKERS; i++) {
+    auto worker = &mWorkers[i];
+    memset (&worker->file, 0, sizeof (struct http_file));
+
+    // sd read targets, whole cache lines
+    for (auto buf = 0; buf < HTTP_FILE_BUFS; buf++)
+      worker->file.buf[buf] = (u8_t*)dmaAlloc (HTTP_FILE_BUF_SIZE);
+
+    vSemaphoreCreateBinary (worker->startSem);
+    xSemaphoreTake (worker->startSem, 0);
+    worker->freeSem = xSemaphoreCreateCounting (HTTP_FILE_BUFS, 0);
+    worker->readyMsg = tcpip_callbackmsg_new (ready, &worker->file);
+
+    TaskHandle_t handle;
+    staticTaskCreate ((TaskFunction_t)httpFileThread, "httpFile", 2048, worker, 2, &handle);
+    }
+  }
+//}}}
+//{{{
+struct http_file* httpFileOpen (void* conn, const char* path, u8_t hasRange, u32_t rangeFirst, u32_t rangeLast) {
+// tcpip thread, NULL if all file tasks are busy
+
+  if (!cFatFs::get())
+    return NULL;
+
+  for (auto i = 0; i < HTTP_FILE_WORKERS; i++) {
+    auto worker = &mWorkers[i];
+    auto file = &worker->file;
+    if (!file->inuse) {
+      file->inuse = 1;
+      file->conn = conn;
+      strncpy (file->path, path, HTTP_FILE_PATH_SIZE - 1);
+      file->path[HTTP_FILE_PATH_SIZE - 1] = 0;
+      file->hasRange = hasRange;
+      file->rangeFirst = rangeFirst;
+      file->rangeLast = rangeLast;
+      file->headerSent = 0;
+      file->sendBuf = 0;
+      file->sendOffset = 0;
+
+      file->abort = 0;
+      file->posted = 0;
+      file->done = 0;
+      file->status = 0;
+      file->size = 0;
+      file->first = 0;
+      file->len = 0;
+      for (auto buf = 0; buf < HTTP_FILE_BUFS; buf++) {
+        file->bufReady[buf] = 0;
+        file->bufLen[buf] = 0;
+        file->bufEnd[buf] = 0xFFFFFFFF;
+        }
+
+      // all buffers empty
+      while (xSemaphoreTake (worker->freeSem, 0) == pdTRUE) {}
+      for (auto buf = 0; buf < HTTP_FILE_BUFS; buf++)
+        xSemaphoreGive (worker->freeSem);
+
+      xSemaphoreGive (worker->startSem);
+      return file;
+      }
+    }
+
+  return NULL;
+  }
+//}}}
+//{{{
+void httpFileFree (struct http_file* file, int buf) {
+// tcpip thread, buf acked, hand it back to the file task
+
+  file->bufReady[buf] = 0;
+  file->bufEnd[buf] = 0xFFFFFFFF;
+  xSemaphoreGive (((tWorker*)file)->freeSem);
+  }
+//}}}
+//{{{
+void httpFileAbort (struct http_file* file) {
+// tcpip thread, connection gone, file task stops at its next buffer, slot frees when it reports done
+
+  file->conn = NULL;
+  file->abort = 1;
+  for (auto buf = 0; buf < HTTP_FILE_BUFS; buf++)
+    xSemaphoreGive (((tWorker*)file)->freeSem);
+  }
+//}}}
+//{{{
+const char* httpFileMimeType (const char* path) {
+
+  const char* ext = strrchr (path, '.');
+  if (ext) {
+    ext++;
+    if (!strcasecmp (ext, "mp3"))
+      return "audio/mpeg";
+    if (!strcasecmp (ext, "aac"))
+      return "audio/aac";
+    if (!strcasecmp (ext, "wav"))
+      return "audio/wav";
+    if (!strcasecmp (ext, "htm") || !strcasecmp (ext, "html"))
+      return "text/html";
+    if (!strcasecmp (ext, "txt"))
+      return "text/plain";
+    if (!strcasecmp (ext, "jpg"))
+      return "image/jpeg";
+    if (!strcasecmp (ext, "gif"))
+      return "image/gif";
+    if (!strcasecmp (ext, "png"))
+      return "image/png";
+    }
+
+  return "application/octet-stream";
+  }
+//}}}
@@ -0,0 +1,53 @@
+// httpFile.h - stream FatFs files into http connections
+#pragma once
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+
+#define HTTP_FILE_WORKERS    2          // concurrent sd file streams, further requests get 503
+#define HTTP_FILE_BUFS       2          // double buffer, one reading while the other sends
+#define HTTP_FILE_BUF_SIZE   0x4000     // 16k, 32 sectors per read
+#define HTTP_FILE_PATH_SIZE  256
+
+//{{{
+#ifdef __cplusplus
+extern "C" {
+#endif
+//}}}
+
+struct http_file {
+  // owned by tcpip thread
+  u8_t inuse;
+  void* conn;                             // http_state, NULL once the connection has gone
+  char path[HTTP_FILE_PATH_SIZE];
+  u32_t rangeFirst;                       // requested Range, rangeLast 0xFFFFFFFF to end of file
+  u32_t rangeLast;
+  u8_t hasRange;
+  u8_t headerSent;
+  u8_t sendBuf;                           // next buffer to queue
+  u32_t sendOffset;                       // bytes of sendBuf queued
+  u32_t bufEnd[HTTP_FILE_BUFS];           // connection stream position of end of queued buffer
+
+  // set by the file task, read by tcpip thread
+  volatile u8_t abort;
+  volatile u8_t posted;
+  volatile u8_t done;                     // file task finished with this request
+  volatile int status;                    // 0 until opened, then 200, 206, 404, 416
+  volatile u32_t size;                    // file size
+  volatile u32_t first;                   // resolved range
+  volatile u32_t len;
+  volatile u8_t bufReady[HTTP_FILE_BUFS]; // filled by file task, not yet acked
+  volatile u32_t bufLen[HTTP_FILE_BUFS];
+  u8_t* buf[HTTP_FILE_BUFS];
+  };
+
+void httpFileInit (tcpip_callback_fn ready);
+struct http_file* httpFileOpen (void* conn, const char* path, u8_t hasRange, u32_t rangeFirst, u32_t rangeLast);
+void httpFileFree (struct http_file* file, int buf);
+void httpFileAbort (struct http_file* file);
+const char* httpFileMimeType (const char* path);
+
+//{{{
+#ifdef __cplusplus
+}
+#endif
+//}}}
@@ -0,0 +1,757 @@
+// httpServer.c - event driven http server on the lwip raw api, runs in the tcpip thread
+/*{{{  includes*/
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/arch.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "taskStats.h"
+
+#include "fs.h"
+#include "httpFile.h"
+
+#include "httpServer.h"
+/*}}}*/
+/*{{{  defines*/
+#define HTTP_PORT           80
+#define HTTP_MAX_CONNS      8     // concurrent connections, each also needs a MEMP_NUM_TCP_PCB
+#define HTTP_REQ_SIZE       512   // request header buffer, longer requests are dropped
+#define HTTP_HDR_SIZE       256   // response header lines built per request, widest is a 206, about 180
+#define HTTP_PAGE_SIZE      2048  // dynamic page body, task stats for TASK_STATS_MAX tasks
+#define HTTP_MAX_SPANS      3     // header, page start, body
+#define HTTP_SD_PREFIX      "/sd/"  // uris under here are served from the sd card
+#define HTTP_POLL_INTERVAL  2     // tcp_poll interval in 500ms coarse timer ticks
+#define HTTP_IDLE_POLLS     10    // keepAlive idle timeout, 10s
+
+// perfect hash of routes that are not plain fsdata files, same fs_hash as the file table, makefshash.py
+#define HTTP_ROUTE_SEED     0x811c9dc6
+#define HTTP_ROUTE_SIZE     4
+/*}}}*/
+
+u32_t nPageHits = 0;
+u32_t nRequests = 0;
+u32_t nConnections = 0;
+
+/*{{{*/
+/* Format of dynamic web page: the page header */
+static const unsigned char PAGE_START[] = {
+  0x3c,0x21,0x44,0x4f,0x43,0x54,0x59,0x50,0x45,0x20,0x68,0x74,0x6d,0x6c,0x20,0x50,
+  0x55,0x42,0x4c,0x49,0x43,0x20,0x22,0x2d,0x2f,0x2f,0x57,0x33,0x43,0x2f,0x2f,0x44,
+  0x54,0x44,0x20,0x48,0x54,0x4d,0x4c,0x20,0x34,0x2e,0x30,0x31,0x2f,0x2f,0x45,0x4e,
+  0x22,0x20,0x22,0x68,0x74,0x74,0x70,0x3a,0x2f,0x2f,0x77,0x77,0x77,0x2e,0x77,0x33,
+  0x2e,0x6f,0x72,0x67,0x2f,0x54,0x52,0x2f,0x68,0x74,0x6d,0x6c,0x34,0x2f,0x73,0x74,
+  0x72,0x69,0x63,0x74,0x2e,0x64,0x74,0x64,0x22,0x3e,0x0d,0x0a,0x3c,0x68,0x74,0x6d,
+  0x6c,0x3e,0x0d,0x0a,0x3c,0x68,0x65,0x61,0x64,0x3e,0x0d,0x0a,0x20,0x20,0x3c,0x74,
+  0x69,0x74,0x6c,0x65,0x3e,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x54,0x41,
+  0x53,0x4b,0x53,0x3c,0x2f,0x74,0x69,0x74,0x6c,0x65,0x3e,0x0d,0x0a,0x20,0x20,0x3c,
+  0x6d,0x65,0x74,0x61,0x20,0x68,0x74,0x74,0x70,0x2d,0x65,0x71,0x75,0x69,0x76,0x3d,
+  0x22,0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x22,0x0d,0x0a,
+  0x20,0x63,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x3d,0x22,0x74,0x65,0x78,0x74,0x2f,0x68,
+  0x74,0x6d,0x6c,0x3b,0x20,0x63,0x68,0x61,0x72,0x73,0x65,0x74,0x3d,0x77,0x69,0x6e,
+  0x64,0x6f,0x77,0x73,0x2d,0x31,0x32,0x35,0x32,0x22,0x3e,0x0d,0x0a,0x20,0x20,0x3c,
+  0x6d,0x65,0x74,0x61,0x20,0x68,0x74,0x74,0x70,0x2d,0x65,0x71,0x75,0x69,0x76,0x3d,
+  0x22,0x72,0x65,0x66,0x72,0x65,0x73,0x68,0x22,0x20,0x63,0x6f,0x6e,0x74,0x65,0x6e,
+  0x74,0x3d,0x22,0x31,0x22,0x3e,0x0d,0x0a,0x20,0x20,0x3c,0x6d,0x65,0x74,0x61,0x20,
+  0x63,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x3d,0x22,0x4d,0x53,0x48,0x54,0x4d,0x4c,0x20,
+  0x36,0x2e,0x30,0x30,0x2e,0x32,0x38,0x30,0x30,0x2e,0x31,0x35,0x36,0x31,0x22,0x20,
+  0x6e,0x61,0x6d,0x65,0x3d,0x22,0x47,0x45,0x4e,0x45,0x52,0x41,0x54,0x4f,0x52,0x22,
+  0x3e,0x0d,0x0a,0x20,0x20,0x3c,0x73,0x74,0x79,0x6c,0x65,0x20,0x3d,0x22,0x66,0x6f,
+  0x6e,0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x6e,0x6f,0x72,0x6d,0x61,
+  0x6c,0x3b,0x20,0x66,0x6f,0x6e,0x74,0x2d,0x66,0x61,0x6d,0x69,0x6c,0x79,0x3a,0x20,
+  0x56,0x65,0x72,0x64,0x61,0x6e,0x61,0x3b,0x22,0x3e,0x3c,0x2f,0x73,0x74,0x79,0x6c,
+  0x65,0x3e,0x0d,0x0a,0x3c,0x2f,0x68,0x65,0x61,0x64,0x3e,0x0d,0x0a,0x3c,0x62,0x6f,
+  0x64,0x79,0x3e,0x0d,0x0a,0x3c,0x68,0x34,0x3e,0x3c,0x73,0x6d,0x61,0x6c,0x6c,0x20,
+  0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,0x74,0x2d,0x66,0x61,0x6d,0x69,
+  0x6c,0x79,0x3a,0x20,0x56,0x65,0x72,0x64,0x61,0x6e,0x61,0x3b,0x22,0x3e,0x3c,0x73,
+  0x6d,0x61,0x6c,0x6c,0x3e,0x3c,0x62,0x69,0x67,0x3e,0x3c,0x62,0x69,0x67,0x3e,0x3c,
+  0x62,0x69,0x67,0x0d,0x0a,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,
+  0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x62,0x6f,0x6c,0x64,0x3b,0x22,
+  0x3e,0x3c,0x62,0x69,0x67,0x3e,0x3c,0x73,0x74,0x72,0x6f,0x6e,0x67,0x3e,0x3c,0x65,
+  0x6d,0x3e,0x3c,0x73,0x70,0x61,0x6e,0x0d,0x0a,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,
+  0x22,0x66,0x6f,0x6e,0x74,0x2d,0x73,0x74,0x79,0x6c,0x65,0x3a,0x20,0x69,0x74,0x61,
+  0x6c,0x69,0x63,0x3b,0x22,0x3e,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x20,
+  0x4c,0x69,0x73,0x74,0x20,0x6f,0x66,0x20,0x74,0x61,0x73,0x6b,0x73,0x20,0x61,0x6e,
+  0x64,0x0d,0x0a,0x74,0x68,0x65,0x69,0x72,0x20,0x73,0x74,0x61,0x74,0x75,0x73,0x3c,
+  0x2f,0x73,0x70,0x61,0x6e,0x3e,0x3c,0x2f,0x65,0x6d,0x3e,0x3c,0x2f,0x73,0x74,0x72,
+  0x6f,0x6e,0x67,0x3e,0x3c,0x2f,0x62,0x69,0x67,0x3e,0x3c,0x2f,0x62,0x69,0x67,0x3e,
+  0x3c,0x2f,0x62,0x69,0x67,0x3e,0x3c,0x2f,0x62,0x69,0x67,0x3e,0x3c,0x2f,0x73,0x6d,
+  0x61,0x6c,0x6c,0x3e,0x3c,0x2f,0x73,0x6d,0x61,0x6c,0x6c,0x3e,0x3c,0x2f,0x68,0x34,
+  0x3e,0x0d,0x0a,0x3c,0x68,0x72,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x77,0x69,
+  0x64,0x74,0x68,0x3a,0x20,0x31,0x30,0x30,0x25,0x3b,0x20,0x68,0x65,0x69,0x67,0x68,
+  0x74,0x3a,0x20,0x32,0x70,0x78,0x3b,0x22,0x3e,0x3c,0x73,0x70,0x61,0x6e,0x0d,0x0a,
+  0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,0x74,0x2d,0x77,0x65,0x69,
+  0x67,0x68,0x74,0x3a,0x20,0x62,0x6f,0x6c,0x64,0x3b,0x22,0x3e,0x0d,0x0a,0x3c,0x2f,
+  0x73,0x70,0x61,0x6e,0x3e,0x3c,0x73,0x70,0x61,0x6e,0x20,0x73,0x74,0x79,0x6c,0x65,
+  0x3d,0x22,0x66,0x6f,0x6e,0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x62,
+  0x6f,0x6c,0x64,0x3b,0x22,0x3e,0x0d,0x0a,0x3c,0x74,0x61,0x62,0x6c,0x65,0x20,0x73,
+  0x74,0x79,0x6c,0x65,0x3d,0x22,0x77,0x69,0x64,0x74,0x68,0x3a,0x20,0x39,0x36,0x31,
+  0x70,0x78,0x3b,0x20,0x68,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x33,0x30,0x70,0x78,
+  0x3b,0x22,0x20,0x62,0x6f,0x72,0x64,0x65,0x72,0x3d,0x22,0x31,0x22,0x0d,0x0a,0x20,
+  0x63,0x65,0x6c,0x6c,0x70,0x61,0x64,0x64,0x69,0x6e,0x67,0x3d,0x22,0x32,0x22,0x20,
+  0x63,0x65,0x6c,0x6c,0x73,0x70,0x61,0x63,0x69,0x6e,0x67,0x3d,0x22,0x32,0x22,0x3e,
+  0x0d,0x0a,0x20,0x20,0x3c,0x74,0x62,0x6f,0x64,0x79,0x3e,0x0d,0x0a,0x20,0x20,0x20,
+  0x20,0x3c,0x74,0x72,0x3e,0x0d,0x0a,0x20,0x20,0x20,0x20,0x20,0x20,0x3c,0x74,0x64,
+  0x0d,0x0a,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,0x74,0x2d,0x66,
+  0x61,0x6d,0x69,0x6c,0x79,0x3a,0x20,0x56,0x65,0x72,0x64,0x61,0x6e,0x61,0x3b,0x20,
+  0x66,0x6f,0x6e,0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x62,0x6f,0x6c,
+  0x64,0x3b,0x20,0x66,0x6f,0x6e,0x74,0x2d,0x73,0x74,0x79,0x6c,0x65,0x3a,0x20,0x69,
+  0x74,0x61,0x6c,0x69,0x63,0x3b,0x20,0x62,0x61,0x63,0x6b,0x67,0x72,0x6f,0x75,0x6e,
+  0x64,0x2d,0x63,0x6f,0x6c,0x6f,0x72,0x3a,0x20,0x72,0x67,0x62,0x28,0x35,0x31,0x2c,
+  0x20,0x35,0x31,0x2c,0x20,0x32,0x35,0x35,0x29,0x3b,0x20,0x74,0x65,0x78,0x74,0x2d,
+  0x61,0x6c,0x69,0x67,0x6e,0x3a,0x20,0x63,0x65,0x6e,0x74,0x65,0x72,0x3b,0x22,0x3e,
+  0x3c,0x73,0x6d,0x61,0x6c,0x6c,0x3e,0x3c,0x61,0x0d,0x0a,0x20,0x68,0x72,0x65,0x66,
+  0x3d,0x22,0x2f,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,0x2e,0x68,0x74,0x6d,
+  0x6c,0x22,0x3e,0x3c,0x73,0x70,0x61,0x6e,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,
+  0x63,0x6f,0x6c,0x6f,0x72,0x3a,0x20,0x77,0x68,0x69,0x74,0x65,0x3b,0x22,0x3e,0x48,
+  0x6f,0x6d,0x65,0x0d,0x0a,0x70,0x61,0x67,0x65,0x3c,0x2f,0x73,0x70,0x61,0x6e,0x3e,
+  0x3c,0x2f,0x61,0x3e,0x3c,0x2f,0x73,0x6d,0x61,0x6c,0x6c,0x3e,0x3c,0x2f,0x74,0x64,
+  0x3e,0x0d,0x0a,0x20,0x20,0x20,0x20,0x20,0x20,0x3c,0x74,0x64,0x0d,0x0a,0x20,0x73,
+  0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,0x74,0x2d,0x66,0x61,0x6d,0x69,0x6c,
+  0x79,0x3a,0x20,0x56,0x65,0x72,0x64,0x61,0x6e,0x61,0x3b,0x20,0x66,0x6f,0x6e,0x74,
+  0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x62,0x6f,0x6c,0x64,0x3b,0x20,0x66,
+  0x6f,0x6e,0x74,0x2d,0x73,0x74,0x79,0x6c,0x65,0x3a,0x20,0x69,0x74,0x61,0x6c,0x69,
+  0x63,0x3b,0x20,0x62,0x61,0x63,0x6b,0x67,0x72,0x6f,0x75,0x6e,0x64,0x2d,0x63,0x6f,
+  0x6c,0x6f,0x72,0x3a,0x20,0x72,0x67,0x62,0x28,0x35,0x31,0x2c,0x20,0x35,0x31,0x2c,
+  0x20,0x32,0x35,0x35,0x29,0x3b,0x20,0x74,0x65,0x78,0x74,0x2d,0x61,0x6c,0x69,0x67,
+  0x6e,0x3a,0x20,0x63,0x65,0x6e,0x74,0x65,0x72,0x3b,0x22,0x3e,0x3c,0x61,0x0d,0x0a,
+  0x20,0x68,0x72,0x65,0x66,0x3d,0x22,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,0x78,0x78,
+  0x41,0x44,0x43,0x2e,0x68,0x74,0x6d,0x6c,0x22,0x3e,0x3c,0x73,0x70,0x61,0x6e,0x20,
+  0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,0x74,0x2d,0x77,0x65,0x69,0x67,
+  0x68,0x74,0x3a,0x20,0x62,0x6f,0x6c,0x64,0x3b,0x22,0x3e,0x3c,0x2f,0x73,0x70,0x61,
+  0x6e,0x3e,0x3c,0x2f,0x61,0x3e,0x3c,0x73,0x6d,0x61,0x6c,0x6c,0x3e,0x3c,0x61,0x0d,
+  0x0a,0x20,0x68,0x72,0x65,0x66,0x3d,0x22,0x2f,0x53,0x54,0x4d,0x33,0x32,0x46,0x37,
+  0x78,0x78,0x54,0x41,0x53,0x4b,0x53,0x2e,0x68,0x74,0x6d,0x6c,0x22,0x3e,0x3c,0x73,
+  0x70,0x61,0x6e,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x63,0x6f,0x6c,0x6f,0x72,
+  0x3a,0x20,0x77,0x68,0x69,0x74,0x65,0x3b,0x22,0x3e,0x4c,0x69,0x73,0x74,0x0d,0x0a,
+  0x6f,0x66,0x20,0x74,0x61,0x73,0x6b,0x73,0x3c,0x2f,0x73,0x70,0x61,0x6e,0x3e,0x3c,
+  0x2f,0x61,0x3e,0x3c,0x2f,0x73,0x6d,0x61,0x6c,0x6c,0x3e,0x3c,0x2f,0x74,0x64,0x3e,
+  0x0d,0x0a,0x20,0x20,0x20,0x20,0x3c,0x2f,0x74,0x72,0x3e,0x0d,0x0a,0x20,0x20,0x3c,
+  0x2f,0x74,0x62,0x6f,0x64,0x79,0x3e,0x0d,0x0a,0x3c,0x2f,0x74,0x61,0x62,0x6c,0x65,
+  0x3e,0x0d,0x0a,0x3c,0x62,0x72,0x3e,0x0d,0x0a,0x3c,0x2f,0x73,0x70,0x61,0x6e,0x3e,
+  0x3c,0x73,0x70,0x61,0x6e,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,0x6e,
+  0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x20,0x62,0x6f,0x6c,0x64,0x3b,0x22,
+  0x3e,0x3c,0x2f,0x73,0x70,0x61,0x6e,0x3e,0x3c,0x73,0x6d,0x61,0x6c,0x6c,0x3e,0x3c,
+  0x73,0x70,0x61,0x6e,0x0d,0x0a,0x20,0x73,0x74,0x79,0x6c,0x65,0x3d,0x22,0x66,0x6f,
+  0x6e,0x74,0x2d,0x66,0x61,0x6d,0x69,0x6c,0x79,0x3a,0x20,0x56,0x65,0x72,0x64,0x61,
+  0x6e,0x61,0x3b,0x22,0x3e,0x4e,0x75,0x6d,0x62,0x65,0x72,0x20,0x6f,0x66,0x20,0x70,
+  0x61,0x67,0x65,0x20,0x68,0x69,0x74,0x73,0x3a,0x0d,0x0a,0x00};
+/*}}}*/
+/*}}}*/
+
+/*{{{  struct http_state*/
+struct http_state {
+  struct tcp_pcb* pcb;
+  u8_t inuse;
+  u8_t keepAlive;
+  u8_t idle;
+
+  // response, sent as spans directly from flash or from this state, never copied
+  u8_t span;
+  u8_t numSpans;
+  const char* data[HTTP_MAX_SPANS];
+  u32_t left[HTTP_MAX_SPANS];
+  u32_t sent;            // stream position written, state buffers can't be reused until acked catches up
+  u32_t acked;
+  struct http_file* file;  // sd file streaming after the spans, owns the connection until done
+
+  u16_t reqLen;
+  char req[HTTP_REQ_SIZE];
+  char hdr[HTTP_HDR_SIZE];
+  char page[HTTP_PAGE_SIZE];
+  };
+/*}}}*/
+/*{{{  struct http_route*/
+typedef void (*http_handler)(struct http_state* hs);
+
+struct http_route {
+  const char* uri;
+  const char* file;      // alias to fsdata file
+  http_handler handler;  // or dynamic page
+  };
+/*}}}*/
+
+static struct http_state http_states[HTTP_MAX_CONNS];
+static struct tcp_pcb* http_listenPcb = NULL;
+
+static err_t http_process (struct http_state* hs);
+
+/*{{{*/
+static struct http_state* http_alloc() {
+
+  for (int i = 0; i < HTTP_MAX_CONNS; i++)
+    if (!http_states[i].inuse) {
+      memset (&http_states[i], 0, offsetof (struct http_state, req));
+      http_states[i].inuse = 1;
+      return &http_states[i];
+      }
+
+  return NULL;
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_close (struct tcp_pcb* pcb, struct http_state* hs) {
+
+  tcp_arg (pcb, NULL);
+  tcp_recv (pcb, NULL);
+  tcp_sent (pcb, NULL);
+  tcp_poll (pcb, NULL, 0);
+  tcp_err (pcb, NULL);
+
+  if (hs) {
+    hs->inuse = 0;
+    if (hs->file) {
+      // unacked no copy writes point into the file buffers, which go back to the file task
+      httpFileAbort (hs->file);
+      hs->file = NULL;
+      tcp_abort (pcb);
+      return ERR_ABRT;
+      }
+    }
+
+  if (tcp_close (pcb) != ERR_OK) {
+    // no memory to queue FIN, give up on graceful close
+    tcp_abort (pcb);
+    return ERR_ABRT;
+    }
+
+  return ERR_OK;
+  }
+/*}}}*/
+
+/*{{{*/
+static void http_addSpan (struct http_state* hs, const char* data, u32_t len) {
+
+  hs->data[hs->numSpans] = data;
+  hs->left[hs->numSpans] = len;
+  hs->numSpans++;
+  }
+/*}}}*/
+/*{{{*/
+static int http_header (struct http_state* hs, const char* format, ...) {
+// header lines into hdr, their length, 0 if they would not fit, a truncated header is never sent
+
+  va_list args;
+  va_start (args, format);
+  int len = vsnprintf (hs->hdr, HTTP_HDR_SIZE, format, args);
+  va_end (args);
+
+  if ((len <= 0) || (len >= HTTP_HDR_SIZE)) {
+    hs->keepAlive = 0;
+    return 0;
+    }
+  return len;
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_send (struct http_state* hs) {
+// queue as much of the response as the send buffer takes, rest is paced by http_sent
+
+  struct tcp_pcb* pcb = hs->pcb;
+
+  while (hs->span < hs->numSpans) {
+    if (!hs->left[hs->span]) {
+      hs->span++;
+      continue;
+      }
+
+    u16_t len = tcp_sndbuf (pcb);
+    if (!len || (tcp_sndqueuelen (pcb) >= TCP_SND_QUEUELEN))
+      break;
+    if (len > 2 * pcb->mss)
+      len = 2 * pcb->mss;
+    if (len > hs->left[hs->span])
+      len = hs->left[hs->span];
+
+    u8_t flags = (hs->span < hs->numSpans - 1) || (len < hs->left[hs->span]) ? TCP_WRITE_FLAG_MORE : 0;
+    err_t err = tcp_write (pcb, hs->data[hs->span], len, flags);
+    while ((err == ERR_MEM) && (len > pcb->mss)) {
+      len /= 2;
+      err = tcp_write (pcb, hs->data[hs->span], len, TCP_WRITE_FLAG_MORE);
+      }
+    if (err != ERR_OK)
+      break;
+
+    hs->data[hs->span] += len;
+    hs->left[hs->span] -= len;
+    hs->sent += len;
+    }
+
+  struct http_file* file = hs->file;
+  if (file && (hs->span >= hs->numSpans)) {
+    // then file buffers as the file task fills them, each freed when its last byte is acked
+    while (file->bufReady[file->sendBuf] && (file->bufEnd[file->sendBuf] == 0xFFFFFFFF)) {
+      u16_t len = tcp_sndbuf (pcb);
+      if (!len || (tcp_sndqueuelen (pcb) >= TCP_SND_QUEUELEN))
+        break;
+      if (len > 2 * pcb->mss)
+        len = 2 * pcb->mss;
+      u32_t left = file->bufLen[file->sendBuf] - file->sendOffset;
+      if (len > left)
+        len = left;
+
+      const u8_t* data = file->buf[file->sendBuf] + file->sendOffset;
+      err_t err = tcp_write (pcb, data, len, TCP_WRITE_FLAG_MORE);
+      while ((err == ERR_MEM) && (len > pcb->mss)) {
+        len /= 2;
+        err = tcp_write (pcb, data, len, TCP_WRITE_FLAG_MORE);
+        }
+      if (err != ERR_OK)
+        break;
+
+      hs->sent += len;
+      file->sendOffset += len;
+      if (file->sendOffset == file->bufLen[file->sendBuf]) {
+        file->bufEnd[file->sendBuf] = hs->sent;
+        file->sendBuf = (file->sendBuf + 1) % HTTP_FILE_BUFS;
+        file->sendOffset = 0;
+        }
+      }
+    }
+
+  tcp_output (pcb);
+  return ERR_OK;
+  }
+/*}}}*/
+
+/*{{{*/
+static void http_tasksPage (struct http_state* hs) {
+
+  nPageHits++;
+
+  const tTaskStat* stats;
+  int numStats = taskStatsGet (&stats);
+
+  // every snprintf bounded by what is left of page, a long task list is truncated, never overruns
+  int len = snprintf (hs->page, HTTP_PAGE_SIZE, "%d", (int)nPageHits);
+  len += snprintf (hs->page + len, HTTP_PAGE_SIZE - len, "%s",
+                   "<pre><br>Name          State Priority  Cpu%  StackFree  Heap"
+                   "<br>-------------------------------------------------------<br>");
+  for (int i = 0; (i < numStats) && (len < HTTP_PAGE_SIZE); i++)
+    len += snprintf (hs->page + len, HTTP_PAGE_SIZE - len, "%-16s%c %4u %4u.%u %8u %8u<br>",
+                     stats[i].name, stats[i].state, stats[i].priority, stats[i].cpu / 10, stats[i].cpu % 10,
+                     stats[i].stackFree * 4, (unsigned)stats[i].heapBytes);
+  if (len < HTTP_PAGE_SIZE)
+    len += snprintf (hs->page + len, HTTP_PAGE_SIZE - len, "%s",
+                     "<br>-------------------------------------------------------"
+                     "<br>X : Running, B : Blocked, R : Ready, D : Deleted, S : Suspended<br>");
+  if (len >= HTTP_PAGE_SIZE)
+    len = HTTP_PAGE_SIZE - 1;
+
+  int pageStartLen = strlen ((char*)PAGE_START);
+  int hdrLen = http_header (hs,
+    "HTTP/1.0 200 OK\r\nContent-type: text/html\r\nContent-Length: %d\r\nConnection: %s\r\n\r\n",
+    pageStartLen + len, hs->keepAlive ? "keep-alive" : "close");
+  if (!hdrLen)
+    return;
+
+  http_addSpan (hs, hs->hdr, hdrLen);
+  http_addSpan (hs, (const char*)PAGE_START, pageStartLen);
+  http_addSpan (hs, hs->page, len);
+  }
+/*}}}*/
+/*{{{*/
+static void http_tasksJson (struct http_state* hs) {
+
+  nPageHits++;
+
+  int len = taskStatsJson (hs->page, HTTP_PAGE_SIZE);
+  int hdrLen = http_header (hs,
+    "HTTP/1.0 200 OK\r\nContent-type: application/json\r\nContent-Length: %d\r\nConnection: %s\r\n\r\n",
+    len, hs->keepAlive ? "keep-alive" : "close");
+  if (!hdrLen)
+    return;
+
+  http_addSpan (hs, hs->hdr, hdrLen);
+  http_addSpan (hs, hs->page, len);
+  }
+/*}}}*/
+/*{{{*/
+static const struct http_route http_routes[HTTP_ROUTE_SIZE] = {
+  { NULL, NULL, NULL },
+  { "/tasks.json", NULL, http_tasksJson },
+  { "/STM32F7xxTASKS.html", NULL, http_tasksPage },
+  { "/", "/STM32F7xx.html", NULL },
+  };
+/*}}}*/
+/*{{{*/
+static void http_filePage (struct http_state* hs, const char* uri) {
+
+  struct fs_file* file = fs_open (uri);
+  if (!file)
+    file = fs_open ("/404.html");
+  if (!file) {
+    hs->keepAlive = 0;
+    return;
+    }
+
+  // fsdata header without its blank line, our length and connection lines, then the body, all from flash
+  int hdrLen = http_header (hs, "Content-Length: %d\r\nConnection: %s\r\n\r\n",
+                            file->len - file->http_header_len, hs->keepAlive ? "keep-alive" : "close");
+  if (!hdrLen) {
+    fs_close (file);
+    return;
+    }
+
+  http_addSpan (hs, file->data, file->http_header_len - 2);
+  http_addSpan (hs, hs->hdr, hdrLen);
+  http_addSpan (hs, file->data + file->http_header_len, file->len - file->http_header_len);
+
+  // data is const flash, the fs_file slot is not needed while sending
+  fs_close (file);
+  }
+/*}}}*/
+/*{{{*/
+static void http_unescape (char* uri) {
+// in place %xx decode, sd file names can have spaces
+
+  char* out = uri;
+  while (*uri) {
+    unsigned int ch;
+    if ((*uri == '%') && uri[1] && uri[2] && (sscanf (uri + 1, "%2x", &ch) == 1)) {
+      *out++ = (char)ch;
+      uri += 3;
+      }
+    else
+      *out++ = *uri++;
+    }
+  *out = 0;
+  }
+/*}}}*/
+/*{{{*/
+static void http_sdPage (struct http_state* hs, char* uri, const char* headers) {
+// hand the file to a file task, the response starts when it reports back in http_fileReady
+
+  // Range: bytes=first-last, bytes=first- or bytes=-suffix, multiple ranges not supported
+  u8_t hasRange = 0;
+  u32_t rangeFirst = 0;
+  u32_t rangeLast = 0xFFFFFFFF;
+  const char* range = strstr (headers, "Range: bytes=");
+  if (range) {
+    range += 13;
+    unsigned long first;
+    unsigned long last;
+    if (sscanf (range, "-%lu", &last) == 1) {
+      hasRange = 1;
+      rangeFirst = 0xFFFFFFFF;
+      rangeLast = last;
+      }
+    else if (sscanf (range, "%lu-%lu", &first, &last) == 2) {
+      hasRange = 1;
+      rangeFirst = first;
+      rangeLast = last;
+      }
+    else if (sscanf (range, "%lu-", &first) == 1) {
+      hasRange = 1;
+      rangeFirst = first;
+      }
+    }
+
+  http_unescape (uri);
+  hs->file = httpFileOpen (hs, uri + strlen (HTTP_SD_PREFIX) - 1, hasRange, rangeFirst, rangeLast);
+  if (!hs->file) {
+    // all file tasks busy, or no card
+    hs->keepAlive = 0;
+    strcpy (hs->hdr, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\n"
+                     "Connection: close\r\n\r\n");
+    http_addSpan (hs, hs->hdr, strlen (hs->hdr));
+    }
+  }
+/*}}}*/
+/*{{{*/
+static int http_fileHeader (struct http_state* hs) {
+// 0 if the header did not fit, the request fails rather than send a body without one
+
+  struct http_file* file = hs->file;
+  const char* connection = hs->keepAlive ? "keep-alive" : "close";
+
+  int hdrLen;
+  if (file->status == 206)
+    hdrLen = http_header (hs,
+      "HTTP/1.1 206 Partial Content\r\nContent-Type: %s\r\nContent-Length: %lu\r\n"
+      "Content-Range: bytes %lu-%lu/%lu\r\nConnection: %s\r\n\r\n",
+      httpFileMimeType (file->path), (unsigned long)file->len, (unsigned long)file->first,
+      (unsigned long)(file->first + file->len - 1), (unsigned long)file->size, connection);
+  else if (file->status == 416)
+    hdrLen = http_header (hs,
+      "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lu\r\n"
+      "Content-Length: 0\r\nConnection: %s\r\n\r\n",
+      (unsigned long)file->size, connection);
+  else
+    hdrLen = http_header (hs,
+      "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %lu\r\n"
+      "Accept-Ranges: bytes\r\nConnection: %s\r\n\r\n",
+      httpFileMimeType (file->path), (unsigned long)file->len, connection);
+
+  if (hdrLen)
+    http_addSpan (hs, hs->hdr, hdrLen);
+  return hdrLen;
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_fileDone (struct http_state* hs) {
+// everything the file task produced has been sent and acked
+
+  struct http_file* file = hs->file;
+  if (!file->done || (hs->sent != hs->acked))
+    return ERR_OK;
+  for (int buf = 0; buf < HTTP_FILE_BUFS; buf++)
+    if (file->bufReady[buf])
+      return ERR_OK;
+
+  hs->file = NULL;
+  file->conn = NULL;
+  file->inuse = 0;
+  if (file->abort)
+    // read error part way, content length can't be met
+    return http_close (hs->pcb, hs);
+
+  return http_process (hs);
+  }
+/*}}}*/
+/*{{{*/
+static void http_fileReady (void* ctx) {
+// tcpip thread, posted by a file task when its status, a buffer or done changes
+
+  struct http_file* file = (struct http_file*)ctx;
+  file->posted = 0;
+  if (!file->inuse)
+    // late post for a finished request
+    return;
+
+  struct http_state* hs = (struct http_state*)file->conn;
+  if (!hs) {
+    // connection already gone
+    if (file->done)
+      file->inuse = 0;
+    return;
+    }
+
+  if (!file->headerSent && (file->status || file->done)) {
+    file->headerSent = 1;
+    if ((file->status == 200) || (file->status == 206) || (file->status == 416)) {
+      if (!http_fileHeader (hs)) {
+        // aborts the file task's request with the connection
+        http_close (hs->pcb, hs);
+        return;
+        }
+      }
+    else
+      http_filePage (hs, "/404.html");
+    }
+
+  http_send (hs);
+  if (file->headerSent)
+    http_fileDone (hs);
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_process (struct http_state* hs) {
+// serve next complete request in req, pipelined requests wait until the previous response is acked
+
+  if ((hs->span < hs->numSpans) || hs->file || (hs->sent != hs->acked))
+    return ERR_OK;
+
+  if (!hs->keepAlive && hs->numSpans)
+    // response to final request fully acked
+    return http_close (hs->pcb, hs);
+
+  char* end = strstr (hs->req, "\r\n\r\n");
+  if (!end) {
+    if (hs->reqLen >= HTTP_REQ_SIZE - 1)
+      // request too big for us
+      return http_close (hs->pcb, hs);
+    return ERR_OK;
+    }
+  *end = 0;
+
+  nRequests++;
+  hs->span = 0;
+  hs->numSpans = 0;
+
+  // HTTP/1.1 is persistent unless told otherwise, HTTP/1.0 only when asked
+  hs->keepAlive = strstr (hs->req, "HTTP/1.1") ? !strstr (hs->req, "Connection: close") :
+                                                  (strstr (hs->req, "Connection: keep-alive") != NULL);
+
+  if (!strncmp (hs->req, "GET /", 5)) {
+    // terminate uri at the space before the protocol
+    char* uri = hs->req + 4;
+    char* uriEnd = strchr (uri, ' ');
+    if (uriEnd)
+      *uriEnd = 0;
+
+    const struct http_route* route = &http_routes[fs_hash (uri, HTTP_ROUTE_SEED) & (HTTP_ROUTE_SIZE - 1)];
+    if (!strncmp (uri, HTTP_SD_PREFIX, strlen (HTTP_SD_PREFIX)))
+      http_sdPage (hs, uri, uriEnd ? uriEnd + 1 : "");
+    else if (route->uri && !strcmp (uri, route->uri)) {
+      if (route->handler)
+        route->handler (hs);
+      else
+        http_filePage (hs, route->file);
+      }
+    else
+      http_filePage (hs, uri);
+    }
+  else
+    hs->keepAlive = 0;
+
+  // shuffle any pipelined request down
+  end += 4;
+  hs->reqLen -= end - hs->req;
+  memmove (hs->req, end, hs->reqLen);
+  hs->req[hs->reqLen] = 0;
+
+  if (!hs->numSpans && !hs->file)
+    return http_close (hs->pcb, hs);
+
+  return http_send (hs);
+  }
+/*}}}*/
+
+/*{{{*/
+static err_t http_sent (void* arg, struct tcp_pcb* pcb, u16_t len) {
+
+  struct http_state* hs = (struct http_state*)arg;
+  if (!hs)
+    return ERR_OK;
+
+  hs->idle = 0;
+  hs->acked += len;
+
+  struct http_file* file = hs->file;
+  if (file) {
+    for (int buf = 0; buf < HTTP_FILE_BUFS; buf++)
+      if (file->bufReady[buf] && ((s32_t)(hs->acked - file->bufEnd[buf]) >= 0) && (file->bufEnd[buf] != 0xFFFFFFFF))
+        httpFileFree (file, buf);
+    http_send (hs);
+    return file->headerSent ? http_fileDone (hs) : ERR_OK;
+    }
+
+  if (hs->span < hs->numSpans)
+    return http_send (hs);
+
+  return http_process (hs);
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_recv (void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err) {
+
+  struct http_state* hs = (struct http_state*)arg;
+
+  if (!p || !hs) {
+    // remote closed
+    if (p)
+      pbuf_free (p);
+    return http_close (pcb, hs);
+    }
+
+  if (err != ERR_OK) {
+    pbuf_free (p);
+    return err;
+    }
+
+  if (p->tot_len > HTTP_REQ_SIZE - 1 - hs->reqLen) {
+    if (strstr (hs->req, "\r\n\r\n"))
+      // pipelined requests fill req, lwip holds p as refused data and offers it again once one is served
+      return ERR_MEM;
+
+    // request too big for us, nothing acknowledged that was not consumed
+    pbuf_free (p);
+    return http_close (pcb, hs);
+    }
+
+  // whole pbuf consumed, only now open the window for it
+  u16_t len = p->tot_len;
+  tcp_recved (pcb, len);
+  pbuf_copy_partial (p, hs->req + hs->reqLen, len, 0);
+  hs->reqLen += len;
+  hs->req[hs->reqLen] = 0;
+  pbuf_free (p);
+
+  hs->idle = 0;
+  return http_process (hs);
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_poll (void* arg, struct tcp_pcb* pcb) {
+
+  struct http_state* hs = (struct http_state*)arg;
+  if (!hs)
+    return http_close (pcb, NULL);
+
+  if (++hs->idle > HTTP_IDLE_POLLS)
+    return http_close (pcb, hs);
+
+  // retry anything tcp_write refused for lack of memory
+  if ((hs->span < hs->numSpans) || hs->file)
+    return http_send (hs);
+
+  return ERR_OK;
+  }
+/*}}}*/
+/*{{{*/
+static void http_err (void* arg, err_t err) {
+// pcb already freed by lwip
+
+  struct http_state* hs = (struct http_state*)arg;
+  if (hs) {
+    hs->inuse = 0;
+    if (hs->file) {
+      httpFileAbort (hs->file);
+      hs->file = NULL;
+      }
+    }
+  }
+/*}}}*/
+/*{{{*/
+static err_t http_accept (void* arg, struct tcp_pcb* pcb, err_t err) {
+
+  tcp_accepted (http_listenPcb);
+
+  struct http_state* hs = http_alloc();
+  if (!hs)
+    // all connections busy, lwip aborts the pcb
+    return ERR_MEM;
+
+  nConnections++;
+  hs->pcb = pcb;
+  tcp_setprio (pcb, TCP_PRIO_MIN);
+  tcp_arg (pcb, hs);
+  tcp_recv (pcb, http_recv);
+  tcp_sent (pcb, http_sent);
+  tcp_err (pcb, http_err);
+  tcp_poll (pcb, http_poll, HTTP_POLL_INTERVAL);
+
+  return ERR_OK;
+  }
+/*}}}*/
+/*{{{*/
+static void http_start (void* ctx) {
+// tcpip thread
+
+  struct tcp_pcb* pcb = tcp_new();
+  if (pcb) {
+    if (tcp_bind (pcb, IP_ADDR_ANY, HTTP_PORT) == ERR_OK) {
+      http_listenPcb = tcp_listen (pcb);
+      tcp_accept (http_listenPcb, http_accept);
+      }
+    else
+      tcp_close (pcb);
+    }
+  }
+/*}}}*/
+
+/*{{{*/
+void httpServerInit() {
+// all serving happens in the tcpip thread, sd files are read by the httpFile tasks
+
+  httpFileInit (http_fileReady);
+  tcpip_callback (http_start, NULL);
+  }
+/*}}}*/
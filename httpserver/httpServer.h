@@ -5,7 +5,7 @@
 extern "C" {
 #endif
 //}}}
-  void httpServerThread (void const* argument);
+  void httpServerInit();
 //{{{
 #ifdef __cplusplus
 }
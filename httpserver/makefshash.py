@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# makefshash.py - perfect hash tables for fs_open and the http routes, same fs_hash as fs.c
+# - fsdata.c comes from makefsdata, this regenerates its fs_hash_table block from the file names
+#   in the data comments, and the http_routes table and seed in httpServer.c from the route uris
+# - smallest power of 2 table, first seed up from the fnv-1a offset basis with no collisions
+# - pre build step of both configurations, rewrites a file only if a table changed,
+#   --check fails instead of rewriting
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+FSDATA = os.path.join(HERE, "fsdata.c")
+SERVER = os.path.join(HERE, "httpServer.c")
+FNV_BASIS = 0x811c9dc5
+MAX_SEEDS = 1 << 20
+
+#{{{
+def fsHash(name, seed):
+  # fs.c fs_hash, fnv-1a folded
+
+  hash = seed
+  for byte in name.encode():
+    hash ^= byte
+    hash = (hash * 16777619) & 0xFFFFFFFF
+  return hash ^ (hash >> 16)
+#}}}
+#{{{
+def perfect(names):
+  # seed, size, slot per name
+
+  size = 1
+  while size < len(names):
+    size *= 2
+  while True:
+    for seed in range(FNV_BASIS, FNV_BASIS + MAX_SEEDS):
+      slots = [fsHash(name, seed) & (size - 1) for name in names]
+      if len(set(slots)) == len(slots):
+        return seed, size, slots
+    size *= 2
+#}}}
+
+#{{{
+def fsdataTable(text):
+
+  files = re.findall(r"static const unsigned char data_(\w+)\[\][^=]*= \{\n/\* (\S+) \(\d+ chars\) \*/", text)
+  seed, size, slots = perfect([name for ident, name in files])
+
+  table = ["file_NULL"] * size
+  for (ident, name), slot in zip(files, slots):
+    table[slot] = "file_" + ident
+
+  block = ("// perfect hash of file names, generated by makefshash.py\n"
+           "#define FS_HASH_SEED 0x%08x\n"
+           "#define FS_HASH_SIZE %d\n"
+           "//{{{\n"
+           "static const struct fsdata_file* const fs_hash_table[FS_HASH_SIZE] = {\n" % (seed, size) +
+           "".join("  %s,\n" % entry for entry in table) +
+           "  };\n"
+           "//}}}\n")
+
+  return re.sub(r"// perfect hash of file names.*?\n  \};\n//\}\}\}\n", lambda m: block, text, flags=re.S)
+#}}}
+#{{{
+def routeTable(text):
+
+  body = re.search(r"static const struct http_route http_routes\[HTTP_ROUTE_SIZE\] = \{\n(.*?)  \};\n", text, re.S)
+  entries = [line for line in body.group(1).splitlines() if not line.strip().startswith("{ NULL")]
+  uris = [re.search(r'"([^"]*)"', line).group(1) for line in entries]
+  seed, size, slots = perfect(uris)
+
+  table = ["  { NULL, NULL, NULL },"] * size
+  for line, slot in zip(entries, slots):
+    table[slot] = line
+
+  text = re.sub(r"#define HTTP_ROUTE_SEED .*\n", "#define HTTP_ROUTE_SEED     0x%08x\n" % seed, text)
+  text = re.sub(r"#define HTTP_ROUTE_SIZE .*\n", "#define HTTP_ROUTE_SIZE     %d\n" % size, text)
+  return text[:body.start(1)] + "".join(line + "\n" for line in table) + text[body.end(1):]
+#}}}
+
+#{{{
+def main():
+
+  check = "--check" in sys.argv[1:]
+  stale = []
+  for path, generate in ((FSDATA, fsdataTable), (SERVER, routeTable)):
+    with open(path, newline="") as file:
+      text = file.read()
+    generated = generate(text)
+    if generated != text:
+      stale.append(os.path.basename(path))
+      if not check:
+        with open(path, "w", newline="") as file:
+          file.write(generated)
+
+  if stale:
+    print("makefshash: %s %s" % ("stale" if check else "regenerated", " ".join(stale)))
+  return 1 if (check and stale) else 0
+#}}}
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -0,0 +1,251 @@
+// cEffects.cpp - in place stereo int16 chain between decode and sai, normalise, eq, soft limit
+// - rbj cookbook shelves and peaks, float, the low shelf poles sit within 1e-4 of z = 1 where 16 bit
+//   coeffs would move a 12dB shelf by 2dB
+// - the float planes have the headroom, eq boosts and normalise gain only meet int16 at the limiter
+// - an eq change repacks the cascade and clears its state, a click on a knob turn rather than a wrong sum
+// - the normalise gain ramps linearly over one process
+//{{{  includes
+#include "cEffects.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __ARM_FEATURE_DSP
+  #include "stm32f7xx.h"
+#endif
+//}}}
+
+//{{{
+static const struct {
+  float freq;
+  float q;
+  } kBand[cEffects::kBands] = {
+    {   100.f, 0.707f },   // low shelf
+    {   400.f, 1.0f },
+    {  1000.f, 1.0f },
+    {  2500.f, 1.0f },
+    {  8000.f, 0.707f },   // high shelf
+  };
+//}}}
+static const float kPi = 3.14159265358979f;
+static const float kKneeLevel = cEffects::kKnee * 32767.f;
+static const float kKneeRange = 32767.f - kKneeLevel;
+
+//{{{
+static inline int32_t limit (float value) {
+// soft knee above kKneeLevel, bends towards full scale, never reaches it, rounded
+
+  float magnitude = value < 0.f ? -value : value;
+  if (magnitude > kKneeLevel) {
+    float over = magnitude - kKneeLevel;
+    magnitude = kKneeLevel + ((over * kKneeRange) / (over + kKneeRange));
+    value = value < 0.f ? -magnitude : magnitude;
+    }
+  return (int32_t)(value < 0.f ? value - 0.5f : value + 0.5f);
+  }
+//}}}
+//{{{
+static inline uint32_t packStereo (int32_t left, int32_t right) {
+// saturate both to int16, left in the low half
+
+#ifdef __ARM_FEATURE_DSP
+  return __PKHBT (__SSAT (left, 16), __SSAT (right, 16), 16);
+#else
+  left = left > 32767 ? 32767 : (left < -32768 ? -32768 : left);
+  right = right > 32767 ? 32767 : (right < -32768 ? -32768 : right);
+  return ((uint32_t)left & 0xFFFF) | ((uint32_t)right << 16);
+#endif
+  }
+//}}}
+
+//{{{
+cEffects::cEffects() {
+
+  for (auto band = 0; band < kBands; band++) {
+    mEqDb[band] = 0.f;
+    design (band);
+    }
+  cascade();
+  }
+//}}}
+
+//{{{
+void cEffects::setRate (uint32_t rate) {
+
+  if (rate && (rate != mRate)) {
+    mRate = rate;
+    for (auto band = 0; band < kBands; band++)
+      design (band);
+    cascade();
+    }
+  }
+//}}}
+//{{{
+void cEffects::setEq (int band, float db) {
+
+  if ((band < 0) || (band >= kBands))
+    return;
+
+  db = db > kMaxEqDb ? kMaxEqDb : (db < -kMaxEqDb ? -kMaxEqDb : db);
+  if (db != mEqDb[band]) {
+    mEqDb[band] = db;
+    design (band);
+    cascade();
+    }
+  }
+//}}}
+//{{{
+float cEffects::getBandFreq (int band) {
+  return kBand[band].freq;
+  }
+//}}}
+//{{{
+void cEffects::setNormalise (float db) {
+
+  db = db > kMaxNormaliseDb ? kMaxNormaliseDb : db;
+  mGainTarget = powf (10.f, db / 20.f);
+  }
+//}}}
+
+//{{{
+void cEffects::process (int16_t* samples, int frames) {
+
+  if (frames > kMaxFrames)
+    frames = kMaxFrames;
+  if ((frames <= 0) || (!mStages && (mGain == 1.f) && (mGainTarget == 1.f)))
+    return;
+
+  // stereo words into float planes
+  auto words = (uint32_t*)samples;
+  for (auto i = 0; i < frames; i++) {
+    uint32_t word = words[i];
+    mPlane[0][i] = (float)(int16_t)word;
+    mPlane[1][i] = (float)(int16_t)(word >> 16);
+    }
+
+  if (mStages) {
+    biquads (0, frames);
+    biquads (1, frames);
+    }
+
+  // gain ramp and limiter back into stereo words
+  float gain = mGain;
+  float step = (mGainTarget - mGain) / frames;
+  for (auto i = 0; i < frames; i++) {
+    words[i] = packStereo (limit (mPlane[0][i] * gain), limit (mPlane[1][i] * gain));
+    gain += step;
+    }
+  mGain = mGainTarget;
+  }
+//}}}
+
+// private
+//{{{
+void cEffects::design (int band) {
+// rbj audio eq cookbook, a0 normalised out, a1 a2 negated for the cascade
+
+  float a = powf (10.f, mEqDb[band] / 40.f);
+  float w0 = 2.f * kPi * kBand[band].freq / mRate;
+  float cosW0 = cosf (w0);
+  float alpha = sinf (w0) / (2.f * kBand[band].q);
+
+  float b0, b1, b2, a0, a1, a2;
+  if (band == 0) {
+    //{{{  low shelf
+    float sqrtA = 2.f * sqrtf (a) * alpha;
+    b0 = a * ((a + 1.f) - ((a - 1.f) * cosW0) + sqrtA);
+    b1 = 2.f * a * ((a - 1.f) - ((a + 1.f) * cosW0));
+    b2 = a * ((a + 1.f) - ((a - 1.f) * cosW0) - sqrtA);
+    a0 = (a + 1.f) + ((a - 1.f) * cosW0) + sqrtA;
+    a1 = -2.f * ((a - 1.f) + ((a + 1.f) * cosW0));
+    a2 = (a + 1.f) + ((a - 1.f) * cosW0) - sqrtA;
+    }
+    //}}}
+  else if (band == kBands - 1) {
+    //{{{  high shelf
+    float sqrtA = 2.f * sqrtf (a) * alpha;
+    b0 = a * ((a + 1.f) + ((a - 1.f) * cosW0) + sqrtA);
+    b1 = -2.f * a * ((a - 1.f) + ((a + 1.f) * cosW0));
+    b2 = a * ((a + 1.f) + ((a - 1.f) * cosW0) - sqrtA);
+    a0 = (a + 1.f) - ((a - 1.f) * cosW0) + sqrtA;
+    a1 = 2.f * ((a - 1.f) - ((a + 1.f) * cosW0));
+    a2 = (a + 1.f) - ((a - 1.f) * cosW0) - sqrtA;
+    }
+    //}}}
+  else {
+    //{{{  peak
+    b0 = 1.f + (alpha * a);
+    b1 = -2.f * cosW0;
+    b2 = 1.f - (alpha * a);
+    a0 = 1.f + (alpha / a);
+    a1 = -2.f * cosW0;
+    a2 = 1.f - (alpha / a);
+    }
+    //}}}
+
+  mCoeffs[band][0] = b0 / a0;
+  mCoeffs[band][1] = b1 / a0;
+  mCoeffs[band][2] = b2 / a0;
+  mCoeffs[band][3] = -a1 / a0;
+  mCoeffs[band][4] = -a2 / a0;
+  }
+//}}}
+//{{{
+void cEffects::cascade() {
+// pack the non flat bands, clear the state
+
+  mStages = 0;
+  for (auto band = 0; band < kBands; band++)
+    if (mEqDb[band] != 0.f) {
+      memcpy (mStageCoeffs + (mStages * 5), mCoeffs[band], 5 * sizeof(float));
+      mStages++;
+      }
+  memset (mState, 0, sizeof(mState));
+
+#ifdef USE_CMSIS_DSP
+  for (auto channel = 0; channel < 2; channel++)
+    arm_biquad_cascade_df1_init_f32 (&mCascade[channel], mStages, mStageCoeffs, mState[channel]);
+#endif
+  }
+//}}}
+//{{{
+void cEffects::biquads (int channel, int frames) {
+// in place on one plane, y = b0 x + b1 x1 + b2 x2 + a1 y1 + a2 y2, a already negated
+
+#ifdef USE_CMSIS_DSP
+  arm_biquad_cascade_df1_f32 (&mCascade[channel], mPlane[channel], mPlane[channel], frames);
+
+#else
+  auto plane = mPlane[channel];
+  auto coeffs = mStageCoeffs;
+  auto state = mState[channel];
+
+  for (auto stage = 0; stage < mStages; stage++, coeffs += 5, state += 4) {
+    float b0 = coeffs[0];
+    float b1 = coeffs[1];
+    float b2 = coeffs[2];
+    float a1 = coeffs[3];
+    float a2 = coeffs[4];
+    float x1 = state[0];
+    float x2 = state[1];
+    float y1 = state[2];
+    float y2 = state[3];
+
+    for (auto i = 0; i < frames; i++) {
+      float x0 = plane[i];
+      float y0 = (b0 * x0) + (b1 * x1) + (b2 * x2) + (a1 * y1) + (a2 * y2);
+      x2 = x1;
+      x1 = x0;
+      y2 = y1;
+      y1 = y0;
+      plane[i] = y0;
+      }
+
+    state[0] = x1;
+    state[1] = x2;
+    state[2] = y1;
+    state[3] = y2;
+    }
+#endif
+  }
+//}}}
@@ -0,0 +1,62 @@
+// cEffects.h - in place stereo int16 chain between decode and sai, normalise, eq, soft limit
+// - one word load per stereo frame into two float planes, kBands biquads per plane, normalise gain
+//   and a soft knee limiter on the way back, SSAT and PKHBT into one word store per frame
+// - USE_CMSIS_DSP runs arm_biquad_cascade_df1_f32 from a linked CMSIS-DSP library, otherwise the built in
+//   df1 with the same coeff and state layout, only non flat bands go in the cascade
+// - no hal or rtos, builds on a host to time it and check the responses
+#pragma once
+#include <stdint.h>
+
+#ifdef USE_CMSIS_DSP
+  #ifndef ARM_MATH_CM7
+    #define ARM_MATH_CM7
+  #endif
+  #include "arm_math.h"
+#endif
+
+class cEffects {
+public:
+  static const int kBands = 5;             // low shelf, three peaks, high shelf
+  static const int kMaxFrames = 1152;
+  static constexpr float kMaxEqDb = 12.f;
+  static constexpr float kMaxNormaliseDb = 12.f;
+  static constexpr float kKnee = 0.8f;     // of full scale, limiter starts bending here
+  static const uint32_t kBudgetCycles = 200000;  // per kMaxFrames, about 4% of a frame at 216MHz
+
+  cEffects();
+
+  // redesigns every band, their coeffs are rate dependent
+  void setRate (uint32_t rate);
+  void setEq (int band, float db);
+  float getEq (int band) { return mEqDb[band]; }
+  float getBandFreq (int band);
+
+  // track gain from the loudness scan, ramps over the next process
+  void setNormalise (float db);
+
+  // stereo interleaved in place, frames <= kMaxFrames
+  void process (int16_t* samples, int frames);
+
+private:
+  void design (int band);
+  void cascade();
+  void biquads (int channel, int frames);
+
+  uint32_t mRate = 44100;
+  float mEqDb[kBands];
+  float mGain = 1.f;
+  float mGainTarget = 1.f;
+
+  // per band b0, b1, b2, a1, a2, a negated, arm_biquad_cascade_df1_f32 layout
+  float mCoeffs[kBands][5];
+
+  // active bands packed for the cascade, per channel x1, x2, y1, y2 per stage
+  int mStages = 0;
+  float mStageCoeffs[kBands * 5];
+  float mState[2][kBands * 4];
+#ifdef USE_CMSIS_DSP
+  arm_biquad_casd_df1_inst_f32 mCascade[2];
+#endif
+
+  float mPlane[2][kMaxFrames];
+  };
@@ -0,0 +1,113 @@
+// cHlsAbr.h - choose hls variant bitrate from chunk load time, under the bitrate the user picked
+// - down at once when a chunk takes too long to load or playout starts to rebuffer
+// - up only after kUpLoads chunks in a row with headroom for the higher rate, never above the cap
+// - the cap is the user's choice, the abr choice is separate, a new cap only clamps the choice
+// - a switch takes effect from the next chunk load, chunks already loaded play out at their own rate
+// no rtos or hls dependencies, feed it a recorded trace of load times to evaluate it off target
+#pragma once
+
+class cHlsAbr {
+public:
+  static const int kNumBitrates = 4;
+  //{{{
+  cHlsAbr (int cap) {
+    setCap (cap);
+    mIndex = mCapIndex;
+    }
+  //}}}
+
+  int getBitrate() { return bitrate (mIndex); }
+  int getCap() { return bitrate (mCapIndex); }
+  int getSwitches() { return mSwitches; }
+  int getAvgBitrate() { return mChunks ? int(mBitrateSum / mChunks) : getBitrate(); }
+
+  //{{{
+  void setCap (int cap) {
+  // highest bitrate at or below cap, lowest if none is
+
+    mCapIndex = 0;
+    for (auto i = 0; i < kNumBitrates; i++)
+      if (bitrate (i) <= cap)
+        mCapIndex = i;
+    if (mIndex > mCapIndex) {
+      mIndex = mCapIndex;
+      mUpLoads = 0;
+      }
+    }
+  //}}}
+  //{{{
+  int loaded (int loadMs, int rebuffers, bool firstChunk) {
+  // chunk of getBitrate loaded in loadMs, returns bitrate for the next chunk
+  // - playout waits for the first chunk after setChan, that is not a rebuffer
+
+    if (firstChunk)
+      mRebuffers = rebuffers;
+
+    mChunks++;
+    mBitrateSum += getBitrate();
+
+    // throughput implied by this chunk, smoothed to ride out single slow chunks
+    float bps = float(getBitrate()) * kChunkMs / (loadMs ? loadMs : 1);
+    mBps = mBps > 0.f ? (mBps * 0.7f) + (bps * 0.3f) : bps;
+
+    if ((rebuffers != mRebuffers) || (bps < getBitrate() * kDownMargin))
+      down();
+    else if ((mIndex < mCapIndex) && (mBps > bitrate (mIndex+1) * kUpMargin)) {
+      if (++mUpLoads >= kUpLoads)
+        up();
+      }
+    else
+      mUpLoads = 0;
+
+    mRebuffers = rebuffers;
+    return getBitrate();
+    }
+  //}}}
+  //{{{
+  int failed() {
+  // load failed, treat as no throughput
+
+    mBps = 0.f;
+    down();
+    return getBitrate();
+    }
+  //}}}
+
+private:
+  static constexpr float kChunkMs = 6400.f;  // 300 aac frames of 1024 samples at 48k
+  static constexpr float kDownMargin = 1.2f; // current rate needs 20% headroom to stay
+  static constexpr float kUpMargin = 1.5f;   // next rate needs 50% headroom to move up
+  static const int kUpLoads = 3;
+
+  //{{{
+  static int bitrate (int index) {
+    static const int kBitrates[kNumBitrates] = { 48000, 96000, 128000, 320000 };
+    return kBitrates[index];
+    }
+  //}}}
+  //{{{
+  void down() {
+    mUpLoads = 0;
+    if (mIndex > 0) {
+      mIndex--;
+      mSwitches++;
+      }
+    }
+  //}}}
+  //{{{
+  void up() {
+    mUpLoads = 0;
+    mIndex++;
+    mSwitches++;
+    }
+  //}}}
+
+  int mIndex = 0;
+  int mCapIndex = 0;
+  int mUpLoads = 0;
+  int mSwitches = 0;
+  int mRebuffers = 0;
+  int mChunks = 0;
+  float mBps = 0.f;
+  float mBitrateSum = 0.f;
+  };
@@ -0,0 +1,115 @@
+// cHlsDrift.h - hold hls playout latency against the local audio clock, a ppm trim for the player's cSrc
+// - feed forward, the sai rate measured from half transfer dma timestamps over a long baseline against
+//   the cpu clock, what the pll dividers really give rather than the nominal rate, the big term
+// - feed back, buffer fill ahead of play, low passed over minutes to lose the chunk load sawtooth and
+//   a second of load time jitter, pi on its error from the target, clamped to kMaxPpm with the integral
+//   held while clamped, slow, it only has the crystal against the server's clock left to take out
+// - the target is the latency playout settled at, the mean fill over kLatchTime after a reset, at kMaxPpm
+//   moving it by a chunk would take hours, so hold what startup gave rather than chase a fixed number
+// - positive trim takes input faster, fill over target pushes it up, a fast sai pulls it down
+// no rtos or hls dependencies, feed it timestamps and fills from a simulated clock to evaluate it off target
+#pragma once
+#include <stdint.h>
+
+class cHlsDrift {
+public:
+  static constexpr float kMaxPpm = 500.f;            // 0.9 cents, inaudible
+  static constexpr float kFillTimeConstant = 300.f;  // s, ~50 chunks
+  static constexpr float kLoopTimeConstant = 3600.f; // s, well clear of the fill low pass
+  static constexpr float kMinBaseline = 10.f;        // s of dma timestamps before the rate is trusted
+  static constexpr float kLatchTime = 2.f * kFillTimeConstant;
+
+  //{{{
+  cHlsDrift (float rate) : mRate(rate) {
+  // pi gains for a critically damped loop round the fill integrator, fill' = -rate * 1e-6 * ppm
+
+    float plant = rate * 1e-6f;
+    mKp = 1.f / (plant * kLoopTimeConstant);
+    mKi = (plant * mKp * mKp) / 4.f;
+    }
+  //}}}
+
+  //{{{
+  void reset() {
+  // channel change or rebuffer, the sai rate estimate survives, it is a property of the board
+
+    mFill = 0.f;
+    mFillTime = 0.f;
+    mTarget = 0.f;
+    mIntegral = 0.f;
+    }
+  //}}}
+
+  //{{{
+  void dmaGap() {
+  // dma timestamps stop being fed, scrubbing, the next call starts a new interval rather than
+  // spanning the gap, 32 bit cycles wrap every ~20s at 216MHz, the baseline so far survives
+
+    mDmaCalls = 0;
+    }
+  //}}}
+  //{{{
+  void dma (uint32_t cycles, uint32_t cpuHz, uint32_t samples) {
+  // samples played by the sai up to the half transfer done at cycles, since the last call,
+  // wrap safe while calls come well inside 2^32 cycles
+
+    if (mDmaCalls++) {
+      mDmaCycles += (uint32_t)(cycles - mLastCycles);
+      mDmaSamples += samples;
+      // double, a day of cycles and samples is well past float's 24 bits, a ppm needs 20 of them
+      double seconds = (double)mDmaCycles / cpuHz;
+      if (seconds >= kMinBaseline)
+        mSaiPpm = (float)(((((double)mDmaSamples / seconds) / mRate) - 1.) * 1e6);
+      }
+    mLastCycles = cycles;
+    }
+  //}}}
+  //{{{
+  void fill (float samples, float seconds) {
+  // buffered samples ahead of play, seconds since the last fill
+
+    // mean until the target latches, low pass after
+    mFillTime += seconds;
+    if (mTarget == 0.f)
+      mFill += (samples - mFill) * (seconds / mFillTime);
+    else
+      mFill += (samples - mFill) * (seconds / (kFillTimeConstant + seconds));
+
+    // feed forward alone until the target latches
+    float ppm = -mSaiPpm;
+    if (mFillTime >= kLatchTime) {
+      if (mTarget == 0.f)
+        mTarget = mFill;
+
+      float error = mFill - mTarget;
+      ppm += (mKp * error) + (mKi * (mIntegral + (error * seconds)));
+      if ((ppm < kMaxPpm) && (ppm > -kMaxPpm))
+        mIntegral += error * seconds;
+      }
+
+    mTrim = ppm > kMaxPpm ? kMaxPpm : (ppm < -kMaxPpm ? -kMaxPpm : ppm);
+    }
+  //}}}
+
+  float getTrim() { return mTrim; }
+  float getSaiPpm() { return mSaiPpm; }
+  float getFill() { return mFill; }
+  float getTarget() { return mTarget; }
+
+private:
+  const float mRate;
+  float mTarget = 0.f;
+  float mFillTime = 0.f;
+  float mKp;
+  float mKi;
+
+  uint32_t mDmaCalls = 0;
+  uint32_t mLastCycles = 0;
+  uint64_t mDmaCycles = 0;
+  uint64_t mDmaSamples = 0;
+  float mSaiPpm = 0.f;
+
+  float mFill = 0.f;
+  float mIntegral = 0.f;
+  float mTrim = 0.f;
+  };
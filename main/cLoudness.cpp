@@ -0,0 +1,145 @@
+// cLoudness.cpp - ebu r128 integrated loudness of a track, for a replaygain 2.0 style normalise gain
+// - k weighting coeffs are derived for the track rate from the bs.1770 48k prototypes, as libebur128 does
+// - a histogram bin stands for its centre energy, which puts the gated mean within 0.05 LU
+//{{{  includes
+#include "cLoudness.h"
+
+#include <math.h>
+#include <string.h>
+//}}}
+
+static const double kPi = 3.14159265358979323846;
+
+//{{{
+static float lufsToEnergy (float lufs) {
+  return powf (10.f, (lufs + 0.691f) / 10.f);
+  }
+//}}}
+//{{{
+static float energyToLufs (float energy) {
+  return -0.691f + (10.f * log10f (energy + 1e-20f));
+  }
+//}}}
+
+//{{{
+void cLoudness::reset (uint32_t rate) {
+
+  mRate = rate ? rate : 44100;
+
+  // stage 1, high shelf, head as a rigid sphere
+  double f0 = 1681.974450955533;
+  double gain = 3.999843853973347;
+  double q = 0.7071752369554196;
+  double k = tan (kPi * f0 / mRate);
+  double vh = pow (10.0, gain / 20.0);
+  double vb = pow (vh, 0.4996667741545416);
+  double a0 = 1.0 + (k / q) + (k * k);
+  mShelf.b0 = (float)((vh + (vb * k / q) + (k * k)) / a0);
+  mShelf.b1 = (float)((2.0 * ((k * k) - vh)) / a0);
+  mShelf.b2 = (float)((vh - (vb * k / q) + (k * k)) / a0);
+  mShelf.a1 = (float)((2.0 * ((k * k) - 1.0)) / a0);
+  mShelf.a2 = (float)((1.0 - (k / q) + (k * k)) / a0);
+
+  // stage 2, rlb high pass
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan (kPi * f0 / mRate);
+  a0 = 1.0 + (k / q) + (k * k);
+  mHighPass.b0 = 1.f;
+  mHighPass.b1 = -2.f;
+  mHighPass.b2 = 1.f;
+  mHighPass.a1 = (float)((2.0 * ((k * k) - 1.0)) / a0);
+  mHighPass.a2 = (float)((1.0 - (k / q) + (k * k)) / a0);
+
+  for (auto channel = 0; channel < 2; channel++) {
+    mShelf.z1[channel] = mShelf.z2[channel] = 0.f;
+    mHighPass.z1[channel] = mHighPass.z2[channel] = 0.f;
+    }
+
+  mSubFrames = mRate / 10;
+  mSubFrame = 0;
+  mSubEnergy = 0.f;
+  mSubBlocks = 0;
+  mBlocks = 0;
+  memset (mHistogram, 0, sizeof(mHistogram));
+  }
+//}}}
+//{{{
+void cLoudness::push (const int16_t* samples, int frames) {
+
+  const float kScale = 1.f / 32768.f;
+
+  for (auto i = 0; i < frames; i++) {
+    for (auto channel = 0; channel < 2; channel++) {
+      float value = filter (mShelf, channel, samples[2*i + channel] * kScale);
+      value = filter (mHighPass, channel, value);
+      mSubEnergy += value * value;
+      }
+
+    if (++mSubFrame == mSubFrames) {
+      mSubEnergies[mSubBlocks & 3] = mSubEnergy / mSubFrames;
+      mSubBlocks++;
+      mSubFrame = 0;
+      mSubEnergy = 0.f;
+      if (mSubBlocks >= 4)
+        block();
+      }
+    }
+  }
+//}}}
+//{{{
+float cLoudness::getLufs() {
+
+  // absolute gate is the bottom of the histogram, mean of everything in it
+  double energy = 0.0;
+  uint32_t count = 0;
+  for (auto bin = 0; bin < kBins; bin++)
+    if (mHistogram[bin]) {
+      energy += mHistogram[bin] * (double)lufsToEnergy (kMinLufs + ((bin + 0.5f) / 10.f));
+      count += mHistogram[bin];
+      }
+  if (!count)
+    return kMinLufs;
+
+  // relative gate 10 LU under that
+  float gate = energyToLufs ((float)(energy / count)) - 10.f;
+  int gateBin = (int)ceilf ((gate - kMinLufs) * 10.f);
+  gateBin = gateBin < 0 ? 0 : gateBin;
+
+  energy = 0.0;
+  count = 0;
+  for (auto bin = gateBin; bin < kBins; bin++)
+    if (mHistogram[bin]) {
+      energy += mHistogram[bin] * (double)lufsToEnergy (kMinLufs + ((bin + 0.5f) / 10.f));
+      count += mHistogram[bin];
+      }
+
+  return count ? energyToLufs ((float)(energy / count)) : kMinLufs;
+  }
+//}}}
+
+// private
+//{{{
+float cLoudness::filter (tBiquad& biquad, int channel, float in) {
+// transposed df2
+
+  float out = (biquad.b0 * in) + biquad.z1[channel];
+  biquad.z1[channel] = (biquad.b1 * in) - (biquad.a1 * out) + biquad.z2[channel];
+  biquad.z2[channel] = (biquad.b2 * in) - (biquad.a2 * out);
+  return out;
+  }
+//}}}
+//{{{
+void cLoudness::block() {
+// 400ms block, mean of the last four sub block energies, channel weights 1 for left and right
+
+  float energy = (mSubEnergies[0] + mSubEnergies[1] + mSubEnergies[2] + mSubEnergies[3]) / 4.f;
+  float lufs = energyToLufs (energy);
+  if (lufs < kMinLufs)
+    return;
+
+  int bin = (int)((lufs - kMinLufs) * 10.f);
+  mHistogram[bin < kBins ? bin : kBins - 1]++;
+  mBlocks++;
+  }
+//}}}
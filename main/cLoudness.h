@@ -0,0 +1,52 @@
+// cLoudness.h - ebu r128 integrated loudness of a track, for a replaygain 2.0 style normalise gain
+// - bs.1770 k weighting, 400ms blocks every 100ms, -70 LUFS absolute and -10 LU relative gates
+// - gated blocks land in a 0.1 LU histogram rather than a list, any track length in fixed memory
+// - float, runs on the wave scan thread, no hal or rtos, builds on a host
+#pragma once
+#include <stdint.h>
+
+class cLoudness {
+public:
+  static constexpr float kReferenceLufs = -18.f;   // replaygain 2.0
+  static constexpr float kMinLufs = -70.f;
+  static constexpr float kMaxLufs = 5.f;
+  static const int kBins = 750;                    // kMinLufs to kMaxLufs in 0.1 LU
+
+  cLoudness() { reset (44100); }
+
+  void reset (uint32_t rate);
+
+  // stereo interleaved, any frame count
+  void push (const int16_t* samples, int frames);
+
+  // integrated so far, kMinLufs until a block passes the gate
+  float getLufs();
+  float getGainDb() { return kReferenceLufs - getLufs(); }
+  int getBlocks() { return mBlocks; }
+
+private:
+  //{{{
+  struct tBiquad {
+    float b0, b1, b2, a1, a2;
+    float z1[2];
+    float z2[2];
+    };
+  //}}}
+
+  float filter (tBiquad& biquad, int channel, float in);
+  void block();
+
+  uint32_t mRate = 44100;
+  tBiquad mShelf;
+  tBiquad mHighPass;
+
+  // 100ms sub blocks, last four make a block
+  int mSubFrames = 4410;
+  int mSubFrame = 0;
+  float mSubEnergy = 0.f;
+  float mSubEnergies[4];
+  int mSubBlocks = 0;
+
+  int mBlocks = 0;
+  uint32_t mHistogram[kBins];
+  };
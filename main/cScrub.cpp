@@ -0,0 +1,176 @@
+// cScrub.cpp - waveform scrubbing, decoded pcm grains around the drag position, played pitch stable at the drag velocity
+// - the head is the last drag position plus velocity times output frames since, so a grain a hop later starts a hop
+//   of source later at velocity 1, consecutive grains line up and the overlap add gives back the source exactly
+// - velocity is the drag step over the output frames between drags, halved towards each new one, a drag after
+//   a hold says nothing about speed and restarts it from 0
+// - an uncached frame reads as silence, the grain still windows so a gap fades rather than clicks
+//{{{  includes
+#include "cScrub.h"
+
+#include <math.h>
+#include <string.h>
+//}}}
+
+static const float kPi = 3.14159265358979f;
+
+//{{{
+static inline int16_t saturate (int32_t value) {
+  return value > 32767 ? 32767 : (value < -32768 ? -32768 : (int16_t)value);
+  }
+//}}}
+
+//{{{
+cScrub::cScrub (int frameSamples) : mFrameSamples(frameSamples) {
+
+  mCache = new int16_t[kSlots * frameSamples * 2];
+  for (auto i = 0; i < kHop; i++)
+    mRise[i] = (int32_t)((32768.f * (0.5f - (0.5f * cosf ((kPi * i) / kHop)))) + 0.5f);
+  reset();
+  }
+//}}}
+//{{{
+cScrub::~cScrub() {
+  delete[] mCache;
+  }
+//}}}
+
+//{{{
+void cScrub::reset() {
+
+  for (auto slot = 0; slot < kSlots; slot++)
+    mSlotFrame[slot] = -1;
+  }
+//}}}
+
+//{{{
+void cScrub::start (int frame) {
+// play was audible up to here, full level, a grain in on its rising half
+
+  mDragPos = (int64_t)frame * mFrameSamples;
+  mDragClock = mClock;
+  mHead = mDragPos;
+  mLastGrain = -1;
+  mVelocity = 0.f;
+  mLevel = 32768;
+  }
+//}}}
+//{{{
+void cScrub::drag (int frame) {
+
+  auto pos = (int64_t)frame * mFrameSamples;
+  auto since = mClock - mDragClock;
+  if (since > 0) {
+    float velocity = since < kHoldFrames ? (float)(pos - mDragPos) / (float)since : 0.f;
+    velocity = velocity > kMaxVelocity ? kMaxVelocity : (velocity < -kMaxVelocity ? -kMaxVelocity : velocity);
+    mVelocity = since < kHoldFrames ? mVelocity + ((velocity - mVelocity) * 0.5f) : 0.f;
+    mDragClock = mClock;
+    }
+  mDragPos = pos;
+  }
+//}}}
+
+//{{{
+bool cScrub::getCached (int frame) {
+  return (frame >= 0) && (mSlotFrame[frame % kSlots] == frame);
+  }
+//}}}
+//{{{
+int16_t* cScrub::getSlot (int frame) {
+
+  auto slot = frame % kSlots;
+  mSlotFrame[slot] = frame;
+  return mCache + (slot * mFrameSamples * 2);
+  }
+//}}}
+//{{{
+bool cScrub::getWork (int& first, int& count, int lastFrame) {
+
+  auto head = getHeadFrame();
+  auto way = mVelocity < 0.f ? -1 : 1;
+
+  for (auto step = 0; step <= kAhead + kBehind; step++) {
+    // out to kAhead in the drag direction, then out to kBehind the other way
+    auto scanWay = step <= kAhead ? way : -way;
+    auto frame = head + (step <= kAhead ? way * step : -way * (step - kAhead));
+    if ((frame >= 0) && (frame < lastFrame) && !getCached (frame)) {
+      // run on the way the scan went, inside the window
+      auto end = frame;
+      count = 1;
+      while (count < kRun) {
+        auto next = end + scanWay;
+        auto offset = (next - head) * way;
+        if ((next < 0) || (next >= lastFrame) || (offset > kAhead) || (offset < -kBehind) || getCached (next))
+          break;
+        end = next;
+        count++;
+        }
+
+      first = scanWay > 0 ? frame : end;
+      return true;
+      }
+    }
+
+  return false;
+  }
+//}}}
+
+//{{{
+void cScrub::render (int16_t* out) {
+
+  // head extrapolated from the last drag, stops at kHoldFrames
+  auto since = mClock - mDragClock;
+  auto moving = since < kHoldFrames;
+  mHead = mDragPos + (int64_t)floorf ((mVelocity * (float)(moving ? since : kHoldFrames)) + 0.5f);
+  if (mHead < 0)
+    mHead = 0;
+
+  // falling half of the last grain, rising half of one at the head
+  memset (mMix, 0, sizeof(mMix));
+  if (mLastGrain >= 0)
+    grain (mLastGrain + kHop, false);
+  grain (mHead, true);
+  mLastGrain = mHead;
+
+  // level ramps a frame at a time towards moving or held
+  int32_t target = moving ? 32768 : 0;
+  int32_t step = 32768 / kFadeFrames;
+  for (auto i = 0; i < kHop; i++) {
+    if (mLevel < target)
+      mLevel = mLevel + step > target ? target : mLevel + step;
+    else if (mLevel > target)
+      mLevel = mLevel - step < target ? target : mLevel - step;
+    out[2*i] = saturate (((mMix[2*i] >> 15) * mLevel) >> 15);
+    out[2*i + 1] = saturate (((mMix[2*i + 1] >> 15) * mLevel) >> 15);
+    }
+
+  mClock += kHop;
+  }
+//}}}
+
+// private
+//{{{
+const int16_t* cScrub::getFrame (int frame) {
+  return getCached (frame) ? mCache + ((frame % kSlots) * mFrameSamples * 2) : nullptr;
+  }
+//}}}
+//{{{
+void cScrub::grain (int64_t start, bool rising) {
+// kHop frames of a grain from start, rising or falling half of the window, added into mMix
+
+  auto frame = (int)(start / mFrameSamples);
+  auto index = (int)(start % mFrameSamples);
+  auto pcm = getFrame (frame);
+
+  for (auto i = 0; i < kHop; i++) {
+    if (pcm) {
+      int32_t window = rising ? mRise[i] : 32768 - mRise[i];
+      mMix[2*i] += pcm[2*index] * window;
+      mMix[2*i + 1] += pcm[(2*index) + 1] * window;
+      }
+    if (++index == mFrameSamples) {
+      index = 0;
+      pcm = getFrame (++frame);
+      }
+    }
+  }
+//}}}
@@ -0,0 +1,65 @@
+// cScrub.h - waveform scrubbing, decoded pcm grains around the drag position, played pitch stable at the drag velocity
+// - a cache of kSlots decoded frames, slot frame % kSlots, the window round the head never evicts itself,
+//   the caller decodes or copies what getWork and getCached say is missing, heap allocated, lands in sdram
+// - the head follows drag positions, extrapolated at the smoothed drag velocity between them, touch reports
+//   only step it a frame at a time
+// - every kHop output frames a kGrain hann grain starts at the head, read at the source rate so pitch holds
+//   whatever the drag speed, 50% overlap sums to unity, each grain crossfades into the next
+// - held still for kHoldFrames the level fades over kFadeFrames, silence rather than a buzzing loop
+// no hal, rtos or decoder, builds on a host
+#pragma once
+#include <stdint.h>
+
+class cScrub {
+public:
+  static const int kSlots = 64;           // frames of pcm, 1.7s of 1152 at 44.1k
+  static const int kHop = 256;            // output frames per render, a new grain each
+  static const int kGrain = 2 * kHop;
+  static const int kAhead = 40;           // frames cached in the drag direction
+  static const int kBehind = 16;          // and behind, kAhead + kBehind < kSlots
+  static const int kRun = 8;              // most frames getWork asks for at once
+  static const int kHoldFrames = 4096;    // output frames without a drag before the fade
+  static const int kFadeFrames = 2048;
+  static constexpr float kMaxVelocity = 16.f;
+
+  cScrub (int frameSamples);
+  ~cScrub();
+
+  // new source, empties the cache
+  void reset();
+
+  // drag positions in frames, start from where play was
+  void start (int frame);
+  void drag (int frame);
+  int getHeadFrame() { return (int)(mHead / mFrameSamples); }
+  float getVelocity() { return mVelocity; }
+
+  // cache, getSlot marks frame cached, the caller fills frameSamples stereo before the next render
+  bool getCached (int frame);
+  int16_t* getSlot (int frame);
+
+  // uncached run nearest the head below lastFrame, ahead first, in file order for a decoder, false if none
+  bool getWork (int& first, int& count, int lastFrame);
+
+  // kHop stereo interleaved frames
+  void render (int16_t* out);
+
+private:
+  const int16_t* getFrame (int frame);
+  void grain (int64_t start, bool rising);
+
+  const int mFrameSamples;
+  int16_t* mCache = nullptr;
+  int mSlotFrame[kSlots];
+
+  int32_t mRise[kHop];                    // q15 hann first half, fall is 32768 - rise
+  int32_t mMix[kHop * 2];
+
+  int64_t mClock = 0;                     // output frames rendered
+  int64_t mDragClock = 0;
+  int64_t mDragPos = 0;                   // samples
+  int64_t mHead = 0;
+  int64_t mLastGrain = -1;
+  float mVelocity = 0.f;                  // source samples per output frame
+  int32_t mLevel = 0;                     // q15
+  };
@@ -0,0 +1,234 @@
+// cSpectrum.cpp - pcm tap to log spaced band levels with peak hold, for a bar graph
+// - the ring index is published after the samples, a render reading while the play thread wraps
+//   sees at worst a torn window for one frame, nothing waits on anything
+// - the built in fft is a kFftLen/2 point complex radix 2 on even, odd sample pairs, then the real split,
+//   same packing as arm_rfft_fast_f32, out[0] dc, out[1] nyquist, then re, im from bin 1
+//{{{  includes
+#include "cSpectrum.h"
+
+#include <math.h>
+#include <string.h>
+//}}}
+
+static const double kPi = 3.14159265358979323846;
+static const float kFallPerFrame = 0.03f;
+static const float kPeakFallPerFrame = 0.01f;
+
+//{{{
+cSpectrum::cSpectrum() {
+
+  // hann, coherent gain 0.5, window and twiddles worked in double once here, a float pi and angle put
+  // them up to 2e-7 out, more than the float fft itself loses
+  for (auto i = 0; i < kFftLen; i++)
+    mWindow[i] = (float)(0.5 - 0.5 * cos ((2.0 * kPi * i) / kFftLen));
+
+#ifdef USE_CMSIS_DSP
+  arm_rfft_fast_init_f32 (&mRfft, kFftLen);
+#else
+  for (auto k = 0; k < kFftLen / 2; k++) {
+    mTwiddle[2*k] = (float)cos ((2.0 * kPi * k) / kFftLen);
+    mTwiddle[2*k + 1] = (float)sin ((2.0 * kPi * k) / kFftLen);
+    }
+
+  int bits = 0;
+  while ((1 << bits) < kFftLen / 2)
+    bits++;
+  for (auto i = 0; i < kFftLen / 2; i++) {
+    int reversed = 0;
+    for (auto bit = 0; bit < bits; bit++)
+      if (i & (1 << bit))
+        reversed |= 1 << (bits - 1 - bit);
+    mBitReverse[i] = reversed;
+    }
+#endif
+
+  memset (mRing, 0, sizeof(mRing));
+  memset (mOut, 0, sizeof(mOut));
+  for (auto band = 0; band < kBands; band++) {
+    mLevels[band] = 0.f;
+    mPeaks[band] = 0.f;
+    mPeakHold[band] = 0;
+    }
+  }
+//}}}
+
+//{{{
+void cSpectrum::push (const int16_t* samples, int frames) {
+
+  uint32_t write = mRingWrite;
+  for (auto i = 0; i < frames; i++)
+    mRing[(write + i) & (kRingLen-1)] = (samples[2*i] + samples[2*i + 1]) >> 1;
+
+  // samples before index
+  __sync_synchronize();
+  mRingWrite = write + frames;
+  }
+//}}}
+//{{{
+void cSpectrum::setRate (uint32_t rate) {
+
+  if (rate != mRate) {
+    mRate = rate;
+    mRateChanged = true;
+    }
+  }
+//}}}
+
+//{{{
+void cSpectrum::analyse() {
+
+  if (mRateChanged) {
+    mRateChanged = false;
+    setBands();
+    }
+
+  uint32_t start = mRingWrite - kFftLen;
+  __sync_synchronize();
+  for (auto i = 0; i < kFftLen; i++)
+    mIn[i] = mRing[(start + i) & (kRingLen-1)] * mWindow[i];
+
+  fft (mIn, mOut);
+
+  for (auto band = 0; band < kBands; band++) {
+    // loudest bin in band, a tone reads the same whatever the band width
+    float power = 0.f;
+    for (auto bin = mBandBin[band]; bin < mBandBin[band+1]; bin++) {
+      float binPower = getBinPower (bin);
+      if (binPower > power)
+        power = binPower;
+      }
+
+    float level = ((10.f * log10f (power + 1e-12f)) - kFloorDb) / -kFloorDb;
+    level = level < 0.f ? 0.f : (level > 1.f ? 1.f : level);
+
+    // bars jump up, fall back slowly
+    mLevels[band] = level > mLevels[band] - kFallPerFrame ? level : mLevels[band] - kFallPerFrame;
+
+    if (mLevels[band] >= mPeaks[band]) {
+      mPeaks[band] = mLevels[band];
+      mPeakHold[band] = kPeakHoldFrames;
+      }
+    else if (mPeakHold[band])
+      mPeakHold[band]--;
+    else if (mPeaks[band] > kPeakFallPerFrame)
+      mPeaks[band] -= kPeakFallPerFrame;
+    else
+      mPeaks[band] = 0.f;
+    }
+  }
+//}}}
+//{{{
+float cSpectrum::getBinPower (int bin) {
+// full scale int16 sine through the hann window peaks at 32768 * kFftLen / 4
+
+  const float kFullScale = 32768.f * (kFftLen / 4);
+  const float kNorm = 1.f / (kFullScale * kFullScale);
+
+  if (bin <= 0)
+    return mOut[0] * mOut[0] * kNorm;
+  else if (bin >= kFftLen / 2)
+    return mOut[1] * mOut[1] * kNorm;
+  else
+    return ((mOut[2*bin] * mOut[2*bin]) + (mOut[2*bin + 1] * mOut[2*bin + 1])) * kNorm;
+  }
+//}}}
+
+// private
+//{{{
+void cSpectrum::setBands() {
+// log spaced edges kMinFreq to nyquist, every band at least one bin, none below bin 1
+
+  float maxFreq = mRate / 2.f;
+  float binsPerHz = (float)kFftLen / mRate;
+
+  // first edge at kMinFreq, bin 1 alone was a band of rumble under it
+  int minBin = (int)(kMinFreq * binsPerHz + 0.5f);
+  mBandBin[0] = minBin < 1 ? 1 : minBin;
+  for (auto band = 1; band <= kBands; band++) {
+    float freq = kMinFreq * powf (maxFreq / kMinFreq, (float)band / kBands);
+    int bin = (int)(freq * binsPerHz + 0.5f);
+    if (bin <= mBandBin[band-1])
+      bin = mBandBin[band-1] + 1;
+    mBandBin[band] = bin > kFftLen / 2 ? kFftLen / 2 : bin;
+    }
+
+  for (auto band = 0; band < kBands; band++)
+    mBandFreq[band] = sqrtf ((float)mBandBin[band] * mBandBin[band+1]) / binsPerHz;
+  }
+//}}}
+//{{{
+void cSpectrum::fft (float* in, float* out) {
+
+#ifdef USE_CMSIS_DSP
+  arm_rfft_fast_f32 (&mRfft, in, out, 0);
+
+#else
+  const int kHalf = kFftLen / 2;
+
+  // even, odd pairs as complex, bit reversed
+  for (auto i = 0; i < kHalf; i++) {
+    auto j = mBitReverse[i];
+    out[2*j] = in[2*i];
+    out[2*j + 1] = in[2*i + 1];
+    }
+
+  // radix 2 stages, twiddle exp(-2 pi i j / size) is table entry j * kFftLen / size
+  for (auto size = 2; size <= kHalf; size *= 2) {
+    auto half = size / 2;
+    auto step = kFftLen / size;
+    for (auto group = 0; group < kHalf; group += size) {
+      for (auto j = 0; j < half; j++) {
+        float wr = mTwiddle[2 * j * step];
+        float wi = -mTwiddle[2 * j * step + 1];
+        float* a = out + 2 * (group + j);
+        float* b = a + 2 * half;
+        float tr = (wr * b[0]) - (wi * b[1]);
+        float ti = (wr * b[1]) + (wi * b[0]);
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+        }
+      }
+    }
+
+  // real split, X[k] = (Z[k] + conj Z[half-k]) / 2 - i W^k (Z[k] - conj Z[half-k]) / 2, k and half-k together
+  float z0r = out[0];
+  float z0i = out[1];
+  out[0] = z0r + z0i;
+  out[1] = z0r - z0i;
+
+  for (auto k = 1; k <= kHalf / 2; k++) {
+    auto m = kHalf - k;
+    float ar = out[2*k];
+    float ai = out[2*k + 1];
+    float br = out[2*m];
+    float bi = out[2*m + 1];
+
+    // k, W^k = cos - i sin
+    float er = (ar + br) * 0.5f;
+    float ei = (ai - bi) * 0.5f;
+    float or_ = (ai + bi) * 0.5f;
+    float oi = (br - ar) * 0.5f;
+    float wr = mTwiddle[2*k];
+    float wi = -mTwiddle[2*k + 1];
+    float xkr = er + (wr * or_) - (wi * oi);
+    float xki = ei + (wr * oi) + (wi * or_);
+
+    // half-k, W^(half-k) = -cos - i sin, roles of the two inputs swapped
+    er = (br + ar) * 0.5f;
+    ei = (bi - ai) * 0.5f;
+    or_ = (bi + ai) * 0.5f;
+    oi = (ar - br) * 0.5f;
+    wr = -mTwiddle[2*k];
+    float xmr = er + (wr * or_) - (wi * oi);
+    float xmi = ei + (wr * oi) + (wi * or_);
+
+    out[2*k] = xkr;
+    out[2*k + 1] = xki;
+    out[2*m] = xmr;
+    out[2*m + 1] = xmi;
+    }
+#endif
+  }
+//}}}
@@ -0,0 +1,68 @@
+// cSpectrum.h - pcm tap to log spaced band levels with peak hold, for a bar graph
+// - the play thread pushes into a ring and never waits, the render thread analyses the latest kFftLen samples
+// - hann window, real fft packed as arm_rfft_fast_f32, bins grouped into kBands log spaced bands
+// - USE_CMSIS_DSP runs arm_rfft_fast_f32 from a linked CMSIS-DSP library, otherwise the built in radix 2 fft,
+//   no hal or rtos either way, builds on a host against the CMSIS reference C sources to check bins
+#pragma once
+#include <stdint.h>
+
+#ifdef USE_CMSIS_DSP
+  #ifndef ARM_MATH_CM7
+    #define ARM_MATH_CM7
+  #endif
+  #include "arm_math.h"
+#endif
+
+class cSpectrum {
+public:
+  static const int kFftLen = 1024;
+  static const int kBands = 32;
+  static const int kRingLen = 2048;        // power of 2, at least kFftLen plus a frame
+  static const int kPeakHoldFrames = 30;
+  static constexpr float kFloorDb = -72.f;
+  static constexpr float kMinFreq = 80.f;
+
+  cSpectrum();
+
+  // play thread, stereo int16 interleaved, copies into the ring, never blocks
+  void push (const int16_t* samples, int frames);
+  void setRate (uint32_t rate);
+
+  // render thread, window and fft the latest kFftLen samples, then band levels and peaks
+  void analyse();
+
+  // 0 floor .. 1 full scale sine
+  const float* getLevels() { return mLevels; }
+  const float* getPeaks() { return mPeaks; }
+  float getBandFreq (int band) { return mBandFreq[band]; }
+
+  // power, full scale sine in bin is 1, from the last analyse
+  float getBinPower (int bin);
+
+private:
+  void setBands();
+  void fft (float* in, float* out);
+
+  uint32_t mRate = 44100;
+  bool mRateChanged = true;
+
+  int16_t mRing[kRingLen];
+  volatile uint32_t mRingWrite = 0;
+
+  float mWindow[kFftLen];
+  float mIn[kFftLen];
+  float mOut[kFftLen];
+
+  uint16_t mBandBin[kBands + 1];
+  float mBandFreq[kBands];
+  float mLevels[kBands];
+  float mPeaks[kBands];
+  int mPeakHold[kBands];
+
+#ifdef USE_CMSIS_DSP
+  arm_rfft_fast_instance_f32 mRfft;
+#else
+  float mTwiddle[kFftLen];                 // cos, sin pairs of exp(-2 pi i k / kFftLen), k < kFftLen/2
+  uint16_t mBitReverse[kFftLen / 2];
+#endif
+  };
@@ -0,0 +1,45 @@
+// cSpectrumWidget.h - cSpectrum band bars with peak hold
+// - analyses on render, so only when shown and only on the render thread
+// - all bars then all peaks, same width throughout, the dma2d list gets one colour and one stride
+//   write per pass and a bare address, size, start per rect
+#pragma once
+#include "widgets/cWidget.h"
+#include "cSpectrum.h"
+
+class cSpectrumWidget : public cWidget {
+public:
+  cSpectrumWidget (cSpectrum* spectrum, float width, float height)
+    : cWidget (COL_BLACK, width, height), mSpectrum(spectrum) {}
+  virtual ~cSpectrumWidget() {}
+
+  //{{{
+  virtual void render (iDraw* draw) {
+
+    mSpectrum->analyse();
+    auto levels = mSpectrum->getLevels();
+    auto peaks = mSpectrum->getPeaks();
+
+    int16_t pitch = mWidth / cSpectrum::kBands;
+    uint16_t barWidth = pitch > 1 ? pitch - 1 : 1;
+    int16_t range = mHeight - kPeakHeight;
+    int16_t bottom = mY + mHeight;
+
+    for (auto band = 0; band < cSpectrum::kBands; band++) {
+      int16_t height = int16_t(levels[band] * range);
+      if (height > 0)
+        draw->rect (COL_GREEN, mX + band * pitch, bottom - height, barWidth, height);
+      }
+
+    for (auto band = 0; band < cSpectrum::kBands; band++) {
+      int16_t height = int16_t(peaks[band] * range);
+      if (height > 0)
+        draw->rect (COL_YELLOW, mX + band * pitch, bottom - height - kPeakHeight, barWidth, kPeakHeight);
+      }
+    }
+  //}}}
+
+private:
+  static const int16_t kPeakHeight = 2;
+
+  cSpectrum* mSpectrum;
+  };
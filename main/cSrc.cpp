@@ -0,0 +1,278 @@
+// cSrc.cpp - polyphase sample rate converter, stereo int16 in, stereo int16 out at a fixed codec rate
+// - history is per channel so a tap pair is two adjacent int16, one unaligned word load, one SMLALD
+// - output n is the prototype centred kTaps/2 after history sample floor(pos), phase from the top bits of pos,
+//   each phase normalised to unity dc gain, low takes the nearest phase, medium and high blend the two either
+//   side by the next 15 bits, the table has one extra row, phase 0 a tap on, so the blend never wraps
+// - cutoff at 0.45 of the lower rate, kaiser beta from the quality, tables built once per rate change
+//{{{  includes
+#include "cSrc.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __ARM_FEATURE_DSP
+  #include "stm32f7xx.h"
+#endif
+//}}}
+
+//{{{
+static const struct {
+  int taps;
+  int phaseBits;
+  float beta;
+  bool blend;
+  } kQuality[] = {
+    {  8, 5, 5.f, false },
+    { 16, 6, 7.f, true },
+    { 32, 7, 9.f, true },
+  };
+//}}}
+static const double kPi = 3.14159265358979323846;
+static const double kCutoff = 0.45;
+
+//{{{
+static inline uint64_t smlald (uint32_t x, uint32_t y, uint64_t acc) {
+// acc + x.lo * y.lo + x.hi * y.hi, signed int16 halves
+
+#ifdef __ARM_FEATURE_DSP
+  return __SMLALD (x, y, acc);
+#else
+  return acc + (int64_t)((int16_t)x * (int16_t)y) + (int64_t)((int16_t)(x >> 16) * (int16_t)(y >> 16));
+#endif
+  }
+//}}}
+//{{{
+static inline int16_t saturate (int64_t acc) {
+// q30 to q15, rounded
+
+  acc = (acc + (1 << 14)) >> 15;
+  return acc > 32767 ? 32767 : (acc < -32768 ? -32768 : (int16_t)acc);
+  }
+//}}}
+//{{{
+static double besselI0 (double x) {
+
+  double sum = 1.0;
+  double term = 1.0;
+  for (auto k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+    }
+  return sum;
+  }
+//}}}
+
+//{{{
+cSrc::~cSrc() {
+  delete[] mCoeffs;
+  }
+//}}}
+
+//{{{
+bool cSrc::setRates (uint32_t inRate, uint32_t outRate, eQuality quality) {
+
+  if (!inRate || !outRate)
+    return false;
+  if (mCoeffs && (inRate == mInRate) && (outRate == mOutRate) && (quality == mQuality))
+    return true;
+
+  mInRate = inRate;
+  mOutRate = outRate;
+  mQuality = quality;
+  mTaps = kQuality[quality].taps;
+  mPhaseShift = 32 - kQuality[quality].phaseBits;
+  mBlend = kQuality[quality].blend;
+  mBaseStep = ((uint64_t)inRate << 32) / outRate;
+  mStep = mBaseStep;
+
+  int phases = 1 << kQuality[quality].phaseBits;
+  delete[] mCoeffs;
+  mCoeffs = new int16_t[(phases + 1) * mTaps];
+  if (!mCoeffs)
+    return false;
+
+  // cutoff in cycles per input sample, below the lower nyquist
+  double cutoff = kCutoff * (inRate < outRate ? inRate : outRate) / inRate;
+  double beta = kQuality[quality].beta;
+  double i0Beta = besselI0 (beta);
+  double halfSpan = mTaps / 2.0;
+
+  double kernel[kMaxTaps];
+  for (auto phase = 0; phase <= phases; phase++) {
+    double sum = 0.0;
+    for (auto tap = 0; tap < mTaps; tap++) {
+      // input sample tap sits at t from the output instant
+      double t = tap - (halfSpan - 1.0) - ((double)phase / phases);
+      double sinc = t == 0.0 ? 2.0 * cutoff : sin (2.0 * kPi * cutoff * t) / (kPi * t);
+      double r = t / halfSpan;
+      double window = r * r < 1.0 ? besselI0 (beta * sqrt (1.0 - r * r)) / i0Beta : 0.0;
+      kernel[tap] = sinc * window;
+      sum += kernel[tap];
+      }
+
+    for (auto tap = 0; tap < mTaps; tap++)
+      mCoeffs[(phase * mTaps) + tap] = (int16_t)lround ((kernel[tap] / sum) * 32768.0);
+    }
+
+  reset();
+  return true;
+  }
+//}}}
+//{{{
+void cSrc::reset() {
+
+  mPos = 0;
+  mHistory = 0;
+  }
+//}}}
+
+//{{{
+void cSrc::setTrim (float ppm) {
+  mStep = mBaseStep + (int64_t)((float)mBaseStep * ppm * 1e-6f);
+  }
+//}}}
+
+//{{{
+int cSrc::process (const int16_t* in, int inFrames, int16_t* out) {
+
+  if (!mCoeffs)
+    return 0;
+
+  if (inFrames > kMaxInFrames)
+    inFrames = kMaxInFrames;
+  for (auto i = 0; i < inFrames; i++) {
+    mLeft[mHistory + i] = in[2*i];
+    mRight[mHistory + i] = in[2*i + 1];
+    }
+  uint32_t avail = mHistory + inFrames;
+
+  int outFrames = 0;
+  while ((uint32_t)(mPos >> 32) + mTaps <= avail) {
+    auto index = (uint32_t)(mPos >> 32);
+    auto coeffs = mCoeffs + (((uint32_t)mPos >> mPhaseShift) * mTaps);
+
+    int64_t left;
+    int64_t right;
+    dot (coeffs, index, left, right);
+    if (mBlend) {
+      int64_t nextLeft;
+      int64_t nextRight;
+      dot (coeffs + mTaps, index, nextLeft, nextRight);
+      int32_t blend = ((uint32_t)mPos >> (mPhaseShift - 15)) & 0x7FFF;
+      left += ((nextLeft - left) * blend) >> 15;
+      right += ((nextRight - right) * blend) >> 15;
+      }
+
+    *out++ = saturate (left);
+    *out++ = saturate (right);
+    outFrames++;
+    mPos += mStep;
+    }
+
+  // keep from the next output's first tap on, a downsample step may have passed the end
+  uint32_t used = (uint32_t)(mPos >> 32);
+  if (used > avail)
+    used = avail;
+  mHistory = avail - used;
+  memmove (mLeft, mLeft + used, mHistory * sizeof(int16_t));
+  memmove (mRight, mRight + used, mHistory * sizeof(int16_t));
+  mPos -= (uint64_t)used << 32;
+
+  return outFrames;
+  }
+//}}}
+
+//{{{
+float cSrc::thdN (float toneHz, float toneDb) {
+// resets the history before and after, integer tone phase so the reference is exact at both rates
+
+  if (!mCoeffs)
+    return 0.f;
+
+  const int kFitFrames = 4096;
+  auto tone = (uint32_t)toneHz;
+  auto amplitude = 32767.0 * pow (10.0, toneDb / 20.0);
+
+  auto in = new int16_t[kMaxInFrames * 2];
+  auto out = new int16_t[(getMaxOutFrames (kMaxInFrames) + kFitFrames) * 2];
+  if (!in || !out) {
+    delete[] in;
+    delete[] out;
+    return 0.f;
+    }
+
+  reset();
+  int outFrames = 0;
+  uint32_t inFrame = 0;
+  while (outFrames < kFitFrames) {
+    for (auto i = 0; i < kMaxInFrames; i++, inFrame++) {
+      auto phase = (uint32_t)(((uint64_t)inFrame * tone) % mInRate);
+      auto sample = (int16_t)lround (amplitude * sin ((2.0 * kPi * phase) / mInRate));
+      in[2*i] = sample;
+      in[2*i + 1] = sample;
+      }
+    outFrames += process (in, kMaxInFrames, out + (outFrames * 2));
+    }
+  reset();
+
+  // least squares fit of sin, cos at the tone over the left channel, residual is everything else
+  double ss = 0.0, sc = 0.0, cc = 0.0, ys = 0.0, yc = 0.0;
+  for (auto i = 0; i < kFitFrames; i++) {
+    auto phase = (2.0 * kPi * (uint32_t)(((uint64_t)i * tone) % mOutRate)) / mOutRate;
+    double s = sin (phase);
+    double c = cos (phase);
+    double y = out[2*i];
+    ss += s * s;
+    sc += s * c;
+    cc += c * c;
+    ys += y * s;
+    yc += y * c;
+    }
+  double det = (ss * cc) - (sc * sc);
+  double a = ((ys * cc) - (yc * sc)) / det;
+  double b = ((yc * ss) - (ys * sc)) / det;
+
+  double signal = 0.0;
+  double residual = 0.0;
+  for (auto i = 0; i < kFitFrames; i++) {
+    auto phase = (2.0 * kPi * (uint32_t)(((uint64_t)i * tone) % mOutRate)) / mOutRate;
+    double fit = (a * sin (phase)) + (b * cos (phase));
+    double error = out[2*i] - fit;
+    signal += fit * fit;
+    residual += error * error;
+    }
+
+  delete[] out;
+  delete[] in;
+
+  return (float)(10.0 * log10 ((residual + 1e-20) / (signal + 1e-20)));
+  }
+//}}}
+
+// private
+//{{{
+void cSrc::dot (const int16_t* coeffs, uint32_t index, int64_t& left, int64_t& right) {
+// q30 sums, tap pairs, mTaps is even, history words may be unaligned, cm7 loads those in one ldr
+
+  const int16_t* leftHistory = mLeft + index;
+  const int16_t* rightHistory = mRight + index;
+
+  uint64_t accLeft = 0;
+  uint64_t accRight = 0;
+  for (auto tap = 0; tap < mTaps; tap += 2) {
+    uint32_t coeffPair;
+    uint32_t leftPair;
+    uint32_t rightPair;
+    memcpy (&coeffPair, coeffs + tap, 4);
+    memcpy (&leftPair, leftHistory + tap, 4);
+    memcpy (&rightPair, rightHistory + tap, 4);
+    accLeft = smlald (leftPair, coeffPair, accLeft);
+    accRight = smlald (rightPair, coeffPair, accRight);
+    }
+
+  left = (int64_t)accLeft;
+  right = (int64_t)accRight;
+  }
+//}}}
@@ -0,0 +1,54 @@
+// cSrc.h - polyphase sample rate converter, stereo int16 in, stereo int16 out at a fixed codec rate
+// - windowed sinc kaiser prototype split into phases of taps q15 coeffs, nearest or blended phases per output
+// - any in, out ratio from a 32.32 phase accumulator, no common factor needed, 22050 -> 44100 is just a step of 0.5
+// - dot products are pairs of int16 through SMLALD from core_cmSimd.h, a plain c pair otherwise,
+//   no hal or rtos, builds on a host to check thd+n and time it
+#pragma once
+#include <stdint.h>
+
+class cSrc {
+public:
+  enum eQuality { eLow, eMedium, eHigh };   // 8 taps 32 phases nearest, 16 x 64 and 32 x 128 blended
+
+  static const int kMaxInFrames = 1152;
+  static const int kMaxTaps = 32;
+
+  cSrc() {}
+  ~cSrc();
+
+  // rebuilds the phase table only if something changed, false if no table
+  bool setRates (uint32_t inRate, uint32_t outRate, eQuality quality);
+  void reset();
+
+  // fine ratio trim on top of the rates, positive takes input faster, for clock drift
+  void setTrim (float ppm);
+
+  // stereo interleaved, inFrames <= kMaxInFrames, out holds getMaxOutFrames, returns frames out
+  int process (const int16_t* in, int inFrames, int16_t* out);
+  int getMaxOutFrames (int inFrames) { return (int)(((uint64_t)inFrames * mOutRate) / mInRate) + 2; }
+
+  uint32_t getInRate() { return mInRate; }
+  uint32_t getOutRate() { return mOutRate; }
+  int getTaps() { return mTaps; }
+
+  // tone at inRate through a scratch history, fundamental fitted out of the output, residual in dB
+  float thdN (float toneHz, float toneDb);
+
+private:
+  void dot (const int16_t* coeffs, uint32_t index, int64_t& left, int64_t& right);
+
+  uint32_t mInRate = 44100;
+  uint32_t mOutRate = 44100;
+  eQuality mQuality = eMedium;
+  int mTaps = 0;
+  int mPhaseShift = 0;                     // 32 - log2 phases
+  bool mBlend = false;
+  uint64_t mBaseStep = 0;                  // in samples per out sample, 32.32
+  uint64_t mStep = 0;                      // mBaseStep trimmed
+  uint64_t mPos = 0;                       // from start of history, 32.32
+
+  int16_t* mCoeffs = nullptr;              // phase major, mTaps per phase, phases + 1 rows
+  uint32_t mHistory = 0;                   // samples held per channel
+  int16_t mLeft[kMaxTaps + kMaxInFrames];
+  int16_t mRight[kMaxTaps + kMaxInFrames];
+  };
@@ -6,8 +6,16 @@
 #include <ctype.h>
 #include <stdint.h>
 #include <math.h>
+#include <new>
 
 #include "memory.h"
+#include "trace.h"
+#include "taskStats.h"
+#include "cpuUsage.h"
+#include "uartLog.h"
+#include "staticTasks.h"
+#include "sdIo.h"
+#include "touch.h"
 
 #include "lwip/netif.h"
 #include "lwip/tcpip.h"
@@ -19,6 +27,7 @@
 #include "usbd_core.h"
 #include "usbd_desc.h"
 #include "usbd_msc.h"
+#include "usbd_audio.h"
 
 #ifdef STM32F746G_DISCO
   #include "stm32746g_discovery.h"
@@ -45,11 +54,18 @@
 #include "widgets/cBmpWidget.h"
 #include "widgets/cWaveCentreWidget.h"
 #include "widgets/cWaveLensWidget.h"
+#include "cSpectrumWidget.h"
+#include "cSrc.h"
+#include "cEffects.h"
+#include "cLoudness.h"
+#include "cHlsAbr.h"
+#include "cHlsDrift.h"
+#include "cScrub.h"
 
 #include "net/cLwipHttp.h"
 #include "net/cUartEsp8266Http.h"
-//#include "../httpServer/httpServer.h"
-//#include "../httpServer/ftpServer.h"
+#include "../httpserver/httpServer.h"
+#include "../httpserver/ftpServer.h"
 
 #include "hls/hls.h"
 #include "decoders/cMp3.h"
@@ -64,15 +80,25 @@ UART_HandleTypeDef DebugUartHandle;
 
 const bool kSdDebug = false;
 const bool kStaticIp = false;
+const bool kHlsAbr = true;
+const bool kTrace = false;
+const bool kUsbAudio = false;   // button at boot, usb dac rather than usb sd
+const uint32_t kMp3Rate = 44100;  // codec rate for mp3, other file rates go through cSrc
+const cSrc::eQuality kSrcQuality = cSrc::eHigh;
+const uint32_t kEffectsBudget = cEffects::kBudgetCycles;  // cycles per 1152 frames
+const int kHlsFifoFrames = 3 * 1024;
+const int kHlsMaxFillFrames = 1024;       // probed ahead of play, over 3 chunks of 300
+const int kScrubLeadFrames = 512;         // grains written this far ahead of the sai dma, 11.6ms at 44.1k
+const int kScrubIdleMs = 200;             // no drag for this long ends a scrub, after the grain fade, play on
+const int kReservoirBytes = 511;          // furthest main_data_begin reaches back into earlier frames
 const std::string kHello = "built " + std::string(__TIME__) + " on " + std::string(__DATE__);
 //{{{  new, delete
-//void* operator new (size_t size) { return pvPortMalloc (size); }
-//void operator delete (void* ptr) { vPortFree (ptr); }
-void* operator new (size_t size) { return malloc (size); }
-void operator delete (void* ptr) { free (ptr); }
+// one heap, pvPortMalloc slabs small blocks and hands static constructor allocations to malloc
+void* operator new (size_t size) { return pvPortMalloc (size); }
+void operator delete (void* ptr) { vPortFree (ptr); }
 
-void* operator new[](size_t size) { return malloc (size); }
-void operator delete[](void *ptr) { free (ptr); }
+void* operator new[](size_t size) { return pvPortMalloc (size); }
+void operator delete[](void *ptr) { vPortFree (ptr); }
 //}}}
 
 //{{{
@@ -87,8 +113,8 @@ static const uint8_t SD_InquiryData[] = {
 static const USBD_StorageTypeDef USBD_DISK_fops = {
   SD_IsReady,
   SD_GetCapacity,
-  SD_ReadCached,
-  SD_WriteCached,
+  sdIoRead,
+  sdIoWrite,
   (int8_t*)SD_InquiryData,
   };
 //}}}
@@ -97,6 +123,10 @@ static USBD_HandleTypeDef USBD_Device;
 
 static SemaphoreHandle_t mAudSem;
 static bool mAudHalf = false;
+static volatile uint32_t mAudCycles = 0;   // half transfer timestamp and count, for hls drift
+static volatile uint32_t mAudHalves = 0;
+static bool mUsbAudio = false;
+static bool mUsbAudioPlaying = false;
 static int mIntVolume = 0;
 
 // ui
@@ -118,17 +148,41 @@ static int* mFrameOffsets = nullptr;
 static float mMp3Volume = 0.9f;
 static bool mMp3VolumeChanged = false;
 
+// decoded pcm tap, analysed by its widget on render
+static cSpectrum* mSpectrum = nullptr;
+
+// eq bands 0..1, 0.5 flat, normalise gain from the wave scan's loudness, both picked up by mp3Play
+static float mEqGains[cEffects::kBands] = { 0.5f, 0.5f, 0.5f, 0.5f, 0.5f };
+static bool mEqChanged = false;
+static float mNormaliseDb = 0.f;
+static bool mNormaliseChanged = false;
+
 // hls
 static cHls* mHls;
 static SemaphoreHandle_t mHlsSem;
-static int16_t* mReSamples;
+static int16_t* mReSamples;    // hls drift src output fifo, kHlsFifoFrames stereo
+
+// hls chunk load time for the abr, measured around each cHls load on the loader's connection
+static int mHlsLoadMs = 0;
+
+// hls playout underruns, counted by the player, a rebuffer is the start of a run of missing frames
+static int mHlsUnderrunFrames = 0;
+static int mHlsRebuffers = 0;
 //}}}
 
+
 //{{{  audio callbacks
 //{{{
 void BSP_AUDIO_OUT_HalfTransfer_CallBack() {
 
+  if (mUsbAudio) {
+    USBD_AUDIO_SaiHalf (0);
+    return;
+    }
+
   mAudHalf = true;
+  mAudCycles = cpuWallCycles();
+  mAudHalves++;
 
   portBASE_TYPE taskWoken = pdFALSE;
   if (xSemaphoreGiveFromISR (mAudSem, &taskWoken) == pdTRUE)
@@ -138,7 +192,14 @@ void BSP_AUDIO_OUT_HalfTransfer_CallBack() {
 //{{{
 void BSP_AUDIO_OUT_TransferComplete_CallBack() {
 
+  if (mUsbAudio) {
+    USBD_AUDIO_SaiHalf (1);
+    return;
+    }
+
   mAudHalf = false;
+  mAudCycles = cpuWallCycles();
+  mAudHalves++;
 
   portBASE_TYPE taskWoken = pdFALSE;
   if (xSemaphoreGiveFromISR (mAudSem, &taskWoken) == pdTRUE)
@@ -147,6 +208,54 @@ void BSP_AUDIO_OUT_TransferComplete_CallBack() {
 //}}}
 //}}}
 //{{{
+static int audioReadFrame (int ringFrames) {
+// stereo frame the sai dma reads next, NDTR counts down the int16 transfers left in the circular AUDIO_BUFFER
+
+  return (ringFrames - (int)(AUDIO_OUT_SAIx_DMAx_STREAM->NDTR / 2)) % ringFrames;
+  }
+//}}}
+//{{{
+static void scrubRender (cScrub* scrub, int ringFrames, int& writeFrame, cEffects* effects) {
+// grain hops into the AUDIO_BUFFER ring up to kScrubLeadFrames ahead of the dma rather than a half at a time,
+// a drag is heard a lead later, not up to two halves, writeFrame -1 to start, effects and spectrum if given
+
+  auto readFrame = audioReadFrame (ringFrames);
+  auto ahead = (writeFrame - readFrame + ringFrames) % ringFrames;
+  if ((writeFrame < 0) || (ahead > kScrubLeadFrames + cScrub::kHop)) {
+    // start, or the dma got past us, next hop boundary after the read
+    writeFrame = (((readFrame / cScrub::kHop) + 1) * cScrub::kHop) % ringFrames;
+    ahead = (writeFrame - readFrame + ringFrames) % ringFrames;
+    }
+
+  while (ahead < kScrubLeadFrames) {
+    auto hop = (int16_t*)AUDIO_BUFFER + (writeFrame * 2);
+    scrub->render (hop);
+    if (effects) {
+      effects->process (hop, cScrub::kHop);
+      mSpectrum->push (hop, cScrub::kHop);
+      }
+    writeFrame = (writeFrame + cScrub::kHop) % ringFrames;
+    ahead += cScrub::kHop;
+    }
+  }
+//}}}
+//{{{
+static void usbAudioPlay (uint32_t rate, int16_t* buf, uint32_t bytes) {
+// usb audio task, sai stopped for the clock change, then round buf at the new rate
+
+  if (mUsbAudioPlaying)
+    BSP_AUDIO_OUT_Stop (CODEC_PDWN_SW);
+  BSP_AUDIO_OUT_SetFrequency (rate);
+  BSP_AUDIO_OUT_Play ((uint16_t*)buf, bytes);
+  mUsbAudioPlaying = true;
+  }
+//}}}
+//{{{
+static USBD_AUDIO_ItfTypeDef USBD_AUDIO_fops = {
+  usbAudioPlay,
+  };
+//}}}
+//{{{
 static void listDirectory (std::string directoryName, std::string ext) {
 
   debug ("dir " + directoryName);
@@ -180,6 +289,7 @@ static void listDirectory (std::string directoryName, std::string ext) {
 
 //{{{
 static void hlsLoaderThread (void const* argument) {
+// one chunk at a time on one keep alive connection, timed for the abr
 
   #ifdef ESP8266
     cUartEsp8266Http http;
@@ -189,48 +299,177 @@ static void hlsLoaderThread (void const* argument) {
 
   http.initialise();
 
+  // mHlsBitrate is the user's cap until the abr writes its choice there for the chunk loads,
+  // a value the abr did not write is a new cap from the user, picking the rate playing now keeps the old one
+  cHlsAbr abr (mHls->mHlsBitrate);
+  int abrBitrate = mHls->mHlsBitrate;
+  bool firstChunk = true;
+
   while (true) {
-    if (mHls->mChanChanged)
-      mHls->setChan (http, mHls->mHlsChan, mHls->mHlsBitrate);
+    if (kHlsAbr && (mHls->mHlsBitrate != abrBitrate)) {
+      abr.setCap (mHls->mHlsBitrate);
+      debug ("abr cap " + dec (abr.getCap()));
+      }
+
+    if (mHls->mChanChanged) {
+      mHls->setChan (http, mHls->mHlsChan, kHlsAbr ? abr.getBitrate() : mHls->mHlsBitrate);
+      firstChunk = true;
+      }
+    if (kHlsAbr)
+      abrBitrate = mHls->mHlsBitrate = abr.getBitrate();
 
     mHls->loadPicAtPlayFrame (http);
-    if (!mHls->loadAtPlayFrame (http))
+
+    int bitrate = mHls->mHlsBitrate;
+    auto startTicks = xTaskGetTickCount();
+    if (mHls->loadAtPlayFrame (http)) {
+      mHlsLoadMs = (xTaskGetTickCount() - startTicks) * portTICK_PERIOD_MS;
+      if (kHlsAbr)
+        bitrate = abr.loaded (mHlsLoadMs, mHlsRebuffers, firstChunk);
+      firstChunk = false;
+      }
+    else {
+      if (kHlsAbr)
+        bitrate = abr.failed();
       vTaskDelay (500);
+      }
+
+    if (bitrate != mHls->mHlsBitrate) {
+      // next chunk load fetches the new variant, loaded chunks play out, no channel reset
+      debug ("abr " + dec (mHls->mHlsBitrate) + " to " + dec (bitrate) +
+             " load " + dec (mHlsLoadMs) + "ms rebuffers " + dec (mHlsRebuffers) +
+             " avg " + dec (abr.getAvgBitrate()));
+      abrBitrate = mHls->mHlsBitrate = bitrate;
+      continue;
+      }
 
     xSemaphoreTake (mHlsSem, portMAX_DELAY);
     }
   }
 //}}}
 //{{{
+static int hlsFillFrames() {
+// loaded frames ahead of play, binary search, loads are whole chunks in order so the loaded run is contiguous
+
+  auto playSample = mHls->getPlaySample();
+  uint32_t seqNum;
+  uint32_t numSamples;
+
+  int loaded = 0;
+  int missing = kHlsMaxFillFrames;
+  while (missing - loaded > 1) {
+    auto frames = (loaded + missing) / 2;
+    if (mHls->getPlaySamples (playSample + (frames * kSamplesPerFrame), seqNum, numSamples))
+      loaded = frames;
+    else
+      missing = frames;
+    }
+  return loaded;
+  }
+//}}}
+//{{{
 static void hlsPlayerThread (void const* argument) {
+// each half is kSamplesPerFrame from the fifo, filled through a cSrc trimmed by cHlsDrift to hold latency,
+// scrubbing plays cScrub grains of the loaded frames round the scrub position instead
 
   // 8192 = 1024 samplesPerFrame * 2 chans * 2 bytesPperSample * 2 swing buffers
   const int kAudioBuffer = 1024 * 2 * 2 * 2;
+  const int kFillHalves = 4;
+  const int kReportHalves = 48000 * 60 / 1024;
   memset ((void*)AUDIO_BUFFER, 0, kAudioBuffer);
   BSP_AUDIO_OUT_Play ((uint16_t*)AUDIO_BUFFER, kAudioBuffer);
 
+  auto src = new cSrc();
+  src->setRates (48000, 48000, cSrc::eMedium);
+  cHlsDrift drift (48000.f);
+  int fifoFrames = 0;
+
+  // scrub frames count from kScrubOrigin at the scrub start, the play sample is too big for an int frame
+  const int kScrubOrigin = 0x100000;
+  auto scrub = new cScrub (kSamplesPerFrame);
+  bool scrubbing = false;
+  int scrubFrame = 0;
+  int writeFrame = -1;
+  double scrubSample = 0;
+  uint32_t audHalves = mAudHalves;
+  int halves = 0;
+
   uint32_t seqNum = 0;
   uint32_t lastSeqNum = 0;
   uint32_t numSamples = 0;
-  uint16_t scrubCount = 0;
-  double scrubSample = 0;
 
   while (true) {
-    if (xSemaphoreTake (mAudSem, 50) == pdTRUE) {
-      int16_t* sample = nullptr;
-      if (mHls->getScrubbing()) {
-        if (scrubCount == 0)
-          scrubSample = mHls->getPlaySample();
-        sample = mHls->getPlaySamples (scrubSample + (scrubCount * kSamplesPerFrame), seqNum, numSamples);
-        if (scrubCount++ > 3) {
-          sample = nullptr;
-          scrubCount = 0;
+    if (mHls->getScrubbing()) {
+      //{{{  grains ahead of the dma, the loaded frames round the head copied into the cache
+      if (!scrubbing) {
+        scrubbing = true;
+        scrubSample = mHls->getPlaySample();
+        scrubFrame = kScrubOrigin;
+        scrub->reset();
+        scrub->start (scrubFrame);
+        writeFrame = -1;
+        fifoFrames = 0;
+        src->reset();
+        drift.reset();
+        drift.dmaGap();
+        }
+
+      auto frame = kScrubOrigin + (int)floor ((mHls->getPlaySample() - scrubSample) / kSamplesPerFrame);
+      if (frame != scrubFrame) {
+        scrubFrame = frame;
+        scrub->drag (frame);
+        }
+
+      // loaded frames either side of the head into the cache, nearest first, then the head's seqNum for the loader
+      auto head = scrub->getHeadFrame();
+      for (auto i = 0; i <= 16; i++) {
+        auto cached = head + ((i & 1) ? (i + 1) / 2 : -(i / 2));
+        if (!scrub->getCached (cached)) {
+          auto samples = mHls->getPlaySamples (scrubSample + ((double)(cached - kScrubOrigin) * kSamplesPerFrame), seqNum, numSamples);
+          if (samples)
+            memcpy (scrub->getSlot (cached), samples, kSamplesPerFrame * 4);
           }
         }
-      else if (mHls->getPlaying()) {
-        sample = mHls->getPlaySamples (mHls->getPlaySample(), seqNum, numSamples);
-        if (sample)
+      mHls->getPlaySamples (scrubSample + ((double)(head - kScrubOrigin) * kSamplesPerFrame), seqNum, numSamples);
+
+      scrubRender (scrub, kAudioBuffer / 4, writeFrame, nullptr);
+
+      if (seqNum != lastSeqNum) {
+        lastSeqNum = seqNum;
+        xSemaphoreGive (mHlsSem);
+        }
+      vTaskDelay (1);
+      continue;
+      }
+      //}}}
+    scrubbing = false;
+
+    if (xSemaphoreTake (mAudSem, 50) == pdTRUE) {
+      // every half the sai played, even those this task was late for
+      uint32_t played = mAudHalves - audHalves;
+      audHalves += played;
+      drift.dma (mAudCycles, SystemCoreClock, played * kSamplesPerFrame);
+
+      int16_t* sample = nullptr;
+      if (mHls->getPlaying()) {
+        // top up the fifo a frame at a time through the trimmed src
+        while (fifoFrames < kSamplesPerFrame) {
+          auto frame = mHls->getPlaySamples (mHls->getPlaySample(), seqNum, numSamples);
+          if (!frame)
+            break;
           mHls->incPlayFrame (1);
+          fifoFrames += src->process (frame, kSamplesPerFrame, mReSamples + (fifoFrames * 2));
+          }
+
+        if (fifoFrames >= kSamplesPerFrame) {
+          sample = mReSamples;
+          mHlsUnderrunFrames = 0;
+          }
+        else if (!mHls->mChanChanged && !mHlsUnderrunFrames++) {
+          // playing but frame not loaded, start of a rebuffer, latency jumps, drift target relatches
+          mHlsRebuffers++;
+          drift.reset();
+          }
         }
 
       if (sample)
@@ -238,6 +477,24 @@ static void hlsPlayerThread (void const* argument) {
       else
         memset ((int16_t*)(mAudHalf ? AUDIO_BUFFER : AUDIO_BUFFER + kAudioBuffer/2), 0, kAudioBuffer/2);
 
+      if (sample == mReSamples) {
+        fifoFrames -= kSamplesPerFrame;
+        memmove (mReSamples, mReSamples + (kSamplesPerFrame * 2), fifoFrames * 4);
+        }
+
+      if (mHls->mChanChanged) {
+        fifoFrames = 0;
+        src->reset();
+        drift.reset();
+        }
+      else if (sample && !(++halves % kFillHalves)) {
+        drift.fill ((float)(hlsFillFrames() * kSamplesPerFrame), (float)(kFillHalves * kSamplesPerFrame) / 48000.f);
+        src->setTrim (drift.getTrim());
+        if (!(halves % kReportHalves))
+          logPrint (LOG_INFO, "hls drift sai %+dppm trim %+dppm fill %d target %d\n",
+                    (int)drift.getSaiPpm(), (int)drift.getTrim(), (int)drift.getFill(), (int)drift.getTarget());
+        }
+
       if (mHls->mChanChanged || !seqNum || (seqNum != lastSeqNum)) {
         lastSeqNum = seqNum;
         xSemaphoreGive (mHlsSem);
@@ -320,10 +577,13 @@ static void hlsNetThread (void const* argument) {
       //}}}
 
     TaskHandle_t handle;
-    xTaskCreate ((TaskFunction_t)hlsLoaderThread, "hlsLoad", 14000, 0, 3, &handle);
-    xTaskCreate ((TaskFunction_t)hlsPlayerThread, "hlsPlay", 2000, 0, 4, &handle);
-    //xTaskCreate ((TaskFunction_t)httpServerThread, "hlsHttp", DEFAULT_THREAD_STACKSIZE, 0, 4, &handle);
-    //xTaskCreate ((TaskFunction_t)ftpServerThread, "ftp", DEFAULT_THREAD_STACKSIZE, 0, 4, &handle);
+    staticTaskCreate ((TaskFunction_t)hlsLoaderThread, "hlsLoad", 14000, 0, 3, &handle);
+    staticTaskCreate ((TaskFunction_t)hlsPlayerThread, "hlsPlay", 2000, 0, 4, &handle);
+    httpServerInit();
+    staticTaskCreate ((TaskFunction_t)ftpServerThread, "ftp", 4096, 0, 4, &handle);
+
+    staticTasksBooted();
+    staticTasksReport();
     }
 
   vTaskDelete (NULL);
@@ -333,7 +593,10 @@ static void hlsNetThread (void const* argument) {
 //{{{
 static void initMp3Menu (cRootContainer* root) {
 
-  root->add (new cListWidget (mMp3Files, fileIndex, fileIndexChanged, 0, -4));
+  root->add (new cListWidget (mMp3Files, fileIndex, fileIndexChanged, 0, -7));
+  root->add (new cSpectrumWidget (mSpectrum, 0, 2));
+  for (auto band = 0; band < cEffects::kBands; band++)
+    root->add (new cValueBox (mEqGains[band], mEqChanged, COL_GREEN, 2, 1));
   root->add (new cWaveCentreWidget (mWave, mMp3PlayFrame, mWaveLoadFrame, mWaveLoadFrame, mWaveChanged, 0, 2));
   root->add (new cWaveLensWidget (mWave, mMp3PlayFrame, mWaveLoadFrame, mWaveLoadFrame, mWaveChanged, 0, 2));
 
@@ -341,9 +604,31 @@ static void initMp3Menu (cRootContainer* root) {
   }
 //}}}
 //{{{
+static uint32_t mp3HeaderRate (const uint8_t* header, int& frames) {
+// rate and stereo frames per frame from a layer 3 header, 0 if not a header
+
+  static const uint32_t kRates[4][3] = { { 11025, 12000, 8000 },    // mpeg 2.5
+                                         { 0, 0, 0 },               // reserved
+                                         { 22050, 24000, 16000 },   // mpeg 2
+                                         { 44100, 48000, 32000 } }; // mpeg 1
+
+  if ((header[0] != 0xFF) || ((header[1] & 0xE0) != 0xE0))
+    return 0;
+
+  auto version = (header[1] >> 3) & 3;
+  auto index = (header[2] >> 2) & 3;
+  if (index == 3)
+    return 0;
+
+  frames = version == 3 ? 1152 : 576;
+  return kRates[version][index];
+  }
+//}}}
+//{{{
 static void mp3WaveThread (void const* argument) {
 
   debug ("mp3WaveThread");
+  sdIoSetClass (eSdIoScan);
 
   auto mp3 = new cMp3;
   debug ("wave mp3");
@@ -352,6 +637,11 @@ static void mp3WaveThread (void const* argument) {
   auto fullChunkSize = 2048 + chunkSize;
   auto chunkBuffer = (uint8_t*)pvPortMalloc (fullChunkSize);
 
+  // pcm for the loudness scan, its gain published every kNormaliseFrames as it converges
+  const int kNormaliseFrames = 40;
+  auto loudness = new cLoudness();
+  auto pcm = (int16_t*)pvPortMalloc (1152 * 4);
+
   int loadedFileIndex = -1;
   while (true) {
     loadedFileIndex = fileIndex;
@@ -360,6 +650,10 @@ static void mp3WaveThread (void const* argument) {
     mWave[0] = 0;
     auto wavePtr = mWave + 1;
 
+    uint32_t loudnessRate = 0;
+    mNormaliseDb = 0.f;
+    mNormaliseChanged = true;
+
     int count = 0;
     debug ("wave load " + mMp3Files[fileIndex]);
     cFile file (mMp3Files[fileIndex], FA_OPEN_EXISTING | FA_READ);
@@ -409,8 +703,24 @@ static void mp3WaveThread (void const* argument) {
                   bytesLeft = 0;
                 }
               if (bytesLeft >= mp3->getFrameBodySize()) {
-                mFrameOffsets[mWaveLoadFrame] = file.getPosition(); // not right !!!!
-                auto frameBytes = mp3->decodeFrameBody (chunkPtr, mWave + 1 + (mWaveLoadFrame * 2), nullptr);
+                // header start, bytesLeft runs from the body to the end of what was read
+                mFrameOffsets[mWaveLoadFrame] = file.getPosition() - bytesLeft - 4;
+
+                int frames;
+                auto rate = mp3HeaderRate (chunkPtr - 4, frames);
+                if (rate && (rate != loudnessRate)) {
+                  loudnessRate = rate;
+                  loudness->reset (rate);
+                  }
+
+                auto frameBytes = mp3->decodeFrameBody (chunkPtr, mWave + 1 + (mWaveLoadFrame * 2), pcm);
+                if (frameBytes && loudnessRate) {
+                  loudness->push (pcm, frames);
+                  if (loudness->getBlocks() && !(mWaveLoadFrame % kNormaliseFrames)) {
+                    mNormaliseDb = loudness->getGainDb();
+                    mNormaliseChanged = true;
+                    }
+                  }
                 if (*wavePtr > *mWave)
                   *mWave = *wavePtr;
                 wavePtr++;
@@ -432,6 +742,10 @@ static void mp3WaveThread (void const* argument) {
         } while ((fileIndex == loadedFileIndex) && (bytesLeft > 0));
       }
   exitWave:
+    if ((fileIndex == loadedFileIndex) && loudness->getBlocks()) {
+      mNormaliseDb = loudness->getGainDb();
+      mNormaliseChanged = true;
+      }
     debug ("wave loaded");
 
     // wait for file change
@@ -441,9 +755,222 @@ static void mp3WaveThread (void const* argument) {
   }
 //}}}
 //{{{
+static void srcReport (cSrc* src) {
+// thd+n and cycles per output frame for a 48k file at kSrcQuality, the worst common ratio
+
+  src->setRates (48000, kMp3Rate, kSrcQuality);
+  auto thdN = src->thdN (1000.f, -1.f);
+
+  auto in = (int16_t*)pvPortMalloc (cSrc::kMaxInFrames * 4);
+  auto out = (int16_t*)pvPortMalloc (src->getMaxOutFrames (cSrc::kMaxInFrames) * 4);
+  memset (in, 0, cSrc::kMaxInFrames * 4);
+  auto start = cpuWallCycles();
+  auto frames = src->process (in, cSrc::kMaxInFrames, out);
+  uint32_t cycles = cpuWallCycles() - start;
+  src->reset();
+  vPortFree (out);
+  vPortFree (in);
+
+  printf ("src 48000>%lu %d taps thd+n %ddB %lu cycles/frame\n",
+          kMp3Rate, src->getTaps(), (int)thdN, frames ? cycles / frames : 0);
+  }
+//}}}
+//{{{
+static void mp3PlacementReport (const std::string& fileName) {
+// decode cycles per frame, decoder instance, chunk and pcm buffers from each heap placement in turn
+// - the same first 32k of the file each pass, the decoder's own tables follow operator new into sdram
+
+  const int kChunk = 32768;
+  const eHeapPlace kPlaces[] = { eHeapFast, eHeapBulk };
+
+  for (auto place : kPlaces) {
+    auto mem = pvPortMallocPlaced (sizeof(cMp3), place);
+    auto chunk = (uint8_t*)pvPortMallocPlaced (kChunk, place);
+    auto pcm = (int16_t*)pvPortMallocPlaced (1152 * 4, place);
+    if (!mem || !chunk || !pcm) {
+      vPortFree (pcm);
+      vPortFree (chunk);
+      vPortFree (mem);
+      return;
+      }
+    auto mp3 = new (mem) cMp3;
+
+    int bytesLeft = 0;
+    cFile file (fileName, FA_OPEN_EXISTING | FA_READ);
+    if (!file.getError())
+      file.read (chunk, kChunk, bytesLeft);
+
+    uint32_t cycles = 0;
+    uint32_t frames = 0;
+    auto chunkPtr = chunk;
+    int headerBytes;
+    while ((bytesLeft > 0) && (headerBytes = mp3->findNextHeader (chunkPtr, bytesLeft))) {
+      chunkPtr += headerBytes;
+      bytesLeft -= headerBytes;
+      if (bytesLeft < mp3->getFrameBodySize())
+        break;
+      auto start = cpuWallCycles();
+      auto frameBytes = mp3->decodeFrameBody (chunkPtr, nullptr, pcm);
+      cycles += cpuWallCycles() - start;
+      if (!frameBytes)
+        break;
+      frames++;
+      chunkPtr += frameBytes;
+      bytesLeft -= frameBytes;
+      }
+
+    printf ("placement %s decoder in %s %lu frames %lu cycles/frame\n",
+            place == eHeapFast ? "fast" : "bulk", ((uint32_t)mem < 0x60000000) ? "sram" : "sdram",
+            frames, frames ? cycles / frames : 0);
+
+    mp3->~cMp3();
+    vPortFree (pcm);
+    vPortFree (chunk);
+    vPortFree (mem);
+    }
+  }
+//}}}
+//{{{
+static void mp3Effects (cEffects* effects, int16_t* half) {
+// eq and normalise changes, then the chain in place on the AUDIO_BUFFER half about to play, cycles against kEffectsBudget
+
+  static uint32_t effectsCycles = 0;
+  static uint32_t effectsMaxCycles = 0;
+  static uint32_t effectsFrames = 0;
+
+  if (mEqChanged) {
+    mEqChanged = false;
+    for (auto band = 0; band < cEffects::kBands; band++)
+      effects->setEq (band, (mEqGains[band] - 0.5f) * 2.f * cEffects::kMaxEqDb);
+    }
+  if (mNormaliseChanged) {
+    mNormaliseChanged = false;
+    effects->setNormalise (mNormaliseDb);
+    }
+
+  auto start = cpuWallCycles();
+  effects->process (half, 1152);
+  uint32_t cycles = cpuWallCycles() - start;
+  effectsCycles += cycles;
+  if (cycles > effectsMaxCycles)
+    effectsMaxCycles = cycles;
+
+  if (++effectsFrames == 1000) {
+    logPrint (LOG_INFO, "effects %lu cycles/frame max %lu budget %lu%s\n",
+              effectsCycles / effectsFrames, effectsMaxCycles, kEffectsBudget,
+              effectsMaxCycles > kEffectsBudget ? " over" : "");
+    effectsCycles = 0;
+    effectsMaxCycles = 0;
+    effectsFrames = 0;
+    }
+
+  mSpectrum->push (half, 1152);
+  }
+//}}}
+//{{{
+static int mp3PrimeFrame (int frame) {
+// first frame to decode so frame's bit reservoir is full, earlier frames until kReservoirBytes of main data,
+// less 4 header, 2 crc and 32 side info bytes a frame, decoded and dropped
+
+  auto from = frame;
+  while ((from > 0) && ((mFrameOffsets[frame] - mFrameOffsets[from]) - ((frame - from) * 38) < kReservoirBytes))
+    from--;
+  return from;
+  }
+//}}}
+//{{{
+static int mp3Scrub (cFile& file, cMp3* mp3, cScrub* scrub, cEffects* effects,
+                     uint8_t* buffer, int bufferSize, int16_t* scratch) {
+// drag on the wave widgets, grains round mMp3PlayFrame ahead of the dma until no drag for kScrubIdleMs,
+// cache misses read a run at a time from exact frame offsets, decoded a frame between each render,
+// returns the frame to play on from
+
+  scrub->start (mMp3PlayFrame);
+  int writeFrame = -1;
+
+  // run being decoded, frames before runFirst prime the reservoir into scratch
+  int frame = 0;
+  int runFirst = 0;
+  int runEnd = 0;
+  int nextFrame = -1;   // the decoder's reservoir follows on to this frame
+  uint8_t* ptr = nullptr;
+  int bytesLeft = 0;
+
+  auto dragTicks = xTaskGetTickCount();
+  while (!fileIndexChanged) {
+    if (mWaveChanged) {
+      mWaveChanged = false;
+      scrub->drag (mMp3PlayFrame);
+      dragTicks = xTaskGetTickCount();
+      }
+    else if ((xTaskGetTickCount() - dragTicks) * portTICK_PERIOD_MS > kScrubIdleMs)
+      break;
+
+    scrubRender (scrub, AUDIO_BUFFER_SIZE / 4, writeFrame, effects);
+
+    if (frame < runEnd) {
+      //{{{  decode a frame of the run
+      auto headerBytes = mp3->findNextHeader (ptr, bytesLeft);
+      auto frameBytes = 0;
+      if (headerBytes) {
+        ptr += headerBytes;
+        bytesLeft -= headerBytes;
+        auto pcm = frame >= runFirst ? scrub->getSlot (frame) : scratch;
+        frameBytes = mp3->decodeFrameBody (ptr, nullptr, pcm);
+        if (!frameBytes)
+          memset (pcm, 0, 1152 * 4);
+        }
+
+      if (frameBytes) {
+        ptr += frameBytes;
+        bytesLeft -= frameBytes;
+        nextFrame = ++frame;
+        }
+      else {
+        runEnd = frame;
+        nextFrame = -1;
+        }
+      }
+      //}}}
+    else {
+      int first, count;
+      if (scrub->getWork (first, count, mWaveLoadFrame - 1)) {
+        //{{{  read a run, from its prime frame unless the decoder follows on
+        auto from = first == nextFrame ? first : mp3PrimeFrame (first);
+        while ((count > 1) && (mFrameOffsets[first + count] - mFrameOffsets[from] > bufferSize - 32))
+          count--;
+
+        // reads start 32 byte aligned, as the play seek does
+        auto offset = mFrameOffsets[from];
+        auto skip = offset & 0x1F;
+        file.seek (offset - skip);
+        int bytesRead;
+        FRESULT fresult = file.read (buffer, skip + mFrameOffsets[first + count] - offset, bytesRead);
+        if (fresult || (bytesRead <= skip)) {
+          debug ("scrub read " + dec (fresult));
+          break;
+          }
+
+        ptr = buffer + skip;
+        bytesLeft = bytesRead - skip;
+        frame = from;
+        runFirst = first;
+        runEnd = first + count;
+        }
+        //}}}
+      else
+        vTaskDelay (1);
+      }
+    }
+
+  return mMp3PlayFrame;
+  }
+//}}}
+//{{{
 static void mp3PlayThread (void const* argument) {
 
   debug ("mp3PlayThread");
+  sdIoSetClass (eSdIoPlayback);
 
   //{{{  mount fatfs
   cFatFs* fatFs = cFatFs::create();
@@ -461,16 +988,34 @@ static void mp3PlayThread (void const* argument) {
   listDirectory ("", "MP3");
 
   TaskHandle_t handle;
-  xTaskCreate ((TaskFunction_t)mp3WaveThread, "mp3Wave", 8192, 0, 2, &handle);
+  staticTaskCreate ((TaskFunction_t)mp3WaveThread, "mp3Wave", 8192, 0, 2, &handle);
 
-  auto mp3 = new cMp3;
+  if (!mMp3Files.empty())
+    mp3PlacementReport (mMp3Files[0]);
+
+  // decoder state in the fast pool, where the placement report times it
+  auto mp3 = new (pvPortMallocPlaced (sizeof(cMp3), eHeapFast)) cMp3;
   debug ("play mp3");
 
+  //{{{  src, decode buffer and output fifo for files not at kMp3Rate
+  auto src = new cSrc();
+  srcReport (src);
+
+  const int kFifoFrames = 8192;
+  auto decoded = (int16_t*)pvPortMalloc (cSrc::kMaxInFrames * 4);
+  auto fifo = (int16_t*)pvPortMalloc (kFifoFrames * 4);
+  //}}}
+  auto effects = new cEffects();
+  effects->setRate (kMp3Rate);
+  auto scrub = new cScrub (1152);
+
   //{{{  chunkSize and buffer
   auto chunkSize = 4096;
   auto fullChunkSize = 2048 + chunkSize;
   auto chunkBuffer = (uint8_t*)pvPortMalloc (fullChunkSize);
   //}}}
+  uint32_t decodeCycles = 0;
+  uint32_t decodeFrames = 0;
 
   while (true) {
     mMp3PlayFrame = 0;
@@ -487,6 +1032,16 @@ static void mp3PlayThread (void const* argument) {
       int count = 0;
       int bytesLeft = 0;
 
+      uint32_t fileRate = kMp3Rate;
+      int fileFrames = 1152;
+      int fifoFrames = 0;
+      src->reset();
+      scrub->reset();
+
+      // after a seek, bytes to the frame start in the aligned read, frames decoded and dropped until playFrom
+      int seekSkip = 0;
+      int playFrom = 0;
+
       do {
         count++;
         FRESULT fresult = file.read (chunkBuffer, fullChunkSize, bytesLeft);
@@ -497,8 +1052,10 @@ static void mp3PlayThread (void const* argument) {
           goto exitPlay;
           }
           //}}}
+        auto chunkPtr = chunkBuffer + (bytesLeft > seekSkip ? seekSkip : 0);
+        bytesLeft -= chunkPtr - chunkBuffer;
+        seekSkip = 0;
         if (bytesLeft) {
-          auto chunkPtr = chunkBuffer;
           int headerBytes;
           do {
             headerBytes = mp3->findNextHeader (chunkPtr, bytesLeft);
@@ -529,8 +1086,55 @@ static void mp3PlayThread (void const* argument) {
                   bytesLeft = 0;
                 }
               if (bytesLeft >= mp3->getFrameBodySize()) {
-                xSemaphoreTake (mAudSem, 100);
-                auto frameBytes = mp3->decodeFrameBody (chunkPtr, nullptr, (int16_t*)(mAudHalf ? AUDIO_BUFFER : AUDIO_BUFFER_HALF));
+                // header is the 4 bytes before the body
+                int frames;
+                auto rate = mp3HeaderRate (chunkPtr - 4, frames);
+                if (rate && (rate != fileRate)) {
+                  debug ("play rate " + dec (rate));
+                  fileRate = rate;
+                  fileFrames = frames;
+                  fifoFrames = 0;
+                  src->setRates (fileRate, kMp3Rate, kSrcQuality);
+                  }
+
+                int frameBytes;
+                if (mMp3PlayFrame < playFrom)
+                  // bit reservoir priming after a seek
+                  frameBytes = mp3->decodeFrameBody (chunkPtr, nullptr, decoded);
+                else if (fileRate == kMp3Rate) {
+                  //{{{  decode straight into the free AUDIO_BUFFER half
+                  xSemaphoreTake (mAudSem, 100);
+                  traceSpanBegin (TRACE_SPAN_DECODE);
+                  auto decodeStart = cpuWallCycles();
+                  frameBytes = mp3->decodeFrameBody (chunkPtr, nullptr, (int16_t*)(mAudHalf ? AUDIO_BUFFER : AUDIO_BUFFER_HALF));
+                  decodeCycles += cpuWallCycles() - decodeStart;
+                  traceSpanEnd (TRACE_SPAN_DECODE);
+                  if (frameBytes)
+                    // 1152 stereo samples, the AUDIO_BUFFER_HALF just decoded
+                    mp3Effects (effects, (int16_t*)(mAudHalf ? AUDIO_BUFFER : AUDIO_BUFFER_HALF));
+                  }
+                  //}}}
+                else {
+                  //{{{  decode, convert into the fifo, fill AUDIO_BUFFER halves from it
+                  traceSpanBegin (TRACE_SPAN_DECODE);
+                  auto decodeStart = cpuWallCycles();
+                  frameBytes = mp3->decodeFrameBody (chunkPtr, nullptr, decoded);
+                  if (frameBytes)
+                    fifoFrames += src->process (decoded, fileFrames, fifo + (fifoFrames * 2));
+                  decodeCycles += cpuWallCycles() - decodeStart;
+                  traceSpanEnd (TRACE_SPAN_DECODE);
+
+                  while (fifoFrames >= 1152) {
+                    xSemaphoreTake (mAudSem, 100);
+                    auto half = (int16_t*)(mAudHalf ? AUDIO_BUFFER : AUDIO_BUFFER_HALF);
+                    memcpy (half, fifo, 1152 * 4);
+                    mp3Effects (effects, half);
+                    fifoFrames -= 1152;
+                    memmove (fifo, fifo + (1152 * 2), fifoFrames * 4);
+                    }
+                  }
+                  //}}}
+
                 if (frameBytes) {
                   chunkPtr += frameBytes;
                   bytesLeft -= frameBytes;
@@ -538,11 +1142,27 @@ static void mp3PlayThread (void const* argument) {
                 else
                   bytesLeft = 0;
                 mMp3PlayFrame++;
+                if (++decodeFrames == 1000) {
+                  // cache benchmark, build with DCACHE_WRITE_BACK 0 and 1, compare the two reports
+                  logPrint (LOG_INFO, "cache %s decode %lu cycles/frame draw %dms\n",
+                            DCACHE_WRITE_BACK ? "writeBack" : "writeThrough", decodeCycles / decodeFrames, mLcd->getDrawTime());
+                  decodeCycles = 0;
+                  decodeFrames = 0;
+                  }
                 }
               }
             if (mWaveChanged) {
-              //{{{  seek new position
+              //{{{  scrub while the drag lasts, seek to its exact frame offset, primed
+              playFrom = fileRate == kMp3Rate ?
+                mp3Scrub (file, mp3, scrub, effects, chunkBuffer, fullChunkSize, decoded) : mMp3PlayFrame;
+              playFrom = playFrom >= mWaveLoadFrame ? mWaveLoadFrame - 1 : playFrom;
+              playFrom = playFrom < 0 ? 0 : playFrom;
+
+              mMp3PlayFrame = mp3PrimeFrame (playFrom);
               file.seek (mFrameOffsets [mMp3PlayFrame] & 0xFFFFFFE0);
+              seekSkip = mFrameOffsets [mMp3PlayFrame] & 0x1F;
+              src->reset();
+              fifoFrames = 0;
               mWaveChanged = false;
               headerBytes = 0;
               }
@@ -562,14 +1182,50 @@ static void mp3PlayThread (void const* argument) {
   }
 //}}}
 
+//{{{
+static void placementReport() {
+// itcm and qspi use from LinkerScript.ld symbols, memcpy cycles from wherever the linker put it
+// - mp3 decode cycles follow in mp3Play's cache report, per heap placement in mp3PlacementReport, dma2d isr cycles are in the trace
+
+  extern uint32_t _sitcm, _eitcm, _qspi_start, _qspi_end;
+
+  auto src = (uint8_t*)pvPortMalloc (4096);
+  auto dst = (uint8_t*)pvPortMalloc (4096);
+  memcpy (dst, src, 4096);
+  auto start = cpuWallCycles();
+  for (auto i = 0; i < 16; i++)
+    memcpy (dst, src, 4096);
+  uint32_t cycles = (cpuWallCycles() - start) / 16;
+  vPortFree (dst);
+  vPortFree (src);
+
+  printf ("placement itcm %u bytes, qspi %u bytes, memcpy %s 4k %lu cycles\n",
+          (unsigned)((uint8_t*)&_eitcm - (uint8_t*)&_sitcm), (unsigned)((uint8_t*)&_qspi_end - (uint8_t*)&_qspi_start),
+          ((uint32_t)memcpy < 0x4000) ? "itcm" : "flash", cycles);
+  }
+//}}}
 //{{{
 static void mainThread (void const* argument) {
 
-  const bool kMaxTouch = 1;
+  placementReport();
   mLcd->displayOn();
 
   SD_Init();
-  if (BSP_PB_GetState (BUTTON_WAKEUP) == GPIO_PIN_SET) {
+  if (kUsbAudio && (BSP_PB_GetState (BUTTON_WAKEUP) == GPIO_PIN_SET)) {
+    //{{{  usb audio DAC
+    BSP_AUDIO_OUT_Init (OUTPUT_DEVICE_HEADPHONE, int(mMp3Volume * 100), 48000);
+    BSP_AUDIO_OUT_SetAudioFrameSlot (CODEC_AUDIOFRAME_SLOT_02);
+    mUsbAudio = true;
+
+    USBD_Init (&USBD_Device, &AUDIO_Desc, 0);
+    USBD_RegisterClass (&USBD_Device, &USBD_AUDIO);
+    USBD_AUDIO_RegisterInterface (&USBD_Device, &USBD_AUDIO_fops);
+    USBD_Start (&USBD_Device);
+
+    debug ("USB audio ok");
+    }
+    //}}}
+  else if (BSP_PB_GetState (BUTTON_WAKEUP) == GPIO_PIN_SET) {
     //{{{  usb sd MSC
     USBD_Init (&USBD_Device, &MSC_Desc, 0);
     USBD_RegisterClass (&USBD_Device, &USBD_MSC);
@@ -597,11 +1253,17 @@ static void mainThread (void const* argument) {
     mWave[0] = 0;
     mWaveLoadFrame = 0;
 
+    mSpectrum = new cSpectrum();
+    mSpectrum->setRate (44100);
+
     initMp3Menu (mRoot);
     mLcd->setShowDebug (false, false, false, true);  // disable debug - title, info, lcdStats, footer
 
     TaskHandle_t handle;
-    xTaskCreate ((TaskFunction_t)mp3PlayThread, "mp3Play", 8192, 0, 3, &handle);
+    staticTaskCreate ((TaskFunction_t)mp3PlayThread, "mp3Play", 8192, 0, 3, &handle);
+
+    staticTasksBooted();
+    staticTasksReport();
     }
     //}}}
   else {
@@ -616,8 +1278,8 @@ static void mainThread (void const* argument) {
       BSP_AUDIO_OUT_SetAudioFrameSlot (CODEC_AUDIOFRAME_SLOT_02);
     #endif
 
-    mReSamples = (int16_t*)pvPortMalloc (4096);
-    memset (mReSamples, 0, 4096);
+    mReSamples = (int16_t*)pvPortMalloc (kHlsFifoFrames * 4);
+    memset (mReSamples, 0, kHlsFifoFrames * 4);
 
     mLcd->setShowDebug (false, false, false, false);  // debug - title, info, lcdStats, footer
 
@@ -628,72 +1290,125 @@ static void mainThread (void const* argument) {
 
     TaskHandle_t handle;
     #ifdef ESP8266
-      xTaskCreate ((TaskFunction_t)hlsLoaderThread, "hlsLoad", 14000, 0, 3, &handle);
-      xTaskCreate ((TaskFunction_t)hlsPlayerThread, "hlsPlay", 2000, 0, 4, &handle);
+      staticTaskCreate ((TaskFunction_t)hlsLoaderThread, "hlsLoad", 14000, 0, 3, &handle);
+      staticTaskCreate ((TaskFunction_t)hlsPlayerThread, "hlsPlay", 2000, 0, 4, &handle);
+      staticTasksBooted();
+      staticTasksReport();
     #else
-      xTaskCreate ((TaskFunction_t)hlsNetThread, "Net", 1024, 0, 3, &handle);
+      staticTaskCreate ((TaskFunction_t)hlsNetThread, "Net", 1024, 0, 3, &handle);
     #endif
     }
     //}}}
 
   //{{{  init vars
-  int16_t x[kMaxTouch];
-  int16_t y[kMaxTouch];
-  uint8_t z[kMaxTouch];
-  int pressed[kMaxTouch];
-  for (auto touch = 0; touch < kMaxTouch; touch++)
-    pressed[touch] = 0;
+  int16_t x = 0;
+  int16_t y = 0;
+  uint8_t z = 0;
+  int16_t xinc = 0;
+  int16_t yinc = 0;
+  bool down = false;
+  int pressed = 0;
   //}}}
-  BSP_TS_Init (mRoot->getPixWidth(), mRoot->getPixHeight());
+  touchInit (mRoot->getPixWidth(), mRoot->getPixHeight());
   while (true) {
     //bool button = true;
 
     bool button = BSP_PB_GetState (BUTTON_WAKEUP) == GPIO_PIN_SET;
-    TS_StateTypeDef tsState;
-    BSP_TS_GetState (&tsState);
-    for (auto touch = 0; touch < kMaxTouch; touch++) {
-      if (touch < tsState.touchDetected) {
-        //{{{  pressed
-        auto xinc = pressed[touch] ? tsState.touchX[touch] - x[touch] : 0;
-        auto yinc = pressed[touch] ? tsState.touchY[touch] - y[touch] : 0;
-        x[touch] = tsState.touchX[touch];
-        y[touch] = tsState.touchY[touch];
-        z[touch] = tsState.touchWeight[touch];
-        if (touch == 0)
-          button ? mLcd->press (pressed[0], x[0], y[0], z[0], xinc, yinc) : mRoot->press (pressed[0], x[0], y[0], z[0], xinc, yinc);
-        pressed[touch]++;
-        }
-        //}}}
-      else {
-        //{{{  released
-        x[touch] = 0;
-        y[touch] = 0;
-        z[touch] = 0;
-        if (!touch && pressed[0])
+    //{{{  gestures, drags since the last frame coalesce into one press
+    tGesture gesture;
+    while (touchGesture (gesture, 0)) {
+      switch (gesture.type) {
+        case eGesturePress:
+        case eGestureDrag:
+          down = true;
+          x = gesture.x;
+          y = gesture.y;
+          z = gesture.z;
+          xinc += gesture.dx;
+          yinc += gesture.dy;
+          break;
+
+        case eGestureRelease:
+          // a tap inside one frame still presses before it releases
+          if (!pressed)
+            button ? mLcd->press (0, x, y, z, 0, 0) : mRoot->press (0, x, y, z, 0, 0);
           mRoot->release();
-        pressed[touch] = 0;
+          down = false;
+          pressed = 0;
+          xinc = 0;
+          yinc = 0;
+          break;
+
+        default:
+          // fling, pinch, long press, no widget takes them yet
+          break;
         }
-        //}}}
       }
 
+    if (down) {
+      button ? mLcd->press (pressed, x, y, z, xinc, yinc) : mRoot->press (pressed, x, y, z, xinc, yinc);
+      pressed++;
+      xinc = 0;
+      yinc = 0;
+      }
+    //}}}
+
     #ifdef STM32F769I_DISCO
       //{{{  update led2,3
       button ? BSP_LED_On (LED2) : BSP_LED_Off (LED2);
-      tsState.touchDetected ? BSP_LED_On (LED3) : BSP_LED_Off (LED3);
+      down ? BSP_LED_On (LED3) : BSP_LED_Off (LED3);
       //}}}
     #endif
 
     mLcd->startRender();
     button ? mLcd->clear (COL_BLACK) : mRoot->render (mLcd);
     //{{{  cursor
-    //if (tsState.touchDetected)
-    //  mLcd->renderCursor (COL_MAGENTA, x[0], y[0], z[0] ? z[0] : cLcd::getHeight()/10);
+    //if (down)
+    //  mLcd->renderCursor (COL_MAGENTA, x, y, z ? z : cLcd::getHeight()/10);
     //}}}
-    if (kSdDebug)
+    if (kSdDebug) {
       mLcd->text (COL_YELLOW, cWidget::getFontHeight(), SD_info(),
                   mLcd->getLcdWidthPix()/2, mLcd->getLcdHeightPix()- cWidget::getBoxHeight(),
                   mLcd->getLcdWidthPix(), cWidget::getBoxHeight());
+      mLcd->text (COL_YELLOW, cWidget::getFontHeight(), sdIoInfo(),
+                  0, mLcd->getLcdHeightPix() - 2*cWidget::getBoxHeight(),
+                  mLcd->getLcdWidthPix(), cWidget::getBoxHeight());
+      }
+    if (button) {
+      //{{{  task stats panel, name cpu% stackFree heap
+      const tTaskStat* stats;
+      auto numStats = taskStatsGet (&stats);
+      auto lineHeight = cWidget::getFontHeight();
+      auto y = 0;
+      for (auto i = 0; (i < numStats) && (y + lineHeight <= mLcd->getLcdHeightPix()); i++, y += lineHeight) {
+        char str[64];
+        sprintf (str, "%-12s %c %3d.%d%% %5d %6d", stats[i].name, stats[i].state,
+                 stats[i].cpu / 10, stats[i].cpu % 10, stats[i].stackFree * 4, (int)stats[i].heapBytes);
+        mLcd->text (stats[i].stackFree < 64 ? COL_RED : COL_YELLOW, lineHeight, str,
+                    mLcd->getLcdWidthPix()/2, y, mLcd->getLcdWidthPix()/2, lineHeight);
+        }
+      //}}}
+      //{{{  cpu load graph, 100ms a bar, bottom left
+      uint8_t history[CPU_LOAD_HISTORY];
+      auto numHistory = cpuLoadHistory (history, CPU_LOAD_HISTORY);
+      auto graphHeight = mLcd->getLcdHeightPix() / 4;
+      auto barWidth = (mLcd->getLcdWidthPix() / 2) / CPU_LOAD_HISTORY;
+      for (auto i = 0; i < numHistory; i++) {
+        auto barHeight = (history[i] * graphHeight) / 100;
+        mLcd->rect (history[i] > 80 ? COL_RED : COL_GREEN,
+                    i * barWidth, mLcd->getLcdHeightPix() - barHeight, barWidth, barHeight);
+        }
+      mLcd->text (COL_WHITE, lineHeight, "cpu " + dec (osGetCPUUsage()) + "%",
+                  0, mLcd->getLcdHeightPix() - graphHeight - lineHeight, mLcd->getLcdWidthPix()/2, lineHeight);
+      //}}}
+      }
+    traceSpanBegin (TRACE_SPAN_RENDER);
     mLcd->endRender (button);
+    traceSpanEnd (TRACE_SPAN_RENDER);
+
+    if (kTrace && traceEnabled && traceFull())
+      // ring wrapped, dump it as chrome trace json, which also stops tracing
+      traceDump();
 
     if (mHls) {
       if (mHls->mVolumeChanged && (int(mHls->mVolume * 100) != mIntVolume)) {
@@ -720,32 +1435,58 @@ static void mainThread (void const* argument) {
 //{{{
 static void initMpuRegions() {
 // init MPU regions
+// - sram and sdram writeBack, writeAllocate when DCACHE_WRITE_BACK, dma buffers there go through dmaBuf.h
+// - frameBuffers stay writeThrough, only dma2d and ltdc touch them
+// - usb pcd handle uncached, USBD_PCD_ALIGN bytes
 
-  // common MPU config for writeThrough
+  // common MPU config
   HAL_MPU_Disable();
 
   MPU_Region_InitTypeDef MPU_InitStruct;
   MPU_InitStruct.Enable = MPU_REGION_ENABLE;
   MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
   MPU_InitStruct.SubRegionDisable = 0x00;
-  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  MPU_InitStruct.IsBufferable = DCACHE_WRITE_BACK ? MPU_ACCESS_BUFFERABLE : MPU_ACCESS_NOT_BUFFERABLE;
   MPU_InitStruct.IsCacheable = MPU_ACCESS_CACHEABLE;
   MPU_InitStruct.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
-  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL0;
+  MPU_InitStruct.TypeExtField = DCACHE_WRITE_BACK ? MPU_TEX_LEVEL1 : MPU_TEX_LEVEL0;
   MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
 
-  // config writeThrough for SRAM1,SRAM2 0x20010000, 256kb, AXI - region0
+  // config SRAM1,SRAM2 0x20010000, 256kb, AXI - region0
   MPU_InitStruct.Number = MPU_REGION_NUMBER0;
   MPU_InitStruct.BaseAddress = 0x20010000;
   MPU_InitStruct.Size = MPU_REGION_SIZE_256KB;
   HAL_MPU_ConfigRegion (&MPU_InitStruct);
 
-  // config writeThrough for SDRAM 0xC0000000, 16mb - region1
+  // config SDRAM 0xC0000000, 16mb - region1
   MPU_InitStruct.Number = MPU_REGION_NUMBER1;
   MPU_InitStruct.BaseAddress = 0xC0000000;
   MPU_InitStruct.Size = MPU_REGION_SIZE_16MB;
   HAL_MPU_ConfigRegion (&MPU_InitStruct);
 
+  // config writeThrough for frameBuffers, overrides region1 - region2
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL0;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER2;
+  MPU_InitStruct.BaseAddress = SDRAM_FRAME0;
+  #ifdef STM32F746G_DISCO
+    MPU_InitStruct.Size = MPU_REGION_SIZE_1MB;
+  #else
+    // 3mb, 6 of 8 512k subregions
+    MPU_InitStruct.Size = MPU_REGION_SIZE_4MB;
+    MPU_InitStruct.SubRegionDisable = 0xC0;
+  #endif
+  HAL_MPU_ConfigRegion (&MPU_InitStruct);
+
+  // config hpcd uncached, otg hs dma writes setup packets into it, overrides region0 - region3
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.SubRegionDisable = 0x00;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER3;
+  MPU_InitStruct.BaseAddress = (uint32_t)&hpcd;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_1KB;
+  HAL_MPU_ConfigRegion (&MPU_InitStruct);
+
   HAL_MPU_Enable (MPU_PRIVILEGED_DEFAULT);
   }
 //}}}
@@ -858,9 +1599,17 @@ int main() {
   initMpuRegions();
   initClock();
   initDebugUart();
+  if (kTrace) {
+    traceInit();
+    traceStart();
+    }
 
-  HeapRegion_t xHeapRegions[] = { {(uint8_t*)SDRAM_HEAP, SDRAM_HEAP_SIZE }, { nullptr, 0 } };
+  // fast sram then bulk sdram, in address order
+  HeapRegion_t xHeapRegions[] = { {(uint8_t*)SRAM_HEAP, SRAM_HEAP_SIZE },
+                                  {(uint8_t*)SDRAM_HEAP, SDRAM_HEAP_SIZE },
+                                  { nullptr, 0 } };
   vPortDefineHeapRegions (xHeapRegions);
+  logInit();
 
   BSP_QSPI_Init();
   BSP_QSPI_EnableMemoryMappedMode();
@@ -883,7 +1632,7 @@ int main() {
   vSemaphoreCreateBinary (mAudSem);
 
   TaskHandle_t handle;
-  xTaskCreate ((TaskFunction_t)mainThread, "main", 2048, 0, 3, &handle);
+  staticTaskCreate ((TaskFunction_t)mainThread, "main", 2048, 0, 3, &handle);
 
   vTaskStartScheduler();
 
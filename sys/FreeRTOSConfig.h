@@ -6,6 +6,7 @@ extern uint32_t SystemCoreClock;
 #define configUSE_PREEMPTION             1
 #define configUSE_IDLE_HOOK              1
 #define configUSE_TICK_HOOK              1
+#define configUSE_TICKLESS_IDLE          2  // vPortSuppressTicksAndSleep in cpuUsage.c
 #define configCPU_CLOCK_HZ               (SystemCoreClock)
 #define configTICK_RATE_HZ               ((TickType_t)1000)
 #define configMAX_PRIORITIES             (7)
@@ -17,20 +18,22 @@ extern uint32_t SystemCoreClock;
 #define configIDLE_SHOULD_YIELD          1
 #define configUSE_MUTEXES                1
 #define configQUEUE_REGISTRY_SIZE        8
-#define configCHECK_FOR_STACK_OVERFLOW   0
+#define configCHECK_FOR_STACK_OVERFLOW   2
 #define configUSE_RECURSIVE_MUTEXES      1
 #define configUSE_MALLOC_FAILED_HOOK     0
-#define configUSE_APPLICATION_TASK_TAG   0
+#define configUSE_APPLICATION_TASK_TAG   1  // sdIo class per task
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 1  // sdIo card handoff semaphore per task
 #define configUSE_COUNTING_SEMAPHORES    1
-#define configGENERATE_RUN_TIME_STATS    0
+#define configGENERATE_RUN_TIME_STATS    1
 #define configUSE_STATS_FORMATTING_FUNCTIONS  1
+#define configAPP_STATIC_ALLOCATION      1  // task stacks from staticTasks.c tables, lwip mboxes and sems from pools
 
 // Co-routine definitions
 #define configUSE_CO_ROUTINES            0
 #define configMAX_CO_ROUTINE_PRIORITIES  (2)
 
 // Software timer definitions
-#define configUSE_TIMERS      0
+#define configUSE_TIMERS                 1  // taskStats.c sampling timer
 #define configTIMER_TASK_PRIORITY        (2)
 #define configTIMER_QUEUE_LENGTH         10
 #define configTIMER_TASK_STACK_DEPTH     (configMINIMAL_STACK_SIZE * 2)
@@ -40,15 +43,40 @@ extern uint32_t SystemCoreClock;
 #define INCLUDE_uxTaskPriorityGet      1
 #define INCLUDE_vTaskDelete            1
 #define INCLUDE_vTaskCleanUpResources  0
-#define INCLUDE_vTaskSuspend           0
+#define INCLUDE_vTaskSuspend           1
 #define INCLUDE_vTaskDelayUntil        1
 #define INCLUDE_vTaskDelay             1
 #define INCLUDE_xTaskGetSchedulerState 1
+#define INCLUDE_pcTaskGetTaskName      1
+
+// run time stats clocked by the dwt cycle counter plus the cycles it missed in tickless sleep, see cpuUsage.c
+#ifdef __cplusplus
+  extern "C" volatile uint32_t cpuSleptCycles;
+#else
+  extern volatile uint32_t cpuSleptCycles;
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() extern void taskStatsInitCounter(void); \
+                                                 taskStatsInitCounter()
+#define portGET_RUN_TIME_COUNTER_VALUE()         ((*(volatile uint32_t*)0xE0001004) + cpuSleptCycles) // DWT->CYCCNT
+
+// task stacks from the fast sram heap, sdram when it is full
+#define pvPortMallocAligned(x, puxStackBuffer) \
+  (((puxStackBuffer) == NULL) ? (pvPortMallocPlaced ((x), eHeapFast)) : (puxStackBuffer))
+// staticTaskCreate stacks belong to their table, only heap stacks are freed
+#define vPortFreeAligned(pv) do { extern int staticStackOwned (void* stack); \
+                                  if (!staticStackOwned (pv)) vPortFree (pv); } while (0)
 
 #define traceTASK_SWITCHED_IN()  extern void StartIdleMonitor(void); \
-                                 StartIdleMonitor()
+                                 extern void traceTaskSwitch (uint32_t type, void* tcb); \
+                                 StartIdleMonitor(); \
+                                 traceTaskSwitch (0, pxCurrentTCB)
 #define traceTASK_SWITCHED_OUT() extern void EndIdleMonitor(void); \
-                                 EndIdleMonitor()
+                                 extern void traceTaskSwitch (uint32_t type, void* tcb); \
+                                 EndIdleMonitor(); \
+                                 traceTaskSwitch (1, pxCurrentTCB)
+// heap_5.c per task stats, the slot is released once the deleted task's blocks are freed
+#define traceTASK_DELETE(pxTaskToDelete) extern void vPortHeapTaskDeleted (void* xTask); \
+                                         vPortHeapTaskDeleted (pxTaskToDelete)
 
 // Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -1,22 +1,40 @@
-// cpuUsage.c
+// cpuUsage.c - tickless idle, busy/idle accounting in core cycles, load history
 /*{{{  includes*/
 #include "cpuUsage.h"
 
+#include "stm32f7xx.h"
 #include "freertos.h"
 #include "task.h"
 /*}}}*/
 
 // const
-#define CALCULATION_PERIOD 1000
+#define CPU_SAMPLE_MS        100  // one load history sample
+#define CPU_USAGE_SAMPLES     10  // osGetCPUUsage averages the last second
+#define STOPPED_SYSTICK_COMP  45  // systick counts lost while it is stopped and restarted
 
 // vars
+volatile uint32_t cpuSleptCycles = 0;  // dwt cycle counter stops in wfi, add the cycles slept back
+static volatile uint32_t halTick = 0;
+
 static xTaskHandle xIdleHandle = NULL;
-static uint32_t osCPU_IdleStartTime = 0;
-static uint32_t osCPU_IdleSpentTime = 0;
-static uint32_t osCPU_TotalIdleTime = 0;
+static uint32_t idleStartCycles = 0;
+static uint32_t idleCycles = 0;
+static uint32_t sampleStartCycles = 0;
 
-static int tick = 0;
-static volatile uint32_t osCPU_Usage = 0;
+static uint8_t loadHistory[CPU_LOAD_HISTORY];
+static volatile uint32_t loadIndex = 0;
+
+/*{{{*/
+void HAL_IncTick() {
+  halTick++;
+  }
+/*}}}*/
+/*{{{*/
+uint32_t HAL_GetTick() {
+// systick interrupts are suppressed in tickless idle, halTick is stepped with the kernel tick
+  return halTick;
+  }
+/*}}}*/
 
 /*{{{*/
 void vApplicationIdleHook() {
@@ -28,15 +46,23 @@ void vApplicationIdleHook() {
 /*}}}*/
 /*{{{*/
 void vApplicationTickHook() {
+// sample load every CPU_SAMPLE_MS of wall cycles, only real ticks get here, suppressed ones make a longer sample
 
-  if (tick++ > CALCULATION_PERIOD) {
-    tick = 0;
+  uint32_t now = cpuWallCycles();
+  uint32_t elapsed = now - sampleStartCycles;
+  if (elapsed >= (SystemCoreClock / 1000) * CPU_SAMPLE_MS) {
+    if (xTaskGetCurrentTaskHandle() == xIdleHandle) {
+      // idle span still running, count it up to now
+      idleCycles += now - idleStartCycles;
+      idleStartCycles = now;
+      }
 
-    if (osCPU_TotalIdleTime > 1000)
-      osCPU_TotalIdleTime = 1000;
+    uint32_t idle = idleCycles > elapsed ? elapsed : idleCycles;
+    loadHistory[loadIndex % CPU_LOAD_HISTORY] = 100 - (uint32_t)(((uint64_t)idle * 100) / elapsed);
+    loadIndex++;
 
-    osCPU_Usage = (osCPU_TotalIdleTime * 100) / CALCULATION_PERIOD;
-    osCPU_TotalIdleTime = 0;
+    idleCycles = 0;
+    sampleStartCycles = now;
     }
   }
 /*}}}*/
@@ -45,22 +71,124 @@ void vApplicationTickHook() {
 void StartIdleMonitor() {
 
   if (xTaskGetCurrentTaskHandle() == xIdleHandle)
-    osCPU_IdleStartTime = xTaskGetTickCountFromISR();
+    idleStartCycles = cpuWallCycles();
   }
 /*}}}*/
 /*{{{*/
 void EndIdleMonitor() {
 
-  if (xTaskGetCurrentTaskHandle() == xIdleHandle) {
-    osCPU_IdleSpentTime = xTaskGetTickCountFromISR() - osCPU_IdleStartTime;
-    osCPU_TotalIdleTime += osCPU_IdleSpentTime;
+  if (xTaskGetCurrentTaskHandle() == xIdleHandle)
+    idleCycles += cpuWallCycles() - idleStartCycles;
+  }
+/*}}}*/
+
+/*{{{*/
+void vPortSuppressTicksAndSleep (TickType_t xExpectedIdleTime) {
+// configUSE_TICKLESS_IDLE 2, the port's systick version plus cycle and HAL tick accounting
+// - sleep mode only, sai, sdmmc, ltdc and ethernet dma keep running and wake us
+// - systick clocks at the core clock, so systick counts slept are core cycles
+
+  uint32_t countsPerTick = SystemCoreClock / configTICK_RATE_HZ;
+  uint32_t maxTicks = SysTick_LOAD_RELOAD_Msk / countsPerTick;
+  if (xExpectedIdleTime > maxTicks)
+    xExpectedIdleTime = maxTicks;
+
+  SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+  // -1 as we are part way through this tick
+  uint32_t reload = SysTick->VAL + (countsPerTick * (xExpectedIdleTime - 1));
+  if (reload > STOPPED_SYSTICK_COMP)
+    reload -= STOPPED_SYSTICK_COMP;
+
+  // not taskENTER_CRITICAL, that masks the interrupts that should wake us
+  __disable_irq();
+
+  if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+    // finish this tick period from what is left
+    SysTick->LOAD = SysTick->VAL;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = countsPerTick - 1;
+    __enable_irq();
+    return;
     }
+
+  SysTick->LOAD = reload;
+  SysTick->VAL = 0;
+  SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+  uint32_t sleepCycles = DWT->CYCCNT;
+  __DSB();
+  __WFI();
+  __ISB();
+  sleepCycles = DWT->CYCCNT - sleepCycles;
+
+  uint32_t ctrl = SysTick->CTRL;
+  SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+
+  uint32_t completeTicks;
+  uint32_t sleptCounts;
+  if (ctrl & SysTick_CTRL_COUNTFLAG_Msk) {
+    // tick interrupt pending, reload whatever remains of this tick
+    sleptCounts = reload + 1 + (reload - SysTick->VAL);
+    uint32_t load = (countsPerTick - 1) - (reload - SysTick->VAL);
+    if ((load < STOPPED_SYSTICK_COMP) || (load > countsPerTick))
+      load = countsPerTick - 1;
+    SysTick->LOAD = load;
+
+    // the pending tick interrupt counts one of them
+    completeTicks = xExpectedIdleTime - 1;
+    }
+  else {
+    // something else woke us, round to complete ticks
+    sleptCounts = reload - SysTick->VAL;
+    uint32_t decrements = (xExpectedIdleTime * countsPerTick) - SysTick->VAL;
+    completeTicks = decrements / countsPerTick;
+    SysTick->LOAD = ((completeTicks + 1) * countsPerTick) - decrements;
+    }
+
+  // cycles the dwt counter missed, zero if a debugger keeps it clocked in sleep
+  if (sleptCounts > sleepCycles)
+    cpuSleptCycles += sleptCounts - sleepCycles;
+
+  __enable_irq();
+
+  SysTick->VAL = 0;
+  portENTER_CRITICAL();
+  SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+  vTaskStepTick (completeTicks);
+  halTick += completeTicks;
+  SysTick->LOAD = countsPerTick - 1;
+  portEXIT_CRITICAL();
   }
 /*}}}*/
 
 /*{{{*/
 unsigned short osGetCPUUsage() {
+// busy percent over the last second
+
+  uint32_t index = loadIndex;
+  uint32_t samples = index < CPU_USAGE_SAMPLES ? index : CPU_USAGE_SAMPLES;
+  if (!samples)
+    return 0;
+
+  uint32_t total = 0;
+  for (uint32_t i = 1; i <= samples; i++)
+    total += loadHistory[(index - i) % CPU_LOAD_HISTORY];
+  return (unsigned short)(total / samples);
+  }
+/*}}}*/
+/*{{{*/
+int cpuLoadHistory (uint8_t* history, int count) {
+// oldest first, busy percent per CPU_SAMPLE_MS, returns samples copied
+
+  uint32_t index = loadIndex;
+  if (count > CPU_LOAD_HISTORY)
+    count = CPU_LOAD_HISTORY;
+  if ((uint32_t)count > index)
+    count = index;
 
-  return (unsigned short)osCPU_Usage;
+  for (int i = 0; i < count; i++)
+    history[i] = loadHistory[(index - count + i) % CPU_LOAD_HISTORY];
+  return count;
   }
 /*}}}*/
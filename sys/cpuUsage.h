@@ -1,11 +1,21 @@
 // cpuUsage.h
 #pragma once
+#include <stdint.h>
+#include "stm32f7xx.h"
+
+#define CPU_LOAD_HISTORY  128  // power of 2
 
 #ifdef __cplusplus
  extern "C" {
 #endif
 
+extern volatile uint32_t cpuSleptCycles;
+
+// core cycles since reset, the dwt counter plus the cycles it missed asleep in tickless idle, wraps in 20s
+static inline uint32_t cpuWallCycles() { return DWT->CYCCNT + cpuSleptCycles; }
+
 unsigned short osGetCPUUsage();
+int cpuLoadHistory (uint8_t* history, int count);
 
 #ifdef __cplusplus
   }
@@ -0,0 +1,103 @@
+// dmaBuf.c - cache line aligned dma buffers, d-cache maintenance per transfer direction
+// - dtcm is never cached, dma buffers placed there by memory.h need no maintenance
+// - sram and sdram are cached write back when DCACHE_WRITE_BACK, write through otherwise,
+//   tx clean is needed for write back, rx invalidate for both
+/*{{{  includes*/
+#include "dmaBuf.h"
+#include "memory.h"
+
+#include "stm32f7xx.h"
+#include "FreeRTOS.h"
+/*}}}*/
+
+#define DTCM_START  0x20000000
+#define DTCM_END    0x20010000
+
+volatile uint32_t dmaCleans = 0;
+volatile uint32_t dmaInvalidates = 0;
+
+/*{{{*/
+static int dmaCached (const void* buf) {
+  return ((uint32_t)buf < DTCM_START) || ((uint32_t)buf >= DTCM_END);
+  }
+/*}}}*/
+/*{{{*/
+static uint32_t* lineStart (const void* buf) {
+  return (uint32_t*)((uint32_t)buf & ~(DMA_LINE-1));
+  }
+/*}}}*/
+/*{{{*/
+static int32_t lineBytes (const void* buf, size_t bytes) {
+// lines covering buf, the cmsis by_Addr ops step a line at a time from addr, so start on a line
+  return (int32_t)(DMA_LINES((uint32_t)buf + bytes) - ((uint32_t)buf & ~(DMA_LINE-1)));
+  }
+/*}}}*/
+
+/*{{{*/
+void* dmaAlloc (size_t bytes) {
+// pvPortMalloc is 8 byte aligned, over allocate by a line, original block kept in the word below
+
+  uint8_t* block = (uint8_t*)pvPortMalloc (DMA_LINES(bytes) + DMA_LINE);
+  if (!block)
+    return NULL;
+
+  void** buf = (void**)DMA_LINES((uint32_t)block + sizeof(void*));
+  buf[-1] = block;
+  return buf;
+  }
+/*}}}*/
+/*{{{*/
+void dmaFree (void* buf) {
+  if (buf)
+    vPortFree (((void**)buf)[-1]);
+  }
+/*}}}*/
+
+/*{{{*/
+int dmaAligned (const void* buf, size_t bytes) {
+  return !dmaCached (buf) || ((((uint32_t)buf | bytes) & (DMA_LINE-1)) == 0);
+  }
+/*}}}*/
+
+/*{{{*/
+void dmaTxStart (const void* buf, size_t bytes) {
+// partial lines are safe to clean, whatever shares them is written back unchanged
+
+#if DCACHE_WRITE_BACK
+  if (dmaCached (buf) && bytes) {
+    SCB_CleanDCache_by_Addr (lineStart (buf), lineBytes (buf, bytes));
+    dmaCleans++;
+    }
+#endif
+  }
+/*}}}*/
+/*{{{*/
+void dmaRxStart (void* buf, size_t bytes) {
+
+#if DCACHE_WRITE_BACK
+  if (dmaCached (buf) && bytes) {
+    SCB_CleanInvalidateDCache_by_Addr (lineStart (buf), lineBytes (buf, bytes));
+    dmaCleans++;
+    }
+#endif
+  }
+/*}}}*/
+/*{{{*/
+void dmaRxDone (void* buf, size_t bytes) {
+
+  if (dmaCached (buf) && bytes) {
+    SCB_InvalidateDCache_by_Addr (lineStart (buf), lineBytes (buf, bytes));
+    dmaInvalidates++;
+    }
+  }
+/*}}}*/
+
+/*{{{*/
+void dmaCleanAll() {
+
+#if DCACHE_WRITE_BACK
+  SCB_CleanDCache();
+  dmaCleans++;
+#endif
+  }
+/*}}}*/
@@ -0,0 +1,37 @@
+// dmaBuf.h - cache line aligned dma buffers, d-cache maintenance per transfer direction
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define DMA_LINE             32   // cortex-m7 d-cache line
+#define DMA_LINES(bytes)     (((bytes) + DMA_LINE-1) & ~(DMA_LINE-1))
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+extern volatile uint32_t dmaCleans;
+extern volatile uint32_t dmaInvalidates;
+
+// start and size on whole lines, padded, from the heap
+void* dmaAlloc (size_t bytes);
+void dmaFree (void* buf);
+
+// device can write buf without sharing a line with anything else, or buf is uncached dtcm
+int dmaAligned (const void* buf, size_t bytes);
+
+// memory to device, write back buf before the device reads it
+void dmaTxStart (const void* buf, size_t bytes);
+
+// device to memory, buf must be dmaAligned
+// - start writes back and drops buf, no dirty line can be evicted over the incoming data
+// - done drops lines speculatively refilled while the device was writing
+void dmaRxStart (void* buf, size_t bytes);
+void dmaRxDone (void* buf, size_t bytes);
+
+// whole d-cache write back, before a device reads from many cpu written buffers, dma2d display lists
+void dmaCleanAll();
+
+#ifdef __cplusplus
+  }
+#endif
@@ -31,7 +31,7 @@
 #define TCP_QUEUE_OOSEQ   0            // TCP queues segments that arrive out of order, 0 low memory
 #define TCP_MSS           (1500 - 40)  // TCP_MSS = (Ethernet MTU - IP header size - TCP header size)
 
-#define TCP_SND_BUF       (4*TCP_MSS)  // TCP sender buffer space (bytes)
+#define TCP_SND_BUF       (8*TCP_MSS)  // TCP sender buffer space (bytes), keeps sd file streams in flight
 
 #define TCP_SND_QUEUELEN  (2* TCP_SND_BUF/TCP_MSS) // TCP sender buffer space (pbufs) must be (2 * TCP_SND_BUF/TCP_MSS) for things to work
 #define TCP_WND           (10*TCP_MSS) // TCP receive window
@@ -50,12 +50,12 @@
 #define NO_SYS                  0 // = 1 provides VERY minimal functionality
 
 #define MEM_ALIGNMENT           4
-#define MEM_SIZE                (5*1024) // size of heap memory, high if lot data copied
+#define MEM_SIZE                (8*1024) // size of heap memory, high if lot data copied, also no copy segment headers
 #define MEMP_NUM_PBUF           100      // number of memp struct pbufs. high if lot of data out of ROM
 #define MEMP_NUM_UDP_PCB        6        // number of UDP protocol control blocks. One per active UDP "connection"
 #define MEMP_NUM_TCP_PCB        10       // number of simulatenously active TCP connections
 #define MEMP_NUM_TCP_PCB_LISTEN 5        // number of listening TCP connections
-#define MEMP_NUM_TCP_SEG        12       // number of simultaneously queued TCP segments
+#define MEMP_NUM_TCP_SEG        32       // number of simultaneously queued TCP segments, at least TCP_SND_QUEUELEN
 #define MEMP_NUM_SYS_TIMEOUT    10       // number of simulateously active timeouts
 
 #define CHECKSUM_GEN_IP     0
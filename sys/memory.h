@@ -1,6 +1,13 @@
 // memory.h - explicit memory placement
 #pragma once
 
+// sram and sdram d-cache write back, dma buffers outside dtcm go through dmaBuf.h, 0 write through
+#define DCACHE_WRITE_BACK  1
+
+// code and const placement, LinkerScript.ld
+#define ITCM_CODE   __attribute__((section(".itcm")))       // copied to itcm ram at reset, zero wait state
+#define QSPI_CONST  __attribute__((section(".textqspi")))   // memory mapped qspi flash, large tables
+
 // DTCM         0x20000000 - 0x2000FFFF
 #define AUDIO_BUFFER         0x20000000
 #define AUDIO_BUFFER_HALF    0x20001200  // SIZE = 0x1200 = 1152*4
@@ -10,7 +17,8 @@
 #define FATFS_BUFFER_SIZE         0x200  // SIZE =  0x200 = 512 bytes - sector size
 
 //#define USB_BUFFER           0x20002600  // 620
-#define UART_DMA             0x20002600  // 620
+#define UART_DMA             0x20002600
+#define UART_DMA_SIZE             0xA00  // SIZE = 2560 bytes - debug log tx dma
 
 #define EthRxDescripSection  0x20003000  // SIZE =   0xA0 bytes
 #define EthRxBUF             0x20003100  // SIZE = 0x1DC4 bytes
@@ -18,20 +26,31 @@
 #define EthTxBUF             0x20005100  // SIZE = 0x1DC4 bytes
 
 #define DMA2D_BUFFER         0x20007000
-#define DMA2D_BUFFER_SIZE        0x9000  // SIZE = rest of dtcm
+#define DMA2D_BUFFER_SIZE        0x8000  // SIZE = 32k
+
+#define TRACE_BUFFER         0x2000F000
+#define TRACE_BUFFER_SIZE        0x1000  // SIZE = rest of dtcm, 512 events of 8 bytes
+
+// SRAM1        0x20010000 - 0x20017FFF, below linker RAM
+#define SRAM_HEAP            0x20010000
+#define SRAM_HEAP_SIZE           0x8000  // SIZE = 32k - fast heap, task stacks
 
 #ifdef STM32F746G_DISCO
   // SDRAM        0xC0000000 - 0xC007FFFF
   #define SDRAM_FRAME0         0xC0000000
   #define SDRAM_FRAME_SIZE       0x07F800  // SIZE = 0x7F800 = 272*480*4 = 512k-2048b leave bit of guard for clipping errors
   #define SDRAM_FRAME1         0xC0080000
-  #define SDRAM_HEAP           0xC0100000
-  #define SDRAM_HEAP_SIZE        0x700000  // SIZE = 7m
+  #define SDRAM_STACKS         0xC0100000
+  #define SDRAM_STACKS_SIZE       0x40000  // SIZE = 256k - bulk task stacks, staticTasks.c
+  #define SDRAM_HEAP           0xC0140000
+  #define SDRAM_HEAP_SIZE        0x6C0000  // SIZE = 7m-256k
 #else
   // SDRAM        0xC0000000 - 0xC00FFFFF
   #define SDRAM_FRAME0         0xC0000000
   #define SDRAM_FRAME_SIZE       0x180000  // SIZE = 0x18000 = 800*480*4 = 0x177000
   #define SDRAM_FRAME1         0xC0180000
-  #define SDRAM_HEAP           0xC0300000
-  #define SDRAM_HEAP_SIZE        0xD00000  // SIZE = 13m
+  #define SDRAM_STACKS         0xC0300000
+  #define SDRAM_STACKS_SIZE       0x40000  // SIZE = 256k - bulk task stacks, staticTasks.c
+  #define SDRAM_HEAP           0xC0340000
+  #define SDRAM_HEAP_SIZE        0xCC0000  // SIZE = 13m-256k
 #endif
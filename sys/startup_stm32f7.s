@@ -53,6 +53,25 @@ LoopFillZerobss:
   cmp  r2, r3
   bcc  FillZerobss
 
+//* Copy the itcm hot code from flash to ITCM RAM, before anything calls it
+  movs  r1, #0
+  b  LoopCopyItcmInit
+
+CopyItcmInit:
+  ldr  r3, =_siitcm
+  ldr  r3, [r3, r1]
+  str  r3, [r0, r1]
+  adds  r1, r1, #4
+
+LoopCopyItcmInit:
+  ldr  r0, =_sitcm
+  ldr  r3, =_eitcm
+  adds  r2, r0, r1
+  cmp  r2, r3
+  bcc  CopyItcmInit
+  dsb
+  isb
+
 // Call the clock system intitialization function
   bl  SystemInit
 
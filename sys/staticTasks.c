@@ -0,0 +1,147 @@
+// staticTasks.c - task stacks from a compile time table, fast sram or bulk sdram, fixed at boot
+// - configAPP_STATIC_ALLOCATION 1, stacks are carved from fixed arenas in table order, never freed
+// - configAPP_STATIC_ALLOCATION 0, table sizes only, stacks come from pvPortMallocAligned as before
+// - kernel 8.2.1 has no static tcb, tcbs are still one heap block each, taken once at boot
+/*{{{  includes*/
+#include <stdio.h>
+#include <string.h>
+
+#include "staticTasks.h"
+#include "uartLog.h"
+#include "memory.h"
+#include "stm32f7xx_hal.h"
+/*}}}*/
+
+#define STATIC_FAST_WORDS  6144  // 24k, sized for the larger of the mp3 and hls task sets
+
+typedef struct {
+  const char* name;
+  uint16_t words;
+  uint8_t place;
+  uint8_t instances;
+  } tStaticTaskDef;
+
+/*{{{*/
+static const tStaticTaskDef kStaticTasks[] = {
+  // name           words   place       instances
+  { "main",          2048,  STACK_FAST, 1 },
+  { "hlsPlay",       2000,  STACK_FAST, 1 },
+  { "tcpip_thread",  1000,  STACK_FAST, 1 },
+  { "log",            512,  STACK_FAST, 1 },
+  { "eth",            350,  STACK_FAST, 1 },
+  { "hlsLoad",      14000,  STACK_BULK, 1 },
+  { "Net",           1024,  STACK_BULK, 1 },
+  { "httpFile",      2048,  STACK_BULK, 2 },
+  { "ftp",           4096,  STACK_BULK, 1 },
+  { "ftpData",       1024,  STACK_BULK, 1 },
+  { "mp3Play",       8192,  STACK_BULK, 1 },
+  { "mp3Wave",       8192,  STACK_BULK, 1 },
+  { "msc",            512,  STACK_BULK, 1 },
+  { "usbAudio",       512,  STACK_BULK, 1 },
+  { "touch",          256,  STACK_BULK, 1 },
+  };
+/*}}}*/
+#define STATIC_TASKS  (sizeof(kStaticTasks) / sizeof(tStaticTaskDef))
+
+#if configAPP_STATIC_ALLOCATION
+  static StackType_t fastStacks[STATIC_FAST_WORDS] __attribute__((aligned(32)));
+#endif
+static uint32_t fastUsed = 0;   // words
+static uint32_t bulkUsed = 0;   // words
+static uint8_t created[STATIC_TASKS];
+static uint32_t fallbacks = 0;
+static uint32_t undersized = 0;  // callers asking for more than their table entry
+static uint32_t bootMs = 0;
+static size_t bootFreeHeap = 0;
+
+/*{{{*/
+static StackType_t* staticStack (const tStaticTaskDef* def) {
+// next slice of the arena for def, NULL if the arena is full
+
+#if configAPP_STATIC_ALLOCATION
+  // keep every stack 32 byte, cache line, aligned
+  uint32_t words = (def->words + 7) & ~7;
+  if (def->place == STACK_FAST) {
+    if (fastUsed + words <= STATIC_FAST_WORDS) {
+      StackType_t* stack = fastStacks + fastUsed;
+      fastUsed += words;
+      return stack;
+      }
+    }
+  else if ((bulkUsed + words) * sizeof(StackType_t) <= SDRAM_STACKS_SIZE) {
+    StackType_t* stack = (StackType_t*)SDRAM_STACKS + bulkUsed;
+    bulkUsed += words;
+    return stack;
+    }
+#endif
+
+  return NULL;
+  }
+/*}}}*/
+
+/*{{{*/
+BaseType_t staticTaskCreate (TaskFunction_t code, const char* name, uint16_t words, void* param,
+                             UBaseType_t priority, TaskHandle_t* handle) {
+// xTaskCreate, stack size and placement from kStaticTasks when name is in it,
+// names not in the table, or past their instances, get a heap stack of words,
+// a caller asking for more than its entry is logged and gets a heap stack of words
+
+  for (uint32_t i = 0; i < STATIC_TASKS; i++) {
+    const tStaticTaskDef* def = &kStaticTasks[i];
+    if (!strcmp (def->name, name)) {
+      if (words > def->words) {
+        // table entry too small for what the caller now needs, heap stack of words, grow the entry
+        undersized++;
+        logPrint (LOG_WARN, "static %s asks %u words, table has %u\n", def->name, words, def->words);
+        }
+
+      StackType_t* stack = NULL;
+      if ((words <= def->words) && (created[i] < def->instances)) {
+        stack = staticStack (def);
+        created[i]++;
+        }
+      if (!stack)
+        fallbacks++;
+      return xTaskGenericCreate (code, name, words > def->words ? words : def->words, param, priority, handle,
+                                 stack, NULL);
+      }
+    }
+
+  fallbacks++;
+  return xTaskGenericCreate (code, name, words, param, priority, handle, NULL, NULL);
+  }
+/*}}}*/
+/*{{{*/
+int staticStackOwned (void* stack) {
+// vPortFreeAligned, table stacks are never returned to the heap
+
+#if configAPP_STATIC_ALLOCATION
+  if (((StackType_t*)stack >= fastStacks) && ((StackType_t*)stack < fastStacks + STATIC_FAST_WORDS))
+    return 1;
+  if (((uint32_t)stack >= SDRAM_STACKS) && ((uint32_t)stack < SDRAM_STACKS + SDRAM_STACKS_SIZE))
+    return 1;
+#endif
+
+  return 0;
+  }
+/*}}}*/
+
+/*{{{*/
+void staticTasksBooted() {
+// mainThread once all its tasks are up, boot time in HAL ticks since reset and free heap
+
+  bootMs = HAL_GetTick();
+  bootFreeHeap = xPortGetFreeHeapSize();
+  }
+/*}}}*/
+/*{{{*/
+void staticTasksReport() {
+// build once with configAPP_STATIC_ALLOCATION 0 and once with 1, compare the two reports
+
+  printf ("static %s boot %lums heapFree %u heapMinFree %u\n",
+          configAPP_STATIC_ALLOCATION ? "on" : "off",
+          bootMs, bootFreeHeap, xPortGetMinimumEverFreeHeapSize());
+  printf ("- stacks fast %lu bulk %lu bytes, heap fallbacks %lu, undersized entries %lu\n",
+          fastUsed * sizeof(StackType_t), bulkUsed * sizeof(StackType_t), fallbacks, undersized);
+  }
+/*}}}*/
@@ -0,0 +1,22 @@
+// staticTasks.h - task stacks from a compile time table, fast sram or bulk sdram, fixed at boot
+#pragma once
+#include "FreeRTOS.h"
+#include "task.h"
+
+// stack placement
+#define STACK_FAST  0   // internal sram, .bss
+#define STACK_BULK  1   // sdram, SDRAM_STACKS
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+BaseType_t staticTaskCreate (TaskFunction_t code, const char* name, uint16_t words, void* param,
+                             UBaseType_t priority, TaskHandle_t* handle);
+int staticStackOwned (void* stack);
+void staticTasksBooted();
+void staticTasksReport();
+
+#ifdef __cplusplus
+  }
+#endif
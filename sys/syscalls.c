@@ -17,6 +17,8 @@
 
 #include "stm32f7xx.h"
 #include "stm32f7xx_hal.h"
+
+#include "uartLog.h"
 /*}}}*/
 
 #define FreeRTOS
@@ -26,8 +28,6 @@
   register char* stack_ptr asm("sp");
 #endif
 
-extern UART_HandleTypeDef DebugUartHandle;
-
 /*{{{*/
 caddr_t _sbrk (int incr) {
 
@@ -89,13 +89,12 @@ int _read (int file, char *ptr, int len) {
 /*}}}*/
 /*{{{*/
 int _write (int file, char *ptr, int len) {
+// queued to the log ring, never waits on the uart, drops if the ring is full
 
-  for (int i = 0; i < len ; i++) {
-    ITM_SendChar ((*ptr) & 0xff);
-    HAL_UART_Transmit (&DebugUartHandle, (uint8_t*)ptr, 1, 0xFFFF);
-    ptr++;
-    }
+  for (int i = 0; i < len ; i++)
+    ITM_SendChar (ptr[i] & 0xff);
 
+  logText (ptr, len);
   return len;
   }
 /*}}}*/
@@ -0,0 +1,161 @@
+// taskStats.c - per task cpu from the dwt run time counter, stack high water and heap
+/*{{{  includes*/
+#include <stdio.h>
+#include <string.h>
+
+#include "taskStats.h"
+#include "uartLog.h"
+
+#include "stm32f7xx.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+/*}}}*/
+
+// cpu is sampled by a timer every window, well inside the 20s the 32 bit run time counters take to wrap,
+// callers get the last sample whenever they ask
+#define TASK_STATS_WINDOW  500
+
+#if TASK_STATS_NAME_LEN < configMAX_TASK_NAME_LEN
+  #error "TASK_STATS_NAME_LEN shorter than configMAX_TASK_NAME_LEN"
+#endif
+
+static TaskStatus_t mStatus[TASK_STATS_MAX];
+static TaskHandle_t mLastHandle[TASK_STATS_MAX];
+static uint32_t mLastRunTime[TASK_STATS_MAX];
+static int mNumLast = 0;
+static uint32_t mLastTotal = 0;
+
+// double buffered, the timer fills one while readers have the other
+static tTaskStat mStats[2][TASK_STATS_MAX];
+static int mNumStats[2] = { 0, 0 };
+static volatile int mCurStats = 0;
+
+static void taskStatsSample (TimerHandle_t timer);
+
+/*{{{*/
+void taskStatsInitCounter() {
+// portCONFIGURE_TIMER_FOR_RUN_TIME_STATS, run time is cpuWallCycles, DWT->CYCCNT plus cycles slept in tickless idle,
+// 32 bits wrap every 20s at 216mhz, so cpu is always taken from differences over a window, never from the totals,
+// called by vTaskStartScheduler after the timer task is created, starts the sampling timer
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  TimerHandle_t timer = xTimerCreate ("taskStats", TASK_STATS_WINDOW / portTICK_PERIOD_MS, pdTRUE, NULL, taskStatsSample);
+  if (timer)
+    xTimerStart (timer, 0);
+  }
+/*}}}*/
+/*{{{*/
+void vApplicationStackOverflowHook (TaskHandle_t xTask, char* pcTaskName) {
+// configCHECK_FOR_STACK_OVERFLOW 2, stop here rather than run on with a corrupt neighbour
+
+  printf ("\n*** stack overflow %s ***\n", pcTaskName);
+  taskDISABLE_INTERRUPTS();
+  logFlush();
+  __asm ("BKPT #0\n");
+  for (;;) {}
+  }
+/*}}}*/
+/*{{{*/
+static uint32_t lastRunTime (TaskHandle_t handle, uint32_t runTime) {
+
+  for (int i = 0; i < mNumLast; i++)
+    if (mLastHandle[i] == handle)
+      return mLastRunTime[i];
+
+  // new task, no history, counts from its start
+  return runTime;
+  }
+/*}}}*/
+/*{{{*/
+static void taskStatsSample (TimerHandle_t timer) {
+// timer task, cpu over the window since the last sample, into the buffer readers are not using
+
+  int next = !mCurStats;
+  tTaskStat* stats = mStats[next];
+
+  vTaskSuspendAll();
+
+  uint32_t total;
+  int numTasks = 0;
+  if (uxTaskGetNumberOfTasks() <= TASK_STATS_MAX)
+    numTasks = uxTaskGetSystemState (mStatus, TASK_STATS_MAX, &total);
+  uint32_t window = total - mLastTotal;
+
+  TaskHandle_t current = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < numTasks; i++) {
+    TaskStatus_t* status = &mStatus[i];
+    tTaskStat* stat = &stats[i];
+    strncpy (stat->name, status->pcTaskName, TASK_STATS_NAME_LEN - 1);
+    stat->name[TASK_STATS_NAME_LEN - 1] = 0;
+    stat->priority = status->uxCurrentPriority;
+    stat->stackFree = status->usStackHighWaterMark;
+    stat->heapBytes = ulPortGetTaskHeapBytes (status->xHandle);
+
+    switch (status->eCurrentState) {
+      case eReady:     stat->state = status->xHandle == current ? 'X' : 'R'; break;
+      case eBlocked:   stat->state = 'B'; break;
+      case eSuspended: stat->state = 'S'; break;
+      case eDeleted:   stat->state = 'D'; break;
+      default:         stat->state = '?'; break;
+      }
+
+    uint32_t run = status->ulRunTimeCounter - lastRunTime (status->xHandle, status->ulRunTimeCounter);
+    stat->cpu = window ? (uint16_t)(((uint64_t)run * 1000) / window) : 0;
+    }
+
+  for (int i = 0; i < numTasks; i++) {
+    mLastHandle[i] = mStatus[i].xHandle;
+    mLastRunTime[i] = mStatus[i].ulRunTimeCounter;
+    }
+  mNumLast = numTasks;
+  mLastTotal = total;
+
+  mNumStats[next] = numTasks;
+  mCurStats = next;
+
+  xTaskResumeAll();
+  }
+/*}}}*/
+/*{{{*/
+int taskStatsGet (const tTaskStat** stats) {
+// last sample, good until the sample after next, a window later
+
+  int cur = mCurStats;
+  *stats = mStats[cur];
+  return mNumStats[cur];
+  }
+/*}}}*/
+/*{{{*/
+int taskStatsJson (char* buf, int len) {
+// bounded, whole task objects only, room for the closing ]} always kept, returns bytes written
+// - tasks that do not fit are left out, the json still parses
+
+  const int kClose = 3;  // ]} and its nul
+
+  const tTaskStat* stats;
+  int numStats = taskStatsGet (&stats);
+
+  int used = snprintf (buf, len, "{\"heapFree\":%u,\"heapMinFree\":%u,\"tasks\":[",
+                       (unsigned)xPortGetFreeHeapSize(), (unsigned)xPortGetMinimumEverFreeHeapSize());
+  if (used + kClose > len)
+    return snprintf (buf, len, "%s", len >= kClose ? "{}" : "");
+
+  for (int i = 0; i < numStats; i++) {
+    int bytes = snprintf (buf + used, len - used,
+                          "%s{\"name\":\"%s\",\"state\":\"%c\",\"priority\":%u,\"cpu\":%u.%u,\"stackFreeBytes\":%u,\"heapBytes\":%u}",
+                          i ? "," : "", stats[i].name, stats[i].state, stats[i].priority,
+                          stats[i].cpu / 10, stats[i].cpu % 10, stats[i].stackFree * 4, (unsigned)stats[i].heapBytes);
+    if (used + bytes + kClose > len)
+      break;
+    used += bytes;
+    }
+
+  // overwrites any partial object the last snprintf left
+  used += snprintf (buf + used, len - used, "]}");
+  return used;
+  }
+/*}}}*/
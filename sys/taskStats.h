@@ -0,0 +1,27 @@
+// taskStats.h - per task cpu from the dwt run time counter, stack high water and heap
+#pragma once
+#include <stdint.h>
+
+#define TASK_STATS_MAX       24
+#define TASK_STATS_NAME_LEN  16   // configMAX_TASK_NAME_LEN
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+typedef struct {
+  char name[TASK_STATS_NAME_LEN];  // copied, the task may be deleted while the stats are read
+  char state;             // R ready, B blocked, S suspended, D deleted, X running
+  uint8_t priority;
+  uint16_t stackFree;     // high water mark, words never used
+  uint16_t cpu;           // tenths of a percent over the last window
+  uint32_t heapBytes;     // heap held by this task now
+  } tTaskStat;
+
+void taskStatsInitCounter();
+int taskStatsGet (const tTaskStat** stats);
+int taskStatsJson (char* buf, int len);
+
+#ifdef __cplusplus
+  }
+#endif
@@ -0,0 +1,129 @@
+// trace.c - dwt cycle stamped event ring, dumped over the debug uart as chrome trace json
+/*{{{  includes*/
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+#include "uartLog.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+/*}}}*/
+
+#define TRACE_MAX_TASKS  24
+
+volatile uint32_t traceEnabled = 0;
+volatile uint32_t traceIndex = 0;   // events written, ring holds the last TRACE_EVENTS
+
+static const char* const kIsrNames[] = { "sai", "sdmmc", "sdDma", "eth", "ltdc", "dma2d" };
+static const char* const kSpanNames[] = { "decode", "diskRead", "render" };
+
+/*{{{*/
+void traceInit() {
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;  // cm7 dwt software lock
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  traceEnabled = 0;
+  traceIndex = 0;
+  }
+/*}}}*/
+/*{{{*/
+void traceStart() {
+
+  traceIndex = 0;
+  traceEnabled = 1;
+  }
+/*}}}*/
+/*{{{*/
+void traceStop() {
+  traceEnabled = 0;
+  }
+/*}}}*/
+/*{{{*/
+void traceTaskSwitch (uint32_t type, void* tcb) {
+// from the FreeRTOSConfig.h switch hooks, TRACE_TASK_IN or TRACE_TASK_OUT
+  traceEvent (type, (uint32_t)tcb);
+  }
+/*}}}*/
+/*{{{*/
+int traceFull() {
+  return traceIndex >= TRACE_EVENTS;
+  }
+/*}}}*/
+
+/*{{{*/
+static const char* traceTaskName (TaskStatus_t* tasks, int numTasks, uint32_t id, char* hexName) {
+// events hold the low 24 bits of the tcb address, names from tasks still alive
+
+  for (int i = 0; i < numTasks; i++)
+    if ((((uint32_t)tasks[i].xHandle) & 0xFFFFFF) == id)
+      return tasks[i].pcTaskName;
+
+  sprintf (hexName, "%06lx", id);
+  return hexName;
+  }
+/*}}}*/
+/*{{{*/
+void traceDump() {
+// stops tracing, prints the ring oldest first, load the output into chrome://tracing or perfetto
+
+  traceEnabled = 0;
+
+  static TaskStatus_t tasks[TRACE_MAX_TASKS];
+  int numTasks = 0;
+  if (uxTaskGetNumberOfTasks() <= TRACE_MAX_TASKS)
+    numTasks = uxTaskGetSystemState (tasks, TRACE_MAX_TASKS, NULL);
+
+  uint32_t count = traceIndex;
+  uint32_t first = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+  uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+
+  printf ("{\"traceEvents\":[\n");
+  printf ("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"tasks\"}},\n");
+  printf ("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"isr\"}}");
+
+  // cycle counter wraps every 20s at 216mhz, accumulate deltas
+  uint64_t cycles = 0;
+  uint32_t lastCycles = ((uint32_t*)TRACE_BUFFER)[(first % TRACE_EVENTS) * 2];
+  for (uint32_t index = first; index < count; index++) {
+    uint32_t* event = (uint32_t*)TRACE_BUFFER + ((index % TRACE_EVENTS) * 2);
+    cycles += event[0] - lastCycles;
+    lastCycles = event[0];
+
+    uint32_t type = event[1] >> 24;
+    uint32_t id = event[1] & 0xFFFFFF;
+    uint32_t us = (uint32_t)(cycles / cyclesPerUs);
+    uint32_t ns = (uint32_t)(((cycles % cyclesPerUs) * 1000) / cyclesPerUs);
+
+    // far more than the log ring holds, let it drain
+    while (logFree() < 256)
+      vTaskDelay (1);
+
+    char hexName[8];
+    switch (type) {
+      case TRACE_TASK_IN:
+      case TRACE_TASK_OUT:
+        printf (",\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":0,\"tid\":0,\"ts\":%lu.%03lu}",
+                type == TRACE_TASK_IN ? "B" : "E", traceTaskName (tasks, numTasks, id, hexName), us, ns);
+        break;
+
+      case TRACE_ISR_IN:
+      case TRACE_ISR_OUT:
+        printf (",\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":0,\"tid\":1,\"ts\":%lu.%03lu}",
+                type == TRACE_ISR_IN ? "B" : "E", id < 6 ? kIsrNames[id] : "isr", us, ns);
+        break;
+
+      case TRACE_SPAN_BEGIN:
+      case TRACE_SPAN_END:
+        // async, spans from different tasks can overlap
+        printf (",\n{\"ph\":\"%s\",\"cat\":\"span\",\"name\":\"%s\",\"id\":%lu,\"pid\":0,\"tid\":0,\"ts\":%lu.%03lu}",
+                type == TRACE_SPAN_BEGIN ? "b" : "e", id < 3 ? kSpanNames[id] : "span", id, us, ns);
+        break;
+      }
+    }
+
+  printf ("\n]}\n");
+  }
+/*}}}*/
@@ -0,0 +1,69 @@
+// trace.h - dwt cycle stamped event ring in dtcm, task switches, isrs and spans
+#pragma once
+#include <stdint.h>
+#include "memory.h"
+#include "cpuUsage.h"
+#include "stm32f7xx.h"
+
+// event types
+#define TRACE_TASK_IN     0
+#define TRACE_TASK_OUT    1
+#define TRACE_ISR_IN      2
+#define TRACE_ISR_OUT     3
+#define TRACE_SPAN_BEGIN  4
+#define TRACE_SPAN_END    5
+
+// isr ids
+#define TRACE_ISR_SAI     0
+#define TRACE_ISR_SDMMC   1
+#define TRACE_ISR_SD_DMA  2
+#define TRACE_ISR_ETH     3
+#define TRACE_ISR_LTDC    4
+#define TRACE_ISR_DMA2D   5
+
+// span ids
+#define TRACE_SPAN_DECODE     0
+#define TRACE_SPAN_DISK_READ  1
+#define TRACE_SPAN_RENDER     2
+
+#define TRACE_EVENTS  (TRACE_BUFFER_SIZE / 8)
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+extern volatile uint32_t traceEnabled;
+extern volatile uint32_t traceIndex;
+
+void traceInit();
+void traceStart();
+void traceStop();
+int traceFull();
+void traceDump();
+void traceTaskSwitch (uint32_t type, void* tcb);
+
+//{{{
+static inline void traceEvent (uint32_t type, uint32_t id) {
+// isr or task, ldrex/strex claims the slot, a preempting event just takes the next one
+
+  if (traceEnabled) {
+    uint32_t index;
+    do {
+      index = __LDREXW ((uint32_t*)&traceIndex);
+      } while (__STREXW (index + 1, (uint32_t*)&traceIndex));
+
+    uint32_t* event = (uint32_t*)TRACE_BUFFER + ((index % TRACE_EVENTS) * 2);
+    event[0] = cpuWallCycles();
+    event[1] = (type << 24) | (id & 0xFFFFFF);
+    }
+  }
+//}}}
+
+#define traceIsrIn(id)      traceEvent (TRACE_ISR_IN, id)
+#define traceIsrOut(id)     traceEvent (TRACE_ISR_OUT, id)
+#define traceSpanBegin(id)  traceEvent (TRACE_SPAN_BEGIN, id)
+#define traceSpanEnd(id)    traceEvent (TRACE_SPAN_END, id)
+
+#ifdef __cplusplus
+  }
+#endif
@@ -0,0 +1,297 @@
+// uartLog.c - lock free multi producer log ring, drained by a low priority task over usart1 tx dma
+/*{{{  includes*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "uartLog.h"
+#include "staticTasks.h"
+#include "memory.h"
+
+#include "stm32f7xx.h"
+#include "stm32f7xx_hal.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+/*}}}*/
+
+#define LOG_RING_WORDS  2048     // 8k, power of 2
+#define LOG_TEXT_MAX    256      // printf text split into records of this size
+#define LOG_LINE_MAX    256      // formatted record, longer lines truncated
+#define LOG_DMA_SIZE    UART_DMA_SIZE
+
+// header word, written last, commit bit tells the drain the record is complete
+#define LOG_COMMIT       0x80000000
+#define LOG_TYPE_FORMAT  0
+#define LOG_TYPE_TEXT    1
+#define LOG_HEADER(type,level,count)  (LOG_COMMIT | ((type) << 24) | ((level) << 16) | (count))
+#define LOG_TYPE(header)   (((header) >> 24) & 0x7F)
+#define LOG_LEVEL(header)  (((header) >> 16) & 0xFF)
+#define LOG_COUNT(header)  ((header) & 0xFFFF)
+
+volatile uint32_t logLevel = LOG_INFO;
+volatile uint32_t logRecords = 0;
+volatile uint32_t logDropped = 0;
+
+extern UART_HandleTypeDef DebugUartHandle;
+DMA_HandleTypeDef logDmaHandle;
+
+static uint32_t logRing[LOG_RING_WORDS];
+static volatile uint32_t logWriteIndex = 0;  // words reserved by producers
+static volatile uint32_t logReadIndex = 0;   // words drained
+static SemaphoreHandle_t logDmaSem = NULL;
+static TaskHandle_t logTask = NULL;
+static uint8_t* const logDmaBuf = (uint8_t*)UART_DMA;  // dtcm, uncached, no cache maintenance for dma
+
+/*{{{*/
+static void logAtomicInc (volatile uint32_t* value) {
+  while (__STREXW (__LDREXW ((uint32_t*)value) + 1, (uint32_t*)value)) {}
+  }
+/*}}}*/
+/*{{{*/
+static void logWake() {
+// notify the drain, from a task or from an isr the kernel allows, others are picked up by its timeout
+// - before logInit and before the scheduler records just wait for the first drain
+
+  if (!logTask || (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED))
+    return;
+
+  uint32_t exception = __get_IPSR();
+  if (!exception)
+    xTaskNotify (logTask, 0, eIncrement);
+  else if ((exception >= 16) &&
+           (NVIC_GetPriority ((IRQn_Type)(exception - 16)) >= configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY)) {
+    BaseType_t taskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR (logTask, &taskWoken);
+    portYIELD_FROM_ISR (taskWoken);
+    }
+  }
+/*}}}*/
+/*{{{*/
+static int logReserve (uint32_t words) {
+// claim words of ring for one record, ldrex/strex so an isr preempting a task just claims the next record
+// - returns ring index, -1 when full, the record is dropped and counted
+
+  uint32_t index;
+  do {
+    index = __LDREXW ((uint32_t*)&logWriteIndex);
+    if (index + words - logReadIndex > LOG_RING_WORDS) {
+      __CLREX();
+      logAtomicInc (&logDropped);
+      logWake();
+      return -1;
+      }
+    } while (__STREXW (index + words, (uint32_t*)&logWriteIndex));
+
+  return index;
+  }
+/*}}}*/
+/*{{{*/
+static void logCommit (uint32_t index, uint32_t header) {
+// the record at the read index takes the ring from empty to non empty, records behind it wait for its drain
+
+  __DMB();
+  logRing[index % LOG_RING_WORDS] = header;
+  logAtomicInc (&logRecords);
+  if (index == logReadIndex)
+    logWake();
+  }
+/*}}}*/
+
+/*{{{*/
+void logFormat (uint32_t level, const char* format, uint32_t numArgs, ...) {
+// logPrint macro, format and args saved as words, formatted by the drain
+
+  if (numArgs > LOG_MAX_ARGS)
+    numArgs = LOG_MAX_ARGS;
+
+  int index = logReserve (3 + numArgs);
+  if (index < 0)
+    return;
+
+  logRing[(index + 1) % LOG_RING_WORDS] = (uint32_t)format;
+  logRing[(index + 2) % LOG_RING_WORDS] = HAL_GetTick();
+
+  va_list args;
+  va_start (args, numArgs);
+  for (uint32_t i = 0; i < numArgs; i++)
+    logRing[(index + 3 + i) % LOG_RING_WORDS] = va_arg (args, uint32_t);
+  va_end (args);
+
+  logCommit (index, LOG_HEADER (LOG_TYPE_FORMAT, level, numArgs));
+  }
+/*}}}*/
+/*{{{*/
+int logText (const char* text, int len) {
+// _write, already formatted by printf, copied in LOG_TEXT_MAX records, returns bytes queued
+
+  int queued = 0;
+  while (queued < len) {
+    int bytes = (len - queued) > LOG_TEXT_MAX ? LOG_TEXT_MAX : len - queued;
+    int index = logReserve (1 + ((bytes + 3) / 4));
+    if (index < 0)
+      break;
+
+    for (int i = 0; i < bytes; i += 4) {
+      uint32_t word = 0;
+      memcpy (&word, text + queued + i, (bytes - i) < 4 ? bytes - i : 4);
+      logRing[(index + 1 + (i / 4)) % LOG_RING_WORDS] = word;
+      }
+
+    logCommit (index, LOG_HEADER (LOG_TYPE_TEXT, LOG_INFO, bytes));
+    queued += bytes;
+    }
+
+  return queued;
+  }
+/*}}}*/
+/*{{{*/
+int logFree() {
+// bytes free in ring, for bulk dumps to pace themselves
+  return (LOG_RING_WORDS - (logWriteIndex - logReadIndex)) * 4;
+  }
+/*}}}*/
+
+/*{{{*/
+static int logDrain (uint8_t* buf, int size) {
+// format committed records into buf, stops at a record still being written or one that won't fit
+
+  int used = 0;
+  char line[LOG_LINE_MAX];
+
+  while (logReadIndex != logWriteIndex) {
+    uint32_t index = logReadIndex;
+    uint32_t header = logRing[index % LOG_RING_WORDS];
+    if (!(header & LOG_COMMIT))
+      break;
+    __DMB();
+
+    uint32_t words;
+    int len;
+    if (LOG_TYPE (header) == LOG_TYPE_TEXT) {
+      len = LOG_COUNT (header);
+      words = 1 + ((len + 3) / 4);
+      for (int i = 0; i < len; i += 4) {
+        uint32_t word = logRing[(index + 1 + (i / 4)) % LOG_RING_WORDS];
+        memcpy (line + i, &word, 4);
+        }
+      }
+    else {
+      uint32_t args[LOG_MAX_ARGS] = { 0 };
+      uint32_t numArgs = LOG_COUNT (header);
+      words = 3 + numArgs;
+      const char* format = (const char*)logRing[(index + 1) % LOG_RING_WORDS];
+      uint32_t tick = logRing[(index + 2) % LOG_RING_WORDS];
+      for (uint32_t i = 0; i < numArgs; i++)
+        args[i] = logRing[(index + 3 + i) % LOG_RING_WORDS];
+
+      len = snprintf (line, LOG_LINE_MAX, "%7lu %c ", tick, "EWID"[LOG_LEVEL (header) & 3]);
+      len += snprintf (line + len, LOG_LINE_MAX - len, format, args[0], args[1], args[2], args[3], args[4], args[5]);
+      if (len >= LOG_LINE_MAX)
+        len = LOG_LINE_MAX - 1;
+      }
+
+    if (used && (used + len > size))
+      break;
+    if (len > size - used)
+      len = size - used;
+    memcpy (buf + used, line, len);
+    used += len;
+
+    // zero so a reserved but uncommitted header reads as not ready next time round
+    for (uint32_t i = 0; i < words; i++)
+      logRing[(index + i) % LOG_RING_WORDS] = 0;
+    __DMB();
+    logReadIndex = index + words;
+    }
+
+  return used;
+  }
+/*}}}*/
+/*{{{*/
+static void logDmaDone (DMA_HandleTypeDef* hdma) {
+
+  BaseType_t taskWoken = pdFALSE;
+  xSemaphoreGiveFromISR (logDmaSem, &taskWoken);
+  portYIELD_FROM_ISR (taskWoken);
+  }
+/*}}}*/
+/*{{{*/
+static void logThread (void* arg) {
+// blocks while the ring is empty, logWake gives when a record lands at the read index or one is dropped,
+// the timeout only for records from isrs above the kernel's priority
+
+  uint32_t reportedDropped = 0;
+
+  while (1) {
+    int len = logDrain (logDmaBuf, LOG_DMA_SIZE);
+
+    uint32_t dropped = logDropped;
+    if ((dropped != reportedDropped) && (len < LOG_DMA_SIZE - 32)) {
+      len += snprintf ((char*)logDmaBuf + len, LOG_DMA_SIZE - len, "log dropped %lu\n", dropped - reportedDropped);
+      reportedDropped = dropped;
+      }
+
+    if (len) {
+      HAL_DMA_Start_IT (&logDmaHandle, (uint32_t)logDmaBuf, (uint32_t)&DebugUartHandle.Instance->TDR, len);
+      xSemaphoreTake (logDmaSem, portMAX_DELAY);
+      }
+    else
+      ulTaskNotifyTake (pdTRUE, 1000);
+    }
+  }
+/*}}}*/
+
+/*{{{*/
+void logInit() {
+// after the debug uart is up, before the scheduler starts, records queued before now are sent first
+
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  // usart1 tx, dma2 stream7 channel4, the only usart1 tx mapping, so the log owns stream7, f746 sai2 audio in
+  // and f769 dfsdm bottom right mic map there too, their BSP_AUDIO_IN inits fail while logDmaStream says so
+  logDmaHandle.Instance = DMA2_Stream7;
+  logDmaHandle.Init.Channel = DMA_CHANNEL_4;
+  logDmaHandle.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  logDmaHandle.Init.PeriphInc = DMA_PINC_DISABLE;
+  logDmaHandle.Init.MemInc = DMA_MINC_ENABLE;
+  logDmaHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  logDmaHandle.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  logDmaHandle.Init.Mode = DMA_NORMAL;
+  logDmaHandle.Init.Priority = DMA_PRIORITY_LOW;
+  logDmaHandle.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init (&logDmaHandle);
+  logDmaHandle.XferCpltCallback = logDmaDone;
+  logDmaHandle.XferErrorCallback = logDmaDone;
+
+  HAL_NVIC_SetPriority (DMA2_Stream7_IRQn, 0x0E, 0);
+  HAL_NVIC_EnableIRQ (DMA2_Stream7_IRQn);
+
+  DebugUartHandle.Instance->CR3 |= USART_CR3_DMAT;
+
+  logDmaSem = xSemaphoreCreateBinary();
+
+  staticTaskCreate ((TaskFunction_t)logThread, "log", 512, 0, 1, &logTask);
+  }
+/*}}}*/
+/*{{{*/
+int logDmaStream (const void* stream) {
+// 1 if the log tx dma has stream, BSP_AUDIO_IN inits ask before they take a stream
+
+  return logDmaHandle.Instance && (logDmaHandle.Instance == stream);
+  }
+/*}}}*/
+/*{{{*/
+void logFlush() {
+// hardFault, stack overflow - no scheduler to rely on, wait for dma, then poll out what is left
+
+  if (logDmaHandle.Instance)
+    for (int timeout = 0; (logDmaHandle.Instance->CR & DMA_SxCR_EN) && (timeout < 10000000); timeout++) {}
+
+
+  int len;
+  while ((len = logDrain (logDmaBuf, LOG_DMA_SIZE)))
+    HAL_UART_Transmit (&DebugUartHandle, logDmaBuf, len, 0xFFFF);
+  }
+/*}}}*/
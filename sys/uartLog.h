@@ -0,0 +1,40 @@
+// uartLog.h - lock free log ring, formatted later by a low priority task, sent by debug uart tx dma
+#pragma once
+#include <stdint.h>
+
+// levels
+#define LOG_ERROR  0
+#define LOG_WARN   1
+#define LOG_INFO   2
+#define LOG_DEBUG  3
+
+#define LOG_MAX_ARGS  6
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+extern volatile uint32_t logLevel;    // records above logLevel are discarded by the caller
+extern volatile uint32_t logRecords;  // records queued
+extern volatile uint32_t logDropped;  // records lost to a full ring
+
+void logInit();
+void logFormat (uint32_t level, const char* format, uint32_t numArgs, ...);
+int logText (const char* text, int len);
+int logFree();
+void logFlush();
+int logDmaStream (const void* stream);
+
+#ifdef __cplusplus
+  }
+#endif
+
+// logPrint (LOG_INFO, "read %d %x\n", count, result)
+// - queues the format pointer and up to LOG_MAX_ARGS word args, no formatting in the caller,
+//   what periodic stats in audio, usb and sd tasks use rather than printf
+// - ints, unsigned and pointers only, %s strings must outlive the record, no floats
+// - safe from any task or isr
+#define LOG_NARGS(...)  LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...)  n
+#define logPrint(level, format, ...) \
+  do { if ((level) <= logLevel) logFormat (level, format, LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); } while (0)
@@ -0,0 +1,221 @@
+// audioFeedbackTest.cpp - usbd_audio.c off target, async feedback against a sai clock off by ppm
+// - audioFeedback nominal values, clamp and fifo correction
+// - closed loop, a host sending iso packets sized by the feedback it reads each (micro)frame, the sai
+//   taking halves at rate +-100..500 ppm, full and high speed, 44.1k and 48k
+// - DSTS FNSOF counted on the otg hs registers mapped at their target address, started just short of the
+//   11 bit fs and 14 bit hs wraps, the loop measures across a wrap every 2 seconds
+// - host frames carry a sequence number, a gap in what the sai plays is an overrun drop, silence once
+//   playing is an underrun, the fill is what was sent less what was played
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "staticTasks.h"
+
+#include "usbPcd.h"
+
+extern "C" {
+#include "usbd_audio.h"
+#include "audioFeedback.h"
+}
+//}}}
+
+static const double kSeconds = 40.0;
+static const double kSettleSeconds = 20.0;  // fill and feedback averaged after this
+static const uint32_t kSaiFrames = 48;      // AUDIO_SAI_FRAMES, a sai half
+
+//{{{  task stubs
+extern "C" {
+  //{{{
+  BaseType_t staticTaskCreate (TaskFunction_t code, const char* name, uint16_t words, void* param,
+                               UBaseType_t priority, TaskHandle_t* handle) {
+    return pdPASS;
+    }
+  //}}}
+  uint32_t ulTaskNotifyTake (BaseType_t clear, TickType_t ticks) { return 0; }
+  void vTaskNotifyGiveFromISR (TaskHandle_t task, BaseType_t* woken) {}
+  TickType_t xTaskGetTickCount() { return 0; }
+  }
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, double value) {
+
+  printf ("%s %s %g\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+
+//{{{
+static void checkFeedback() {
+// nominal, measured rate, fifo correction spread over 2 seconds, clamp at 1/64
+
+  check (audioFeedbackNominal (48000, 8000, AUDIO_FEEDBACK_HS_FRAC) == (6 << 16), "hs 48k nominal 6.0",
+         audioFeedbackNominal (48000, 8000, AUDIO_FEEDBACK_HS_FRAC));
+  check (audioFeedbackNominal (48000, 1000, AUDIO_FEEDBACK_FS_FRAC) == (48 << 14), "fs 48k nominal 48.0",
+         audioFeedbackNominal (48000, 1000, AUDIO_FEEDBACK_FS_FRAC));
+  check (audioFeedbackNominal (44100, 8000, AUDIO_FEEDBACK_HS_FRAC) == (uint32_t)(5.5125 * 65536), "hs 44.1k nominal 5.5125",
+         audioFeedbackNominal (44100, 8000, AUDIO_FEEDBACK_HS_FRAC));
+
+  auto measured = audioFeedback (48000, 1000, AUDIO_FEEDBACK_FS_FRAC, 48024, 1000, 0);
+  check (measured == (uint32_t)(48.024 * 16384), "fs measured 48.024", measured / 16384.0);
+  auto corrected = audioFeedback (48000, 1000, AUDIO_FEEDBACK_FS_FRAC, 48000, 1000, 200);
+  check (corrected == (48 << 14) + (200 << 14) / 2000, "fs 200 frames short, 0.1 a frame more", corrected / 16384.0);
+  auto fast = audioFeedback (48000, 8000, AUDIO_FEEDBACK_HS_FRAC, 96000, 8000, 0);
+  check (fast == (6 << 16) + ((6 << 16) >> 6), "hs clamped to nominal + 1/64", fast / 65536.0);
+  auto slow = audioFeedback (48000, 8000, AUDIO_FEEDBACK_HS_FRAC, 0, 8000, -AUDIO_FIFO_FRAMES);
+  check (slow == (6 << 16) - ((6 << 16) >> 6), "hs clamped to nominal - 1/64", slow / 65536.0);
+  }
+//}}}
+//{{{
+static void runLoop (USBD_HandleTypeDef* device, volatile uint32_t* dsts, bool hs, uint32_t rate, int ppm) {
+
+  // the host at this speed, sampling frequency, streaming alt 1
+  USBD_LL_Reset (device);
+  USBD_LL_SetSpeed (device, hs ? USBD_SPEED_HIGH : USBD_SPEED_FULL);
+  pcdSetup (0x00, USB_REQ_SET_ADDRESS, 1, 0, 0);
+  pcdSetup (0x00, USB_REQ_SET_CONFIGURATION, 1, 0, 0);
+
+  uint8_t rateBytes[4] = { (uint8_t)rate, (uint8_t)(rate >> 8), (uint8_t)(rate >> 16), (uint8_t)(rate >> 24) };
+  pcdSetup (0x21, 0x01, 0x0100, 0x1000, 4);
+  pcdOutData (0x00, rateBytes, 4);
+  pcdSetup (0x01, USB_REQ_SET_INTERFACE, 1, 1, 0);
+
+  uint32_t framesPerSec = hs ? 8000 : 1000;
+  int frac = hs ? AUDIO_FEEDBACK_HS_FRAC : AUDIO_FEEDBACK_FS_FRAC;
+  uint32_t mask = hs ? AUDIO_HS_FRAME_MASK : AUDIO_FS_FRAME_MASK;
+  uint32_t fnsof = mask - 300;
+  *dsts = fnsof << 8;
+
+  double saiRate = rate * (1.0 + ppm * 1e-6);
+  double sofPeriod = 1.0 / framesPerSec;
+  double saiPeriod = kSaiFrames / saiRate;
+  double sof = sofPeriod;
+  double sai = saiPeriod;
+
+  uint32_t feedback = audioFeedbackNominal (rate, framesPerSec, frac);
+  uint64_t accumulator = 0;
+  uint32_t sent = 0;      // sequence of the last frame sent, frames numbered from 1
+  uint32_t expected = 0;  // sequence the sai should play next, 0 till playing
+  int second = 0;
+
+  uint32_t wraps = 0;
+  uint32_t gaps = 0;
+  uint32_t underruns = 0;
+  uint32_t minFill = ~0u;
+  uint32_t maxFill = 0;
+  double fillSum = 0;
+  uint32_t fills = 0;
+  double feedbackSum = 0;
+  uint32_t feedbacks = 0;
+
+  uint32_t packet[64];
+  while (std::min (sof, sai) < kSeconds) {
+    if (sof <= sai) {
+      // sof, the frame number moves on, feedback read, a packet of what it asks for
+      fnsof = (fnsof + 1) & mask;
+      if (!fnsof)
+        wraps++;
+      *dsts = fnsof << 8;
+
+      if (pcdIn[1].pending) {
+        auto buf = pcdIn[1].buf;
+        feedback = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (hs ? (buf[3] << 24) : 0);
+        pcdInDone (0x81);
+        if (sof >= kSettleSeconds) {
+          feedbackSum += (double)feedback * framesPerSec / (1 << frac);
+          feedbacks++;
+          }
+        }
+
+      accumulator += feedback;
+      uint32_t frames = accumulator >> frac;
+      accumulator -= (uint64_t)frames << frac;
+      for (uint32_t i = 0; i < frames; i++)
+        packet[i] = ++sent;
+      if (pcdOut[1].pending)
+        pcdOutData (0x01, packet, frames * 4);
+      sof += sofPeriod;
+      }
+
+    else {
+      // sai half, a run of sequence numbers or silence
+      USBD_AUDIO_SaiHalf (second);
+      second ^= 1;
+      auto half = (const uint32_t*)pcdDmaTx;
+      if (half[0]) {
+        for (uint32_t i = 0; i < kSaiFrames; i++) {
+          if (expected && (half[i] != expected))
+            gaps++;
+          expected = half[i] + 1;
+          }
+        }
+      else if (expected)
+        underruns++;
+
+      if (expected && (sai >= kSettleSeconds)) {
+        uint32_t fill = sent + 1 - expected;
+        minFill = std::min (minFill, fill);
+        maxFill = std::max (maxFill, fill);
+        fillSum += fill;
+        fills++;
+        }
+      sai += saiPeriod;
+      }
+    }
+
+  pcdSetup (0x01, USB_REQ_SET_INTERFACE, 0, 1, 0);
+
+  double meanFill = fills ? fillSum / fills : 0;
+  double feedbackPpm = feedbacks ? (feedbackSum / feedbacks / saiRate - 1.0) * 1e6 : 1e6;
+  printf ("%s %u %+dppm, fill mean %.1f min %u max %u, feedback %+.1fppm off the sai, %u wraps\n",
+          hs ? "hs" : "fs", rate, ppm, meanFill, minFill, maxFill, feedbackPpm, wraps);
+
+  check (wraps >= (uint32_t)(kSeconds * framesPerSec) / (mask + 1), "fnsof wraps", wraps);
+  check (expected != 0, "playing", expected);
+  check (gaps == 0, "no overrun drops", gaps);
+  check (underruns == 0, "no underruns", underruns);
+  // a fs measure ends on a 1ms frame, a frame out of a second's 1000 is 1000ppm in one window
+  check (fabs (meanFill - AUDIO_FIFO_TARGET) <= (hs ? 8 : kSaiFrames / 2), "fill mean at AUDIO_FIFO_TARGET", meanFill);
+  check ((minFill >= kSaiFrames) && (maxFill <= AUDIO_FIFO_FRAMES - kSaiFrames), "fill kept off empty and full",
+         maxFill - minFill);
+  check (fabs (feedbackPpm) <= (hs ? 20 : 100), "feedback mean near the sai rate", feedbackPpm);
+  }
+//}}}
+
+int main() {
+
+  checkFeedback();
+
+  // otg hs registers at their target address, audioFrameNumber reads DSTS
+  auto otg = (uint8_t*)mmap ((void*)USB_OTG_HS_PERIPH_BASE, 0x1000, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (otg != (void*)USB_OTG_HS_PERIPH_BASE) {
+    printf ("FAIL map otg hs registers at their target address\n");
+    return 1;
+    }
+  auto dsts = &((USB_OTG_DeviceTypeDef*)(otg + USB_OTG_DEVICE_BASE))->DSTS;
+
+  static USBD_HandleTypeDef device;
+  static USBD_AUDIO_ItfTypeDef audio = { [](uint32_t rate, int16_t* buf, uint32_t bytes) {} };
+  USBD_Init (&device, &AUDIO_Desc, 0);
+  USBD_RegisterClass (&device, &USBD_AUDIO);
+  USBD_AUDIO_RegisterInterface (&device, &audio);
+  USBD_Start (&device);
+
+  for (auto hs : { false, true })
+    for (auto rate : { 48000u, 44100u })
+      for (auto ppm : { -500, -100, 100, 500 })
+        runLoop (&device, dsts, hs, rate, ppm);
+
+  printf ("%s\n", mFails ? "audioFeedbackTest failed" : "audioFeedbackTest passed");
+  return mFails ? 1 : 0;
+  }
@@ -0,0 +1,326 @@
+// effectsTest.cpp - cEffects and cLoudness off target, eq responses, limiter, r128 level, time per half
+// - each band alone at +-12 and +6dB, and all five at +12, tones through process against the rbj cookbook
+//   response worked in double, shelves at dc and nyquist and peaks at f0 against the cookbook's closed form
+// - limiter, +12dB normalise and eq on full scale sines and a ramp, never at the int16 rails, monotonic,
+//   untouched under kKnee
+// - ebu tech 3341 cases 1 to 4, stereo 1khz at -23 and -33dBFS and the gated sequences, within 0.1 LU,
+//   at 44.1k and 48k
+// - process of kMaxFrames with every band on and the normalise ramping, best of kBenchRuns, against
+//   kBudgetCycles at the cm7's 216MHz, a host faster than the target is a floor not a measure
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <complex>
+#include <vector>
+
+#include "cEffects.h"
+#include "cLoudness.h"
+//}}}
+
+static const double kCoreHz = 216e6;
+static const int kBenchRuns = 20;
+static const int kBenchBlocks = 200;
+
+//{{{
+static const struct {
+  double freq;
+  double q;
+  } kBand[cEffects::kBands] = {
+    {  100, 0.707 },  // low shelf
+    {  400, 1.0 },
+    { 1000, 1.0 },
+    { 2500, 1.0 },
+    { 8000, 0.707 },  // high shelf
+  };
+//}}}
+static const double kFreqs[] = { 30, 100, 200, 400, 700, 1000, 1600, 2500, 4000, 8000, 12000, 18000 };
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, double value) {
+
+  printf ("%s %s %g\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+
+//{{{
+static double cookbookDb (int band, double db, double freq, double rate) {
+// rbj audio eq cookbook in double, |H| at freq in dB
+
+  double a = pow (10.0, db / 40.0);
+  double w0 = 2 * M_PI * kBand[band].freq / rate;
+  double cosW0 = cos (w0);
+  double alpha = sin (w0) / (2 * kBand[band].q);
+  double sqrtA = 2 * sqrt (a) * alpha;
+
+  double b[3];
+  double den[3];
+  if (band == 0) {
+    b[0] = a * ((a + 1) - (a - 1) * cosW0 + sqrtA);
+    b[1] = 2 * a * ((a - 1) - (a + 1) * cosW0);
+    b[2] = a * ((a + 1) - (a - 1) * cosW0 - sqrtA);
+    den[0] = (a + 1) + (a - 1) * cosW0 + sqrtA;
+    den[1] = -2 * ((a - 1) + (a + 1) * cosW0);
+    den[2] = (a + 1) + (a - 1) * cosW0 - sqrtA;
+    }
+  else if (band == cEffects::kBands - 1) {
+    b[0] = a * ((a + 1) + (a - 1) * cosW0 + sqrtA);
+    b[1] = -2 * a * ((a - 1) + (a + 1) * cosW0);
+    b[2] = a * ((a + 1) + (a - 1) * cosW0 - sqrtA);
+    den[0] = (a + 1) - (a - 1) * cosW0 + sqrtA;
+    den[1] = 2 * ((a - 1) - (a + 1) * cosW0);
+    den[2] = (a + 1) - (a - 1) * cosW0 - sqrtA;
+    }
+  else {
+    b[0] = 1 + alpha * a;
+    b[1] = -2 * cosW0;
+    b[2] = 1 - alpha * a;
+    den[0] = 1 + alpha / a;
+    den[1] = -2 * cosW0;
+    den[2] = 1 - alpha / a;
+    }
+
+  auto z1 = std::polar (1.0, -2 * M_PI * freq / rate);
+  auto z2 = z1 * z1;
+  return 20 * log10 (std::abs ((b[0] + b[1] * z1 + b[2] * z2) / (den[0] + den[1] * z1 + den[2] * z2)));
+  }
+//}}}
+//{{{
+static double measureDb (cEffects& effects, double freq, double rate) {
+// -24dBFS tone in kMaxFrames halves, half a second to settle, sin cos fitted to the left channel after
+
+  const double kAmplitude = 32767 * pow (10, -24 / 20.0);
+  const int kSettleBlocks = (int)(rate / 2 / cEffects::kMaxFrames) + 1;
+  const int kFitBlocks = 8;
+
+  std::vector<int16_t> samples (cEffects::kMaxFrames * 2);
+  double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+  long frame = 0;
+  for (auto block = 0; block < kSettleBlocks + kFitBlocks; block++) {
+    for (auto i = 0; i < cEffects::kMaxFrames; i++) {
+      double phase = 2 * M_PI * fmod (freq * (frame + i) / rate, 1.0);
+      samples[2*i] = samples[2*i + 1] = (int16_t)lrint (kAmplitude * sin (phase));
+      }
+    effects.process (samples.data(), cEffects::kMaxFrames);
+
+    if (block >= kSettleBlocks)
+      for (auto i = 0; i < cEffects::kMaxFrames; i++) {
+        double phase = 2 * M_PI * fmod (freq * (frame + i) / rate, 1.0);
+        double s = sin (phase);
+        double c = cos (phase);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += samples[2*i] * s;
+        yc += samples[2*i] * c;
+        }
+    frame += cEffects::kMaxFrames;
+    }
+
+  double det = (ss * cc) - (sc * sc);
+  double a = ((ys * cc) - (yc * sc)) / det;
+  double b = ((yc * ss) - (ys * sc)) / det;
+  return 20 * log10 (sqrt ((a * a) + (b * b)) / kAmplitude);
+  }
+//}}}
+
+//{{{
+static void eq (uint32_t rate) {
+
+  printf ("eq at %u\n", rate);
+  char what[96];
+
+  for (auto band = 0; band < cEffects::kBands; band++)
+    for (auto db : { 12.0, -12.0, 6.0 }) {
+      double worst = 0;
+      double worstFreq = 0;
+      for (auto freq : kFreqs) {
+        cEffects effects;
+        effects.setRate (rate);
+        effects.setEq (band, (float)db);
+        double error = fabs (measureDb (effects, freq, rate) - cookbookDb (band, db, freq, rate));
+        if (error > worst) {
+          worst = error;
+          worstFreq = freq;
+          }
+        }
+      sprintf (what, "band %d %+.0fdB against the cookbook, worst dB at %.0fHz", band, db, worstFreq);
+      check (worst < 0.05, what, worst);
+      }
+
+  // closed forms, shelves reach A^2 at their far end, peaks A^2 at f0
+  for (auto band = 0; band < cEffects::kBands; band++) {
+    double freq = band == 0 ? 0 : (band == cEffects::kBands - 1 ? rate / 2.0 : kBand[band].freq);
+    sprintf (what, "band %d reference +12dB at %.0fHz", band, freq);
+    check (fabs (cookbookDb (band, 12, freq, rate) - 12) < 1e-6, what, cookbookDb (band, 12, freq, rate));
+    }
+
+  // all five at +12, the cascade is the product
+  double worst = 0;
+  for (auto freq : kFreqs) {
+    cEffects effects;
+    effects.setRate (rate);
+    double expected = 0;
+    for (auto band = 0; band < cEffects::kBands; band++) {
+      effects.setEq (band, 12.f);
+      expected += cookbookDb (band, 12, freq, rate);
+      }
+    worst = std::max (worst, fabs (measureDb (effects, freq, rate) - expected));
+    }
+  check (worst < 0.05, "all bands +12dB against the cookbook product, worst dB", worst);
+  }
+//}}}
+//{{{
+static void limiter() {
+
+  printf ("limiter\n");
+  std::vector<int16_t> samples (cEffects::kMaxFrames * 2);
+
+  // full scale sines, normalise and every band at their most
+  int rails = 0;
+  int peak = 0;
+  for (auto freq : { 50.0, 1000.0, 9000.0 }) {
+    cEffects effects;
+    effects.setNormalise (cEffects::kMaxNormaliseDb);
+    for (auto band = 0; band < cEffects::kBands; band++)
+      effects.setEq (band, cEffects::kMaxEqDb);
+    long frame = 0;
+    for (auto block = 0; block < 20; block++) {
+      for (auto i = 0; i < cEffects::kMaxFrames; i++, frame++) {
+        samples[2*i] = (int16_t)lrint (32767 * sin (2 * M_PI * freq * frame / 44100));
+        samples[2*i + 1] = (int16_t)-samples[2*i];
+        }
+      effects.process (samples.data(), cEffects::kMaxFrames);
+      for (auto sample : samples) {
+        rails += (sample == 32767) || (sample == -32768);
+        peak = std::max (peak, abs (sample));
+        }
+      }
+    }
+  check (rails == 0, "+12dB eq and normalise on full scale sines, samples at the rails", rails);
+  check (peak > 32000, "limited peak near full scale", peak);
+
+  // ramp through +12dB normalise, no eq, one half first so the gain has ramped
+  cEffects effects;
+  effects.setNormalise (12.f);
+  effects.process (samples.data(), cEffects::kMaxFrames);
+  double gain = pow (10, 12 / 20.0);
+
+  bool monotonic = true;
+  int untouched = 0;
+  int knee = 0;
+  int last = -32768;
+  for (int start = -32768; start <= 32767; start += cEffects::kMaxFrames) {
+    int frames = 0;
+    for (; (frames < cEffects::kMaxFrames) && (start + frames <= 32767); frames++)
+      samples[2*frames] = samples[2*frames + 1] = (int16_t)(start + frames);
+    effects.process (samples.data(), frames);
+    for (auto i = 0; i < frames; i++) {
+      monotonic &= samples[2*i] >= last;
+      last = samples[2*i];
+      rails += (samples[2*i] == 32767) || (samples[2*i] == -32768);
+      double in = (start + i) * gain;
+      if (fabs (in) < cEffects::kKnee * 32767) {
+        knee++;
+        untouched += abs (samples[2*i] - lrint (in)) <= 1;
+        }
+      }
+    }
+  check (monotonic, "ramp through +12dB monotonic", last);
+  check (rails == 0, "ramp samples at the rails", rails);
+  check (untouched == knee, "under kKnee only the gain", knee - untouched);
+  }
+//}}}
+//{{{
+static float lufs (uint32_t rate, std::vector<std::pair<double,double>> sequence) {
+// stereo 1khz, both channels, dBFS and seconds per step
+
+  cLoudness loudness;
+  loudness.reset (rate);
+  std::vector<int16_t> samples (2 * 1000);
+  long frame = 0;
+  for (auto& step : sequence) {
+    double amplitude = 32767 * pow (10, step.first / 20);
+    long frames = (long)(step.second * rate);
+    for (long done = 0; done < frames; ) {
+      int count = (int)std::min (1000L, frames - done);
+      for (auto i = 0; i < count; i++, frame++)
+        samples[2*i] = samples[2*i + 1] = (int16_t)lrint (amplitude * sin (2 * M_PI * fmod (1000.0 * frame / rate, 1.0)));
+      loudness.push (samples.data(), count);
+      done += count;
+      }
+    }
+  return loudness.getLufs();
+  }
+//}}}
+//{{{
+static void loudness (uint32_t rate) {
+
+  printf ("loudness at %u\n", rate);
+  float level = lufs (rate, { { -23, 20 } });
+  check (fabs (level + 23) <= 0.1, "3341 case 1, -23dBFS reads -23 LUFS", level);
+  level = lufs (rate, { { -33, 20 } });
+  check (fabs (level + 33) <= 0.1, "3341 case 2, -33dBFS reads -33 LUFS", level);
+  level = lufs (rate, { { -36, 10 }, { -23, 60 }, { -36, 10 } });
+  check (fabs (level + 23) <= 0.1, "3341 case 3, relative gate", level);
+  level = lufs (rate, { { -72, 10 }, { -36, 10 }, { -23, 60 }, { -36, 10 }, { -72, 10 } });
+  check (fabs (level + 23) <= 0.1, "3341 case 4, absolute and relative gates", level);
+
+  cLoudness silent;
+  silent.reset (rate);
+  check (silent.getLufs() == cLoudness::kMinLufs, "nothing pushed, kMinLufs", silent.getLufs());
+  }
+//}}}
+//{{{
+static void budget() {
+// every band on, normalise ramping every half, a full scale mix of tones
+
+  printf ("budget\n");
+  cEffects effects;
+  for (auto band = 0; band < cEffects::kBands; band++)
+    effects.setEq (band, band & 1 ? -6.f : 6.f);
+
+  std::vector<int16_t> in (cEffects::kMaxFrames * 2);
+  for (auto i = 0; i < cEffects::kMaxFrames; i++) {
+    in[2*i] = (int16_t)lrint (16000 * (sin (2 * M_PI * 220 * i / 44100) + sin (2 * M_PI * 3100 * i / 44100)));
+    in[2*i + 1] = (int16_t)lrint (16000 * sin (2 * M_PI * 700 * i / 44100));
+    }
+  std::vector<int16_t> samples (in.size());
+
+  double best = 1e12;
+  for (auto run = 0; run < kBenchRuns; run++) {
+    std::chrono::duration<double, std::nano> took (0);
+    for (auto block = 0; block < kBenchBlocks; block++) {
+      samples = in;
+      effects.setNormalise (block & 1 ? 3.f : -3.f);
+      auto start = std::chrono::steady_clock::now();
+      effects.process (samples.data(), cEffects::kMaxFrames);
+      took += std::chrono::steady_clock::now() - start;
+      }
+    best = std::min (best, took.count() / kBenchBlocks);
+    }
+
+  double budgetNs = cEffects::kBudgetCycles / kCoreHz * 1e9;
+  printf ("process %d frames %.0f ns, %.1f ns/frame, budget %.0f ns at %.0fMHz\n",
+          cEffects::kMaxFrames, best, best / cEffects::kMaxFrames, budgetNs, kCoreHz / 1e6);
+  check (best < budgetNs, "process under kBudgetCycles at the core clock, ns", best);
+  }
+//}}}
+
+int main() {
+
+  eq (44100);
+  eq (48000);
+  limiter();
+  loudness (44100);
+  loudness (48000);
+  budget();
+
+  printf ("%s\n", mFails ? "effectsTest failed" : "effectsTest passed");
+  return mFails ? 1 : 0;
+  }
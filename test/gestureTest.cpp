@@ -0,0 +1,272 @@
+// gestureTest.cpp - cGesture off target, touch report traces replayed through report
+// - tap inside kSlop, a drag past it carrying the movement since the press
+// - fling velocity over kFlingWindowMs, none once the finger stopped kFlingStopMs before lifting, none slow
+// - pinch scale and centre with the second finger in either slot, no fling or drag jump after it
+// - long press once after kLongPressMs still, none for a drag
+// - controller reordering its slots, fingers followed by id
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "cGesture.h"
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, int value) {
+
+  printf ("%s %s %d\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+
+//{{{
+struct tFinger {
+  int16_t x;
+  int16_t y;
+  uint8_t id;
+  };
+//}}}
+//{{{
+static std::vector<tGesture> touch (cGesture& gesture, uint32_t ms, std::vector<tFinger> fingers) {
+// one report, fingers in controller slot order, none is all up
+
+  tTouchReport report = {};
+  report.ms = ms;
+  report.touches = fingers.size();
+  for (size_t slot = 0; slot < fingers.size(); slot++) {
+    report.x[slot] = fingers[slot].x;
+    report.y[slot] = fingers[slot].y;
+    report.id[slot] = fingers[slot].id;
+    report.z[slot] = 40;
+    }
+
+  tGesture gestures[cGesture::kMaxGestures];
+  int count = gesture.report (report, gestures);
+  return std::vector<tGesture> (gestures, gestures + count);
+  }
+//}}}
+//{{{
+static int count (const std::vector<tGesture>& gestures, eGesture type) {
+
+  int found = 0;
+  for (auto& gesture : gestures)
+    found += gesture.type == type;
+  return found;
+  }
+//}}}
+//{{{
+static const tGesture* find (const std::vector<tGesture>& gestures, eGesture type) {
+
+  for (auto& gesture : gestures)
+    if (gesture.type == type)
+      return &gesture;
+  return nullptr;
+  }
+//}}}
+//{{{
+static std::vector<tGesture> swipe (cGesture& gesture, uint32_t& ms, int16_t& x, int steps, int16_t stepX,
+                                    uint32_t stepMs) {
+// one finger moving in x, a report every stepMs, all the gestures it made
+
+  std::vector<tGesture> all;
+  for (int i = 0; i < steps; i++) {
+    ms += stepMs;
+    x += stepX;
+    auto gestures = touch (gesture, ms, { { x, 100, 1 } });
+    all.insert (all.end(), gestures.begin(), gestures.end());
+    }
+  return all;
+  }
+//}}}
+
+//{{{
+static void slop() {
+
+  printf ("slop\n");
+  cGesture gesture;
+  auto gestures = touch (gesture, 1000, { { 100, 100, 1 } });
+  check ((gestures.size() == 1) && (gestures[0].type == eGesturePress) && (gestures[0].x == 100), "press",
+         (int)gestures.size());
+
+  gestures = touch (gesture, 1010, { { 100 + cGesture::kSlop, 100 - cGesture::kSlop, 1 } });
+  check (gestures.empty(), "inside slop, no drag", (int)gestures.size());
+
+  gestures = touch (gesture, 1020, { { 100 + cGesture::kSlop + 1, 100, 1 } });
+  auto drag = find (gestures, eGestureDrag);
+  check (drag && (drag->dx == cGesture::kSlop + 1) && (drag->dy == 0), "past slop, drag from the press",
+         drag ? drag->dx : 0);
+
+  gestures = touch (gesture, 1030, { { 100 + cGesture::kSlop + 4, 103, 1 } });
+  drag = find (gestures, eGestureDrag);
+  check (drag && (drag->dx == 3) && (drag->dy == 3), "drag since the last drag", drag ? drag->dx : 0);
+
+  gestures = touch (gesture, 1040, { { 100 + cGesture::kSlop + 4, 103, 1 } });
+  check (gestures.empty(), "no move, no drag", (int)gestures.size());
+
+  // tap, released inside slop, no drag, no fling
+  cGesture tap;
+  touch (tap, 0, { { 50, 50, 3 } });
+  gestures = touch (tap, 30, { { 52, 49, 3 } });
+  check (gestures.empty(), "tap jitter", (int)gestures.size());
+  gestures = touch (tap, 60, {});
+  check ((gestures.size() == 1) && (gestures[0].type == eGestureRelease) && !tap.down(), "tap release",
+         (int)gestures.size());
+  }
+//}}}
+//{{{
+static void fling() {
+
+  printf ("fling\n");
+  {
+  // slow then 1000 pixels per second for the last kFlingWindowMs, released as it moves
+  cGesture gesture;
+  uint32_t ms = 0;
+  int16_t x = 100;
+  touch (gesture, ms, { { x, 100, 1 } });
+  swipe (gesture, ms, x, 10, 2, 20);
+  swipe (gesture, ms, x, 10, 10, 10);
+  auto gestures = touch (gesture, ms + 10, {});
+  auto fling = find (gestures, eGestureFling);
+  check ((gestures.size() == 2) && (gestures[0].type == eGestureRelease), "release then fling", (int)gestures.size());
+  check (fling && (fling->vx == 1000) && (fling->vy == 0), "fling vx over the window", fling ? fling->vx : 0);
+  }
+
+  {
+  // left, down and up a diagonal
+  cGesture gesture;
+  uint32_t ms = 0;
+  touch (gesture, ms, { { 300, 300, 1 } });
+  for (int i = 1; i <= 8; i++)
+    touch (gesture, ms += 10, { { (int16_t)(300 - 8 * i), (int16_t)(300 + 6 * i), 1 } });
+  auto fling = find (touch (gesture, ms + 5, {}), eGestureFling);
+  check (fling && (fling->vx == -800) && (fling->vy == 600), "fling diagonal", fling ? fling->vx : 0);
+  }
+
+  // stopped before lifting, kFlingStopMs is the last still gap that flings
+  for (auto gap : { cGesture::kFlingStopMs, cGesture::kFlingStopMs + 1 }) {
+    cGesture gesture;
+    uint32_t ms = 0;
+    int16_t x = 100;
+    touch (gesture, ms, { { x, 100, 1 } });
+    swipe (gesture, ms, x, 10, 10, 10);
+    auto gestures = touch (gesture, ms + gap, {});
+    bool flung = count (gestures, eGestureFling);
+    check (flung == (gap <= cGesture::kFlingStopMs), gap <= cGesture::kFlingStopMs ?
+           "lifted kFlingStopMs after the last move, fling" : "lifted after kFlingStopMs, no fling", (int)gap);
+    }
+
+  {
+  // under kFlingMin
+  cGesture gesture;
+  uint32_t ms = 0;
+  int16_t x = 100;
+  touch (gesture, ms, { { x, 100, 1 } });
+  swipe (gesture, ms, x, 10, 3, 10);
+  auto gestures = touch (gesture, ms + 10, {});
+  check (!count (gestures, eGestureFling) && count (gestures, eGestureRelease), "300 pixels per second, no fling",
+         (int)gestures.size());
+  }
+  }
+//}}}
+//{{{
+static void pinch (bool secondInSlot0) {
+
+  printf ("pinch, second finger in slot %d\n", secondInSlot0 ? 0 : 1);
+  cGesture gesture;
+  auto fingers = [&](tFinger primary, tFinger second) {
+    return secondInSlot0 ? std::vector<tFinger> { second, primary } : std::vector<tFinger> { primary, second };
+    };
+
+  touch (gesture, 0, { { 100, 100, 5 } });
+  auto gestures = touch (gesture, 10, fingers ({ 100, 100, 5 }, { 200, 100, 6 }));
+  check (gestures.empty(), "second finger starts the pinch", (int)gestures.size());
+
+  gestures = touch (gesture, 20, fingers ({ 50, 100, 5 }, { 250, 100, 6 }));
+  auto pinch = find (gestures, eGesturePinch);
+  check (pinch && (pinch->scale == 512), "spread to twice, scale 512", pinch ? pinch->scale : 0);
+  check (pinch && (pinch->x == 150) && (pinch->y == 100), "pinch centre", pinch ? pinch->x : 0);
+  check (!count (gestures, eGestureDrag), "no drag while pinching", count (gestures, eGestureDrag));
+
+  gestures = touch (gesture, 30, fingers ({ 125, 100, 5 }, { 175, 100, 6 }));
+  pinch = find (gestures, eGesturePinch);
+  check (pinch && (pinch->scale == 128), "pinch to half, scale 128", pinch ? pinch->scale : 0);
+
+  gestures = touch (gesture, 40, fingers ({ 125, 100, 5 }, { 175, 100, 6 }));
+  check (gestures.empty(), "same distance, no pinch", (int)gestures.size());
+
+  // second finger up, primary carries on from where it is, no jump, then fast, still no fling
+  gestures = touch (gesture, 50, { { 125, 100, 5 } });
+  check (gestures.empty(), "second finger up, no drag jump", (int)gestures.size());
+  gestures = touch (gesture, 60, { { 135, 100, 5 } });
+  auto drag = find (gestures, eGestureDrag);
+  check (drag && (drag->dx == 10), "drag from where the pinch left the primary", drag ? drag->dx : 0);
+  gestures = touch (gesture, 70, { { 155, 100, 5 } });
+  gestures = touch (gesture, 75, {});
+  check (!count (gestures, eGestureFling) && count (gestures, eGestureRelease), "no fling after a pinch",
+         (int)gestures.size());
+  }
+//}}}
+//{{{
+static void longPress() {
+
+  printf ("long press\n");
+  cGesture gesture;
+  touch (gesture, 0, { { 100, 100, 1 } });
+  int longPresses = 0;
+  uint32_t at = 0;
+  for (uint32_t ms = 20; ms <= 2000; ms += 20) {
+    auto gestures = touch (gesture, ms, { { (int16_t)(100 + (ms / 20) % 3), 100, 1 } });
+    if (count (gestures, eGestureLongPress) && !longPresses++)
+      at = ms;
+    }
+  check (longPresses == 1, "one long press, jitter inside slop", longPresses);
+  check (at == cGesture::kLongPressMs, "long press at kLongPressMs", (int)at);
+
+  cGesture dragged;
+  touch (dragged, 0, { { 100, 100, 1 } });
+  touch (dragged, 100, { { 120, 100, 1 } });
+  longPresses = 0;
+  for (uint32_t ms = 120; ms <= 2000; ms += 20)
+    longPresses += count (touch (dragged, ms, { { 120, 100, 1 } }), eGestureLongPress);
+  check (longPresses == 0, "no long press once dragged", longPresses);
+  }
+//}}}
+//{{{
+static void reorder() {
+
+  printf ("slot reorder\n");
+  cGesture gesture;
+  touch (gesture, 0, { { 100, 100, 7 } });
+  touch (gesture, 10, { { 100, 100, 7 }, { 300, 300, 8 } });
+
+  // controller swaps slots, same fingers, same places
+  auto gestures = touch (gesture, 20, { { 300, 300, 8 }, { 100, 100, 7 } });
+  check (gestures.empty(), "slot swap, no pinch, no drag", (int)gestures.size());
+
+  // primary up, the other finger is followed from where it is
+  gestures = touch (gesture, 30, { { 300, 300, 8 } });
+  check (gestures.empty(), "primary up, no jump to the other finger", (int)gestures.size());
+  gestures = touch (gesture, 40, { { 300 + cGesture::kSlop + 2, 300, 8 } });
+  auto drag = find (gestures, eGestureDrag);
+  check (drag && (drag->dx == cGesture::kSlop + 2) && (drag->x == 300 + cGesture::kSlop + 2),
+         "remaining finger drags from its own place", drag ? drag->dx : 0);
+
+  }
+//}}}
+
+int main() {
+
+  slop();
+  fling();
+  pinch (false);
+  pinch (true);
+  longPress();
+  reorder();
+
+  printf ("%s\n", mFails ? "gestureTest failed" : "gestureTest passed");
+  return mFails ? 1 : 0;
+  }
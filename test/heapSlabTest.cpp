@@ -0,0 +1,192 @@
+// heapSlabTest.cpp - heap_5.c off target, slab front end against the list heap, counters from vPortHeapStats
+// - regions mapped at the target's addresses, 256k of sram below heapINTERNAL_END, 8m of sdram above it
+// - times 16..256 byte churn, a window of live blocks with random sizes replaced in random order, through
+//   the slabs with pvPortMalloc and through the list with pvPortMallocPlaced
+// - checks use and fill per class, bytes held per task by whichever task frees, a deleted task's slot
+//   kept until its blocks are freed, placements in their regions
+// - one thread, the task calls heap_5 makes are stubbed, a test switches tasks by setting mCurrentTask
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <chrono>
+#include <string>
+
+#include "FreeRTOS.h"
+#include "task.h"
+//}}}
+
+static const uintptr_t kSramBase = 0x20020000;
+static const size_t kSramSize = 0x40000;
+static const uintptr_t kSdramBase = 0xC0000000;
+static const size_t kSdramSize = 0x800000;
+static const uintptr_t kInternalEnd = 0x60000000;
+
+//{{{  task stubs
+struct tTask {
+  char name[configMAX_TASK_NAME_LEN];
+  };
+static tTask mTasks[3] = { { "audio" }, { "http" }, { "usb" } };
+static tTask* mCurrentTask = nullptr;
+
+extern "C" {
+  void vTaskSuspendAll() {}
+  BaseType_t xTaskResumeAll() { return pdFALSE; }
+  TaskHandle_t xTaskGetCurrentTaskHandle() { return (TaskHandle_t)mCurrentTask; }
+  char* pcTaskGetTaskName (TaskHandle_t task) { return ((tTask*)task)->name; }
+  }
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, double value) {
+
+  printf ("%s %s %g\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+//{{{
+static void* mapAt (uintptr_t address, size_t bytes) {
+
+  void* map = mmap ((void*)address, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  return map == (void*)address ? map : nullptr;
+  }
+//}}}
+//{{{
+static std::string heapStats() {
+
+  char report[2048];
+  vPortHeapStats (report, sizeof(report));
+  return report;
+  }
+//}}}
+//{{{
+static bool slabClass (unsigned size, unsigned& pages, unsigned& use, unsigned& free, unsigned& fill) {
+// class line of the heap report, slab%4u pages%3u use%6u free%6u fill%3u%%
+
+  auto report = heapStats();
+  for (size_t pos = 0; (pos = report.find ("slab", pos)) != std::string::npos; pos++) {
+    unsigned blockSize;
+    if ((sscanf (report.c_str() + pos, "slab%u pages%u use%u free%u fill%u%%",
+                 &blockSize, &pages, &use, &free, &fill) == 5) && (blockSize == size))
+      return true;
+    }
+  return false;
+  }
+//}}}
+//{{{
+static double churn (bool slab, int ops) {
+// ns per free and alloc pair, kLive blocks of 16..256 bytes live at once
+
+  const int kLive = 1024;
+  void* live[kLive];
+
+  srand (1);
+  for (auto& block : live) {
+    size_t size = 16 + (rand() % 241);
+    block = slab ? pvPortMalloc (size) : pvPortMallocPlaced (size, eHeapBulk);
+    }
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < ops; i++) {
+    auto& block = live[rand() % kLive];
+    vPortFree (block);
+    size_t size = 16 + (rand() % 241);
+    block = slab ? pvPortMalloc (size) : pvPortMallocPlaced (size, eHeapBulk);
+    }
+  auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+
+  for (auto& block : live)
+    vPortFree (block);
+  return ns;
+  }
+//}}}
+
+int main() {
+
+  auto sram = (uint8_t*)mapAt (kSramBase, kSramSize);
+  auto sdram = (uint8_t*)mapAt (kSdramBase, kSdramSize);
+  if (!sram || !sdram) {
+    printf ("FAIL map regions at target addresses\n");
+    return 1;
+    }
+
+  const HeapRegion_t regions[] = { { sram, kSramSize }, { sdram, kSdramSize }, { nullptr, 0 } };
+  vPortDefineHeapRegions (regions);
+  auto listFree = xPortGetFreeHeapSize();
+
+  // slab class and fill, 24 bytes from the 32 byte class
+  mCurrentTask = &mTasks[0];
+  const int kBlocks = 100;
+  void* blocks[kBlocks];
+  for (auto& block : blocks)
+    block = pvPortMalloc (24);
+
+  unsigned pages, use, free, fill;
+  check (slabClass (32, pages, use, free, fill) && (use == kBlocks), "slab32 use", use);
+  check (fill == 75, "slab32 fill percent", fill);
+  check (pages == 1, "slab32 pages", pages);
+  check (ulPortGetTaskHeapBytes (&mTasks[0]) == kBlocks * 32, "audio bytes after slab allocs",
+         ulPortGetTaskHeapBytes (&mTasks[0]));
+  check (xPortGetFreeHeapSize() == listFree, "slab allocs leave the list heap alone", xPortGetFreeHeapSize());
+
+  bool distinct = true;
+  for (auto i = 1; i < kBlocks; i++)
+    distinct &= ((uint8_t*)blocks[i] - (uint8_t*)blocks[i-1]) % 32 == 0;
+  check (distinct, "slab32 blocks on the class stride", 0);
+
+  // freed by another task, bytes come off the allocating task
+  mCurrentTask = &mTasks[1];
+  for (auto& block : blocks)
+    vPortFree (block);
+  check (slabClass (32, pages, use, free, fill) && (use == 0), "slab32 use after free", use);
+  check (ulPortGetTaskHeapBytes (&mTasks[0]) == 0, "audio bytes after free by http",
+         ulPortGetTaskHeapBytes (&mTasks[0]));
+  check (ulPortGetTaskHeapBytes (&mTasks[1]) == 0, "http bytes after freeing", ulPortGetTaskHeapBytes (&mTasks[1]));
+
+  // list block, header and cache line padding counted
+  auto list = pvPortMallocPlaced (100, eHeapBulk);
+  check ((uintptr_t)list >= kSdramBase, "bulk placement in sdram", (double)(uintptr_t)list);
+  check (((uintptr_t)list & 31) == 0, "list block on a cache line", (double)((uintptr_t)list & 31));
+  check (ulPortGetTaskHeapBytes (&mTasks[1]) == 160, "http bytes for a 100 byte list block",
+         ulPortGetTaskHeapBytes (&mTasks[1]));
+  vPortFree (list);
+  check (ulPortGetTaskHeapBytes (&mTasks[1]) == 0, "http bytes after list free", ulPortGetTaskHeapBytes (&mTasks[1]));
+
+  auto fast = pvPortMallocPlaced (4096, eHeapFast);
+  check ((uintptr_t)fast < kInternalEnd, "fast placement in sram", (double)(uintptr_t)fast);
+  vPortFree (fast);
+  check (xPortGetFreeHeapSize() == listFree, "list heap whole again", xPortGetFreeHeapSize());
+
+  // deleted task keeps its slot while it holds blocks
+  mCurrentTask = &mTasks[2];
+  auto held = pvPortMalloc (200);
+  vPortHeapTaskDeleted (&mTasks[2]);
+  check (heapStats().find ("usb          allocs      1 bytes      256 deleted") != std::string::npos,
+         "deleted task listed with its bytes", 0);
+  mCurrentTask = &mTasks[0];
+  vPortFree (held);
+  check (heapStats().find ("usb") == std::string::npos, "deleted task slot released by its last free", 0);
+
+  // churn, same sizes and order through both front ends
+  mCurrentTask = &mTasks[0];
+  const int kOps = 2000000;
+  auto slabNs = churn (true, kOps);
+  auto listNs = churn (false, kOps);
+  printf ("16..256 byte churn, slab %.1fns list %.1fns per free and alloc\n", slabNs, listNs);
+  check (ulPortGetTaskHeapBytes (&mTasks[0]) == 0, "audio bytes after churn", ulPortGetTaskHeapBytes (&mTasks[0]));
+  check (xPortGetFreeHeapSize() == listFree, "list heap whole after churn", xPortGetFreeHeapSize());
+
+  unsigned inUse = 0;
+  for (unsigned size = 16; size <= 256; size *= 2)
+    if (slabClass (size, pages, use, free, fill))
+      inUse += use;
+  check (inUse == 0, "slab use after churn", inUse);
+
+  printf ("%s\n", mFails ? "heapSlabTest failed" : "heapSlabTest passed");
+  return mFails ? 1 : 0;
+  }
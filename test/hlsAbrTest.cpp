@@ -0,0 +1,73 @@
+// hlsAbrTest.cpp - cHlsAbr off target, load time traces through the abr, checked against the cap
+// - fast link climbs one rate at a time, kUpLoads loads apart, and stops at the user's cap
+// - a lowered cap clamps the choice at once, a raised cap lets it climb again
+// - a slow chunk, a failed load or a rebuffer steps down at once
+//{{{  includes
+#include <stdio.h>
+
+#include "cHlsAbr.h"
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, int value) {
+
+  printf ("%s %s %d\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+//{{{
+static int loadMs (int bitrate, int bps) {
+// time to load a 6.4s chunk of bitrate over a link of bps
+  return (int)((6400.f * bitrate) / bps);
+  }
+//}}}
+
+int main() {
+
+  // 2Mbit link, cap 128k, starts at the cap, never above it
+  cHlsAbr abr (128000);
+  check (abr.getBitrate() == 128000, "start at cap", abr.getBitrate());
+  for (auto i = 0; i < 20; i++)
+    abr.loaded (loadMs (abr.getBitrate(), 2000000), 0, i == 0);
+  check (abr.getBitrate() == 128000, "held at cap", abr.getBitrate());
+  check (abr.getSwitches() == 0, "no switches under cap", abr.getSwitches());
+
+  // raised cap, climbs after kUpLoads loads with headroom
+  abr.setCap (320000);
+  auto loads = 0;
+  while ((abr.getBitrate() < 320000) && (loads < 20)) {
+    abr.loaded (loadMs (abr.getBitrate(), 2000000), 0, false);
+    loads++;
+    }
+  check (abr.getBitrate() == 320000, "climb to raised cap", abr.getBitrate());
+  check (loads == 3, "climb after 3 loads", loads);
+
+  // lowered cap clamps at once
+  abr.setCap (100000);
+  check (abr.getBitrate() == 96000, "clamp to lowered cap", abr.getBitrate());
+
+  // link drops to 100k, 96k needs 20% headroom, steps down
+  abr.setCap (320000);
+  abr.loaded (loadMs (abr.getBitrate(), 100000), 0, false);
+  check (abr.getBitrate() == 48000, "down on slow chunk", abr.getBitrate());
+
+  // failed load at the bottom stays at the bottom
+  abr.failed();
+  check (abr.getBitrate() == 48000, "floor on failed load", abr.getBitrate());
+
+  // rebuffer steps down even with headroom, first chunk after setChan is not a rebuffer
+  cHlsAbr rebuffer (320000);
+  rebuffer.loaded (loadMs (320000, 2000000), 5, true);
+  check (rebuffer.getBitrate() == 320000, "first chunk rebuffers ignored", rebuffer.getBitrate());
+  rebuffer.loaded (loadMs (320000, 2000000), 6, false);
+  check (rebuffer.getBitrate() == 128000, "down on rebuffer", rebuffer.getBitrate());
+
+  // cap below the lowest rate still plays the lowest
+  cHlsAbr low (8000);
+  check (low.getBitrate() == 48000, "cap below lowest", low.getBitrate());
+
+  printf ("%s\n", mFails ? "hlsAbrTest failed" : "hlsAbrTest passed");
+  return mFails ? 1 : 0;
+  }
@@ -0,0 +1,168 @@
+// hlsDriftTest.cpp - cHlsDrift off target, 24h of hls live playout against a simulated sai and cpu clock
+// - the server publishes a 6.4s chunk every 6.4s of true time, the loader fetches the next chunk once
+//   play enters the last loaded one, each load takes 0.5..1.5s
+// - the sai is off by pll ppm and crystal ppm, the cpu cycle counter only by crystal ppm, isr jitter on
+//   every half transfer timestamp
+// - controlled, latency holds within kMaxDrift of where it settled after startup, no rebuffers,
+//   sai estimate within kMaxSaiError
+// - uncontrolled, the same clocks drift latency or rebuffer, so the controlled pass means something
+// - a scrub longer than a cycle counter wrap with dma timestamps unfed leaves the sai estimate intact
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "cHlsDrift.h"
+//}}}
+
+static const double kRate = 48000.;
+static const double kCpuHz = 216e6;
+static const double kHalfSamples = 1024.;
+static const double kChunkSamples = 307200.;  // 300 aac frames of 1024
+static const double kChunkSeconds = kChunkSamples / kRate;
+static const int kFillHalves = 4;             // player feeds fill every kFillHalves halves
+static const int kEdgeChunks = 100;           // chunks published before playout starts
+
+static const double kHours = 24.;
+static const double kStartup = 2. * cHlsDrift::kLatchTime;
+static const double kMaxDrift = 0.15;         // s of latency from where it settled after startup
+static const double kMaxSaiError = 0.2;       // ppm
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, double value) {
+
+  printf ("%s %s %.3f\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+
+//{{{
+struct tResult {
+  int rebuffers = 0;
+  double settled = 0.;
+  double maxDrift = 0.;
+  double saiPpm = 0.;
+  double saiError = 0.;
+  };
+//}}}
+//{{{
+static tResult run (double pllPpm, double crystalPpm, bool control, double scrubSeconds) {
+// scrubSeconds of scrub halfway through, dma unfed, halves still counted, as hlsPlayerThread does
+
+  double saiHz = kRate * (1. + pllPpm * 1e-6) * (1. + crystalPpm * 1e-6);
+  double cpuHz = kCpuHz * (1. + crystalPpm * 1e-6);
+  double halfSeconds = kHalfSamples / saiHz;
+
+  cHlsDrift drift ((float)kRate);
+  tResult result;
+
+  srand (1);
+  double t = 0.;
+  double cycles = 0.;
+  double play = kEdgeChunks * kChunkSamples;
+  double loadedEnd = play + kChunkSamples;
+  double loadDone = 0.;
+  bool loading = false;
+  bool scrubbed = false;
+  int halves = 0;
+
+  while (t < kHours * 3600.) {
+    // loader, next chunk once play is in the last loaded one and the server has published it
+    if (!loading && ((int)(loadedEnd / kChunkSamples) <= (int)(play / kChunkSamples) + 1)) {
+      double published = ((int)(loadedEnd / kChunkSamples) - kEdgeChunks + 1) * kChunkSeconds;
+      if (t >= published) {
+        loading = true;
+        loadDone = t + 0.5 + (rand() % 1000) / 1000.;
+        }
+      }
+    if (loading && (t >= loadDone)) {
+      loadedEnd += kChunkSamples;
+      loading = false;
+      }
+
+    if (scrubSeconds && !scrubbed && (t > kHours * 1800.)) {
+      // sai keeps playing, nothing fed to the drift, the halves are counted into the next dma call
+      scrubbed = true;
+      drift.reset();
+      drift.dmaGap();
+      auto scrubHalves = (int)(scrubSeconds / halfSeconds);
+      t += scrubHalves * halfSeconds;
+      cycles += scrubHalves * halfSeconds * cpuHz;
+      drift.dma ((uint32_t)(uint64_t)cycles, (uint32_t)kCpuHz, (uint32_t)(scrubHalves * kHalfSamples));
+      continue;
+      }
+
+    // sai half transfer
+    t += halfSeconds;
+    cycles += halfSeconds * cpuHz;
+    drift.dma ((uint32_t)(uint64_t)(cycles + (rand() % 2001)), (uint32_t)kCpuHz, (uint32_t)kHalfSamples);
+
+    double need = kHalfSamples * (1. + (control ? drift.getTrim() * 1e-6 : 0.));
+    if (play + need > loadedEnd) {
+      // rebuffer, wait for the chunk to load and a second more, latency jumps, target relatches
+      if (t > kStartup)
+        result.rebuffers++;
+      double published = ((int)(loadedEnd / kChunkSamples) - kEdgeChunks + 1) * kChunkSeconds;
+      double until = (t > published ? t : published) + 1.;
+      while (t < until) {
+        t += halfSeconds;
+        cycles += halfSeconds * cpuHz;
+        drift.dma ((uint32_t)(uint64_t)cycles, (uint32_t)kCpuHz, (uint32_t)kHalfSamples);
+        }
+      loadedEnd += kChunkSamples;
+      loading = false;
+      drift.reset();
+      continue;
+      }
+
+    play += need;
+    if (!(++halves % kFillHalves))
+      drift.fill ((float)(floor ((loadedEnd - play) / kHalfSamples) * kHalfSamples),
+                  (float)(kFillHalves * kHalfSamples / kRate));
+
+    if (t > kStartup) {
+      double edge = ((kEdgeChunks - 1) * kChunkSamples) + (t / kChunkSeconds * kChunkSamples);
+      double latency = (edge - play) / kRate;
+      if (result.settled == 0.)
+        result.settled = latency;
+      result.maxDrift = fmax (result.maxDrift, fabs (latency - result.settled));
+      }
+    }
+
+  // the sai rate against the cpu clock, the crystal is common to both
+  result.saiPpm = drift.getSaiPpm();
+  result.saiError = fabs (result.saiPpm - pllPpm);
+  return result;
+  }
+//}}}
+
+int main() {
+
+  const double kClocks[][2] = { { -190., 40. }, { -190., -50. }, { 300., 0. }, { 150., 50. }, { 0., 0. } };
+
+  for (auto& clock : kClocks) {
+    printf ("pll %+.0fppm crystal %+.0fppm\n", clock[0], clock[1]);
+
+    auto result = run (clock[0], clock[1], true, 0.);
+    check (result.rebuffers == 0, "controlled rebuffers", result.rebuffers);
+    check (result.maxDrift <= kMaxDrift, "controlled latency drift s", result.maxDrift);
+    check (result.saiError <= kMaxSaiError, "sai estimate error ppm", result.saiError);
+
+    if (clock[0] || clock[1]) {
+      auto free = run (clock[0], clock[1], false, 0.);
+      check ((free.rebuffers > 0) || (free.maxDrift > 10. * kMaxDrift), "uncontrolled drifts, latency drift s",
+             free.maxDrift);
+      }
+    }
+
+  // a minute of scrub, three cycle counter wraps with no timestamps
+  printf ("pll +300ppm crystal -50ppm, 60s scrub\n");
+  auto result = run (300., -50., true, 60.);
+  check (result.saiError <= kMaxSaiError, "sai estimate error after scrub ppm", result.saiError);
+  check (result.rebuffers == 0, "rebuffers after scrub", result.rebuffers);
+
+  printf ("%s\n", mFails ? "hlsDriftTest failed" : "hlsDriftTest passed");
+  return mFails ? 1 : 0;
+  }
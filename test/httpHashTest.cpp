@@ -0,0 +1,131 @@
+// httpHashTest.cpp - fs_open and the http route table off target, the perfect hashes makefshash.py generates
+// - makefshash.py --check, the committed fsdata.c and httpServer.c tables are what the generator gives
+// - every file named in fsdata.c opens through fs.c's one probe, a distinct file, with its http header,
+//   near misses of each name miss
+// - every route uri in httpServer.c sits in the slot fs_hash gives it with HTTP_ROUTE_SEED
+// - times fs_open, hit and miss, against the lwip arch of the target, not a load test
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+// lwip's arch cpu.h defines BYTE_ORDER, so does glibc's endian.h under g++'s _GNU_SOURCE
+#undef BYTE_ORDER
+extern "C" {
+#include "fs.h"
+}
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, const std::string& value) {
+
+  printf ("%s %s %s\n", ok ? "pass" : "FAIL", what, value.c_str());
+  if (!ok)
+    mFails++;
+  }
+//}}}
+//{{{
+static std::string readFile (const char* path) {
+
+  std::string text;
+  FILE* file = fopen (path, "rb");
+  if (file) {
+    char buf[4096];
+    size_t bytes;
+    while ((bytes = fread (buf, 1, sizeof(buf), file)) > 0)
+      text.append (buf, bytes);
+    fclose (file);
+    }
+  return text;
+  }
+//}}}
+
+//{{{
+static std::vector<std::string> fsdataNames (const std::string& text) {
+// names from the makefsdata comments, /* /name (n chars) */ at the start of each data array
+
+  std::vector<std::string> names;
+  size_t pos = 0;
+  while ((pos = text.find ("[] QSPI_CONST = {\n/* ", pos)) != std::string::npos) {
+    pos += strlen ("[] QSPI_CONST = {\n/* ");
+    names.push_back (text.substr (pos, text.find (' ', pos) - pos));
+    }
+  return names;
+  }
+//}}}
+//{{{
+static unsigned long define (const std::string& text, const char* name) {
+
+  auto pos = text.find (std::string ("#define ") + name);
+  return pos == std::string::npos ? 0 : strtoul (text.c_str() + pos + strlen ("#define ") + strlen (name), nullptr, 0);
+  }
+//}}}
+
+int main() {
+
+  check (system ("python3 ../httpserver/makefshash.py --check") == 0, "makefshash --check", "");
+
+  // files
+  auto names = fsdataNames (readFile ("../httpserver/fsdata.c"));
+  check (!names.empty(), "fsdata names", std::to_string (names.size()));
+
+  std::set<const char*> datas;
+  for (auto& name : names) {
+    struct fs_file* file = fs_open (name.c_str());
+    check (file && (file->len > 0) && file->http_header_included && !strncmp (file->data, "HTTP/1.", 7),
+           "fs_open", name);
+    if (file) {
+      datas.insert (file->data);
+      fs_close (file);
+      }
+
+    std::string miss = name + "x";
+    file = fs_open (miss.c_str());
+    check (!file, "fs_open miss", miss);
+    if (file)
+      fs_close (file);
+    }
+  check (datas.size() == names.size(), "distinct files", std::to_string (datas.size()));
+
+  // routes, the table text as http_process indexes it
+  auto server = readFile ("../httpserver/httpServer.c");
+  auto seed = define (server, "HTTP_ROUTE_SEED");
+  auto size = define (server, "HTTP_ROUTE_SIZE");
+  check (size && !(size & (size - 1)), "route table size", std::to_string (size));
+
+  auto table = server.find ("http_routes[HTTP_ROUTE_SIZE] = {\n");
+  auto end = server.find ("  };\n", table);
+  auto pos = server.find ('\n', table) + 1;
+  for (unsigned long slot = 0; (pos < end) && (slot < size); slot++) {
+    auto line = server.substr (pos, server.find ('\n', pos) - pos);
+    pos += line.size() + 1;
+    auto quote = line.find ('"');
+    if (quote == std::string::npos)
+      continue;
+    auto uri = line.substr (quote + 1, line.find ('"', quote + 1) - quote - 1);
+    check ((fs_hash (uri.c_str(), (u32_t)seed) & (size - 1)) == slot, "route slot", uri);
+    }
+
+  // one probe, a hit costs a hash and a strcmp
+  const int kLookups = 1000000;
+  auto start = std::chrono::steady_clock::now();
+  int opened = 0;
+  for (auto i = 0; i < kLookups; i++) {
+    struct fs_file* file = fs_open ((i & 1) ? names[i % names.size()].c_str() : "/missing.html");
+    if (file) {
+      opened++;
+      fs_close (file);
+      }
+    }
+  auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kLookups;
+  check (opened == kLookups / 2, "lookups hit", std::to_string (opened));
+  printf ("fs_open %.1fns per lookup, half misses\n", ns);
+
+  printf ("%s\n", mFails ? "httpHashTest failed" : "httpHashTest passed");
+  return mFails ? 1 : 0;
+  }
@@ -0,0 +1,55 @@
+// portmacro.h - host port for test/ builds of kernel side sources against the tree's FreeRTOS headers and config
+// - one thread, no interrupts, no scheduler, the test provides the task calls a source makes
+// - disabling interrupts is where configASSERT stops the target, on the host it aborts the test
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define portCHAR    char
+#define portFLOAT   float
+#define portDOUBLE  double
+#define portLONG    long
+#define portSHORT   short
+#define portSTACK_TYPE  uint32_t
+#define portBASE_TYPE   long
+
+typedef portSTACK_TYPE StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+typedef uint32_t TickType_t;
+#define portMAX_DELAY  (TickType_t)0xffffffffUL
+#define portTICK_TYPE_IS_ATOMIC  1
+
+#define portSTACK_GROWTH      (-1)
+#define portTICK_PERIOD_MS    ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portBYTE_ALIGNMENT    8
+#define portPOINTER_SIZE_TYPE uintptr_t
+
+#define portYIELD()
+#define portEND_SWITCHING_ISR(xSwitchRequired)  (void)(xSwitchRequired)
+#define portYIELD_FROM_ISR(x)                   portEND_SWITCHING_ISR (x)
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()      0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)   (void)(x)
+#define portDISABLE_INTERRUPTS()               abort()
+#define portENABLE_INTERRUPTS()
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+
+#define portTASK_FUNCTION_PROTO(vFunction, pvParameters)  void vFunction (void* pvParameters)
+#define portTASK_FUNCTION(vFunction, pvParameters)        void vFunction (void* pvParameters)
+
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+#define portSUPPRESS_TICKS_AND_SLEEP(xExpectedIdleTime)
+#define portASSERT_IF_INTERRUPT_PRIORITY_INVALID()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+// spectrumTest.cpp - cSpectrum off target, the built in fft, bands and levels for known tones
+// - peak bin and power of bin centred and off bin tones, full scale reading 0dB less hann scalloping
+// - every bin from kMinFreq to nyquist in exactly one band, bands in order, none empty, at 44.1k and 48k
+// - bin magnitudes against a double precision dft of the same windowed samples, within 1e-7 of full scale
+// - bars fall kFallPerFrame a frame, peaks hold kPeakHoldFrames
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <memory>
+#include <vector>
+
+#include "cSpectrum.h"
+//}}}
+
+static const int kFftLen = cSpectrum::kFftLen;
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, double value) {
+
+  printf ("%s %s %g\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+
+//{{{
+static std::vector<int16_t> tone (double freq, double dbfs, uint32_t rate) {
+// kFftLen stereo frames, same sample both channels
+
+  std::vector<int16_t> samples (2 * kFftLen);
+  double amplitude = 32767 * pow (10, dbfs / 20);
+  for (auto i = 0; i < kFftLen; i++)
+    samples[2*i] = samples[2*i + 1] = (int16_t)lrint (amplitude * sin (2 * M_PI * freq * i / rate));
+  return samples;
+  }
+//}}}
+//{{{
+static std::unique_ptr<cSpectrum> analysed (const std::vector<int16_t>& samples, uint32_t rate) {
+
+  std::unique_ptr<cSpectrum> spectrum (new cSpectrum());
+  spectrum->setRate (rate);
+  spectrum->push (samples.data(), kFftLen);
+  spectrum->analyse();
+  return spectrum;
+  }
+//}}}
+//{{{
+static int peakBin (cSpectrum& spectrum) {
+
+  int peak = 0;
+  for (auto bin = 1; bin <= kFftLen / 2; bin++)
+    if (spectrum.getBinPower (bin) > spectrum.getBinPower (peak))
+      peak = bin;
+  return peak;
+  }
+//}}}
+//{{{
+static int loudestBand (cSpectrum& spectrum) {
+
+  int loudest = 0;
+  for (auto band = 1; band < cSpectrum::kBands; band++)
+    if (spectrum.getLevels()[band] > spectrum.getLevels()[loudest])
+      loudest = band;
+  return loudest;
+  }
+//}}}
+
+//{{{
+static void tones() {
+
+  printf ("tones\n");
+  const uint32_t rate = 44100;
+  const double binHz = (double)rate / kFftLen;
+
+  // bin centred, full scale reads 0dB, -20dB reads -20dB
+  auto spectrum = analysed (tone (80 * binHz, 0, rate), rate);
+  check (peakBin (*spectrum) == 80, "bin centred full scale peak bin", peakBin (*spectrum));
+  double db = 10 * log10 (spectrum->getBinPower (80));
+  check (fabs (db) < 0.01, "bin centred full scale dB", db);
+  check (fabs (10 * log10 (spectrum->getBinPower (79)) + 6.02) < 0.01, "hann neighbour bin -6dB",
+         10 * log10 (spectrum->getBinPower (79)));
+  float level = spectrum->getLevels()[loudestBand (*spectrum)];
+  check (level > 0.9999f, "full scale level 1", level);
+
+  spectrum = analysed (tone (80 * binHz, -20, rate), rate);
+  db = 10 * log10 (spectrum->getBinPower (80));
+  check (fabs (db + 20) < 0.01, "bin centred -20dB", db);
+  level = spectrum->getLevels()[loudestBand (*spectrum)];
+  check (fabs (level - (-20 - cSpectrum::kFloorDb) / -cSpectrum::kFloorDb) < 1e-3, "-20dB level", level);
+
+  // off bin, 1khz is bin 23.22, hann scallops it under 0dB
+  spectrum = analysed (tone (1000, 0, rate), rate);
+  check (peakBin (*spectrum) == 23, "1khz peak bin", peakBin (*spectrum));
+  db = 10 * log10 (spectrum->getBinPower (23));
+  check ((db < 0) && (db > -1.43), "1khz full scale, inside hann's 1.42dB scallop", db);
+
+  // half a bin off, the worst scallop
+  spectrum = analysed (tone (100.5 * binHz, 0, rate), rate);
+  db = 10 * log10 (std::max (spectrum->getBinPower (100), spectrum->getBinPower (101)));
+  check (fabs (db + 1.42) < 0.02, "half bin off, hann scallop -1.42dB", db);
+
+  // band of the tone is the band its frequency sits in
+  spectrum = analysed (tone (1000, -6, rate), rate);
+  auto band = loudestBand (*spectrum);
+  check ((band > 0) && (spectrum->getBandFreq (band - 1) < 1000) && (spectrum->getBandFreq (band + 1) > 1000),
+         "1khz lights the band around it", spectrum->getBandFreq (band));
+  }
+//}}}
+//{{{
+static void bands (uint32_t rate) {
+// a bin centred tone per bin, its loudest band, bands in order, every band hit
+
+  printf ("bands at %u\n", rate);
+  const double binHz = (double)rate / kFftLen;
+  int firstBin = (int)(cSpectrum::kMinFreq / binHz + 0.5);
+
+  std::vector<int> binsInBand (cSpectrum::kBands);
+  int lastBand = 0;
+  bool ordered = true;
+  std::unique_ptr<cSpectrum> spectrum;
+  for (auto bin = firstBin; bin < kFftLen / 2; bin++) {
+    spectrum = analysed (tone (bin * binHz, -6, rate), rate);
+    auto band = loudestBand (*spectrum);
+    ordered &= (band == lastBand) || (band == lastBand + 1);
+    lastBand = band;
+    binsInBand[band]++;
+    }
+  check (ordered, "each bin in the same band as the one below or the next", lastBand);
+
+  int empty = 0;
+  for (auto bins : binsInBand)
+    empty += bins == 0;
+  check (empty == 0, "no band without a bin", empty);
+  spectrum = analysed (tone ((firstBin - 1) * binHz, -6, rate), rate);
+  float leak = (-6 - 6.02f - cSpectrum::kFloorDb) / -cSpectrum::kFloorDb;
+  check (fabs (spectrum->getLevels()[0] - leak) < 1e-3, "bin under kMinFreq in no band, its hann leak only",
+         spectrum->getLevels()[0]);
+  check (lastBand == cSpectrum::kBands - 1, "last band to nyquist", lastBand);
+
+  float last = 0.f;
+  ordered = true;
+  for (auto band = 0; band < cSpectrum::kBands; band++) {
+    ordered &= spectrum->getBandFreq (band) > last;
+    last = spectrum->getBandFreq (band);
+    }
+  check (ordered && (spectrum->getBandFreq (0) >= cSpectrum::kMinFreq) && (last <= rate / 2.f),
+         "band centres rising kMinFreq to nyquist", last);
+  }
+//}}}
+//{{{
+static void dft() {
+// double precision dft of the windowed mono samples, magnitude per bin, full scale sine in bin is 1
+
+  printf ("dft\n");
+  const uint32_t rate = 44100;
+  const double kFullScale = 32768.0 * (kFftLen / 4);
+
+  struct tTone { double freq; double dbfs; };
+  for (auto t : { tTone { 1000, 0 }, tTone { 80 * 43.06640625, 0 }, tTone { 440, -3 }, tTone { 100, -20 },
+                  tTone { 10000, -6 }, tTone { 15000, -40 } }) {
+    auto samples = tone (t.freq, t.dbfs, rate);
+    auto spectrum = analysed (samples, rate);
+
+    double worst = 0;
+    for (auto bin = 0; bin <= kFftLen / 2; bin++) {
+      double re = 0;
+      double im = 0;
+      for (auto i = 0; i < kFftLen; i++) {
+        double x = samples[2*i] * (0.5 - 0.5 * cos (2 * M_PI * i / kFftLen));
+        re += x * cos (2 * M_PI * bin * i / kFftLen);
+        im -= x * sin (2 * M_PI * bin * i / kFftLen);
+        }
+      double magnitude = sqrt ((re * re) + (im * im)) / kFullScale;
+      worst = std::max (worst, fabs (sqrt (spectrum->getBinPower (bin)) - magnitude));
+      }
+
+    char what[64];
+    sprintf (what, "%.0fHz %.0fdB bins against dft, of full scale", t.freq, t.dbfs);
+    check (worst <= 1e-7, what, worst);
+    }
+  }
+//}}}
+//{{{
+static void fall() {
+// tone then silence, bar down kFallPerFrame a frame, peak held kPeakHoldFrames then falling
+
+  printf ("fall\n");
+  const uint32_t rate = 44100;
+  auto samples = tone (1000, 0, rate);
+  auto spectrum = analysed (samples, rate);
+  auto band = loudestBand (*spectrum);
+  float level = spectrum->getLevels()[band];
+
+  std::vector<int16_t> silence (2 * kFftLen);
+  spectrum->push (silence.data(), kFftLen);
+  spectrum->analyse();
+  check (fabs (spectrum->getLevels()[band] - (level - 0.03f)) < 1e-6, "bar falls 0.03 a frame",
+         level - spectrum->getLevels()[band]);
+
+  for (auto frame = 1; frame < cSpectrum::kPeakHoldFrames; frame++) {
+    spectrum->push (silence.data(), kFftLen);
+    spectrum->analyse();
+    }
+  check (spectrum->getPeaks()[band] == level, "peak held kPeakHoldFrames", spectrum->getPeaks()[band]);
+  spectrum->push (silence.data(), kFftLen);
+  spectrum->analyse();
+  check (spectrum->getPeaks()[band] < level, "peak falls the frame after the hold", spectrum->getPeaks()[band]);
+  }
+//}}}
+
+int main() {
+
+  tones();
+  bands (44100);
+  bands (48000);
+  dft();
+  fall();
+
+  printf ("%s\n", mFails ? "spectrumTest failed" : "spectrumTest passed");
+  return mFails ? 1 : 0;
+  }
@@ -0,0 +1,101 @@
+// srcTest.cpp - cSrc off target, thd+n per quality and host time per output frame
+// - 1khz at -1dBFS from each mpeg 1 and 2 rate to the 44.1k codec rate, thd+n under a bound per quality,
+//   high under -87dB from 48k and 32k as mp3Play reports it on the target
+// - 44.1k through unconverted, a step of 1 on phase 0, only the q15 rounding left
+// - ns per output frame per quality, 48k to 44.1k, the worst common ratio, best of a few runs of
+//   kBenchSeconds of audio so a busy host doesn't inflate it, printed not checked, the target counts cycles itself
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "cSrc.h"
+//}}}
+
+static const uint32_t kCodecRate = 44100;
+static const double kBenchSeconds = 2.0;   // of audio
+static const int kBenchRuns = 5;
+
+//{{{
+static const struct {
+  cSrc::eQuality quality;
+  const char* name;
+  float thdN;      // dB, bound from every mpeg 1 and 2 rate
+  } kQualities[] = {
+    { cSrc::eLow,    "low",    -47.f },
+    { cSrc::eMedium, "medium", -74.f },
+    { cSrc::eHigh,   "high",   -86.f },
+  };
+//}}}
+static const uint32_t kRates[] = { 48000, 32000, 24000, 22050, 16000 };
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, double value) {
+
+  printf ("%s %s %.1f\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+
+//{{{
+static double bench (cSrc& src) {
+// 1khz at -1dBFS in kMaxInFrames blocks, ns per output frame, best run
+
+  std::vector<int16_t> in (cSrc::kMaxInFrames * 2);
+  std::vector<int16_t> out (src.getMaxOutFrames (cSrc::kMaxInFrames) * 2);
+  for (auto i = 0; i < cSrc::kMaxInFrames; i++)
+    in[2*i] = in[2*i + 1] = (int16_t)lrint (29204 * sin (2 * M_PI * 1000 * i / src.getInRate()));
+
+  double best = 1e9;
+  int blocks = (int)(kBenchSeconds * src.getInRate() / cSrc::kMaxInFrames);
+  for (auto run = 0; run < kBenchRuns; run++) {
+    src.reset();
+    long frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto block = 0; block < blocks; block++)
+      frames += src.process (in.data(), cSrc::kMaxInFrames, out.data());
+    std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+    if (frames)
+      best = std::min (best, took.count() / frames);
+    }
+  src.reset();
+  return best;
+  }
+//}}}
+
+int main() {
+
+  for (auto& quality : kQualities) {
+    printf ("%s\n", quality.name);
+    cSrc src;
+    char what[80];
+
+    for (auto rate : kRates) {
+      bool table = src.setRates (rate, kCodecRate, quality.quality);
+      check (table && (src.getTaps() == cSrc::kMaxTaps >> (cSrc::eHigh - quality.quality)), "phase table taps",
+             src.getTaps());
+      float thdN = src.thdN (1000.f, -1.f);
+      sprintf (what, "%u>%u thd+n under %.0fdB", rate, kCodecRate, quality.thdN);
+      check (thdN <= quality.thdN, what, thdN);
+      if ((quality.quality == cSrc::eHigh) && ((rate == 48000) || (rate == 32000))) {
+        sprintf (what, "%u>%u thd+n under the -87dB reported", rate, kCodecRate);
+        check (thdN <= -87.f, what, thdN);
+        }
+      }
+
+    src.setRates (kCodecRate, kCodecRate, quality.quality);
+    float thdN = src.thdN (1000.f, -1.f);
+    check (thdN <= -90.f, "44100>44100 thd+n under -90dB", thdN);
+
+    src.setRates (48000, kCodecRate, quality.quality);
+    printf ("48000>%u %d taps %.1f ns/frame\n", kCodecRate, src.getTaps(), bench (src));
+    }
+
+  printf ("%s\n", mFails ? "srcTest failed" : "srcTest passed");
+  return mFails ? 1 : 0;
+  }
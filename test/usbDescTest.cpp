@@ -0,0 +1,160 @@
+// usbDescTest.cpp - usbd_conf.c and usbd_msc.c off target, USE_USB_HS, what the host enumerates and the fifo split
+// - device, qualifier, hs, fs and other speed configuration descriptors read back through GET_DESCRIPTOR,
+//   each walked descriptor by descriptor against its wTotalLength
+// - bulk endpoints 512 bytes at high speed, 64 at full speed and in the other speed descriptor, and the
+//   sizes SET_CONFIGURATION opens them with
+// - rx and tx fifos from USBD_LL_Init against the otg hs core's 4k of fifo ram and the reference manual's
+//   minimums for them
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "staticTasks.h"
+
+#include "usbPcd.h"
+//}}}
+
+static const unsigned kFifoWords = 1024;  // otg hs, 4k of fifo ram
+static const unsigned kHsBulk = 512;
+static const unsigned kFsBulk = 64;
+
+//{{{  task stubs
+extern "C" {
+  //{{{
+  BaseType_t staticTaskCreate (TaskFunction_t code, const char* name, uint16_t words, void* param,
+                               UBaseType_t priority, TaskHandle_t* handle) {
+    return pdPASS;
+    }
+  //}}}
+  uint32_t ulTaskNotifyTake (BaseType_t clear, TickType_t ticks) { return 0; }
+  void vTaskNotifyGiveFromISR (TaskHandle_t task, BaseType_t* woken) {}
+  }
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, unsigned value) {
+
+  printf ("%s %s %u\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+//{{{
+static uint32_t getDescriptor (uint8_t type, uint8_t* desc) {
+// GET_DESCRIPTOR asking for more than any descriptor, the stack sends the whole one
+
+  auto len = pcdSetup (0x80, USB_REQ_GET_DESCRIPTOR, type << 8, 0, 0xFF);
+  if (len)
+    memcpy (desc, pcdIn[0].buf, len);
+  return len;
+  }
+//}}}
+//{{{
+static void checkConfig (const char* speed, uint8_t type, unsigned bulkSize) {
+// configuration descriptor, then one interface and its two bulk endpoints, lengths adding up to wTotalLength
+
+  uint8_t desc[256];
+  auto len = getDescriptor (type, desc);
+  printf ("%s configuration\n", speed);
+  check ((len >= USB_LEN_CFG_DESC) && (desc[0] == USB_LEN_CFG_DESC) && (desc[1] == type), "descriptor type", desc[1]);
+
+  unsigned totalLength = desc[2] | (desc[3] << 8);
+  check (totalLength == len, "wTotalLength is what was sent", totalLength);
+
+  unsigned walked = 0;
+  unsigned interfaces = 0;
+  unsigned endpoints = 0;
+  unsigned endpointsFound = 0;
+  while ((walked < len) && desc[walked]) {
+    auto d = desc + walked;
+    if (d[1] == USB_DESC_TYPE_INTERFACE) {
+      interfaces++;
+      endpoints += d[4];
+      check ((d[5] == 0x08) && (d[6] == 0x06) && (d[7] == 0x50), "interface msc scsi bulk only", d[5]);
+      }
+    else if (d[1] == USB_DESC_TYPE_ENDPOINT) {
+      endpointsFound++;
+      unsigned size = d[4] | (d[5] << 8);
+      check ((d[3] & 3) == USBD_EP_TYPE_BULK, "endpoint bulk", d[2]);
+      check (size == bulkSize, (d[2] & 0x80) ? "bulk in wMaxPacketSize" : "bulk out wMaxPacketSize", size);
+      }
+    walked += d[0];
+    }
+  check (walked == totalLength, "descriptor lengths add up to wTotalLength", walked);
+  check (desc[4] == interfaces, "bNumInterfaces", desc[4]);
+  check ((endpoints == 2) && (endpointsFound == 2), "bulk endpoints", endpointsFound);
+  }
+//}}}
+
+int main() {
+
+  static USBD_HandleTypeDef device;
+  static USBD_StorageTypeDef storage = {};
+
+  // as mainThread brings up msc, then a bus reset at the speed hpcd was initialised for
+  USBD_Init (&device, &MSC_Desc, 0);
+  USBD_RegisterClass (&device, &USBD_MSC);
+  USBD_MSC_RegisterStorage (&device, &storage);
+  USBD_Start (&device);
+  HAL_PCD_ResetCallback (&hpcd);
+  check (device.dev_speed == USBD_SPEED_HIGH, "reset speed high", device.dev_speed);
+  check (pcdOut[0].open && pcdIn[0].open && (pcdIn[0].mps == 64), "ep0 open at 64", pcdIn[0].mps);
+
+  // device and qualifier, ep0 64 bytes, usb 2.0, one configuration
+  uint8_t desc[256];
+  auto len = getDescriptor (USB_DESC_TYPE_DEVICE, desc);
+  check ((len == USB_LEN_DEV_DESC) && (desc[1] == USB_DESC_TYPE_DEVICE), "device descriptor", len);
+  check ((desc[2] | (desc[3] << 8)) == 0x0200, "device bcdUSB 2.0", desc[2] | (desc[3] << 8));
+  check (desc[7] == 64, "device bMaxPacketSize0", desc[7]);
+  check (desc[17] == 1, "device bNumConfigurations", desc[17]);
+
+  len = getDescriptor (USB_DESC_TYPE_DEVICE_QUALIFIER, desc);
+  check ((len == USB_LEN_DEV_QUALIFIER_DESC) && (desc[1] == USB_DESC_TYPE_DEVICE_QUALIFIER), "qualifier descriptor", len);
+  check ((desc[2] | (desc[3] << 8)) == 0x0200, "qualifier bcdUSB 2.0", desc[2] | (desc[3] << 8));
+  check (desc[7] == 64, "qualifier bMaxPacketSize0", desc[7]);
+  check (desc[8] == 1, "qualifier bNumConfigurations", desc[8]);
+
+  // high speed, and what it would be at full speed
+  checkConfig ("hs", USB_DESC_TYPE_CONFIGURATION, kHsBulk);
+  checkConfig ("other speed", USB_DESC_TYPE_OTHER_SPEED_CONFIGURATION, kFsBulk);
+
+  pcdSetup (0x00, USB_REQ_SET_ADDRESS, 1, 0, 0);
+  pcdSetup (0x00, USB_REQ_SET_CONFIGURATION, 1, 0, 0);
+  check (device.dev_state == USBD_STATE_CONFIGURED, "hs configured", device.dev_state);
+  check (pcdIn[1].open && (pcdIn[1].mps == kHsBulk), "hs bulk in opened at", pcdIn[1].mps);
+  check (pcdOut[1].open && (pcdOut[1].mps == kHsBulk), "hs bulk out opened at", pcdOut[1].mps);
+  check (pcdOut[1].len == 31, "cbw receive armed", pcdOut[1].len);
+
+  // a full speed host, the same core reset at full speed
+  USBD_LL_Reset (&device);
+  USBD_LL_SetSpeed (&device, USBD_SPEED_FULL);
+  checkConfig ("fs", USB_DESC_TYPE_CONFIGURATION, kFsBulk);
+  pcdSetup (0x00, USB_REQ_SET_ADDRESS, 1, 0, 0);
+  pcdSetup (0x00, USB_REQ_SET_CONFIGURATION, 1, 0, 0);
+  check (pcdIn[1].open && (pcdIn[1].mps == kFsBulk), "fs bulk in opened at", pcdIn[1].mps);
+  check (pcdOut[1].open && (pcdOut[1].mps == kFsBulk), "fs bulk out opened at", pcdOut[1].mps);
+
+  // fifo split, rm0385 device mode fifo ram allocation
+  // - rx, 5 words per control endpoint + 8 setup, largest packet / 4 + 1 status, 2 per out endpoint, 1 global nak
+  // - tx, at least one max packet for the endpoint's in packets
+  // - dma, one word per endpoint and direction at the top of fifo ram for the endpoint dma addresses
+  printf ("fifo words rx %u tx0 %u tx1 %u\n", pcdRxFifo, pcdTxFifo[0], pcdTxFifo[1]);
+  unsigned rxMin = (5 * 1 + 8) + (kHsBulk / 4 + 1) + (2 * 2) + 1;
+  check (pcdRxFifo >= rxMin, "rx fifo holds a hs bulk packet and setups", rxMin);
+  check (pcdRxFifo >= 3 * kHsBulk / 4, "rx fifo holds three hs bulk packets", 3 * kHsBulk / 4);
+  check (pcdTxFifo[0] >= 64 / 4, "tx0 fifo holds an ep0 packet", pcdTxFifo[0]);
+  check (pcdTxFifo[1] >= 3 * kHsBulk / 4, "tx1 fifo holds three hs bulk packets", pcdTxFifo[1]);
+
+  unsigned used = pcdRxFifo;
+  for (auto fifo : pcdTxFifo)
+    used += fifo;
+  unsigned dmaWords = hpcd.Init.dma_enable ? 2 * hpcd.Init.dev_endpoints : 0;
+  check (used + dmaWords <= kFifoWords, "fifo words used with the dma registers, of 1024", used + dmaWords);
+
+  printf ("%s\n", mFails ? "usbDescTest failed" : "usbDescTest passed");
+  return mFails ? 1 : 0;
+  }
@@ -0,0 +1,399 @@
+// usbMscTest.cpp - usbd_msc.c off target, a host's scsi commands replayed through bulk only transport
+// - cbw out, data in or out, csw in, on the usbPcd endpoints, a stalled in endpoint cleared as a host does
+// - msc task run as a coroutine on the notifications the otg side gives it, held to see what waits for it
+// - ram disk storage, its card writes counted and failed on demand
+// - MODE SENSE 6 and 10 caching page with WCE set, its changeable values, the header only for other pages
+// - write back, the WRITE csw passes before the card has the data, SYNCHRONIZE CACHE and START STOP UNIT
+//   csws wait for it, a sequential write merged into the queued one, a failed card write failing the next command
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <vector>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "staticTasks.h"
+
+#include "usbPcd.h"
+//}}}
+
+static const uint32_t kBlocks = 4096;
+static const uint16_t kBlockSize = 512;
+static const uintptr_t kDwtBase = 0xE0001000;  // DWT, cpuWallCycles reads its CYCCNT
+
+//{{{  msc task coroutine
+static ucontext_t mMainContext;
+static ucontext_t mTaskContext;
+static TaskFunction_t mTaskCode = nullptr;
+static void* mTaskParam = nullptr;
+static uint32_t mNotified = 0;
+static bool mTaskHeld = false;
+
+static void taskEntry() { mTaskCode (mTaskParam); }
+
+extern "C" {
+  //{{{
+  BaseType_t staticTaskCreate (TaskFunction_t code, const char* name, uint16_t words, void* param,
+                               UBaseType_t priority, TaskHandle_t* handle) {
+
+    static std::vector<uint8_t> stack (0x40000);
+    getcontext (&mTaskContext);
+    mTaskContext.uc_stack.ss_sp = stack.data();
+    mTaskContext.uc_stack.ss_size = stack.size();
+    mTaskContext.uc_link = &mMainContext;
+    makecontext (&mTaskContext, taskEntry, 0);
+
+    mTaskCode = code;
+    mTaskParam = param;
+    *handle = (TaskHandle_t)&mTaskContext;
+    return pdPASS;
+    }
+  //}}}
+  //{{{
+  uint32_t ulTaskNotifyTake (BaseType_t clear, TickType_t ticks) {
+  // msc task, back to the host until the otg side notifies it
+
+    while (!mNotified)
+      swapcontext (&mTaskContext, &mMainContext);
+
+    auto notified = mNotified;
+    mNotified = clear ? 0 : mNotified - 1;
+    return notified;
+    }
+  //}}}
+  void vTaskNotifyGiveFromISR (TaskHandle_t task, BaseType_t* woken) { mNotified++; }
+  }
+
+//{{{
+static bool runTask() {
+// msc task runs till it waits again, false if it had nothing to do or is held
+
+  if (!mNotified || mTaskHeld)
+    return false;
+
+  swapcontext (&mMainContext, &mTaskContext);
+  return true;
+  }
+//}}}
+//}}}
+//{{{  ram disk storage
+static std::vector<uint8_t> mDisk (kBlocks * kBlockSize);
+static uint32_t mDiskWrites = 0;
+static uint32_t mDiskWriteBlocks = 0;  // of the last card write
+static bool mDiskFail = false;
+
+static const int8_t kInquiry[36] = { 0, (int8_t)0x80, 2, 2, 36 - 5 };  // removable, additional length
+
+extern "C" {
+  static int8_t diskIsReady() { return 0; }
+  //{{{
+  static int8_t diskGetCapacity (uint32_t* blocks, uint16_t* blockSize) {
+
+    *blocks = kBlocks;
+    *blockSize = kBlockSize;
+    return 0;
+    }
+  //}}}
+  //{{{
+  static int8_t diskRead (uint8_t* buf, uint32_t block, uint16_t blocks) {
+
+    memcpy (buf, mDisk.data() + block * kBlockSize, blocks * kBlockSize);
+    return 0;
+    }
+  //}}}
+  //{{{
+  static int8_t diskWrite (uint8_t* buf, uint32_t block, uint16_t blocks) {
+
+    mDiskWrites++;
+    mDiskWriteBlocks = blocks;
+    if (mDiskFail)
+      return -1;
+
+    memcpy (mDisk.data() + block * kBlockSize, buf, blocks * kBlockSize);
+    return 0;
+    }
+  //}}}
+  }
+//}}}
+
+static int mFails = 0;
+//{{{
+static void check (bool ok, const char* what, unsigned value) {
+
+  printf ("%s %s %u\n", ok ? "pass" : "FAIL", what, value);
+  if (!ok)
+    mFails++;
+  }
+//}}}
+//{{{  host bulk only transport
+struct tCommand {
+  uint32_t tag = 0;
+  uint32_t length = 0;
+  bool in = false;
+  uint8_t* data = nullptr;
+  uint32_t moved = 0;
+
+  bool done = false;  // csw taken
+  uint32_t cswTag = 0;
+  uint32_t residue = 0;
+  uint8_t status = 0xFF;
+  };
+
+static uint32_t mTag = 0;
+
+//{{{
+static uint32_t le32 (const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  }
+//}}}
+//{{{
+static uint32_t be32 (const uint8_t* bytes) {
+  return ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+  }
+//}}}
+//{{{
+static void put32 (uint8_t* bytes, uint32_t value) {
+
+  for (auto i = 0; i < 4; i++)
+    bytes[i] = value >> (i * 8);
+  }
+//}}}
+//{{{
+static bool pump (tCommand& command) {
+// moves whatever the device has armed, runs the msc task when nothing is, true once the csw is in
+
+  while (!command.done) {
+    auto& in = pcdIn[1];
+    auto& out = pcdOut[1];
+
+    if (in.stalled) {
+      // clear halt on bulk in, the device sends its csw after it
+      pcdSetup (0x02, USB_REQ_CLEAR_FEATURE, USB_FEATURE_EP_HALT, 0x81, 0);
+      }
+
+    else if (in.pending) {
+      if ((in.len == 13) && (le32 (in.buf) == 0x53425355)) {
+        command.cswTag = le32 (in.buf + 4);
+        command.residue = le32 (in.buf + 8);
+        command.status = in.buf[12];
+        command.done = true;
+        }
+      else if (command.in && (command.moved + in.len <= command.length)) {
+        memcpy (command.data + command.moved, in.buf, in.len);
+        command.moved += in.len;
+        }
+      else {
+        printf ("FAIL device sent %u bytes past the %u asked for\n", (unsigned)in.len, (unsigned)command.length);
+        exit (1);
+        }
+      pcdInDone (0x81);
+      }
+
+    else if (out.pending && !command.in && (command.moved < command.length)) {
+      auto bytes = std::min (out.len, command.length - command.moved);
+      pcdOutData (0x01, command.data + command.moved, bytes);
+      command.moved += bytes;
+      }
+
+    else if (!runTask())
+      return false;
+    }
+
+  return true;
+  }
+//}}}
+//{{{
+static tCommand start (const std::vector<uint8_t>& cb, uint32_t length, bool in, uint8_t* data) {
+// cbw to the armed cbw receive, then as far as the device gets
+
+  tCommand command;
+  command.tag = ++mTag;
+  command.length = length;
+  command.in = in;
+  command.data = data;
+
+  uint8_t cbw[31] = {};
+  put32 (cbw, 0x43425355);
+  put32 (cbw + 4, command.tag);
+  put32 (cbw + 8, length);
+  cbw[12] = in ? 0x80 : 0x00;
+  cbw[14] = cb.size();
+  memcpy (cbw + 15, cb.data(), cb.size());
+
+  if (!pcdOut[1].pending || (pcdOut[1].len != 31)) {
+    printf ("FAIL no cbw receive armed\n");
+    exit (1);
+    }
+  pcdOutData (0x01, cbw, sizeof(cbw));
+
+  pump (command);
+  return command;
+  }
+//}}}
+//{{{
+static tCommand scsi (const std::vector<uint8_t>& cb, uint32_t length = 0, bool in = true, uint8_t* data = nullptr) {
+// whole command, csw checked against the cbw
+
+  auto command = start (cb, length, in, data);
+  if (!command.done)
+    printf ("FAIL no csw for command %02x\n", cb[0]);
+  if (command.done && (command.cswTag != command.tag))
+    printf ("FAIL csw tag %u for cbw tag %u\n", command.cswTag, command.tag);
+  if (!command.done || (command.cswTag != command.tag))
+    mFails++;
+  return command;
+  }
+//}}}
+//}}}
+//{{{
+static std::vector<uint8_t> rw10 (uint8_t op, uint32_t block, uint16_t blocks) {
+  return { op, 0, (uint8_t)(block >> 24), (uint8_t)(block >> 16), (uint8_t)(block >> 8), (uint8_t)block, 0,
+           (uint8_t)(blocks >> 8), (uint8_t)blocks, 0 };
+  }
+//}}}
+//{{{
+static void fill (std::vector<uint8_t>& buf, uint8_t seed) {
+
+  for (size_t i = 0; i < buf.size(); i++)
+    buf[i] = (uint8_t)(i * 7 + seed + (i >> 9));
+  }
+//}}}
+
+int main() {
+
+  if (mmap ((void*)kDwtBase, 0x1000, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != (void*)kDwtBase) {
+    printf ("FAIL map DWT at its target address\n");
+    return 1;
+    }
+
+  static USBD_HandleTypeDef device;
+  static USBD_StorageTypeDef storage = { diskIsReady, diskGetCapacity, diskRead, diskWrite, (int8_t*)kInquiry };
+
+  USBD_Init (&device, &MSC_Desc, 0);
+  USBD_RegisterClass (&device, &USBD_MSC);
+  USBD_MSC_RegisterStorage (&device, &storage);
+  USBD_Start (&device);
+  HAL_PCD_ResetCallback (&hpcd);
+  pcdSetup (0x00, USB_REQ_SET_ADDRESS, 1, 0, 0);
+  pcdSetup (0x00, USB_REQ_SET_CONFIGURATION, 1, 0, 0);
+  check (device.dev_state == USBD_STATE_CONFIGURED, "configured", device.dev_state);
+
+  // what a host asks first
+  uint8_t data[256];
+  auto command = scsi ({ 0x12, 0, 0, 0, 36, 0 }, 36, true, data);
+  check ((command.status == 0) && (command.moved == 36), "INQUIRY", command.moved);
+  command = scsi ({ 0x00, 0, 0, 0, 0, 0 });
+  check (command.status == 0, "TEST UNIT READY", command.status);
+  command = scsi ({ 0x25, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 8, true, data);
+  check ((command.status == 0) && (be32 (data) == kBlocks - 1) && (be32 (data + 4) == kBlockSize),
+         "READ CAPACITY10 last block", be32 (data));
+
+  // mode sense, caching page with WCE for page 8 and all pages, header only for others
+  printf ("mode sense\n");
+  command = scsi ({ 0x1A, 0, 0x3F, 0, 0xFF, 0 }, 0xFF, true, data);
+  check ((command.status == 0) && (command.moved == 24) && (data[0] == 23), "MODE SENSE6 all pages length", command.moved);
+  check ((data[4] == 0x08) && (data[5] == 18), "MODE SENSE6 caching page", data[4]);
+  check (data[6] & 0x04, "MODE SENSE6 caching WCE", data[6]);
+  check (!(data[2] & 0x80) && (data[3] == 0), "MODE SENSE6 not write protected, no block descriptors", data[2]);
+  check (command.residue == 0xFF - 24, "MODE SENSE6 residue", command.residue);
+
+  command = scsi ({ 0x1A, 0, 0x08, 0, 0xFF, 0 }, 0xFF, true, data);
+  check ((command.moved == 24) && (data[4] == 0x08) && (data[6] & 0x04), "MODE SENSE6 page 8 WCE", data[6]);
+  command = scsi ({ 0x1A, 0, 0x48, 0, 0xFF, 0 }, 0xFF, true, data);
+  check ((command.moved == 24) && (data[4] == 0x08) && !(data[6] & 0x04), "MODE SENSE6 page 8 changeable, WCE not",
+         data[6]);
+  command = scsi ({ 0x1A, 0, 0x1C, 0, 0xFF, 0 }, 0xFF, true, data);
+  check ((command.status == 0) && (command.moved == 4) && (data[0] == 3), "MODE SENSE6 other page, header only",
+         command.moved);
+  command = scsi ({ 0x1A, 0, 0x3F, 0, 4, 0 }, 4, true, data);
+  check ((command.moved == 4) && (data[0] == 23) && (command.residue == 0), "MODE SENSE6 cut to allocation length",
+         command.moved);
+
+  command = scsi ({ 0x5A, 0, 0x08, 0, 0, 0, 0, 0, 0xFF, 0 }, 0xFF, true, data);
+  check ((command.status == 0) && (command.moved == 28) && (((data[0] << 8) | data[1]) == 26),
+         "MODE SENSE10 page 8 length", command.moved);
+  check ((data[8] == 0x08) && (data[9] == 18) && (data[10] & 0x04), "MODE SENSE10 caching WCE", data[10]);
+
+  // read, through the ring, more than one media buffer
+  printf ("read\n");
+  fill (mDisk, 1);
+  std::vector<uint8_t> readBuf (128 * kBlockSize);
+  command = scsi (rw10 (0x28, 100, 128), readBuf.size(), true, readBuf.data());
+  check ((command.status == 0) && (command.residue == 0), "READ10 128 blocks", command.moved);
+  check (!memcmp (readBuf.data(), mDisk.data() + 100 * kBlockSize, readBuf.size()), "READ10 data", 0);
+
+  // write back, csw before the card write
+  printf ("write back\n");
+  std::vector<uint8_t> writeBuf (8 * kBlockSize);
+  fill (writeBuf, 2);
+  mTaskHeld = true;
+  auto writes = mDiskWrites;
+  command = scsi (rw10 (0x2A, 200, 8), writeBuf.size(), false, writeBuf.data());
+  check ((command.status == 0) && (command.residue == 0), "WRITE10 csw passed", command.status);
+  check (mDiskWrites == writes, "WRITE10 csw before the card write", mDiskWrites - writes);
+
+  // sequential write received onto the queued one
+  std::vector<uint8_t> nextBuf (8 * kBlockSize);
+  fill (nextBuf, 3);
+  command = scsi (rw10 (0x2A, 208, 8), nextBuf.size(), false, nextBuf.data());
+  check (command.status == 0, "sequential WRITE10 csw passed", command.status);
+
+  // SYNCHRONIZE CACHE waits for the card
+  command = start ({ 0x35, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 0, false, nullptr);
+  check (!command.done, "SYNCHRONIZE CACHE csw held while writes are queued", command.done);
+  mTaskHeld = false;
+  pump (command);
+  check (command.done && (command.status == 0) && (command.cswTag == command.tag), "SYNCHRONIZE CACHE csw after the card write",
+         command.status);
+  check ((mDiskWrites == writes + 1) && (mDiskWriteBlocks == 16), "sequential writes merged into one card write",
+         mDiskWriteBlocks);
+  check (!memcmp (mDisk.data() + 200 * kBlockSize, writeBuf.data(), writeBuf.size()) &&
+         !memcmp (mDisk.data() + 208 * kBlockSize, nextBuf.data(), nextBuf.size()), "card has the written data", 0);
+
+  command = scsi ({ 0x35, 0, 0, 0, 0, 0, 0, 0, 0, 0 });
+  check (command.status == 0, "SYNCHRONIZE CACHE, nothing queued", command.status);
+
+  // read of a queued write waits for it
+  mTaskHeld = true;
+  fill (writeBuf, 4);
+  command = scsi (rw10 (0x2A, 300, 8), writeBuf.size(), false, writeBuf.data());
+  mTaskHeld = false;
+  std::vector<uint8_t> backBuf (writeBuf.size());
+  command = scsi (rw10 (0x28, 300, 8), backBuf.size(), true, backBuf.data());
+  check ((command.status == 0) && (backBuf == writeBuf), "READ10 after a queued write reads it", command.status);
+
+  // START STOP UNIT waits for the card too
+  mTaskHeld = true;
+  fill (writeBuf, 5);
+  command = scsi (rw10 (0x2A, 400, 8), writeBuf.size(), false, writeBuf.data());
+  command = start ({ 0x1B, 0, 0, 0, 0x02, 0 }, 0, false, nullptr);
+  check (!command.done, "START STOP UNIT csw held while writes are queued", command.done);
+  mTaskHeld = false;
+  pump (command);
+  check (command.done && (command.status == 0) &&
+         !memcmp (mDisk.data() + 400 * kBlockSize, writeBuf.data(), writeBuf.size()), "START STOP UNIT csw after the card write",
+         command.status);
+
+  // failed card write, acknowledged already, fails the next command with its sense
+  printf ("write fault\n");
+  mDiskFail = true;
+  command = scsi (rw10 (0x2A, 500, 8), writeBuf.size(), false, writeBuf.data());
+  check (command.status == 0, "WRITE10 csw passed before the card fails it", command.status);
+  while (runTask()) {}
+  check (mDiskWrites && (mDiskWriteBlocks == 8), "card write failed", mDiskWriteBlocks);
+  mDiskFail = false;
+  command = scsi ({ 0x00, 0, 0, 0, 0, 0 });
+  check (command.status == 1, "next command fails", command.status);
+  command = scsi ({ 0x03, 0, 0, 0, 18, 0 }, 18, true, data);
+  check ((command.status == 0) && ((data[2] & 0x0F) == 4) && (data[12] == 0x03), "REQUEST SENSE hardware error, write fault",
+         data[12]);
+  command = scsi ({ 0x00, 0, 0, 0, 0, 0 });
+  check (command.status == 0, "TEST UNIT READY after the sense", command.status);
+
+  printf ("%s\n", mFails ? "usbMscTest failed" : "usbMscTest passed");
+  return mFails ? 1 : 0;
+  }
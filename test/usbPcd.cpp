@@ -0,0 +1,179 @@
+// usbPcd.cpp - host otg core for test/ builds of USB_Device, HAL pcd, gpio, nvic, dma cache and log stubs
+//{{{  includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usbPcd.h"
+
+extern "C" {
+#include "dmaBuf.h"
+#include "uartLog.h"
+}
+//}}}
+
+uint16_t pcdRxFifo = 0;
+uint16_t pcdTxFifo[16];
+tPcdEp pcdIn[16];
+tPcdEp pcdOut[16];
+
+const void* pcdDmaTx = nullptr;
+size_t pcdDmaTxBytes = 0;
+
+//{{{  target globals
+extern "C" {
+  uint32_t SystemCoreClock = 216000000;
+  volatile uint32_t cpuSleptCycles = 0;
+  volatile uint32_t logLevel = LOG_INFO;
+  }
+//}}}
+//{{{  hal stubs
+extern "C" {
+  void HAL_Delay (uint32_t delay) {}
+  void HAL_GPIO_Init (GPIO_TypeDef* gpio, GPIO_InitTypeDef* init) {}
+  void HAL_NVIC_SetPriority (IRQn_Type irq, uint32_t preempt, uint32_t sub) {}
+  void HAL_NVIC_EnableIRQ (IRQn_Type irq) {}
+
+  HAL_StatusTypeDef HAL_PCD_Init (PCD_HandleTypeDef* hpcd) { return HAL_OK; }
+  HAL_StatusTypeDef HAL_PCD_DeInit (PCD_HandleTypeDef* hpcd) { return HAL_OK; }
+  HAL_StatusTypeDef HAL_PCD_Start (PCD_HandleTypeDef* hpcd) { return HAL_OK; }
+  HAL_StatusTypeDef HAL_PCD_Stop (PCD_HandleTypeDef* hpcd) { return HAL_OK; }
+  HAL_StatusTypeDef HAL_PCD_SetAddress (PCD_HandleTypeDef* hpcd, uint8_t address) { return HAL_OK; }
+
+  //{{{
+  HAL_StatusTypeDef HAL_PCDEx_SetRxFiFo (PCD_HandleTypeDef* hpcd, uint16_t size) {
+    pcdRxFifo = size;
+    return HAL_OK;
+    }
+  //}}}
+  //{{{
+  HAL_StatusTypeDef HAL_PCDEx_SetTxFiFo (PCD_HandleTypeDef* hpcd, uint8_t fifo, uint16_t size) {
+    pcdTxFifo[fifo & 0x0F] = size;
+    return HAL_OK;
+    }
+  //}}}
+
+  //{{{
+  HAL_StatusTypeDef HAL_PCD_EP_Open (PCD_HandleTypeDef* hpcd, uint8_t ep_addr, uint16_t ep_mps, uint8_t ep_type) {
+
+    auto& ep = (ep_addr & 0x80) ? pcdIn[ep_addr & 0x0F] : pcdOut[ep_addr & 0x0F];
+    ep.open = true;
+    ep.stalled = false;
+    ep.mps = ep_mps;
+    ep.type = ep_type;
+    return HAL_OK;
+    }
+  //}}}
+  //{{{
+  HAL_StatusTypeDef HAL_PCD_EP_Close (PCD_HandleTypeDef* hpcd, uint8_t ep_addr) {
+
+    auto& ep = (ep_addr & 0x80) ? pcdIn[ep_addr & 0x0F] : pcdOut[ep_addr & 0x0F];
+    ep.open = false;
+    return HAL_OK;
+    }
+  //}}}
+  //{{{
+  HAL_StatusTypeDef HAL_PCD_EP_SetStall (PCD_HandleTypeDef* hpcd, uint8_t ep_addr) {
+
+    auto& ep = (ep_addr & 0x80) ? pcdIn[ep_addr & 0x0F] : pcdOut[ep_addr & 0x0F];
+    ep.stalled = true;
+    return HAL_OK;
+    }
+  //}}}
+  //{{{
+  HAL_StatusTypeDef HAL_PCD_EP_ClrStall (PCD_HandleTypeDef* hpcd, uint8_t ep_addr) {
+
+    auto& ep = (ep_addr & 0x80) ? pcdIn[ep_addr & 0x0F] : pcdOut[ep_addr & 0x0F];
+    ep.stalled = false;
+    return HAL_OK;
+    }
+  //}}}
+  HAL_StatusTypeDef HAL_PCD_EP_Flush (PCD_HandleTypeDef* hpcd, uint8_t ep_addr) { return HAL_OK; }
+
+  //{{{
+  HAL_StatusTypeDef HAL_PCD_EP_Transmit (PCD_HandleTypeDef* hpcd, uint8_t ep_addr, uint8_t* pBuf, uint32_t len) {
+
+    auto& ep = pcdIn[ep_addr & 0x0F];
+    ep.buf = pBuf;
+    ep.len = len;
+    ep.transfers++;
+    ep.pending = true;
+    hpcd->IN_ep[ep_addr & 0x0F].xfer_buff = pBuf;
+    return HAL_OK;
+    }
+  //}}}
+  //{{{
+  HAL_StatusTypeDef HAL_PCD_EP_Receive (PCD_HandleTypeDef* hpcd, uint8_t ep_addr, uint8_t* pBuf, uint32_t len) {
+
+    auto& ep = pcdOut[ep_addr & 0x0F];
+    ep.buf = pBuf;
+    ep.len = len;
+    ep.count = 0;
+    ep.transfers++;
+    ep.pending = true;
+    hpcd->OUT_ep[ep_addr & 0x0F].xfer_buff = pBuf;
+    return HAL_OK;
+    }
+  //}}}
+  //{{{
+  uint16_t HAL_PCD_EP_GetRxCount (PCD_HandleTypeDef* hpcd, uint8_t ep_addr) {
+    return pcdOut[ep_addr & 0x0F].count;
+    }
+  //}}}
+  }
+//}}}
+//{{{  dma and log stubs
+extern "C" {
+  //{{{
+  void* dmaAlloc (size_t bytes) {
+    return aligned_alloc (DMA_LINE, DMA_LINES (bytes));
+    }
+  //}}}
+  //{{{
+  void dmaTxStart (const void* buf, size_t bytes) {
+
+    pcdDmaTx = buf;
+    pcdDmaTxBytes = bytes;
+    }
+  //}}}
+  void dmaRxStart (void* buf, size_t bytes) {}
+  void dmaRxDone (void* buf, size_t bytes) {}
+  void logFormat (uint32_t level, const char* format, uint32_t numArgs, ...) {}
+  }
+//}}}
+
+//{{{
+uint32_t pcdSetup (uint8_t bmRequest, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+
+  uint8_t setup[8] = { bmRequest, bRequest, (uint8_t)wValue, (uint8_t)(wValue >> 8),
+                       (uint8_t)wIndex, (uint8_t)(wIndex >> 8), (uint8_t)wLength, (uint8_t)(wLength >> 8) };
+  memcpy (hpcd.Setup, setup, sizeof(setup));
+
+  pcdIn[0].len = 0;
+  pcdIn[0].buf = nullptr;
+  HAL_PCD_SetupStageCallback (&hpcd);
+  return pcdIn[0].len;
+  }
+//}}}
+//{{{
+void pcdOutData (uint8_t ep, const void* data, uint32_t bytes) {
+
+  auto& out = pcdOut[ep & 0x0F];
+  if (bytes > out.len) {
+    printf ("FAIL host sent %u bytes into a %u byte receive on ep %u\n", (unsigned)bytes, (unsigned)out.len, ep);
+    exit (1);
+    }
+
+  memcpy (out.buf, data, bytes);
+  out.count = bytes;
+  out.pending = false;
+  HAL_PCD_DataOutStageCallback (&hpcd, ep & 0x0F);
+  }
+//}}}
+//{{{
+void pcdInDone (uint8_t ep) {
+
+  pcdIn[ep & 0x0F].pending = false;
+  HAL_PCD_DataInStageCallback (&hpcd, ep & 0x0F);
+  }
+//}}}
@@ -0,0 +1,43 @@
+// usbPcd.h - host otg core for test/ builds of USB_Device, records what the device stack asks of the HAL pcd
+// - fifo sizes, endpoints opened, the last transmit and the receive armed on each endpoint
+// - usbd_conf.c's HAL callbacks drive the stack as the otg isr does on the target
+#pragma once
+//{{{  includes
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include "usbd_core.h"
+#include "usbd_desc.h"
+#include "usbd_msc.h"
+}
+//}}}
+
+struct tPcdEp {
+  bool open = false;
+  bool stalled = false;
+  uint16_t mps = 0;
+  uint8_t type = 0;
+  uint8_t* buf = nullptr;  // last transmit on an in endpoint, receive armed on an out endpoint
+  uint32_t len = 0;
+  uint32_t count = 0;      // out, bytes the host sent into buf
+  uint32_t transfers = 0;
+  bool pending = false;    // transmit or receive armed, not yet taken by the host
+  };
+
+extern uint16_t pcdRxFifo;      // words
+extern uint16_t pcdTxFifo[16];  // words
+extern tPcdEp pcdIn[16];
+extern tPcdEp pcdOut[16];
+
+extern const void* pcdDmaTx;  // last dmaTxStart, the buffer a class handed the sai dma
+extern size_t pcdDmaTxBytes;
+
+// control request on ep0, standard layout, returns what the stack transmitted on ep0 in
+uint32_t pcdSetup (uint8_t bmRequest, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength);
+
+// host sends bytes into the receive armed on ep, the data out stage callback follows
+void pcdOutData (uint8_t ep, const void* data, uint32_t bytes);
+
+// in transfer on ep taken by the host, the data in stage callback follows
+void pcdInDone (uint8_t ep);